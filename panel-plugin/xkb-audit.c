@@ -0,0 +1,359 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-audit.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xkb-audit.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gdk/gdkx.h>
+
+/*
+ * Counts the wakeups caused by the plugin, per source. The audit is
+ * switched on with XFCE4_XKB_AUDIT=1 in the environment of the panel.
+ * The counts are logged at most once a minute, from the next counted
+ * dispatch, so the audit itself never wakes the main loop up.
+ *
+ * The audit also accounts for the X requests made during the main
+ * operations of the plugin. An Xlib after function sees every request
+ * of the display connection, and a call which comes back with the
+ * reply to its last request has waited for the server, which counts as
+ * a round trip. Requests of nested operations only count for the
+ * innermost one.
+ *
+ * Requests sent straight through xcb, which is how xkbcommon-x11 talks
+ * to the server, never pass the Xlib after function. The xkbcommon
+ * backend therefore hides the request and round trip counts instead of
+ * reporting a part of them.
+ *
+ * The bytes are those the main thread read and wrote in the meantime,
+ * taken from /proc/thread-self/io. Xlib and xcb both talk to the server
+ * from the thread which makes the call, so this is the X traffic in
+ * both directions, xcb included. The D-Bus traffic of GDBus goes
+ * through its worker thread and is not counted, the trace file is.
+ */
+
+#define XKB_AUDIT_REPORT_INTERVAL   (60 * G_USEC_PER_SEC)
+#define XKB_AUDIT_MAX_DEPTH         8
+
+typedef int (*XkbAuditAfterFunction) (Display *display);
+
+static const gchar *audit_source_names[XKB_AUDIT_N_SOURCES] =
+{
+  "config-timeout",
+  "popup-idle",
+  "backend-event",
+  "modifier-event",
+  "window-event",
+  "dbus-call",
+  "remote-event",
+  "config-commit"
+};
+
+static const gchar *audit_operation_names[XKB_AUDIT_N_OPERATIONS] =
+{
+  "startup",
+  "config-rebuild",
+  "group-switch",
+  "caps-lock",
+  "focus-change"
+};
+
+static gint     audit_enabled = -1;
+static guint    audit_counts[XKB_AUDIT_N_SOURCES];
+static guint    audit_wakeups = 0;
+static gint64   audit_last_report = 0;
+
+static Display                *audit_display = NULL;
+static XkbAuditAfterFunction   audit_next_after_function = NULL;
+static gulong                  audit_last_request = 0;
+static gulong                  audit_last_read = 0;
+static XkbAuditOperation       audit_operations[XKB_AUDIT_MAX_DEPTH];
+static guint                   audit_depth = 0;
+static XkbAuditOperationStats  audit_operation_stats[XKB_AUDIT_N_OPERATIONS];
+static gboolean                audit_requests_hidden = FALSE;
+
+static gint                    audit_io_fd = -2;
+static guint64                 audit_io_own_reads = 0;
+static guint64                 audit_io_read = 0;
+static guint64                 audit_io_written = 0;
+
+
+
+gboolean
+xkb_audit_get_enabled (void)
+{
+  if (G_UNLIKELY (audit_enabled < 0))
+    audit_enabled = g_strcmp0 (g_getenv ("XFCE4_XKB_AUDIT"), "1") == 0;
+
+  return audit_enabled;
+}
+
+
+
+void
+xkb_audit_count_real (XkbAuditSource source)
+{
+  gint64 now;
+
+  g_return_if_fail (source < XKB_AUDIT_N_SOURCES);
+
+  audit_counts[source]++;
+  audit_wakeups++;
+
+  now = g_get_monotonic_time ();
+  if (audit_last_report == 0)
+    audit_last_report = now;
+  else if (now - audit_last_report >= XKB_AUDIT_REPORT_INTERVAL)
+    xkb_audit_report ();
+}
+
+
+
+static int
+xkb_audit_after_function (Display *display)
+{
+  XkbAuditOperationStats *stats;
+  gulong                  request, read;
+
+  request = NextRequest (display) - 1;
+  read = XLastKnownRequestProcessed (display);
+
+  if (audit_depth > 0 && request != audit_last_request && !audit_requests_hidden)
+    {
+      stats = &audit_operation_stats[audit_operations[MIN (audit_depth, XKB_AUDIT_MAX_DEPTH) - 1]];
+      stats->requests += request - audit_last_request;
+      if (read == request && read != audit_last_read)
+        stats->round_trips++;
+    }
+
+  audit_last_request = request;
+  audit_last_read = read;
+
+  return audit_next_after_function != NULL ? audit_next_after_function (display) : 0;
+}
+
+
+
+static void
+xkb_audit_watch_display (void)
+{
+  GdkDisplay *display;
+
+  display = gdk_display_get_default ();
+  if (display == NULL || !GDK_IS_X11_DISPLAY (display))
+    return;
+
+  audit_display = gdk_x11_display_get_xdisplay (display);
+  audit_last_request = NextRequest (audit_display) - 1;
+  audit_last_read = XLastKnownRequestProcessed (audit_display);
+  audit_next_after_function = XSetAfterFunction (audit_display, xkb_audit_after_function);
+}
+
+
+
+static gboolean
+xkb_audit_sample_io (guint64 *bytes_received,
+                     guint64 *bytes_sent)
+{
+  gchar   buffer[512];
+  gssize  len;
+  guint64 rchar, wchar;
+
+  /* opened from the main thread, so it stays the file of that thread */
+  if (G_UNLIKELY (audit_io_fd == -2))
+    audit_io_fd = open ("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+
+  if (audit_io_fd < 0)
+    return FALSE;
+
+  len = pread (audit_io_fd, buffer, sizeof (buffer) - 1, 0);
+  if (len <= 0)
+    return FALSE;
+  buffer[len] = '\0';
+
+  if (sscanf (buffer, "rchar: %" G_GUINT64_FORMAT " wchar: %" G_GUINT64_FORMAT,
+              &rchar, &wchar) != 2)
+    return FALSE;
+
+  /* the earlier reads of the file are counted as well */
+  *bytes_received = rchar - audit_io_own_reads;
+  *bytes_sent = wchar;
+  audit_io_own_reads += len;
+
+  return TRUE;
+}
+
+
+
+/* the bytes since the last sample go to the innermost operation */
+static void
+xkb_audit_account_io (void)
+{
+  XkbAuditOperationStats *stats;
+  guint64                 bytes_received, bytes_sent;
+
+  if (!xkb_audit_sample_io (&bytes_received, &bytes_sent))
+    return;
+
+  if (audit_depth > 0)
+    {
+      stats = &audit_operation_stats[audit_operations[MIN (audit_depth, XKB_AUDIT_MAX_DEPTH) - 1]];
+      stats->bytes_received += bytes_received - audit_io_read;
+      stats->bytes_sent += bytes_sent - audit_io_written;
+    }
+
+  audit_io_read = bytes_received;
+  audit_io_written = bytes_sent;
+}
+
+
+
+void
+xkb_audit_begin_real (XkbAuditOperation operation)
+{
+  g_return_if_fail (operation < XKB_AUDIT_N_OPERATIONS);
+
+  if (G_UNLIKELY (audit_display == NULL))
+    xkb_audit_watch_display ();
+
+  xkb_audit_account_io ();
+
+  /* deeper nesting counts for the deepest operation kept */
+  if (audit_depth < XKB_AUDIT_MAX_DEPTH)
+    audit_operations[audit_depth] = operation;
+  audit_depth++;
+
+  audit_operation_stats[operation].count++;
+}
+
+
+
+void
+xkb_audit_end_real (XkbAuditOperation operation)
+{
+  g_return_if_fail (operation < XKB_AUDIT_N_OPERATIONS);
+  g_return_if_fail (audit_depth > 0);
+
+  xkb_audit_account_io ();
+
+  audit_depth--;
+}
+
+
+
+/*
+ * Called by backends which send requests through xcb, the after
+ * function of Xlib would only see some of them.
+ */
+void
+xkb_audit_hide_requests (void)
+{
+  audit_requests_hidden = TRUE;
+}
+
+
+
+/* the totals since the last report or reset */
+void
+xkb_audit_get_operation_stats (XkbAuditOperation       operation,
+                               XkbAuditOperationStats *stats)
+{
+  g_return_if_fail (operation < XKB_AUDIT_N_OPERATIONS);
+  g_return_if_fail (stats != NULL);
+
+  *stats = audit_operation_stats[operation];
+}
+
+
+
+/* unlike the per source counts, this total survives the reports */
+guint
+xkb_audit_get_wakeups (void)
+{
+  return audit_wakeups;
+}
+
+
+
+void
+xkb_audit_reset (void)
+{
+  memset (audit_counts, 0, sizeof (audit_counts));
+  audit_wakeups = 0;
+  memset (audit_operation_stats, 0, sizeof (audit_operation_stats));
+  audit_last_report = g_get_monotonic_time ();
+}
+
+
+
+void
+xkb_audit_report (void)
+{
+  GString *report;
+  gint64   now;
+  guint    i, total = 0;
+
+  if (!xkb_audit_get_enabled ())
+    return;
+
+  now = g_get_monotonic_time ();
+  report = g_string_new (NULL);
+
+  for (i = 0; i < XKB_AUDIT_N_SOURCES; i++)
+    {
+      g_string_append_printf (report, " %s=%u", audit_source_names[i], audit_counts[i]);
+      total += audit_counts[i];
+      audit_counts[i] = 0;
+    }
+
+  g_message ("wakeups in the last %" G_GINT64_FORMAT " s: %u,%s",
+             audit_last_report > 0 ? (now - audit_last_report) / G_USEC_PER_SEC : 0,
+             total, report->str);
+
+  g_string_truncate (report, 0);
+
+  for (i = 0; i < XKB_AUDIT_N_OPERATIONS; i++)
+    {
+      if (audit_operation_stats[i].count == 0)
+        continue;
+
+      g_string_append_printf (report, " %s=%u/", audit_operation_names[i],
+                              audit_operation_stats[i].count);
+
+      if (audit_requests_hidden)
+        g_string_append (report, "-/-");
+      else
+        g_string_append_printf (report, "%lu/%lu",
+                                audit_operation_stats[i].requests,
+                                audit_operation_stats[i].round_trips);
+
+      g_string_append_printf (report, "/%" G_GUINT64_FORMAT "/%" G_GUINT64_FORMAT,
+                              audit_operation_stats[i].bytes_received,
+                              audit_operation_stats[i].bytes_sent);
+      memset (&audit_operation_stats[i], 0, sizeof (XkbAuditOperationStats));
+    }
+
+  if (report->len > 0)
+    g_message ("X operations/requests/round trips/bytes received/bytes sent:%s", report->str);
+
+  audit_last_report = now;
+  g_string_free (report, TRUE);
+}
@@ -0,0 +1,91 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-audit.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_AUDIT_H_
+#define _XKB_AUDIT_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* the main loop dispatches which run code of the plugin */
+typedef enum
+{
+  XKB_AUDIT_CONFIG_TIMEOUT,
+  XKB_AUDIT_POPUP_IDLE,
+  XKB_AUDIT_BACKEND_EVENT,
+  XKB_AUDIT_MODIFIER_EVENT,
+  XKB_AUDIT_WINDOW_EVENT,
+  XKB_AUDIT_DBUS_CALL,
+  XKB_AUDIT_REMOTE_EVENT,
+  XKB_AUDIT_CONFIG_COMMIT,
+  XKB_AUDIT_N_SOURCES
+} XkbAuditSource;
+
+/* the operations whose X requests are accounted for */
+typedef enum
+{
+  XKB_AUDIT_OP_STARTUP,
+  XKB_AUDIT_OP_CONFIG_REBUILD,
+  XKB_AUDIT_OP_GROUP_SWITCH,
+  XKB_AUDIT_OP_CAPS_LOCK,
+  XKB_AUDIT_OP_FOCUS_CHANGE,
+  XKB_AUDIT_N_OPERATIONS
+} XkbAuditOperation;
+
+typedef struct
+{
+  guint                count;
+  gulong               requests;
+  gulong               round_trips;
+  guint64              bytes_received;
+  guint64              bytes_sent;
+} XkbAuditOperationStats;
+
+gboolean    xkb_audit_get_enabled           (void);
+void        xkb_audit_count_real            (XkbAuditSource     source);
+void        xkb_audit_begin_real            (XkbAuditOperation  operation);
+void        xkb_audit_end_real              (XkbAuditOperation  operation);
+void        xkb_audit_report                (void);
+void        xkb_audit_reset                 (void);
+guint       xkb_audit_get_wakeups           (void);
+void        xkb_audit_hide_requests         (void);
+void        xkb_audit_get_operation_stats   (XkbAuditOperation       operation,
+                                             XkbAuditOperationStats *stats);
+
+#define xkb_audit_count(source) \
+  G_STMT_START { \
+    if (G_UNLIKELY (xkb_audit_get_enabled ())) \
+      xkb_audit_count_real (source); \
+  } G_STMT_END
+
+#define xkb_audit_begin(operation) \
+  G_STMT_START { \
+    if (G_UNLIKELY (xkb_audit_get_enabled ())) \
+      xkb_audit_begin_real (operation); \
+  } G_STMT_END
+
+#define xkb_audit_end(operation) \
+  G_STMT_START { \
+    if (G_UNLIKELY (xkb_audit_get_enabled ())) \
+      xkb_audit_end_real (operation); \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,354 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-backend-mock.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * In-process backend driven entirely by the caller, so the keyboard
+ * model can run without an X server. Group locks take effect and are
+ * reported synchronously.
+ */
+
+#include "xkb-backend-mock.h"
+#include "xkb-util.h"
+
+#define MOCK_MAX_GROUP_COUNT  4
+
+struct _XkbBackendMockClass
+{
+  XkbBackendClass      __parent__;
+};
+
+struct _XkbBackendMock
+{
+  XkbBackend           __parent__;
+
+  gchar              **layouts;
+  gchar              **variants;
+
+  gint                 current_group;
+  guint                lock_count;
+};
+
+static gboolean          xkb_backend_mock_lock_group           (XkbBackend           *backend,
+                                                                gint                  group);
+static gint              xkb_backend_mock_get_current_group    (XkbBackend           *backend);
+static gint              xkb_backend_mock_get_next_group       (XkbBackend           *backend);
+static gint              xkb_backend_mock_get_prev_group       (XkbBackend           *backend);
+static guint             xkb_backend_mock_get_max_group_count  (XkbBackend           *backend);
+static void              xkb_backend_mock_get_config           (XkbBackend           *backend,
+                                                                gchar              ***layouts,
+                                                                gchar              ***variants);
+static gboolean          xkb_backend_mock_activate_config      (XkbBackend           *backend,
+                                                                const gchar * const  *layouts,
+                                                                const gchar * const  *variants);
+static void              xkb_backend_mock_describe_groups      (XkbBackend           *backend,
+                                                                const gchar * const  *layouts,
+                                                                const gchar * const  *variants,
+                                                                guint                 mask,
+                                                                gchar               **pretty_names,
+                                                                gchar               **language_names);
+
+static void              xkb_backend_mock_finalize             (GObject              *object);
+
+G_DEFINE_TYPE (XkbBackendMock, xkb_backend_mock, TYPE_XKB_BACKEND)
+
+
+
+static void
+xkb_backend_mock_class_init (XkbBackendMockClass *klass)
+{
+  GObjectClass    *gobject_class;
+  XkbBackendClass *backend_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_backend_mock_finalize;
+
+  backend_class = XKB_BACKEND_CLASS (klass);
+  backend_class->lock_group = xkb_backend_mock_lock_group;
+  backend_class->get_current_group = xkb_backend_mock_get_current_group;
+  backend_class->get_next_group = xkb_backend_mock_get_next_group;
+  backend_class->get_prev_group = xkb_backend_mock_get_prev_group;
+  backend_class->get_max_group_count = xkb_backend_mock_get_max_group_count;
+  backend_class->get_config = xkb_backend_mock_get_config;
+  backend_class->activate_config = xkb_backend_mock_activate_config;
+  backend_class->describe_groups = xkb_backend_mock_describe_groups;
+}
+
+
+
+static void
+xkb_backend_mock_init (XkbBackendMock *mock)
+{
+  mock->layouts = g_new0 (gchar *, 1);
+  mock->variants = g_new0 (gchar *, 1);
+
+  mock->current_group = 0;
+  mock->lock_count = 0;
+}
+
+
+
+XkbBackend *
+xkb_backend_mock_new (void)
+{
+  return g_object_new (TYPE_XKB_BACKEND_MOCK, NULL);
+}
+
+
+
+static void
+xkb_backend_mock_finalize (GObject *object)
+{
+  XkbBackendMock *mock = XKB_BACKEND_MOCK (object);
+
+  g_strfreev (mock->layouts);
+  g_strfreev (mock->variants);
+
+  G_OBJECT_CLASS (xkb_backend_mock_parent_class)->finalize (object);
+}
+
+
+
+static gint
+xkb_backend_mock_group_count (XkbBackendMock *mock)
+{
+  return g_strv_length (mock->layouts);
+}
+
+
+
+static gboolean
+xkb_backend_mock_lock_group (XkbBackend *backend,
+                             gint        group)
+{
+  XkbBackendMock *mock = XKB_BACKEND_MOCK (backend);
+
+  mock->lock_count++;
+
+  if (group < 0 || group >= xkb_backend_mock_group_count (mock))
+    return FALSE;
+
+  mock->current_group = group;
+  xkb_backend_emit_group_changed (backend, group);
+
+  return TRUE;
+}
+
+
+
+static gint
+xkb_backend_mock_get_current_group (XkbBackend *backend)
+{
+  return XKB_BACKEND_MOCK (backend)->current_group;
+}
+
+
+
+static gint
+xkb_backend_mock_get_next_group (XkbBackend *backend)
+{
+  XkbBackendMock *mock = XKB_BACKEND_MOCK (backend);
+  gint            group_count;
+
+  group_count = xkb_backend_mock_group_count (mock);
+
+  return group_count > 0 ? (mock->current_group + 1) % group_count : 0;
+}
+
+
+
+static gint
+xkb_backend_mock_get_prev_group (XkbBackend *backend)
+{
+  XkbBackendMock *mock = XKB_BACKEND_MOCK (backend);
+  gint            group_count;
+
+  group_count = xkb_backend_mock_group_count (mock);
+
+  return group_count > 0 ? (mock->current_group + group_count - 1) % group_count : 0;
+}
+
+
+
+static guint
+xkb_backend_mock_get_max_group_count (XkbBackend *backend)
+{
+  return MOCK_MAX_GROUP_COUNT;
+}
+
+
+
+static void
+xkb_backend_mock_get_config (XkbBackend   *backend,
+                             gchar      ***layouts,
+                             gchar      ***variants)
+{
+  XkbBackendMock *mock = XKB_BACKEND_MOCK (backend);
+
+  *layouts = g_strdupv (mock->layouts);
+  *variants = g_strdupv (mock->variants);
+}
+
+
+
+static gboolean
+xkb_backend_mock_activate_config (XkbBackend          *backend,
+                                  const gchar * const *layouts,
+                                  const gchar * const *variants)
+{
+  xkb_backend_mock_set_config (XKB_BACKEND_MOCK (backend), layouts, variants);
+
+  return TRUE;
+}
+
+
+
+static void
+xkb_backend_mock_describe_groups (XkbBackend          *backend,
+                                  const gchar * const *layouts,
+                                  const gchar * const *variants,
+                                  guint                mask,
+                                  gchar              **pretty_names,
+                                  gchar              **language_names)
+{
+  gint i;
+
+  for (i = 0; layouts[i] != NULL; i++)
+    {
+      if ((mask & (1u << i)) == 0)
+        continue;
+
+      pretty_names[i] = xkb_util_get_layout_string (layouts[i], variants[i]);
+      language_names[i] = g_strdup (layouts[i]);
+    }
+}
+
+
+
+/*
+ * Replaces the layout configuration and reports it like the X server
+ * would. The group is reset to the first one.
+ */
+void
+xkb_backend_mock_set_config (XkbBackendMock      *mock,
+                             const gchar * const *layouts,
+                             const gchar * const *variants)
+{
+  guint i, n_layouts;
+
+  g_return_if_fail (IS_XKB_BACKEND_MOCK (mock));
+  g_return_if_fail (layouts != NULL);
+
+  g_strfreev (mock->layouts);
+  g_strfreev (mock->variants);
+
+  n_layouts = g_strv_length ((gchar **) layouts);
+  n_layouts = MIN (n_layouts, MOCK_MAX_GROUP_COUNT);
+
+  mock->layouts = g_new0 (gchar *, n_layouts + 1);
+  mock->variants = g_new0 (gchar *, n_layouts + 1);
+
+  for (i = 0; i < n_layouts; i++)
+    {
+      mock->layouts[i] = g_strdup (layouts[i]);
+      mock->variants[i] = g_strdup (variants != NULL && variants[i] != NULL ? variants[i] : "");
+    }
+
+  mock->current_group = 0;
+
+  xkb_backend_emit_config_changed (XKB_BACKEND (mock));
+}
+
+
+
+void
+xkb_backend_mock_activate_window (XkbBackendMock *mock,
+                                  guint           window_id,
+                                  guint           application_id,
+                                  const gchar    *wm_class,
+                                  const gchar    *title)
+{
+  g_return_if_fail (IS_XKB_BACKEND_MOCK (mock));
+
+  xkb_backend_emit_active_window_changed (XKB_BACKEND (mock), window_id, application_id,
+                                          wm_class, title);
+}
+
+
+
+void
+xkb_backend_mock_close_window (XkbBackendMock *mock,
+                               guint           window_id)
+{
+  g_return_if_fail (IS_XKB_BACKEND_MOCK (mock));
+
+  xkb_backend_emit_window_closed (XKB_BACKEND (mock), window_id);
+}
+
+
+
+void
+xkb_backend_mock_close_application (XkbBackendMock *mock,
+                                    guint           application_id)
+{
+  g_return_if_fail (IS_XKB_BACKEND_MOCK (mock));
+
+  xkb_backend_emit_application_closed (XKB_BACKEND (mock), application_id);
+}
+
+
+
+/*
+ * Switches the group like a key combination handled by the server, the
+ * switch is not counted as a lock.
+ */
+void
+xkb_backend_mock_switch_group (XkbBackendMock *mock,
+                               gint            group)
+{
+  g_return_if_fail (IS_XKB_BACKEND_MOCK (mock));
+
+  if (group < 0 || group >= xkb_backend_mock_group_count (mock))
+    return;
+
+  mock->current_group = group;
+  xkb_backend_emit_group_changed (XKB_BACKEND (mock), group);
+}
+
+
+
+void
+xkb_backend_mock_switch_workspace (XkbBackendMock *mock,
+                                   gint            workspace)
+{
+  g_return_if_fail (IS_XKB_BACKEND_MOCK (mock));
+
+  xkb_backend_emit_workspace_changed (XKB_BACKEND (mock), workspace);
+}
+
+
+
+/*
+ * Number of group locks requested so far, including rejected ones.
+ */
+guint
+xkb_backend_mock_get_lock_count (XkbBackendMock *mock)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND_MOCK (mock), 0);
+
+  return mock->lock_count;
+}
@@ -0,0 +1,60 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-backend-mock.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_BACKEND_MOCK_H_
+#define _XKB_BACKEND_MOCK_H_
+
+#include "xkb-backend.h"
+
+G_BEGIN_DECLS
+
+typedef struct _XkbBackendMockClass     XkbBackendMockClass;
+typedef struct _XkbBackendMock          XkbBackendMock;
+
+#define TYPE_XKB_BACKEND_MOCK            (xkb_backend_mock_get_type ())
+#define XKB_BACKEND_MOCK(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_BACKEND_MOCK, XkbBackendMock))
+#define XKB_BACKEND_MOCK_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_BACKEND_MOCK, XkbBackendMockClass))
+#define IS_XKB_BACKEND_MOCK(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_XKB_BACKEND_MOCK))
+#define IS_XKB_BACKEND_MOCK_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass),  TYPE_XKB_BACKEND_MOCK))
+#define XKB_BACKEND_MOCK_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj),  TYPE_XKB_BACKEND_MOCK, XkbBackendMockClass))
+
+GType             xkb_backend_mock_get_type                 (void)                           G_GNUC_CONST;
+
+XkbBackend       *xkb_backend_mock_new                      (void);
+
+void              xkb_backend_mock_set_config               (XkbBackendMock      *mock,
+                                                             const gchar * const *layouts,
+                                                             const gchar * const *variants);
+void              xkb_backend_mock_activate_window          (XkbBackendMock      *mock,
+                                                             guint                window_id,
+                                                             guint                application_id,
+                                                             const gchar         *wm_class,
+                                                             const gchar         *title);
+void              xkb_backend_mock_close_window             (XkbBackendMock      *mock,
+                                                             guint                window_id);
+void              xkb_backend_mock_close_application        (XkbBackendMock      *mock,
+                                                             guint                application_id);
+void              xkb_backend_mock_switch_group             (XkbBackendMock      *mock,
+                                                             gint                 group);
+void              xkb_backend_mock_switch_workspace         (XkbBackendMock      *mock,
+                                                             gint                 workspace);
+guint             xkb_backend_mock_get_lock_count           (XkbBackendMock      *mock);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,514 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-backend-xkbcommon.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Keyboard backend built on xkbcommon-x11 and libxkbregistry instead of
+ * libxklavier. The keymap and state come from the server through the
+ * connection GDK already has open; layout codes are read from the
+ * _XKB_RULES_NAMES root window property, like setxkbmap writes them.
+ */
+
+#include "xkb-backend-xkbcommon.h"
+#include "xkb-audit.h"
+#include "xkb-probes.h"
+#include "xkb-util.h"
+
+#include <string.h>
+
+#include <gdk/gdkx.h>
+#include <X11/Xatom.h>
+#include <X11/XKBlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xkbcommon/xkbcommon-x11.h>
+#include <xkbcommon/xkbregistry.h>
+
+#define RULES_NAMES_PROPERTY  "_XKB_RULES_NAMES"
+#define RULES_NAMES_LAYOUT    2
+#define RULES_NAMES_VARIANT   3
+
+struct _XkbBackendXkbcommonClass
+{
+  XkbBackendClass      __parent__;
+};
+
+struct _XkbBackendXkbcommon
+{
+  XkbBackend           __parent__;
+
+  Display             *display;
+  xcb_connection_t    *connection;
+  gint32               device_id;
+  gint                 xkb_event_type;
+
+  struct xkb_context  *context;
+  struct xkb_keymap   *keymap;
+  struct xkb_state    *state;
+
+  /* the keymap is fetched again only when it is needed after a change */
+  gboolean             keymap_stale;
+
+  gint                 current_group;
+};
+
+static gboolean          xkb_backend_xkbcommon_lock_group            (XkbBackend           *backend,
+                                                                      gint                  group);
+static gint              xkb_backend_xkbcommon_get_current_group     (XkbBackend           *backend);
+static gint              xkb_backend_xkbcommon_get_next_group        (XkbBackend           *backend);
+static gint              xkb_backend_xkbcommon_get_prev_group        (XkbBackend           *backend);
+static guint             xkb_backend_xkbcommon_get_max_group_count   (XkbBackend           *backend);
+static void              xkb_backend_xkbcommon_get_config            (XkbBackend           *backend,
+                                                                      gchar              ***layouts,
+                                                                      gchar              ***variants);
+static void              xkb_backend_xkbcommon_describe_groups       (XkbBackend           *backend,
+                                                                      const gchar * const  *layouts,
+                                                                      const gchar * const  *variants,
+                                                                      guint                 mask,
+                                                                      gchar               **pretty_names,
+                                                                      gchar               **language_names);
+
+static GdkFilterReturn   xkb_backend_xkbcommon_handle_xevent         (GdkXEvent            *xev,
+                                                                      GdkEvent             *event,
+                                                                      gpointer              user_data);
+
+static void              xkb_backend_xkbcommon_finalize              (GObject              *object);
+
+G_DEFINE_TYPE (XkbBackendXkbcommon, xkb_backend_xkbcommon, TYPE_XKB_BACKEND)
+
+
+
+static void
+xkb_backend_xkbcommon_class_init (XkbBackendXkbcommonClass *klass)
+{
+  GObjectClass    *gobject_class;
+  XkbBackendClass *backend_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_backend_xkbcommon_finalize;
+
+  backend_class = XKB_BACKEND_CLASS (klass);
+  backend_class->lock_group = xkb_backend_xkbcommon_lock_group;
+  backend_class->get_current_group = xkb_backend_xkbcommon_get_current_group;
+  backend_class->get_next_group = xkb_backend_xkbcommon_get_next_group;
+  backend_class->get_prev_group = xkb_backend_xkbcommon_get_prev_group;
+  backend_class->get_max_group_count = xkb_backend_xkbcommon_get_max_group_count;
+  backend_class->get_config = xkb_backend_xkbcommon_get_config;
+  backend_class->describe_groups = xkb_backend_xkbcommon_describe_groups;
+}
+
+
+
+static void
+xkb_backend_xkbcommon_init (XkbBackendXkbcommon *xkbcommon)
+{
+  xkbcommon->display = NULL;
+  xkbcommon->connection = NULL;
+  xkbcommon->device_id = -1;
+  xkbcommon->xkb_event_type = 0;
+
+  xkbcommon->context = NULL;
+  xkbcommon->keymap = NULL;
+  xkbcommon->state = NULL;
+
+  xkbcommon->keymap_stale = FALSE;
+
+  xkbcommon->current_group = 0;
+}
+
+
+
+static gboolean
+xkb_backend_xkbcommon_load_keymap (XkbBackendXkbcommon *xkbcommon)
+{
+  struct xkb_keymap *keymap;
+  struct xkb_state  *state;
+
+  keymap = xkb_x11_keymap_new_from_device (xkbcommon->context, xkbcommon->connection,
+                                           xkbcommon->device_id, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (keymap == NULL)
+    return FALSE;
+
+  state = xkb_x11_state_new_from_device (keymap, xkbcommon->connection, xkbcommon->device_id);
+  if (state == NULL)
+    {
+      xkb_keymap_unref (keymap);
+      return FALSE;
+    }
+
+  if (xkbcommon->state != NULL)
+    xkb_state_unref (xkbcommon->state);
+
+  if (xkbcommon->keymap != NULL)
+    xkb_keymap_unref (xkbcommon->keymap);
+
+  xkbcommon->keymap = keymap;
+  xkbcommon->state = state;
+  xkbcommon->keymap_stale = FALSE;
+
+  xkbcommon->current_group = xkb_state_serialize_layout (state, XKB_STATE_LAYOUT_EFFECTIVE);
+
+  return TRUE;
+}
+
+
+
+static void
+xkb_backend_xkbcommon_ensure_keymap (XkbBackendXkbcommon *xkbcommon)
+{
+  if (xkbcommon->keymap_stale)
+    xkb_backend_xkbcommon_load_keymap (xkbcommon);
+}
+
+
+
+XkbBackend *
+xkb_backend_xkbcommon_new (void)
+{
+  XkbBackendXkbcommon *xkbcommon;
+  Display             *display;
+  xcb_connection_t    *connection;
+  guint8               first_event;
+  gint32               device_id;
+
+  display = gdk_x11_get_default_xdisplay ();
+  connection = XGetXCBConnection (display);
+
+  if (!xkb_x11_setup_xkb_extension (connection,
+                                    XKB_X11_MIN_MAJOR_XKB_VERSION,
+                                    XKB_X11_MIN_MINOR_XKB_VERSION,
+                                    XKB_X11_SETUP_XKB_EXTENSION_NO_FLAGS,
+                                    NULL, NULL, &first_event, NULL))
+    return NULL;
+
+  device_id = xkb_x11_get_core_keyboard_device_id (connection);
+  if (device_id < 0)
+    return NULL;
+
+  xkbcommon = g_object_new (TYPE_XKB_BACKEND_XKBCOMMON, NULL);
+
+  /* xkbcommon-x11 sends its requests past the Xlib after function */
+  xkb_audit_hide_requests ();
+
+  xkbcommon->display = display;
+  xkbcommon->connection = connection;
+  xkbcommon->device_id = device_id;
+  xkbcommon->xkb_event_type = first_event;
+  xkbcommon->context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+
+  if (xkbcommon->context == NULL || !xkb_backend_xkbcommon_load_keymap (xkbcommon))
+    {
+      g_object_unref (xkbcommon);
+      return NULL;
+    }
+
+  /* GDK shares this connection and relies on its own XKB selection,
+   * so events are only ever added here and never deselected */
+  XkbSelectEventDetails (display, XkbUseCoreKbd, XkbStateNotify,
+                         XkbGroupStateMask, XkbGroupStateMask);
+  XkbSelectEvents (display, XkbUseCoreKbd,
+                   XkbNewKeyboardNotifyMask | XkbMapNotifyMask,
+                   XkbNewKeyboardNotifyMask | XkbMapNotifyMask);
+
+  gdk_window_add_filter (NULL, xkb_backend_xkbcommon_handle_xevent, xkbcommon);
+
+  xkb_backend_track_windows (XKB_BACKEND (xkbcommon));
+
+  return XKB_BACKEND (xkbcommon);
+}
+
+
+
+static void
+xkb_backend_xkbcommon_finalize (GObject *object)
+{
+  XkbBackendXkbcommon *xkbcommon = XKB_BACKEND_XKBCOMMON (object);
+
+  if (xkbcommon->xkb_event_type != 0)
+    gdk_window_remove_filter (NULL, xkb_backend_xkbcommon_handle_xevent, xkbcommon);
+
+  if (xkbcommon->state != NULL)
+    xkb_state_unref (xkbcommon->state);
+
+  if (xkbcommon->keymap != NULL)
+    xkb_keymap_unref (xkbcommon->keymap);
+
+  if (xkbcommon->context != NULL)
+    xkb_context_unref (xkbcommon->context);
+
+  G_OBJECT_CLASS (xkb_backend_xkbcommon_parent_class)->finalize (object);
+}
+
+
+
+static gboolean
+xkb_backend_xkbcommon_lock_group (XkbBackend *backend,
+                                  gint        group)
+{
+  XkbBackendXkbcommon *xkbcommon = XKB_BACKEND_XKBCOMMON (backend);
+
+  if (!XkbLockGroup (xkbcommon->display, XkbUseCoreKbd, group))
+    return FALSE;
+
+  XFlush (xkbcommon->display);
+
+  return TRUE;
+}
+
+
+
+static gint
+xkb_backend_xkbcommon_get_current_group (XkbBackend *backend)
+{
+  return XKB_BACKEND_XKBCOMMON (backend)->current_group;
+}
+
+
+
+static gint
+xkb_backend_xkbcommon_get_layout_count (XkbBackendXkbcommon *xkbcommon)
+{
+  xkb_backend_xkbcommon_ensure_keymap (xkbcommon);
+
+  return MAX (xkb_keymap_num_layouts (xkbcommon->keymap), 1);
+}
+
+
+
+static gint
+xkb_backend_xkbcommon_get_next_group (XkbBackend *backend)
+{
+  XkbBackendXkbcommon *xkbcommon = XKB_BACKEND_XKBCOMMON (backend);
+
+  return (xkbcommon->current_group + 1) % xkb_backend_xkbcommon_get_layout_count (xkbcommon);
+}
+
+
+
+static gint
+xkb_backend_xkbcommon_get_prev_group (XkbBackend *backend)
+{
+  XkbBackendXkbcommon *xkbcommon = XKB_BACKEND_XKBCOMMON (backend);
+  gint                 layout_count;
+
+  layout_count = xkb_backend_xkbcommon_get_layout_count (xkbcommon);
+
+  return (xkbcommon->current_group + layout_count - 1) % layout_count;
+}
+
+
+
+static guint
+xkb_backend_xkbcommon_get_max_group_count (XkbBackend *backend)
+{
+  return XkbNumKbdGroups;
+}
+
+
+
+static gchar **
+xkb_backend_xkbcommon_read_rules_names (XkbBackendXkbcommon *xkbcommon)
+{
+  Atom           atom, type;
+  gint           format;
+  gulong         n_items, bytes_after;
+  guchar        *data = NULL;
+  GPtrArray     *fields;
+  gulong         offset;
+
+  atom = XInternAtom (xkbcommon->display, RULES_NAMES_PROPERTY, True);
+  if (atom == None)
+    return NULL;
+
+  if (XGetWindowProperty (xkbcommon->display, DefaultRootWindow (xkbcommon->display),
+                          atom, 0, 1024, False, XA_STRING,
+                          &type, &format, &n_items, &bytes_after, &data) != Success ||
+      type != XA_STRING || format != 8 || data == NULL)
+    {
+      if (data != NULL)
+        XFree (data);
+
+      return NULL;
+    }
+
+  /* rules, model, layout, variant and options, separated by NULs */
+  fields = g_ptr_array_new ();
+  for (offset = 0; offset < n_items; offset += strlen ((gchar *) data + offset) + 1)
+    g_ptr_array_add (fields, g_strndup ((gchar *) data + offset, n_items - offset));
+  g_ptr_array_add (fields, NULL);
+
+  XFree (data);
+
+  return (gchar **) g_ptr_array_free (fields, FALSE);
+}
+
+
+
+static void
+xkb_backend_xkbcommon_get_config (XkbBackend   *backend,
+                                  gchar      ***layouts,
+                                  gchar      ***variants)
+{
+  XkbBackendXkbcommon  *xkbcommon = XKB_BACKEND_XKBCOMMON (backend);
+  gchar               **rules_names;
+  gchar               **split_variants = NULL;
+  guint                 i, n_layouts, n_variants = 0;
+
+  xkb_backend_xkbcommon_ensure_keymap (xkbcommon);
+
+  rules_names = xkb_backend_xkbcommon_read_rules_names (xkbcommon);
+
+  if (rules_names != NULL && g_strv_length (rules_names) > RULES_NAMES_LAYOUT)
+    {
+      *layouts = g_strsplit (rules_names[RULES_NAMES_LAYOUT], ",", -1);
+
+      if (g_strv_length (rules_names) > RULES_NAMES_VARIANT)
+        {
+          split_variants = g_strsplit (rules_names[RULES_NAMES_VARIANT], ",", -1);
+          n_variants = g_strv_length (split_variants);
+        }
+    }
+  else
+    {
+      /* no rules names, fall back to what the keymap calls its layouts */
+      n_layouts = xkb_keymap_num_layouts (xkbcommon->keymap);
+      *layouts = g_new0 (gchar *, n_layouts + 1);
+
+      for (i = 0; i < n_layouts; i++)
+        (*layouts)[i] = g_strdup (xkb_keymap_layout_get_name (xkbcommon->keymap, i));
+    }
+
+  n_layouts = g_strv_length (*layouts);
+  *variants = g_new0 (gchar *, n_layouts + 1);
+
+  for (i = 0; i < n_layouts; i++)
+    (*variants)[i] = g_strdup (i < n_variants ? split_variants[i] : "");
+
+  g_strfreev (split_variants);
+  g_strfreev (rules_names);
+}
+
+
+
+static void
+xkb_backend_xkbcommon_describe_groups (XkbBackend          *backend,
+                                       const gchar * const *layouts,
+                                       const gchar * const *variants,
+                                       guint                mask,
+                                       gchar              **pretty_names,
+                                       gchar              **language_names)
+{
+  struct rxkb_context *context;
+  struct rxkb_layout  *layout, *base, *match;
+  const gchar         *description, *brief;
+  gint                 i;
+
+  context = rxkb_context_new (RXKB_CONTEXT_NO_FLAGS);
+  if (context == NULL)
+    return;
+
+  if (!rxkb_context_parse_default_ruleset (context))
+    {
+      rxkb_context_unref (context);
+      return;
+    }
+
+  for (i = 0; layouts[i] != NULL; i++)
+    {
+      if ((mask & (1u << i)) == 0)
+        continue;
+
+      base = match = NULL;
+
+      for (layout = rxkb_layout_first (context); layout != NULL; layout = rxkb_layout_next (layout))
+        {
+          if (g_strcmp0 (rxkb_layout_get_name (layout), layouts[i]) != 0)
+            continue;
+
+          if (rxkb_layout_get_variant (layout) == NULL)
+            base = layout;
+          else if (g_strcmp0 (rxkb_layout_get_variant (layout), variants[i]) == 0)
+            match = layout;
+        }
+
+      description = NULL;
+      if (match != NULL)
+        description = rxkb_layout_get_description (match);
+      if (description == NULL && base != NULL)
+        description = rxkb_layout_get_description (base);
+
+      brief = base != NULL ? rxkb_layout_get_brief (base) : NULL;
+
+      pretty_names[i] = description != NULL
+        ? g_strdup (description)
+        : xkb_util_get_layout_string (layouts[i], variants[i]);
+      language_names[i] = g_strdup (brief != NULL ? brief : layouts[i]);
+    }
+
+  rxkb_context_unref (context);
+}
+
+
+
+static GdkFilterReturn
+xkb_backend_xkbcommon_handle_xevent (GdkXEvent *xev,
+                                     GdkEvent  *event,
+                                     gpointer   user_data)
+{
+  XkbBackendXkbcommon *xkbcommon = user_data;
+  XkbEvent            *xkb_event = xev;
+  gint                 group;
+
+  if (xkb_event->type != xkbcommon->xkb_event_type ||
+      xkb_event->any.device != (guint) xkbcommon->device_id)
+    {
+      XKB_PROBE_X_EVENT_REJECTED (xkb_event->type);
+      return GDK_FILTER_CONTINUE;
+    }
+
+  xkb_audit_count (XKB_AUDIT_BACKEND_EVENT);
+  XKB_PROBE_X_EVENT_ACCEPTED (xkb_event->type);
+
+  switch (xkb_event->any.xkb_type)
+    {
+    case XkbStateNotify:
+      xkb_backend_xkbcommon_ensure_keymap (xkbcommon);
+
+      xkb_state_update_mask (xkbcommon->state,
+                             xkb_event->state.base_mods,
+                             xkb_event->state.latched_mods,
+                             xkb_event->state.locked_mods,
+                             xkb_event->state.base_group,
+                             xkb_event->state.latched_group,
+                             xkb_event->state.locked_group);
+
+      group = xkb_state_serialize_layout (xkbcommon->state, XKB_STATE_LAYOUT_EFFECTIVE);
+      if (group != xkbcommon->current_group)
+        {
+          xkbcommon->current_group = group;
+          xkb_backend_emit_group_changed (XKB_BACKEND (xkbcommon), group);
+        }
+      break;
+
+    case XkbNewKeyboardNotify:
+    case XkbMapNotify:
+      xkbcommon->keymap_stale = TRUE;
+      xkb_backend_emit_config_changed (XKB_BACKEND (xkbcommon));
+      break;
+    }
+
+  return GDK_FILTER_CONTINUE;
+}
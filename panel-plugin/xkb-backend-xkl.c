@@ -0,0 +1,596 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-backend-xkl.c
+ *
+ * A part of this file comes from the gnome keyboard capplet (control-center):
+ * Copyright (C) 2003 Sergey V. Oudaltsov <svu@users.sourceforge.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xkb-backend-xkl.h"
+#include "xkb-audit.h"
+#include "xkb-probes.h"
+#include "xkb-util.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gdk/gdkx.h>
+#include <X11/XKBlib.h>
+#include <X11/extensions/XKBrules.h>
+#include <libxklavier/xklavier.h>
+
+struct _XkbBackendXklClass
+{
+  XkbBackendClass      __parent__;
+};
+
+struct _XkbBackendXkl
+{
+  XkbBackend           __parent__;
+
+  XklEngine           *engine;
+
+  /* rules are parsed once per rules file, and the keymap each
+   * configuration compiles to is fetched once and kept, so switching
+   * back to a configuration only uploads it */
+  gchar               *rules_file;
+  XkbRF_RulesPtr       rules;
+  GHashTable          *keymap_cache;
+
+  /* libxklavier only rereads the group count when the server reports a
+   * new keyboard, which an uploaded keymap does not cause */
+  gint                 uploaded_group_count;
+};
+
+static gboolean          xkb_backend_xkl_lock_group            (XkbBackend           *backend,
+                                                                gint                  group);
+static gint              xkb_backend_xkl_get_current_group     (XkbBackend           *backend);
+static gint              xkb_backend_xkl_get_next_group        (XkbBackend           *backend);
+static gint              xkb_backend_xkl_get_prev_group        (XkbBackend           *backend);
+static guint             xkb_backend_xkl_get_max_group_count   (XkbBackend           *backend);
+static void              xkb_backend_xkl_get_config            (XkbBackend           *backend,
+                                                                gchar              ***layouts,
+                                                                gchar              ***variants);
+static gboolean          xkb_backend_xkl_activate_config       (XkbBackend           *backend,
+                                                                const gchar * const  *layouts,
+                                                                const gchar * const  *variants);
+static void              xkb_backend_xkl_describe_groups       (XkbBackend           *backend,
+                                                                const gchar * const  *layouts,
+                                                                const gchar * const  *variants,
+                                                                guint                 mask,
+                                                                gchar               **pretty_names,
+                                                                gchar               **language_names);
+
+static void              xkb_backend_xkl_state_changed         (XklEngine            *engine,
+                                                                XklEngineStateChange  change,
+                                                                gint                  group,
+                                                                gboolean              restore,
+                                                                XkbBackendXkl        *xkl);
+static void              xkb_backend_xkl_config_changed        (XklEngine            *engine,
+                                                                XkbBackendXkl        *xkl);
+
+static GdkFilterReturn   xkb_backend_xkl_handle_xevent         (GdkXEvent            *xev,
+                                                                GdkEvent             *event,
+                                                                gpointer              user_data);
+
+static void              xkb_backend_xkl_finalize              (GObject              *object);
+
+G_DEFINE_TYPE (XkbBackendXkl, xkb_backend_xkl, TYPE_XKB_BACKEND)
+
+
+
+static void
+xkb_backend_xkl_class_init (XkbBackendXklClass *klass)
+{
+  GObjectClass    *gobject_class;
+  XkbBackendClass *backend_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_backend_xkl_finalize;
+
+  backend_class = XKB_BACKEND_CLASS (klass);
+  backend_class->lock_group = xkb_backend_xkl_lock_group;
+  backend_class->get_current_group = xkb_backend_xkl_get_current_group;
+  backend_class->get_next_group = xkb_backend_xkl_get_next_group;
+  backend_class->get_prev_group = xkb_backend_xkl_get_prev_group;
+  backend_class->get_max_group_count = xkb_backend_xkl_get_max_group_count;
+  backend_class->get_config = xkb_backend_xkl_get_config;
+  backend_class->activate_config = xkb_backend_xkl_activate_config;
+  backend_class->describe_groups = xkb_backend_xkl_describe_groups;
+}
+
+
+
+static void
+xkb_backend_xkl_keymap_free (gpointer data)
+{
+  XkbFreeKeyboard (data, XkbAllComponentsMask, True);
+}
+
+
+
+static void
+xkb_backend_xkl_init (XkbBackendXkl *xkl)
+{
+  xkl->engine = NULL;
+
+  xkl->rules_file = NULL;
+  xkl->rules = NULL;
+  xkl->uploaded_group_count = 0;
+  xkl->keymap_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             xkb_backend_xkl_keymap_free);
+}
+
+
+
+XkbBackend *
+xkb_backend_xkl_new (void)
+{
+  XkbBackendXkl *xkl;
+  XklEngine     *engine;
+
+  engine = xkl_engine_get_instance (gdk_x11_get_default_xdisplay ());
+  if (engine == NULL)
+    return NULL;
+
+  xkl = g_object_new (TYPE_XKB_BACKEND_XKL, NULL);
+
+  xkl->engine = engine;
+
+  xkl_engine_set_group_per_toplevel_window (xkl->engine, FALSE);
+
+  xkl_engine_start_listen (xkl->engine, XKLL_TRACK_KEYBOARD_STATE);
+
+  g_signal_connect (xkl->engine, "X-state-changed",
+                    G_CALLBACK (xkb_backend_xkl_state_changed), xkl);
+  g_signal_connect (xkl->engine, "X-config-changed",
+                    G_CALLBACK (xkb_backend_xkl_config_changed), xkl);
+
+  gdk_window_add_filter (NULL, xkb_backend_xkl_handle_xevent, xkl);
+
+  xkb_backend_track_windows (XKB_BACKEND (xkl));
+
+  return XKB_BACKEND (xkl);
+}
+
+
+
+static void
+xkb_backend_xkl_finalize (GObject *object)
+{
+  XkbBackendXkl *xkl = XKB_BACKEND_XKL (object);
+
+  if (xkl->engine)
+    {
+      g_signal_handlers_disconnect_by_data (xkl->engine, xkl);
+      xkl_engine_stop_listen (xkl->engine, XKLL_TRACK_KEYBOARD_STATE);
+      g_object_unref (xkl->engine);
+
+      gdk_window_remove_filter (NULL, xkb_backend_xkl_handle_xevent, xkl);
+    }
+
+  if (xkl->rules != NULL)
+    XkbRF_Free (xkl->rules, True);
+
+  g_free (xkl->rules_file);
+  g_hash_table_destroy (xkl->keymap_cache);
+
+  G_OBJECT_CLASS (xkb_backend_xkl_parent_class)->finalize (object);
+}
+
+
+
+static gboolean
+xkb_backend_xkl_lock_group (XkbBackend *backend,
+                            gint        group)
+{
+  XkbBackendXkl *xkl = XKB_BACKEND_XKL (backend);
+
+  xkl_engine_lock_group (xkl->engine, group);
+
+  return TRUE;
+}
+
+
+
+static gint
+xkb_backend_xkl_get_current_group (XkbBackend *backend)
+{
+  XkbBackendXkl *xkl = XKB_BACKEND_XKL (backend);
+  XklState      *state;
+
+  state = xkl_engine_get_current_state (xkl->engine);
+
+  return state != NULL ? state->group : 0;
+}
+
+
+
+static gint
+xkb_backend_xkl_get_next_group (XkbBackend *backend)
+{
+  XkbBackendXkl *xkl = XKB_BACKEND_XKL (backend);
+
+  if (xkl->uploaded_group_count > 0)
+    return (xkb_backend_xkl_get_current_group (backend) + 1) % xkl->uploaded_group_count;
+
+  return xkl_engine_get_next_group (xkl->engine);
+}
+
+
+
+static gint
+xkb_backend_xkl_get_prev_group (XkbBackend *backend)
+{
+  XkbBackendXkl *xkl = XKB_BACKEND_XKL (backend);
+
+  if (xkl->uploaded_group_count > 0)
+    return (xkb_backend_xkl_get_current_group (backend) + xkl->uploaded_group_count - 1)
+           % xkl->uploaded_group_count;
+
+  return xkl_engine_get_prev_group (xkl->engine);
+}
+
+
+
+static guint
+xkb_backend_xkl_get_max_group_count (XkbBackend *backend)
+{
+  return xkl_engine_get_max_num_groups (XKB_BACKEND_XKL (backend)->engine);
+}
+
+
+
+static void
+xkb_backend_xkl_get_config (XkbBackend   *backend,
+                            gchar      ***layouts,
+                            gchar      ***variants)
+{
+  XkbBackendXkl *xkl = XKB_BACKEND_XKL (backend);
+  XklConfigRec  *config_rec;
+  guint          i, n_layouts;
+  gboolean       variants_done = FALSE;
+
+  config_rec = xkl_config_rec_new ();
+  xkl_config_rec_get_from_server (config_rec, xkl->engine);
+
+  n_layouts = config_rec->layouts != NULL ? g_strv_length (config_rec->layouts) : 0;
+
+  *layouts = g_new0 (gchar *, n_layouts + 1);
+  *variants = g_new0 (gchar *, n_layouts + 1);
+
+  /* the server may report fewer variants than layouts */
+  for (i = 0; i < n_layouts; i++)
+    {
+      (*layouts)[i] = g_strdup (config_rec->layouts[i]);
+
+      if (config_rec->variants == NULL || config_rec->variants[i] == NULL)
+        variants_done = TRUE;
+
+      (*variants)[i] = g_strdup (variants_done ? "" : config_rec->variants[i]);
+    }
+
+  g_object_unref (config_rec);
+}
+
+
+
+static XkbRF_RulesPtr
+xkb_backend_xkl_get_rules (XkbBackendXkl *xkl,
+                           const gchar   *rules_file)
+{
+  gchar *path;
+
+  if (xkl->rules != NULL && g_strcmp0 (xkl->rules_file, rules_file) == 0)
+    return xkl->rules;
+
+  if (xkl->rules != NULL)
+    XkbRF_Free (xkl->rules, True);
+
+  g_free (xkl->rules_file);
+  xkl->rules_file = g_strdup (rules_file);
+
+  if (g_path_is_absolute (rules_file))
+    path = g_strdup (rules_file);
+  else
+    path = g_build_filename (XKB_RULES_DIR, rules_file, NULL);
+
+  xkl->rules = XkbRF_Load (path, "", True, True);
+  g_free (path);
+
+  return xkl->rules;
+}
+
+
+
+/*
+ * Returns the keymap the configuration compiles to. The server compiles
+ * it only the first time, without loading it, and the client keeps it.
+ */
+static XkbDescPtr
+xkb_backend_xkl_get_keymap (XkbBackendXkl    *xkl,
+                            Display          *display,
+                            const gchar      *rules_file,
+                            XkbRF_VarDefsRec *var_defs)
+{
+  XkbComponentNamesRec names;
+  XkbRF_RulesPtr       rules;
+  XkbDescPtr           xkb = NULL;
+  gchar               *key;
+
+  key = g_strjoin ("\t", rules_file,
+                   var_defs->model != NULL ? var_defs->model : "",
+                   var_defs->layout, var_defs->variant,
+                   var_defs->options != NULL ? var_defs->options : "",
+                   NULL);
+
+  xkb = g_hash_table_lookup (xkl->keymap_cache, key);
+  if (xkb != NULL)
+    {
+      g_free (key);
+      return xkb;
+    }
+
+  rules = xkb_backend_xkl_get_rules (xkl, rules_file);
+  memset (&names, 0, sizeof (names));
+
+  if (rules != NULL && XkbRF_GetComponents (rules, var_defs, &names))
+    {
+      xkb = XkbGetKeyboardByName (display, XkbUseCoreKbd, &names,
+                                  XkbGBN_AllComponentsMask & ~XkbGBN_GeometryMask,
+                                  XkbGBN_AllComponentsMask & ~XkbGBN_GeometryMask,
+                                  False);
+    }
+
+  /* allocated by libxkbfile */
+  free (names.keymap);
+  free (names.keycodes);
+  free (names.types);
+  free (names.compat);
+  free (names.symbols);
+  free (names.geometry);
+
+  if (xkb == NULL)
+    {
+      g_free (key);
+      return NULL;
+    }
+
+  g_hash_table_insert (xkl->keymap_cache, key, xkb);
+
+  return xkb;
+}
+
+
+
+/*
+ * Replaces the keymap of the server with the given one, which costs
+ * the requests and a single round trip to learn whether it took.
+ */
+static gboolean
+xkb_backend_xkl_upload_keymap (Display    *display,
+                               XkbDescPtr  xkb)
+{
+  GdkDisplay *gdk_display;
+
+  gdk_display = gdk_x11_lookup_xdisplay (display);
+  gdk_x11_display_error_trap_push (gdk_display);
+
+  XkbSetMap (display, XkbAllMapComponentsMask, xkb);
+  XkbSetCompatMap (display, XkbAllCompatMask, xkb, True);
+  XkbSetIndicatorMap (display, XkbAllIndicatorsMask, xkb);
+  XkbSetNames (display, XkbAllNamesMask & ~XkbGeometryNameMask,
+               0, xkb->map->num_types, xkb);
+
+  return gdk_x11_display_error_trap_pop (gdk_display) == 0;
+}
+
+
+
+static gboolean
+xkb_backend_xkl_activate_config (XkbBackend          *backend,
+                                 const gchar * const *layouts,
+                                 const gchar * const *variants)
+{
+  XkbBackendXkl        *xkl = XKB_BACKEND_XKL (backend);
+  Display              *display;
+  XkbRF_VarDefsRec      var_defs, query;
+  XkbDescPtr            xkb;
+  gchar                *rules_file = NULL;
+  gchar                *layout, *variant;
+  gboolean              success = FALSE;
+
+  display = xkl_engine_get_display (xkl->engine);
+
+  /* model and options stay as they are on the server */
+  memset (&var_defs, 0, sizeof (var_defs));
+  if (!XkbRF_GetNamesProp (display, &rules_file, &var_defs) || rules_file == NULL)
+    return FALSE;
+
+  layout = g_strjoinv (",", (gchar **) layouts);
+  variant = g_strjoinv (",", (gchar **) variants);
+
+  query = var_defs;
+  query.layout = layout;
+  query.variant = variant;
+
+  xkb = xkb_backend_xkl_get_keymap (xkl, display, rules_file, &query);
+  if (xkb != NULL && xkb_backend_xkl_upload_keymap (display, xkb))
+    {
+      XkbRF_SetNamesProp (display, rules_file, &query);
+      xkl->uploaded_group_count = MIN (g_strv_length ((gchar **) layouts), XkbNumKbdGroups);
+      success = TRUE;
+    }
+
+  g_free (layout);
+  g_free (variant);
+
+  free (rules_file);
+  free (var_defs.model);
+  free (var_defs.layout);
+  free (var_defs.variant);
+  free (var_defs.options);
+
+  return success;
+}
+
+
+
+static gchar *
+xkb_backend_xkl_description (XklConfigItem *config_item)
+{
+  gchar *ci_description;
+  gchar *description;
+
+  ci_description = g_strstrip (config_item->description);
+
+  if (ci_description[0] == 0)
+    description = g_strdup (config_item->name);
+  else
+    description = g_strdup (ci_description);
+
+  return description;
+}
+
+
+
+static gchar*
+xkb_backend_xkl_create_pretty_layout_name (XklConfigRegistry *registry,
+                                           XklConfigItem     *config_item,
+                                           const gchar       *layout_name,
+                                           const gchar       *layout_variant)
+{
+  gchar *pretty_layout_name;
+
+  g_snprintf (config_item->name, sizeof (config_item->name),
+              "%s", layout_variant);
+  if (xkl_config_registry_find_variant (registry, layout_name, config_item))
+    {
+      pretty_layout_name = xkb_backend_xkl_description (config_item);
+    }
+  else
+    {
+      g_snprintf (config_item->name, sizeof (config_item->name),
+                 "%s", layout_name);
+      if (xkl_config_registry_find_layout (registry, config_item))
+        pretty_layout_name = xkb_backend_xkl_description (config_item);
+      else
+        pretty_layout_name = xkb_util_get_layout_string (layout_name, layout_variant);
+    }
+
+  return pretty_layout_name;
+}
+
+
+
+static gchar *
+xkb_backend_xkl_obtain_language_name (XklConfigRegistry *registry,
+                                      XklConfigItem     *config_item,
+                                      const gchar       *layout_name)
+{
+  g_snprintf (config_item->name, sizeof (config_item->name),
+              "%s", layout_name);
+
+  if (xkl_config_registry_find_layout (registry, config_item))
+    return g_strdup (config_item->short_description);
+  else
+    return g_strdup (layout_name);
+}
+
+
+
+static void
+xkb_backend_xkl_describe_groups (XkbBackend          *backend,
+                                 const gchar * const *layouts,
+                                 const gchar * const *variants,
+                                 guint                mask,
+                                 gchar              **pretty_names,
+                                 gchar              **language_names)
+{
+  XkbBackendXkl     *xkl = XKB_BACKEND_XKL (backend);
+  XklConfigRegistry *registry;
+  XklConfigItem     *config_item;
+  gint               i;
+
+  registry = xkl_config_registry_get_instance (xkl->engine);
+  xkl_config_registry_load (registry, FALSE);
+  config_item = xkl_config_item_new ();
+
+  for (i = 0; layouts[i] != NULL; i++)
+    {
+      if ((mask & (1u << i)) == 0)
+        continue;
+
+      pretty_names[i] =
+        xkb_backend_xkl_create_pretty_layout_name (registry, config_item,
+                                                   layouts[i], variants[i]);
+      language_names[i] =
+        xkb_backend_xkl_obtain_language_name (registry, config_item, layouts[i]);
+    }
+
+  g_object_unref (config_item);
+  g_object_unref (registry);
+}
+
+
+
+static void
+xkb_backend_xkl_state_changed (XklEngine            *engine,
+                               XklEngineStateChange  change,
+                               gint                  group,
+                               gboolean              restore,
+                               XkbBackendXkl        *xkl)
+{
+  if (change == GROUP_CHANGED)
+    xkb_backend_emit_group_changed (XKB_BACKEND (xkl), group);
+}
+
+
+
+static void
+xkb_backend_xkl_config_changed (XklEngine     *engine,
+                                XkbBackendXkl *xkl)
+{
+  xkl->uploaded_group_count = 0;
+
+  xkb_backend_emit_config_changed (XKB_BACKEND (xkl));
+}
+
+
+
+static GdkFilterReturn
+xkb_backend_xkl_handle_xevent (GdkXEvent *xev,
+                               GdkEvent  *event,
+                               gpointer   user_data)
+{
+  XkbBackendXkl *xkl = user_data;
+  XEvent        *xevent = (XEvent *) xev;
+
+  /* zero when the event was one libxklavier is interested in */
+  if (xkl_engine_filter_events (xkl->engine, xevent) == 0)
+    {
+      xkb_audit_count (XKB_AUDIT_BACKEND_EVENT);
+      XKB_PROBE_X_EVENT_ACCEPTED (xevent->type);
+    }
+  else
+    XKB_PROBE_X_EVENT_REJECTED (xevent->type);
+
+  return GDK_FILTER_CONTINUE;
+}
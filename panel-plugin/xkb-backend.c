@@ -0,0 +1,415 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-backend.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xkb-backend.h"
+#include "xkb-audit.h"
+#include "xkb-probes.h"
+
+#include <libwnck/libwnck.h>
+
+typedef struct
+{
+  WnckScreen          *wnck_screen;
+
+  gulong               active_window_changed_handler_id;
+  gulong               application_closed_handler_id;
+  gulong               window_closed_handler_id;
+  gulong               workspace_changed_handler_id;
+} XkbBackendPrivate;
+
+enum
+{
+  GROUP_CHANGED,
+  CONFIG_CHANGED,
+  ACTIVE_WINDOW_CHANGED,
+  WINDOW_CLOSED,
+  APPLICATION_CLOSED,
+  WORKSPACE_CHANGED,
+  LAST_SIGNAL
+};
+
+static guint xkb_backend_signals[LAST_SIGNAL] = { 0, };
+
+static void              xkb_backend_finalize                  (GObject              *object);
+
+G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (XkbBackend, xkb_backend, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_backend_class_init (XkbBackendClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_backend_finalize;
+
+  xkb_backend_signals[GROUP_CHANGED] =
+    g_signal_new (g_intern_static_string ("group-changed"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__INT,
+                  G_TYPE_NONE, 1, G_TYPE_INT);
+
+  xkb_backend_signals[CONFIG_CHANGED] =
+    g_signal_new (g_intern_static_string ("config-changed"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE, 0);
+
+  xkb_backend_signals[ACTIVE_WINDOW_CHANGED] =
+    g_signal_new (g_intern_static_string ("active-window-changed"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  NULL,
+                  G_TYPE_NONE, 4, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING);
+
+  xkb_backend_signals[WINDOW_CLOSED] =
+    g_signal_new (g_intern_static_string ("window-closed"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__UINT,
+                  G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  xkb_backend_signals[APPLICATION_CLOSED] =
+    g_signal_new (g_intern_static_string ("application-closed"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__UINT,
+                  G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  xkb_backend_signals[WORKSPACE_CHANGED] =
+    g_signal_new (g_intern_static_string ("workspace-changed"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__INT,
+                  G_TYPE_NONE, 1, G_TYPE_INT);
+}
+
+
+
+static void
+xkb_backend_init (XkbBackend *backend)
+{
+  XkbBackendPrivate *priv = xkb_backend_get_instance_private (backend);
+
+  priv->wnck_screen = NULL;
+
+  priv->active_window_changed_handler_id = 0;
+  priv->application_closed_handler_id = 0;
+  priv->window_closed_handler_id = 0;
+  priv->workspace_changed_handler_id = 0;
+}
+
+
+
+static void
+xkb_backend_finalize (GObject *object)
+{
+  XkbBackendPrivate *priv = xkb_backend_get_instance_private (XKB_BACKEND (object));
+
+  if (priv->active_window_changed_handler_id > 0)
+    g_signal_handler_disconnect (priv->wnck_screen, priv->active_window_changed_handler_id);
+
+  if (priv->application_closed_handler_id > 0)
+    g_signal_handler_disconnect (priv->wnck_screen, priv->application_closed_handler_id);
+
+  if (priv->window_closed_handler_id > 0)
+    g_signal_handler_disconnect (priv->wnck_screen, priv->window_closed_handler_id);
+
+  if (priv->workspace_changed_handler_id > 0)
+    g_signal_handler_disconnect (priv->wnck_screen, priv->workspace_changed_handler_id);
+
+  G_OBJECT_CLASS (xkb_backend_parent_class)->finalize (object);
+}
+
+
+
+static void
+xkb_backend_active_window_changed (WnckScreen *screen,
+                                   WnckWindow *previously_active_window,
+                                   XkbBackend *backend)
+{
+  WnckWindow  *window;
+  const gchar *instance_name, *class_name;
+  gchar       *wm_class = NULL;
+
+  xkb_audit_count (XKB_AUDIT_WINDOW_EVENT);
+
+  window = wnck_screen_get_active_window (screen);
+
+  if (!WNCK_IS_WINDOW (window))
+    return;
+
+  /* the same form X resources use, e.g. "xterm.XTerm" */
+  instance_name = wnck_window_get_class_instance_name (window);
+  class_name = wnck_window_get_class_group_name (window);
+  if (instance_name != NULL || class_name != NULL)
+    wm_class = g_strconcat (instance_name != NULL ? instance_name : "", ".",
+                            class_name != NULL ? class_name : "", NULL);
+
+  xkb_backend_emit_active_window_changed (backend,
+                                          wnck_window_get_xid (window),
+                                          wnck_window_get_pid (window),
+                                          wm_class,
+                                          wnck_window_get_name (window));
+  g_free (wm_class);
+}
+
+
+
+static void
+xkb_backend_application_closed (WnckScreen      *screen,
+                                WnckApplication *application,
+                                XkbBackend      *backend)
+{
+  xkb_audit_count (XKB_AUDIT_WINDOW_EVENT);
+  xkb_backend_emit_application_closed (backend, wnck_application_get_pid (application));
+}
+
+
+
+static void
+xkb_backend_window_closed (WnckScreen *screen,
+                           WnckWindow *window,
+                           XkbBackend *backend)
+{
+  xkb_audit_count (XKB_AUDIT_WINDOW_EVENT);
+  xkb_backend_emit_window_closed (backend, wnck_window_get_xid (window));
+}
+
+
+
+static void
+xkb_backend_workspace_changed (WnckScreen    *screen,
+                               WnckWorkspace *previously_active_space,
+                               XkbBackend    *backend)
+{
+  WnckWorkspace *workspace;
+
+  xkb_audit_count (XKB_AUDIT_WINDOW_EVENT);
+
+  /* follows _NET_CURRENT_DESKTOP */
+  workspace = wnck_screen_get_active_workspace (screen);
+
+  if (workspace != NULL)
+    xkb_backend_emit_workspace_changed (backend, wnck_workspace_get_number (workspace));
+}
+
+
+
+/*
+ * Reports window activation and closing from the default wnck screen,
+ * shared by the backends which run on a real X server.
+ */
+void
+xkb_backend_track_windows (XkbBackend *backend)
+{
+  XkbBackendPrivate *priv;
+
+  g_return_if_fail (IS_XKB_BACKEND (backend));
+
+  priv = xkb_backend_get_instance_private (backend);
+
+  if (priv->wnck_screen != NULL)
+    return;
+
+  priv->wnck_screen = wnck_screen_get_default ();
+
+  priv->active_window_changed_handler_id =
+    g_signal_connect (G_OBJECT (priv->wnck_screen), "active-window-changed",
+                      G_CALLBACK (xkb_backend_active_window_changed), backend);
+  priv->application_closed_handler_id =
+    g_signal_connect (G_OBJECT (priv->wnck_screen), "application-closed",
+                      G_CALLBACK (xkb_backend_application_closed), backend);
+  priv->window_closed_handler_id =
+    g_signal_connect (G_OBJECT (priv->wnck_screen), "window-closed",
+                      G_CALLBACK (xkb_backend_window_closed), backend);
+  priv->workspace_changed_handler_id =
+    g_signal_connect (G_OBJECT (priv->wnck_screen), "active-workspace-changed",
+                      G_CALLBACK (xkb_backend_workspace_changed), backend);
+}
+
+
+
+gboolean
+xkb_backend_lock_group (XkbBackend *backend,
+                        gint        group)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND (backend), FALSE);
+
+  XKB_PROBE_GROUP_LOCK_REQUESTED (group);
+
+  return XKB_BACKEND_GET_CLASS (backend)->lock_group (backend, group);
+}
+
+
+
+gint
+xkb_backend_get_current_group (XkbBackend *backend)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND (backend), 0);
+
+  return XKB_BACKEND_GET_CLASS (backend)->get_current_group (backend);
+}
+
+
+
+gint
+xkb_backend_get_next_group (XkbBackend *backend)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND (backend), 0);
+
+  return XKB_BACKEND_GET_CLASS (backend)->get_next_group (backend);
+}
+
+
+
+gint
+xkb_backend_get_prev_group (XkbBackend *backend)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND (backend), 0);
+
+  return XKB_BACKEND_GET_CLASS (backend)->get_prev_group (backend);
+}
+
+
+
+guint
+xkb_backend_get_max_group_count (XkbBackend *backend)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND (backend), 0);
+
+  return XKB_BACKEND_GET_CLASS (backend)->get_max_group_count (backend);
+}
+
+
+
+void
+xkb_backend_get_config (XkbBackend   *backend,
+                        gchar      ***layouts,
+                        gchar      ***variants)
+{
+  g_return_if_fail (IS_XKB_BACKEND (backend));
+  g_return_if_fail (layouts != NULL && variants != NULL);
+
+  XKB_BACKEND_GET_CLASS (backend)->get_config (backend, layouts, variants);
+}
+
+
+
+gboolean
+xkb_backend_activate_config (XkbBackend          *backend,
+                             const gchar * const *layouts,
+                             const gchar * const *variants)
+{
+  g_return_val_if_fail (IS_XKB_BACKEND (backend), FALSE);
+  g_return_val_if_fail (layouts != NULL && variants != NULL, FALSE);
+
+  if (XKB_BACKEND_GET_CLASS (backend)->activate_config == NULL)
+    return FALSE;
+
+  return XKB_BACKEND_GET_CLASS (backend)->activate_config (backend, layouts, variants);
+}
+
+
+
+void
+xkb_backend_describe_groups (XkbBackend          *backend,
+                             const gchar * const *layouts,
+                             const gchar * const *variants,
+                             guint                mask,
+                             gchar              **pretty_names,
+                             gchar              **language_names)
+{
+  g_return_if_fail (IS_XKB_BACKEND (backend));
+
+  if (mask == 0)
+    return;
+
+  XKB_BACKEND_GET_CLASS (backend)->describe_groups (backend, layouts, variants, mask,
+                                                    pretty_names, language_names);
+}
+
+
+
+void
+xkb_backend_emit_group_changed (XkbBackend *backend,
+                                gint        group)
+{
+  g_signal_emit (G_OBJECT (backend), xkb_backend_signals[GROUP_CHANGED], 0, group);
+}
+
+
+
+void
+xkb_backend_emit_config_changed (XkbBackend *backend)
+{
+  g_signal_emit (G_OBJECT (backend), xkb_backend_signals[CONFIG_CHANGED], 0);
+}
+
+
+
+void
+xkb_backend_emit_active_window_changed (XkbBackend  *backend,
+                                        guint        window_id,
+                                        guint        application_id,
+                                        const gchar *wm_class,
+                                        const gchar *title)
+{
+  g_signal_emit (G_OBJECT (backend), xkb_backend_signals[ACTIVE_WINDOW_CHANGED], 0,
+                 window_id, application_id, wm_class, title);
+}
+
+
+
+void
+xkb_backend_emit_window_closed (XkbBackend *backend,
+                                guint       window_id)
+{
+  g_signal_emit (G_OBJECT (backend), xkb_backend_signals[WINDOW_CLOSED], 0, window_id);
+}
+
+
+
+void
+xkb_backend_emit_application_closed (XkbBackend *backend,
+                                     guint       application_id)
+{
+  g_signal_emit (G_OBJECT (backend), xkb_backend_signals[APPLICATION_CLOSED], 0, application_id);
+}
+
+
+
+void
+xkb_backend_emit_workspace_changed (XkbBackend *backend,
+                                    gint        workspace)
+{
+  g_signal_emit (G_OBJECT (backend), xkb_backend_signals[WORKSPACE_CHANGED], 0, workspace);
+}
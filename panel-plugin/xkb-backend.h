@@ -0,0 +1,125 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-backend.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_BACKEND_H_
+#define _XKB_BACKEND_H_
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _XkbBackendClass      XkbBackendClass;
+typedef struct _XkbBackend           XkbBackend;
+
+#define TYPE_XKB_BACKEND             (xkb_backend_get_type ())
+#define XKB_BACKEND(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_BACKEND, XkbBackend))
+#define XKB_BACKEND_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_BACKEND, XkbBackendClass))
+#define IS_XKB_BACKEND(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_XKB_BACKEND))
+#define IS_XKB_BACKEND_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass),  TYPE_XKB_BACKEND))
+#define XKB_BACKEND_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj),  TYPE_XKB_BACKEND, XkbBackendClass))
+
+/*
+ * Everything XkbKeyboard needs from the keyboard and window system.
+ * Implementations report changes with the signals below:
+ *
+ *   group-changed          (gint group)
+ *   config-changed         ()
+ *   active-window-changed  (guint window_id, guint application_id,
+ *                           const gchar *wm_class, const gchar *title)
+ *   window-closed          (guint window_id)
+ *   application-closed     (guint application_id)
+ *   workspace-changed      (gint workspace)
+ */
+struct _XkbBackendClass
+{
+  GObjectClass         __parent__;
+
+  gboolean           (*lock_group)              (XkbBackend          *backend,
+                                                 gint                 group);
+  gint               (*get_current_group)       (XkbBackend          *backend);
+  gint               (*get_next_group)          (XkbBackend          *backend);
+  gint               (*get_prev_group)          (XkbBackend          *backend);
+  guint              (*get_max_group_count)     (XkbBackend          *backend);
+
+  /* layouts and variants of the active configuration, both
+   * NULL-terminated and of the same length */
+  void               (*get_config)              (XkbBackend          *backend,
+                                                 gchar             ***layouts,
+                                                 gchar             ***variants);
+
+  /* switches the server to another layout configuration, optional */
+  gboolean           (*activate_config)         (XkbBackend          *backend,
+                                                 const gchar * const *layouts,
+                                                 const gchar * const *variants);
+
+  /* fills the pretty and language names of the groups set in the mask,
+   * looking up several groups at once keeps registry loads to one */
+  void               (*describe_groups)         (XkbBackend          *backend,
+                                                 const gchar * const *layouts,
+                                                 const gchar * const *variants,
+                                                 guint                mask,
+                                                 gchar              **pretty_names,
+                                                 gchar              **language_names);
+};
+
+struct _XkbBackend
+{
+  GObject              __parent__;
+};
+
+GType             xkb_backend_get_type                      (void)                           G_GNUC_CONST;
+
+gboolean          xkb_backend_lock_group                    (XkbBackend          *backend,
+                                                             gint                 group);
+gint              xkb_backend_get_current_group             (XkbBackend          *backend);
+gint              xkb_backend_get_next_group                (XkbBackend          *backend);
+gint              xkb_backend_get_prev_group                (XkbBackend          *backend);
+guint             xkb_backend_get_max_group_count           (XkbBackend          *backend);
+void              xkb_backend_get_config                    (XkbBackend          *backend,
+                                                             gchar             ***layouts,
+                                                             gchar             ***variants);
+gboolean          xkb_backend_activate_config               (XkbBackend          *backend,
+                                                             const gchar * const *layouts,
+                                                             const gchar * const *variants);
+void              xkb_backend_describe_groups               (XkbBackend          *backend,
+                                                             const gchar * const *layouts,
+                                                             const gchar * const *variants,
+                                                             guint                mask,
+                                                             gchar              **pretty_names,
+                                                             gchar              **language_names);
+
+/* for implementations */
+void              xkb_backend_track_windows                 (XkbBackend          *backend);
+void              xkb_backend_emit_group_changed            (XkbBackend          *backend,
+                                                             gint                 group);
+void              xkb_backend_emit_config_changed           (XkbBackend          *backend);
+void              xkb_backend_emit_active_window_changed    (XkbBackend          *backend,
+                                                             guint                window_id,
+                                                             guint                application_id,
+                                                             const gchar         *wm_class,
+                                                             const gchar         *title);
+void              xkb_backend_emit_window_closed            (XkbBackend          *backend,
+                                                             guint                window_id);
+void              xkb_backend_emit_application_closed       (XkbBackend          *backend,
+                                                             guint                application_id);
+void              xkb_backend_emit_workspace_changed        (XkbBackend          *backend,
+                                                             gint                 workspace);
+
+G_END_DECLS
+
+#endif
@@ -23,34 +23,547 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gmodule.h>
 #include <libxfce4util/libxfce4util.h>
 
 #include "xkb-cairo.h"
+#include "xkb-properties.h"
+#include "xkb-flag-format.h"
 #include "xkb-util.h"
 
 #define XKB_PREFERRED_FONT "Courier New, Courier 10 Pitch, Monospace Bold"
 
+/* found by configure when the librsvg development files are there */
+#ifndef LIBRSVG_SONAME
+#define LIBRSVG_SONAME     "librsvg-2.so.2"
+#endif
+
+struct _XkbCairoFlag
+{
+  gdouble              width;
+  gdouble              height;
+
+  /* compiled program from the flag bundle */
+  GBytes              *program;
+  GPtrArray           *images;
+
+  /* RsvgHandle for user supplied flags */
+  gpointer             svg_handle;
+};
+
+typedef struct
+{
+  gint                 width;
+  gint                 height;
+  gdouble              em;
+  gdouble              ex;
+} XkbRsvgDimensionData;
+
+/* librsvg is only needed for user supplied flags, so it is not linked
+ * into the plugin but opened the first time such a flag shows up */
+static struct
+{
+  gboolean             loaded;
+  GModule             *module;
+  gpointer           (*handle_new_from_file)  (const gchar          *filename,
+                                               GError              **error);
+  void               (*handle_get_dimensions) (gpointer              handle,
+                                               XkbRsvgDimensionData *dimension_data);
+  gboolean           (*handle_render_cairo)   (gpointer              handle,
+                                               cairo_t              *cr);
+} xkb_cairo_rsvg = { FALSE, NULL, NULL, NULL, NULL };
+
+typedef struct
+{
+  const guint8        *data;
+  gsize                length;
+} XkbCairoPngReader;
+
+
+
+static gboolean
+xkb_cairo_rsvg_load (void)
+{
+  if (!xkb_cairo_rsvg.loaded)
+    {
+      xkb_cairo_rsvg.loaded = TRUE;
+      xkb_cairo_rsvg.module = g_module_open (LIBRSVG_SONAME,
+                                             G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+
+      if (xkb_cairo_rsvg.module == NULL)
+        {
+          g_warning ("Unable to load %s, SVG flags are not available: %s",
+                     LIBRSVG_SONAME, g_module_error ());
+          return FALSE;
+        }
+
+      if (!g_module_symbol (xkb_cairo_rsvg.module, "rsvg_handle_new_from_file",
+                            (gpointer *) &xkb_cairo_rsvg.handle_new_from_file) ||
+          !g_module_symbol (xkb_cairo_rsvg.module, "rsvg_handle_get_dimensions",
+                            (gpointer *) &xkb_cairo_rsvg.handle_get_dimensions) ||
+          !g_module_symbol (xkb_cairo_rsvg.module, "rsvg_handle_render_cairo",
+                            (gpointer *) &xkb_cairo_rsvg.handle_render_cairo))
+        {
+          g_warning ("Unable to resolve librsvg symbols: %s", g_module_error ());
+          g_module_close (xkb_cairo_rsvg.module);
+          xkb_cairo_rsvg.module = NULL;
+          return FALSE;
+        }
+
+      /* librsvg registers GTypes, it must never be unloaded again */
+      g_module_make_resident (xkb_cairo_rsvg.module);
+    }
+
+  return xkb_cairo_rsvg.module != NULL;
+}
+
+
+
+static cairo_status_t
+xkb_cairo_png_read (gpointer       closure,
+                    unsigned char *data,
+                    unsigned int   length)
+{
+  XkbCairoPngReader *reader = closure;
+
+  if (length > reader->length)
+    return CAIRO_STATUS_READ_ERROR;
+
+  memcpy (data, reader->data, length);
+  reader->data += length;
+  reader->length -= length;
+
+  return CAIRO_STATUS_SUCCESS;
+}
+
+
+
+static gboolean
+xkb_cairo_flag_read (const guint8 **p,
+                     const guint8  *end,
+                     gpointer       dest,
+                     gsize          size)
+{
+  if ((gsize) (end - *p) < size)
+    return FALSE;
+
+  memcpy (dest, *p, size);
+  *p += size;
+
+  return TRUE;
+}
+
+
+
+static gboolean
+xkb_cairo_flag_read_floats (const guint8 **p,
+                            const guint8  *end,
+                            gdouble       *values,
+                            guint          n_values)
+{
+  union { gfloat f; guint32 u; } conv;
+  guint i;
+
+  for (i = 0; i < n_values; i++)
+    {
+      if (!xkb_cairo_flag_read (p, end, &conv.u, 4))
+        return FALSE;
+
+      conv.u = GUINT32_FROM_LE (conv.u);
+      values[i] = conv.f;
+    }
+
+  return TRUE;
+}
+
+
+
+/*
+ * Walks the compiled program of the flag. Without a cairo context the
+ * program is only validated and its embedded images are decoded, which
+ * happens once when the flag is loaded. With a context the program is
+ * drawn in the flag's own coordinate space.
+ */
+static gboolean
+xkb_cairo_flag_interpret (XkbCairoFlag *flag,
+                          cairo_t      *cr)
+{
+  const guint8      *p, *end;
+  gsize              length;
+  guint8             op, rgba[4], fill_rule;
+  gdouble            args[6];
+  guint32            image_length;
+  guint              image_index = 0;
+  gint               depth = 0;
+  cairo_matrix_t     matrix;
+  cairo_surface_t   *image;
+  XkbCairoPngReader  reader;
+
+  p = g_bytes_get_data (flag->program, &length);
+  end = p + length;
+
+  /* skip the flag size */
+  p += 8;
+
+  while (xkb_cairo_flag_read (&p, end, &op, 1))
+    {
+      switch (op)
+        {
+        case XKB_FLAG_OP_END:
+          while (cr != NULL && depth-- > 0)
+            cairo_restore (cr);
+          return TRUE;
+
+        case XKB_FLAG_OP_MOVE_TO:
+        case XKB_FLAG_OP_LINE_TO:
+          if (!xkb_cairo_flag_read_floats (&p, end, args, 2))
+            return FALSE;
+
+          if (cr != NULL && op == XKB_FLAG_OP_MOVE_TO)
+            cairo_move_to (cr, args[0], args[1]);
+          else if (cr != NULL)
+            cairo_line_to (cr, args[0], args[1]);
+          break;
+
+        case XKB_FLAG_OP_CURVE_TO:
+          if (!xkb_cairo_flag_read_floats (&p, end, args, 6))
+            return FALSE;
+
+          if (cr != NULL)
+            cairo_curve_to (cr, args[0], args[1], args[2], args[3], args[4], args[5]);
+          break;
+
+        case XKB_FLAG_OP_CLOSE_PATH:
+          if (cr != NULL)
+            cairo_close_path (cr);
+          break;
+
+        case XKB_FLAG_OP_SET_RGBA:
+          if (!xkb_cairo_flag_read (&p, end, rgba, 4))
+            return FALSE;
+
+          if (cr != NULL)
+            cairo_set_source_rgba (cr, rgba[0] / 255.0, rgba[1] / 255.0,
+                                   rgba[2] / 255.0, rgba[3] / 255.0);
+          break;
+
+        case XKB_FLAG_OP_FILL:
+          if (!xkb_cairo_flag_read (&p, end, &fill_rule, 1))
+            return FALSE;
+
+          if (cr != NULL)
+            {
+              cairo_set_fill_rule (cr, fill_rule == CAIRO_FILL_RULE_EVEN_ODD
+                                       ? CAIRO_FILL_RULE_EVEN_ODD : CAIRO_FILL_RULE_WINDING);
+              cairo_fill (cr);
+            }
+          break;
+
+        case XKB_FLAG_OP_SAVE:
+          depth++;
+          if (cr != NULL)
+            cairo_save (cr);
+          break;
+
+        case XKB_FLAG_OP_RESTORE:
+          if (depth-- == 0)
+            return FALSE;
+
+          if (cr != NULL)
+            cairo_restore (cr);
+          break;
+
+        case XKB_FLAG_OP_TRANSFORM:
+          if (!xkb_cairo_flag_read_floats (&p, end, args, 6))
+            return FALSE;
+
+          if (cr != NULL)
+            {
+              cairo_matrix_init (&matrix, args[0], args[1], args[2], args[3], args[4], args[5]);
+              cairo_transform (cr, &matrix);
+            }
+          break;
+
+        case XKB_FLAG_OP_IMAGE:
+          if (!xkb_cairo_flag_read_floats (&p, end, args, 4) ||
+              !xkb_cairo_flag_read (&p, end, &image_length, 4))
+            return FALSE;
+
+          image_length = GUINT32_FROM_LE (image_length);
+          if ((gsize) (end - p) < image_length)
+            return FALSE;
+
+          if (cr == NULL)
+            {
+              reader.data = p;
+              reader.length = image_length;
+              image = cairo_image_surface_create_from_png_stream (xkb_cairo_png_read, &reader);
+              if (cairo_surface_status (image) != CAIRO_STATUS_SUCCESS)
+                {
+                  cairo_surface_destroy (image);
+                  return FALSE;
+                }
+              g_ptr_array_add (flag->images, image);
+            }
+          else
+            {
+              image = g_ptr_array_index (flag->images, image_index);
+
+              cairo_save (cr);
+              cairo_translate (cr, args[0], args[1]);
+              cairo_scale (cr,
+                           args[2] / cairo_image_surface_get_width (image),
+                           args[3] / cairo_image_surface_get_height (image));
+              cairo_set_source_surface (cr, image, 0, 0);
+              cairo_pattern_set_filter (cairo_get_source (cr), CAIRO_FILTER_GOOD);
+              cairo_paint (cr);
+              cairo_restore (cr);
+            }
+
+          image_index++;
+          p += image_length;
+          break;
+
+        default:
+          return FALSE;
+        }
+    }
+
+  /* the program must be terminated by XKB_FLAG_OP_END */
+  return FALSE;
+}
+
+
+
+static gint
+xkb_cairo_flag_bundle_compare (gconstpointer key,
+                               gconstpointer entry)
+{
+  return strncmp (key, entry, XKB_FLAG_BUNDLE_NAME_LEN);
+}
+
+
+
+XkbCairoFlag *
+xkb_cairo_flag_new_from_bundle (GMappedFile *bundle,
+                                const gchar *name)
+{
+  XkbCairoFlag *flag;
+  const guint8 *data, *entry;
+  gsize         length;
+  guint32       version, n_entries, offset, program_length;
+  gdouble       size[2];
+  GBytes       *bytes;
+
+  g_return_val_if_fail (bundle != NULL, NULL);
+
+  if (name == NULL || strlen (name) >= XKB_FLAG_BUNDLE_NAME_LEN)
+    return NULL;
+
+  data = (const guint8 *) g_mapped_file_get_contents (bundle);
+  length = g_mapped_file_get_length (bundle);
+
+  if (length < XKB_FLAG_BUNDLE_HEADER_SIZE ||
+      memcmp (data, XKB_FLAG_BUNDLE_MAGIC, XKB_FLAG_BUNDLE_MAGIC_LEN) != 0)
+    return NULL;
+
+  memcpy (&version, data + XKB_FLAG_BUNDLE_MAGIC_LEN, 4);
+  memcpy (&n_entries, data + XKB_FLAG_BUNDLE_MAGIC_LEN + 4, 4);
+  version = GUINT32_FROM_LE (version);
+  n_entries = GUINT32_FROM_LE (n_entries);
+
+  if (version != XKB_FLAG_BUNDLE_VERSION ||
+      (length - XKB_FLAG_BUNDLE_HEADER_SIZE) / XKB_FLAG_BUNDLE_ENTRY_SIZE < n_entries)
+    return NULL;
+
+  entry = bsearch (name, data + XKB_FLAG_BUNDLE_HEADER_SIZE, n_entries,
+                   XKB_FLAG_BUNDLE_ENTRY_SIZE, xkb_cairo_flag_bundle_compare);
+  if (entry == NULL)
+    return NULL;
+
+  memcpy (&offset, entry + XKB_FLAG_BUNDLE_NAME_LEN, 4);
+  memcpy (&program_length, entry + XKB_FLAG_BUNDLE_NAME_LEN + 4, 4);
+  offset = GUINT32_FROM_LE (offset);
+  program_length = GUINT32_FROM_LE (program_length);
+
+  if (offset > length || length - offset < program_length || program_length < 8)
+    return NULL;
+
+  bytes = g_mapped_file_get_bytes (bundle);
+
+  flag = g_slice_new0 (XkbCairoFlag);
+  flag->program = g_bytes_new_from_bytes (bytes, offset, program_length);
+  flag->images = g_ptr_array_new_with_free_func ((GDestroyNotify) cairo_surface_destroy);
+
+  g_bytes_unref (bytes);
+
+  data = g_bytes_get_data (flag->program, NULL);
+  xkb_cairo_flag_read_floats (&data, data + 8, size, 2);
+  flag->width = size[0];
+  flag->height = size[1];
+
+  if (flag->width <= 0 || flag->height <= 0 || !xkb_cairo_flag_interpret (flag, NULL))
+    {
+      g_warning ("Invalid compiled flag '%s'", name);
+      xkb_cairo_flag_free (flag);
+      return NULL;
+    }
+
+  return flag;
+}
+
+
+
+XkbCairoFlag *
+xkb_cairo_flag_new_from_svg (const gchar *filename)
+{
+  XkbCairoFlag         *flag;
+  gpointer              handle;
+  XkbRsvgDimensionData  dimension_data;
+
+  if (filename == NULL || !g_file_test (filename, G_FILE_TEST_EXISTS))
+    return NULL;
+
+  if (!xkb_cairo_rsvg_load ())
+    return NULL;
+
+  handle = xkb_cairo_rsvg.handle_new_from_file (filename, NULL);
+  if (handle == NULL)
+    return NULL;
+
+  xkb_cairo_rsvg.handle_get_dimensions (handle, &dimension_data);
+  if (dimension_data.width <= 0 || dimension_data.height <= 0)
+    {
+      g_object_unref (handle);
+      return NULL;
+    }
+
+  flag = g_slice_new0 (XkbCairoFlag);
+  flag->width = dimension_data.width;
+  flag->height = dimension_data.height;
+  flag->svg_handle = handle;
+
+  return flag;
+}
+
 
 
 void
-xkb_cairo_draw_flag (cairo_t         *cr,
-                     const GdkPixbuf *image,
-                     gint             actual_width,
-                     gint             actual_height,
-                     gint             variant_markers_count,
-                     guint            max_variant_markers_count,
-                     guint            scale)
+xkb_cairo_flag_free (XkbCairoFlag *flag)
+{
+  if (flag == NULL)
+    return;
+
+  if (flag->program != NULL)
+    g_bytes_unref (flag->program);
+
+  if (flag->images != NULL)
+    g_ptr_array_unref (flag->images);
+
+  if (flag->svg_handle != NULL)
+    g_object_unref (flag->svg_handle);
+
+  g_slice_free (XkbCairoFlag, flag);
+}
+
+
+
+gdouble
+xkb_cairo_flag_get_width (const XkbCairoFlag *flag)
+{
+  g_return_val_if_fail (flag != NULL, 0);
+  return flag->width;
+}
+
+
+
+gdouble
+xkb_cairo_flag_get_height (const XkbCairoFlag *flag)
+{
+  g_return_val_if_fail (flag != NULL, 0);
+  return flag->height;
+}
+
+
+
+void
+xkb_cairo_flag_render (cairo_t            *cr,
+                       const XkbCairoFlag *flag)
+{
+  g_return_if_fail (flag != NULL);
+
+  cairo_save (cr);
+  cairo_new_path (cr);
+
+  if (flag->svg_handle != NULL)
+    xkb_cairo_rsvg.handle_render_cairo (flag->svg_handle, cr);
+  else
+    xkb_cairo_flag_interpret ((XkbCairoFlag *) flag, cr);
+
+  cairo_restore (cr);
+}
+
+
+
+/*
+ * Renders the flag into an image surface of width x height logical pixels,
+ * backed by scale_factor times as many device pixels.
+ */
+cairo_surface_t *
+xkb_cairo_flag_render_surface (const XkbCairoFlag *flag,
+                               gint                width,
+                               gint                height,
+                               gint                scale_factor)
+{
+  cairo_surface_t *surface;
+  cairo_t         *cr;
+
+  g_return_val_if_fail (flag != NULL, NULL);
+
+  scale_factor = MAX (scale_factor, 1);
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        width * scale_factor,
+                                        height * scale_factor);
+  cairo_surface_set_device_scale (surface, scale_factor, scale_factor);
+
+  cr = cairo_create (surface);
+  cairo_scale (cr, width / flag->width, height / flag->height);
+  xkb_cairo_flag_render (cr, flag);
+  cairo_destroy (cr);
+
+  return surface;
+}
+
+
+
+void
+xkb_cairo_draw_flag (cairo_t            *cr,
+                     const XkbCairoFlag *flag,
+                     gint                actual_width,
+                     gint                actual_height,
+                     gint                variant_markers_count,
+                     guint               max_variant_markers_count,
+                     guint               scale)
 {
   double scalex, scaley;
-  gint   i, x, y, width, height;
+  gint   i, x, y;
+  double width, height;
   double layoutx, layouty, img_width, img_height;
   double radius, diameter;
   guint  spacing;
 
-  g_assert (image != NULL);
+  g_assert (flag != NULL);
 
-  width = gdk_pixbuf_get_width (image);
-  height = gdk_pixbuf_get_height (image);
+  width = flag->width;
+  height = flag->height;
 
   scalex = (double) (actual_width - 4) / width;
   scaley = (double) (actual_height - 4) / height;
@@ -61,7 +574,7 @@ xkb_cairo_draw_flag (cairo_t         *cr,
   img_width  = width * scalex;
   img_height = height * scaley;
 
-  DBG ("scale x/y: %.3f/%.3f, dim w/h: %d/%d, scaled w/h: %.1f/%.1f",
+  DBG ("scale x/y: %.3f/%.3f, dim w/h: %.1f/%.1f, scaled w/h: %.1f/%.1f",
        scalex, scaley, width, height, scalex * width, scaley * height);
 
   layoutx = (actual_width - img_width) / 2;
@@ -71,8 +584,7 @@ xkb_cairo_draw_flag (cairo_t         *cr,
   cairo_save (cr);
 
   cairo_scale (cr, scalex, scaley);
-  gdk_cairo_set_source_pixbuf (cr, image, 0, 0);
-  cairo_paint (cr);
+  xkb_cairo_flag_render (cr, flag);
 
   cairo_restore (cr);
 
@@ -225,13 +737,30 @@ xkb_cairo_draw_label (cairo_t     *cr,
 
 
 
+static void
+xkb_cairo_draw_vertical_bar (cairo_t *cr,
+                             double   x,
+                             double   y,
+                             double   height,
+                             double   radius)
+{
+  cairo_arc (cr, x, y + radius, radius, 0, 2 * G_PI);
+  cairo_fill (cr);
+  cairo_arc (cr, x, y + height - radius, radius, 0, 2 * G_PI);
+  cairo_fill (cr);
+  cairo_rectangle (cr, x - radius, y + radius, 2 * radius, height - 2 * radius);
+  cairo_fill (cr);
+}
+
+
+
 void
 xkb_cairo_draw_label_system (cairo_t                    *cr,
                              const gchar                *group_name,
                              gint                        actual_width,
                              gint                        actual_height,
                              gint                        variant_markers_count,
-                             gboolean                    caps_lock_enabled,
+                             guint                       indicators,
                              const PangoFontDescription *desc,
                              GdkRGBA                     rgba)
 {
@@ -280,12 +809,15 @@ xkb_cairo_draw_label_system (cairo_t                    *cr,
       cairo_fill (cr);
     }
 
-  if (caps_lock_enabled)
+  cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_width (cr, 1);
+
+  /* caps lock is a bar above the label, num and scroll lock are bars
+   * to the left and to the right of it */
+  if (indicators & INDICATOR_CAPS_LOCK)
     {
       y = layouty - radius;
 
-      cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
-      cairo_set_line_width (cr, 1);
       cairo_arc (cr, layoutx + radius, y, radius, 0, 2 * G_PI);
       cairo_fill (cr);
       cairo_arc (cr, layoutx + pango_width - radius, y, radius, 0, 2 * G_PI);
@@ -294,6 +826,12 @@ xkb_cairo_draw_label_system (cairo_t                    *cr,
       cairo_fill (cr);
     }
 
+  if (indicators & INDICATOR_NUM_LOCK)
+    xkb_cairo_draw_vertical_bar (cr, layoutx - diameter, layouty, pango_height, radius);
+
+  if (indicators & INDICATOR_SCROLL_LOCK)
+    xkb_cairo_draw_vertical_bar (cr, layoutx + pango_width + diameter, layouty, pango_height, radius);
+
   g_free (normalized_group_name);
   g_object_unref (layout);
 }
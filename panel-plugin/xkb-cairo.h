@@ -30,8 +30,26 @@
 #include <cairo/cairo.h>
 #include <pango/pangocairo.h>
 
+typedef struct _XkbCairoFlag XkbCairoFlag;
+
+XkbCairoFlag *xkb_cairo_flag_new_from_bundle  (GMappedFile                    *bundle,
+                                               const gchar                    *name);
+XkbCairoFlag *xkb_cairo_flag_new_from_svg     (const gchar                    *filename);
+void          xkb_cairo_flag_free             (XkbCairoFlag                   *flag);
+
+gdouble       xkb_cairo_flag_get_width        (const XkbCairoFlag             *flag);
+gdouble       xkb_cairo_flag_get_height       (const XkbCairoFlag             *flag);
+
+void          xkb_cairo_flag_render           (cairo_t                        *cr,
+                                               const XkbCairoFlag             *flag);
+cairo_surface_t *
+              xkb_cairo_flag_render_surface   (const XkbCairoFlag             *flag,
+                                               gint                            width,
+                                               gint                            height,
+                                               gint                            scale_factor);
+
 void        xkb_cairo_draw_flag             (cairo_t                        *cr,
-                                             const GdkPixbuf                *image,
+                                             const XkbCairoFlag             *flag,
                                              gint                            actual_width,
                                              gint                            actual_height,
                                              gint                            variant_markers_count,
@@ -51,7 +69,7 @@ void        xkb_cairo_draw_label_system     (cairo_t                        *cr,
                                              gint                            actual_width,
                                              gint                            actual_height,
                                              gint                            variant_markers_count,
-                                             gboolean                        caps_lock_enabled,
+                                             guint                           indicators,
                                              const PangoFontDescription     *desc,
                                              GdkRGBA                         rgba);
 
@@ -0,0 +1,298 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-class-store.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xkb-class-store.h"
+#include "xkb-util.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * The store is a fixed size open addressing table which is used in place
+ * through a shared mapping, so loading it is a single mmap () and the
+ * kernel writes the dirty pages back in batches. Entries only hold a
+ * 64 bit hash of the window class, an entry which does not fit into its
+ * probe window replaces the least recently changed one there.
+ *
+ * The layout is kept as "layout(variant)" rather than as a group index,
+ * so it stays right when the layouts are reordered or another layout
+ * set is active.
+ */
+
+#define XKB_CLASS_STORE_FILENAME    "xfce4/xkb/window-class-groups"
+#define XKB_CLASS_STORE_MAGIC       0x53434b58 /* "XKCS" */
+#define XKB_CLASS_STORE_VERSION     2
+#define XKB_CLASS_STORE_SLOTS       1024
+#define XKB_CLASS_STORE_PROBES      8
+#define XKB_CLASS_STORE_LAYOUT_SIZE 52
+
+typedef struct
+{
+  guint64              hash;
+  guint32              stamp;
+  gchar                layout[XKB_CLASS_STORE_LAYOUT_SIZE];
+} XkbClassStoreEntry;
+
+typedef struct
+{
+  guint32              magic;
+  guint32              version;
+  guint32              slots;
+  guint32              clock;
+  XkbClassStoreEntry   entries[XKB_CLASS_STORE_SLOTS];
+} XkbClassStoreData;
+
+struct _XkbClassStoreClass
+{
+  GObjectClass         __parent__;
+};
+
+struct _XkbClassStore
+{
+  GObject              __parent__;
+
+  XkbClassStoreData   *data;
+};
+
+static void              xkb_class_store_finalize              (GObject              *object);
+
+G_DEFINE_TYPE (XkbClassStore, xkb_class_store, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_class_store_class_init (XkbClassStoreClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_class_store_finalize;
+}
+
+
+
+static void
+xkb_class_store_init (XkbClassStore *store)
+{
+  store->data = NULL;
+}
+
+
+
+static XkbClassStoreData *
+xkb_class_store_map (const gchar *path)
+{
+  XkbClassStoreData *data;
+  gpointer           map;
+  struct stat        st;
+  gchar             *dirname;
+  gint               fd;
+
+  dirname = g_path_get_dirname (path);
+  g_mkdir_with_parents (dirname, 0700);
+  g_free (dirname);
+
+  fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &st) < 0 ||
+      (st.st_size != sizeof (XkbClassStoreData) &&
+       ftruncate (fd, sizeof (XkbClassStoreData)) < 0))
+    {
+      close (fd);
+      return NULL;
+    }
+
+  map = mmap (NULL, sizeof (XkbClassStoreData), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  data = map;
+
+  /* a new, truncated or foreign file starts out empty */
+  if (data->magic != XKB_CLASS_STORE_MAGIC ||
+      data->version != XKB_CLASS_STORE_VERSION ||
+      data->slots != XKB_CLASS_STORE_SLOTS)
+    {
+      memset (data, 0, sizeof (XkbClassStoreData));
+      data->magic = XKB_CLASS_STORE_MAGIC;
+      data->version = XKB_CLASS_STORE_VERSION;
+      data->slots = XKB_CLASS_STORE_SLOTS;
+    }
+
+  return data;
+}
+
+
+
+XkbClassStore *
+xkb_class_store_new (void)
+{
+  XkbClassStore *store;
+  gchar         *path;
+
+  store = g_object_new (TYPE_XKB_CLASS_STORE, NULL);
+
+  path = xkb_util_get_user_state_filename (XKB_CLASS_STORE_FILENAME);
+  store->data = xkb_class_store_map (path);
+
+  if (store->data == NULL)
+    g_warning ("Unable to open the window class store %s", path);
+
+  g_free (path);
+
+  return store;
+}
+
+
+
+static void
+xkb_class_store_finalize (GObject *object)
+{
+  XkbClassStore *store = XKB_CLASS_STORE (object);
+
+  if (store->data != NULL)
+    {
+      msync (store->data, sizeof (XkbClassStoreData), MS_ASYNC);
+      munmap (store->data, sizeof (XkbClassStoreData));
+    }
+
+  G_OBJECT_CLASS (xkb_class_store_parent_class)->finalize (object);
+}
+
+
+
+static guint64
+xkb_class_store_hash (const gchar *wm_class)
+{
+  guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+  /* FNV-1a, zero marks an empty slot */
+  for (; *wm_class != '\0'; wm_class++)
+    {
+      hash ^= (guchar) *wm_class;
+      hash *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+
+  return hash != 0 ? hash : 1;
+}
+
+
+
+gboolean
+xkb_class_store_lookup (XkbClassStore  *store,
+                        const gchar    *wm_class,
+                        gchar         **layout,
+                        gchar         **variant)
+{
+  XkbClassStoreEntry *entry;
+  guint64             hash;
+  guint               i;
+  gchar               name[XKB_CLASS_STORE_LAYOUT_SIZE];
+  gchar              *paren;
+
+  g_return_val_if_fail (IS_XKB_CLASS_STORE (store), FALSE);
+  g_return_val_if_fail (wm_class != NULL && layout != NULL && variant != NULL, FALSE);
+
+  if (G_UNLIKELY (store->data == NULL))
+    return FALSE;
+
+  hash = xkb_class_store_hash (wm_class);
+
+  for (i = 0; i < XKB_CLASS_STORE_PROBES; i++)
+    {
+      entry = &store->data->entries[(hash + i) % XKB_CLASS_STORE_SLOTS];
+
+      if (entry->hash == hash)
+        {
+          /* the file may have been written by anything */
+          memcpy (name, entry->layout, sizeof (name));
+          name[sizeof (name) - 1] = '\0';
+
+          paren = strchr (name, '(');
+          if (name[0] == '\0' || paren == NULL || !g_str_has_suffix (paren, ")"))
+            return FALSE;
+
+          *layout = g_strndup (name, paren - name);
+          *variant = g_strndup (paren + 1, strlen (paren) - 2);
+
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+
+
+void
+xkb_class_store_set (XkbClassStore *store,
+                     const gchar   *wm_class,
+                     const gchar   *layout,
+                     const gchar   *variant)
+{
+  XkbClassStoreEntry *entry, *victim = NULL;
+  guint64             hash;
+  guint               i;
+  gchar               name[XKB_CLASS_STORE_LAYOUT_SIZE];
+
+  g_return_if_fail (IS_XKB_CLASS_STORE (store));
+  g_return_if_fail (wm_class != NULL && layout != NULL);
+
+  if (G_UNLIKELY (store->data == NULL))
+    return;
+
+  /* layouts which do not fit are not remembered rather than cut */
+  memset (name, 0, sizeof (name));
+  if (g_snprintf (name, sizeof (name), "%s(%s)", layout,
+                  variant != NULL ? variant : "") >= (gint) sizeof (name))
+    return;
+
+  hash = xkb_class_store_hash (wm_class);
+
+  for (i = 0; i < XKB_CLASS_STORE_PROBES; i++)
+    {
+      entry = &store->data->entries[(hash + i) % XKB_CLASS_STORE_SLOTS];
+
+      if (entry->hash == hash)
+        {
+          /* do not dirty the page when nothing changes */
+          if (memcmp (entry->layout, name, sizeof (name)) == 0)
+            return;
+
+          victim = entry;
+          break;
+        }
+
+      if (victim == NULL || victim->hash != 0)
+        {
+          if (entry->hash == 0 || victim == NULL || entry->stamp < victim->stamp)
+            victim = entry;
+        }
+    }
+
+  victim->hash = hash;
+  memcpy (victim->layout, name, sizeof (name));
+  victim->stamp = ++store->data->clock;
+}
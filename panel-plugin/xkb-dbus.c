@@ -0,0 +1,362 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-dbus.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xkb-dbus.h"
+#include "xkb-audit.h"
+
+#include <gio/gio.h>
+
+#define XKB_DBUS_NAME            "org.xfce.XkbPlugin"
+#define XKB_DBUS_PATH            "/org/xfce/XkbPlugin"
+#define XKB_DBUS_INTERFACE       "org.xfce.XkbPlugin.Keyboard"
+
+static const gchar xkb_dbus_introspection_xml[] =
+  "<node>"
+  "  <interface name='" XKB_DBUS_INTERFACE "'>"
+  "    <method name='SetGroup'>"
+  "      <arg type='i' name='group' direction='in'/>"
+  "      <arg type='b' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='NextGroup'>"
+  "      <arg type='b' name='success' direction='out'/>"
+  "    </method>"
+  "    <method name='PrevGroup'>"
+  "      <arg type='b' name='success' direction='out'/>"
+  "    </method>"
+  "    <signal name='GroupChanged'>"
+  "      <arg type='i' name='group'/>"
+  "      <arg type='s' name='layout'/>"
+  "      <arg type='s' name='variant'/>"
+  "    </signal>"
+  "    <property type='i' name='CurrentGroup' access='read'/>"
+  "    <property type='a(sss)' name='Groups' access='read'/>"
+  "  </interface>"
+  "</node>";
+
+struct _XkbDBusClass
+{
+  GObjectClass         __parent__;
+};
+
+struct _XkbDBus
+{
+  GObject              __parent__;
+
+  XkbKeyboard         *keyboard;
+
+  GDBusNodeInfo       *introspection_data;
+  GDBusConnection     *connection;
+  guint                owner_id;
+  guint                registration_id;
+
+  gint                 last_group;
+
+  gulong               state_changed_handler_id;
+};
+
+static void              xkb_dbus_state_changed                (XkbDBus              *dbus,
+                                                                gboolean              config_changed);
+static void              xkb_dbus_finalize                     (GObject              *object);
+
+G_DEFINE_TYPE (XkbDBus, xkb_dbus, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_dbus_class_init (XkbDBusClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_dbus_finalize;
+}
+
+
+
+static void
+xkb_dbus_init (XkbDBus *dbus)
+{
+  dbus->keyboard = NULL;
+
+  dbus->introspection_data = NULL;
+  dbus->connection = NULL;
+  dbus->owner_id = 0;
+  dbus->registration_id = 0;
+
+  dbus->last_group = -1;
+
+  dbus->state_changed_handler_id = 0;
+}
+
+
+
+static GVariant *
+xkb_dbus_get_groups (XkbDBus *dbus)
+{
+  GVariantBuilder builder;
+  const gchar    *layout, *variant;
+  gchar          *pretty_name;
+  gint            group, group_count;
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(sss)"));
+
+  group_count = xkb_keyboard_get_group_count (dbus->keyboard);
+  for (group = 0; group < group_count; group++)
+    {
+      layout = xkb_keyboard_get_group_name (dbus->keyboard, DISPLAY_NAME_COUNTRY, group);
+      variant = xkb_keyboard_get_variant (dbus->keyboard, group);
+      pretty_name = xkb_keyboard_get_pretty_layout_name (dbus->keyboard, group);
+
+      g_variant_builder_add (&builder, "(sss)",
+                             layout != NULL ? layout : "",
+                             variant != NULL ? variant : "",
+                             pretty_name != NULL ? pretty_name : "");
+    }
+
+  return g_variant_builder_end (&builder);
+}
+
+
+
+static void
+xkb_dbus_handle_method_call (GDBusConnection       *connection,
+                             const gchar           *sender,
+                             const gchar           *object_path,
+                             const gchar           *interface_name,
+                             const gchar           *method_name,
+                             GVariant              *parameters,
+                             GDBusMethodInvocation *invocation,
+                             gpointer               user_data)
+{
+  XkbDBus  *dbus = user_data;
+  gboolean  success;
+  gint      group;
+
+  xkb_audit_count (XKB_AUDIT_DBUS_CALL);
+
+  if (g_strcmp0 (method_name, "SetGroup") == 0)
+    {
+      g_variant_get (parameters, "(i)", &group);
+      success = xkb_keyboard_set_group (dbus->keyboard, group);
+    }
+  else if (g_strcmp0 (method_name, "NextGroup") == 0)
+    {
+      success = xkb_keyboard_next_group (dbus->keyboard);
+    }
+  else if (g_strcmp0 (method_name, "PrevGroup") == 0)
+    {
+      success = xkb_keyboard_prev_group (dbus->keyboard);
+    }
+  else
+    {
+      g_dbus_method_invocation_return_error (invocation, G_DBUS_ERROR,
+                                             G_DBUS_ERROR_UNKNOWN_METHOD,
+                                             "Unknown method %s", method_name);
+      return;
+    }
+
+  g_dbus_method_invocation_return_value (invocation, g_variant_new ("(b)", success));
+}
+
+
+
+static GVariant *
+xkb_dbus_handle_get_property (GDBusConnection *connection,
+                              const gchar     *sender,
+                              const gchar     *object_path,
+                              const gchar     *interface_name,
+                              const gchar     *property_name,
+                              GError         **error,
+                              gpointer         user_data)
+{
+  XkbDBus *dbus = user_data;
+
+  if (g_strcmp0 (property_name, "CurrentGroup") == 0)
+    return g_variant_new_int32 (xkb_keyboard_get_current_group (dbus->keyboard));
+  else if (g_strcmp0 (property_name, "Groups") == 0)
+    return xkb_dbus_get_groups (dbus);
+
+  g_set_error (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+               "Unknown property %s", property_name);
+
+  return NULL;
+}
+
+
+
+static const GDBusInterfaceVTable xkb_dbus_interface_vtable =
+{
+  xkb_dbus_handle_method_call,
+  xkb_dbus_handle_get_property,
+  NULL
+};
+
+
+
+static void
+xkb_dbus_bus_acquired (GDBusConnection *connection,
+                       const gchar     *name,
+                       gpointer         user_data)
+{
+  XkbDBus *dbus = user_data;
+  GError  *error = NULL;
+
+  dbus->connection = g_object_ref (connection);
+  dbus->registration_id =
+    g_dbus_connection_register_object (connection, XKB_DBUS_PATH,
+                                       dbus->introspection_data->interfaces[0],
+                                       &xkb_dbus_interface_vtable,
+                                       dbus, NULL, &error);
+
+  if (dbus->registration_id == 0)
+    {
+      g_warning ("Unable to export keyboard object: %s", error->message);
+      g_error_free (error);
+    }
+}
+
+
+
+static void
+xkb_dbus_name_lost (GDBusConnection *connection,
+                    const gchar     *name,
+                    gpointer         user_data)
+{
+  if (connection == NULL)
+    g_warning ("Unable to connect to the session bus");
+  else
+    g_warning ("Unable to own the name %s on the session bus", name);
+}
+
+
+
+XkbDBus *
+xkb_dbus_new (XkbKeyboard *keyboard)
+{
+  XkbDBus *dbus;
+
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), NULL);
+
+  dbus = g_object_new (TYPE_XKB_DBUS, NULL);
+
+  dbus->keyboard = g_object_ref (keyboard);
+  dbus->last_group = xkb_keyboard_get_current_group (keyboard);
+  dbus->introspection_data = g_dbus_node_info_new_for_xml (xkb_dbus_introspection_xml, NULL);
+
+  dbus->state_changed_handler_id =
+    g_signal_connect_swapped (G_OBJECT (keyboard), "state-changed",
+                              G_CALLBACK (xkb_dbus_state_changed), dbus);
+
+  dbus->owner_id = g_bus_own_name (G_BUS_TYPE_SESSION, XKB_DBUS_NAME,
+                                   G_BUS_NAME_OWNER_FLAGS_NONE,
+                                   xkb_dbus_bus_acquired, NULL,
+                                   xkb_dbus_name_lost, dbus, NULL);
+
+  return dbus;
+}
+
+
+
+static void
+xkb_dbus_finalize (GObject *object)
+{
+  XkbDBus *dbus = XKB_DBUS (object);
+
+  if (dbus->state_changed_handler_id > 0)
+    g_signal_handler_disconnect (dbus->keyboard, dbus->state_changed_handler_id);
+
+  if (dbus->registration_id > 0)
+    g_dbus_connection_unregister_object (dbus->connection, dbus->registration_id);
+
+  if (dbus->owner_id > 0)
+    g_bus_unown_name (dbus->owner_id);
+
+  if (dbus->connection != NULL)
+    g_object_unref (dbus->connection);
+
+  g_dbus_node_info_unref (dbus->introspection_data);
+
+  g_object_unref (dbus->keyboard);
+
+  G_OBJECT_CLASS (xkb_dbus_parent_class)->finalize (object);
+}
+
+
+
+static void
+xkb_dbus_emit_group_changed (XkbDBus *dbus,
+                             gint     group)
+{
+  const gchar *layout, *variant;
+
+  layout = xkb_keyboard_get_group_name (dbus->keyboard, DISPLAY_NAME_COUNTRY, group);
+  variant = xkb_keyboard_get_variant (dbus->keyboard, group);
+
+  g_dbus_connection_emit_signal (dbus->connection, NULL,
+                                 XKB_DBUS_PATH, XKB_DBUS_INTERFACE, "GroupChanged",
+                                 g_variant_new ("(iss)", group,
+                                                layout != NULL ? layout : "",
+                                                variant != NULL ? variant : ""),
+                                 NULL);
+}
+
+
+
+static void
+xkb_dbus_state_changed (XkbDBus  *dbus,
+                        gboolean  config_changed)
+{
+  GVariantBuilder builder;
+  gint            group;
+
+  /* the object is exported as soon as the bus is acquired */
+  if (dbus->registration_id == 0)
+    return;
+
+  group = xkb_keyboard_get_current_group (dbus->keyboard);
+  if (group == dbus->last_group && !config_changed)
+    return;
+
+  dbus->last_group = group;
+
+  xkb_dbus_emit_group_changed (dbus, group);
+
+  g_variant_builder_init (&builder, G_VARIANT_TYPE_VARDICT);
+  g_variant_builder_add (&builder, "{sv}", "CurrentGroup", g_variant_new_int32 (group));
+  if (config_changed)
+    g_variant_builder_add (&builder, "{sv}", "Groups", xkb_dbus_get_groups (dbus));
+
+  g_dbus_connection_emit_signal (dbus->connection, NULL,
+                                 XKB_DBUS_PATH, "org.freedesktop.DBus.Properties",
+                                 "PropertiesChanged",
+                                 g_variant_new ("(sa{sv}as)", XKB_DBUS_INTERFACE, &builder, NULL),
+                                 NULL);
+}
+
+
+
+void
+xkb_dbus_announce (XkbDBus *dbus)
+{
+  g_return_if_fail (IS_XKB_DBUS (dbus));
+
+  if (dbus->registration_id == 0)
+    return;
+
+  xkb_dbus_emit_group_changed (dbus, xkb_keyboard_get_current_group (dbus->keyboard));
+}
@@ -0,0 +1,1101 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-flag-compiler.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Build-time tool which translates the SVG flags into the compact program
+ * format described in xkb-flag-format.h, so that the plugin does not need
+ * librsvg for the flags it ships. Only the SVG subset used by flag artwork
+ * is understood; files using anything else are skipped with a warning and
+ * are rendered from the SVG at run time instead.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "xkb-flag-format.h"
+
+#define CAIRO_FILL_RULE_WINDING     0
+#define CAIRO_FILL_RULE_EVEN_ODD    1
+
+/* magic number for approximating a quarter of a circle with a bezier curve */
+#define KAPPA                       0.5522847498
+
+typedef struct
+{
+  gboolean  none;
+  guint8    rgba[4];
+  guint8    fill_rule;
+  gboolean  transformed;
+} FlagStyle;
+
+typedef struct
+{
+  GByteArray *program;
+  GArray     *styles;
+  gint        skip_depth;
+  gint        depth;
+  gdouble     width;
+  gdouble     height;
+} FlagCompiler;
+
+typedef struct
+{
+  gchar      *name;
+  GByteArray *program;
+} FlagEntry;
+
+
+
+static void
+flag_emit_op (FlagCompiler *compiler,
+              XkbFlagOp     op)
+{
+  guint8 byte = op;
+
+  g_byte_array_append (compiler->program, &byte, 1);
+}
+
+
+
+static void
+flag_emit_u8 (FlagCompiler *compiler,
+              guint8        value)
+{
+  g_byte_array_append (compiler->program, &value, 1);
+}
+
+
+
+static void
+flag_emit_u32 (GByteArray *array,
+               guint32     value)
+{
+  value = GUINT32_TO_LE (value);
+  g_byte_array_append (array, (const guint8 *) &value, 4);
+}
+
+
+
+static void
+flag_emit_float (FlagCompiler *compiler,
+                 gdouble       value)
+{
+  union { gfloat f; guint32 u; } conv;
+
+  conv.f = value;
+  flag_emit_u32 (compiler->program, conv.u);
+}
+
+
+
+static void
+flag_emit_point (FlagCompiler *compiler,
+                 XkbFlagOp     op,
+                 gdouble       x,
+                 gdouble       y)
+{
+  flag_emit_op (compiler, op);
+  flag_emit_float (compiler, x);
+  flag_emit_float (compiler, y);
+}
+
+
+
+static void
+flag_emit_curve (FlagCompiler *compiler,
+                 gdouble       x1,
+                 gdouble       y1,
+                 gdouble       x2,
+                 gdouble       y2,
+                 gdouble       x3,
+                 gdouble       y3)
+{
+  flag_emit_op (compiler, XKB_FLAG_OP_CURVE_TO);
+  flag_emit_float (compiler, x1);
+  flag_emit_float (compiler, y1);
+  flag_emit_float (compiler, x2);
+  flag_emit_float (compiler, y2);
+  flag_emit_float (compiler, x3);
+  flag_emit_float (compiler, y3);
+}
+
+
+
+static FlagStyle *
+flag_current_style (FlagCompiler *compiler)
+{
+  return &g_array_index (compiler->styles, FlagStyle, compiler->styles->len - 1);
+}
+
+
+
+static void
+flag_emit_fill (FlagCompiler *compiler)
+{
+  FlagStyle *style = flag_current_style (compiler);
+
+  flag_emit_op (compiler, XKB_FLAG_OP_SET_RGBA);
+  flag_emit_u8 (compiler, style->rgba[0]);
+  flag_emit_u8 (compiler, style->rgba[1]);
+  flag_emit_u8 (compiler, style->rgba[2]);
+  flag_emit_u8 (compiler, style->rgba[3]);
+  flag_emit_op (compiler, XKB_FLAG_OP_FILL);
+  flag_emit_u8 (compiler, style->fill_rule);
+}
+
+
+
+static gboolean
+flag_read_number (const gchar **cursor,
+                  gdouble      *value)
+{
+  const gchar *p = *cursor;
+  gchar       *end;
+
+  while (g_ascii_isspace (*p) || *p == ',')
+    p++;
+
+  *value = g_ascii_strtod (p, &end);
+  if (end == p)
+    return FALSE;
+
+  *cursor = end;
+  return TRUE;
+}
+
+
+
+static gdouble
+flag_attribute_number (const gchar *value,
+                       gdouble      fallback)
+{
+  gdouble result;
+
+  if (value == NULL || !flag_read_number (&value, &result))
+    return fallback;
+
+  return result;
+}
+
+
+
+static gboolean
+flag_parse_color (const gchar *value,
+                  FlagStyle   *style,
+                  GError     **error)
+{
+  static const struct
+  {
+    const gchar *name;
+    guint32      rgb;
+  } named_colors[] =
+    {
+      { "black",  0x000000 },
+      { "white",  0xffffff },
+      { "red",    0xff0000 },
+      { "lime",   0x00ff00 },
+      { "green",  0x008000 },
+      { "blue",   0x0000ff },
+      { "yellow", 0xffff00 },
+    };
+  gchar    *color;
+  gchar    *end;
+  guint32   rgb = 0;
+  gboolean  found = FALSE;
+  guint     i;
+
+  color = g_strstrip (g_strdup (value));
+
+  if (strcmp (color, "none") == 0)
+    {
+      style->none = TRUE;
+      g_free (color);
+      return TRUE;
+    }
+
+  if (color[0] == '#' && (strlen (color) == 4 || strlen (color) == 7))
+    {
+      rgb = strtoul (color + 1, &end, 16);
+      found = *end == '\0';
+
+      /* expand #rgb to #rrggbb */
+      if (found && strlen (color) == 4)
+        rgb = ((rgb & 0xf00) << 12) | ((rgb & 0xf00) << 8)
+            | ((rgb & 0x0f0) << 8)  | ((rgb & 0x0f0) << 4)
+            | ((rgb & 0x00f) << 4)  |  (rgb & 0x00f);
+    }
+
+  for (i = 0; !found && i < G_N_ELEMENTS (named_colors); i++)
+    {
+      if (g_ascii_strcasecmp (color, named_colors[i].name) == 0)
+        {
+          rgb = named_colors[i].rgb;
+          found = TRUE;
+        }
+    }
+
+  if (!found)
+    {
+      g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                   "unsupported fill \"%s\"", color);
+      g_free (color);
+      return FALSE;
+    }
+
+  style->none = FALSE;
+  style->rgba[0] = (rgb >> 16) & 0xff;
+  style->rgba[1] = (rgb >> 8) & 0xff;
+  style->rgba[2] = rgb & 0xff;
+
+  g_free (color);
+  return TRUE;
+}
+
+
+
+static gboolean
+flag_apply_style_property (FlagStyle   *style,
+                           const gchar *name,
+                           const gchar *value,
+                           gboolean     is_group,
+                           GError     **error)
+{
+  gdouble opacity;
+
+  if (strcmp (name, "fill") == 0)
+    return flag_parse_color (value, style, error);
+
+  if (strcmp (name, "fill-rule") == 0)
+    {
+      style->fill_rule = strstr (value, "evenodd") != NULL
+                         ? CAIRO_FILL_RULE_EVEN_ODD : CAIRO_FILL_RULE_WINDING;
+      return TRUE;
+    }
+
+  if (strcmp (name, "fill-opacity") == 0 || strcmp (name, "opacity") == 0)
+    {
+      opacity = CLAMP (flag_attribute_number (value, 1.0), 0.0, 1.0);
+
+      /* group opacity needs an offscreen group, which the format lacks */
+      if (is_group && strcmp (name, "opacity") == 0 && opacity < 1.0)
+        {
+          g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                       "group opacity is not supported");
+          return FALSE;
+        }
+
+      style->rgba[3] = style->rgba[3] * opacity + 0.5;
+      return TRUE;
+    }
+
+  if (strcmp (name, "stroke") == 0)
+    {
+      while (g_ascii_isspace (*value))
+        value++;
+
+      if (!g_str_has_prefix (value, "none"))
+        {
+          g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                       "strokes are not supported");
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+
+
+static gboolean
+flag_apply_style (FlagStyle    *style,
+                  const gchar **attribute_names,
+                  const gchar **attribute_values,
+                  gboolean      is_group,
+                  GError      **error)
+{
+  gchar **declarations, **pair;
+  gint    i, j;
+
+  for (i = 0; attribute_names[i] != NULL; i++)
+    {
+      if (strcmp (attribute_names[i], "style") == 0)
+        {
+          declarations = g_strsplit (attribute_values[i], ";", -1);
+          for (j = 0; declarations[j] != NULL; j++)
+            {
+              pair = g_strsplit (declarations[j], ":", 2);
+              if (pair[0] != NULL && pair[1] != NULL &&
+                  !flag_apply_style_property (style, g_strstrip (pair[0]), pair[1],
+                                              is_group, error))
+                {
+                  g_strfreev (pair);
+                  g_strfreev (declarations);
+                  return FALSE;
+                }
+              g_strfreev (pair);
+            }
+          g_strfreev (declarations);
+        }
+      else if (!flag_apply_style_property (style, attribute_names[i], attribute_values[i],
+                                           is_group, error))
+        {
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
+
+
+
+static void
+flag_matrix_multiply (gdouble       *m,
+                      const gdouble *n)
+{
+  gdouble r[6];
+
+  /* m = m * n, both in cairo order: xx, yx, xy, yy, x0, y0 */
+  r[0] = m[0] * n[0] + m[2] * n[1];
+  r[1] = m[1] * n[0] + m[3] * n[1];
+  r[2] = m[0] * n[2] + m[2] * n[3];
+  r[3] = m[1] * n[2] + m[3] * n[3];
+  r[4] = m[0] * n[4] + m[2] * n[5] + m[4];
+  r[5] = m[1] * n[4] + m[3] * n[5] + m[5];
+
+  memcpy (m, r, sizeof (r));
+}
+
+
+
+static gboolean
+flag_parse_transform (const gchar *value,
+                      gdouble     *matrix,
+                      GError     **error)
+{
+  const gchar *p = value;
+  gchar        name[16];
+  gdouble      args[6], m[6];
+  gint         n_args, len;
+
+  matrix[0] = 1; matrix[1] = 0; matrix[2] = 0;
+  matrix[3] = 1; matrix[4] = 0; matrix[5] = 0;
+
+  while (TRUE)
+    {
+      while (g_ascii_isspace (*p) || *p == ',')
+        p++;
+
+      if (*p == '\0')
+        return TRUE;
+
+      for (len = 0; g_ascii_isalpha (*p) && len < (gint) sizeof (name) - 1; len++)
+        name[len] = *p++;
+      name[len] = '\0';
+
+      while (g_ascii_isspace (*p))
+        p++;
+
+      if (*p++ != '(')
+        break;
+
+      for (n_args = 0; n_args < 6 && flag_read_number (&p, &args[n_args]); n_args++);
+
+      while (g_ascii_isspace (*p))
+        p++;
+
+      if (*p++ != ')')
+        break;
+
+      if (strcmp (name, "matrix") == 0 && n_args == 6)
+        {
+          memcpy (m, args, sizeof (m));
+        }
+      else if (strcmp (name, "translate") == 0 && (n_args == 1 || n_args == 2))
+        {
+          m[0] = 1; m[1] = 0; m[2] = 0; m[3] = 1;
+          m[4] = args[0];
+          m[5] = n_args == 2 ? args[1] : 0;
+        }
+      else if (strcmp (name, "scale") == 0 && (n_args == 1 || n_args == 2))
+        {
+          m[0] = args[0]; m[1] = 0; m[2] = 0;
+          m[3] = n_args == 2 ? args[1] : args[0];
+          m[4] = 0; m[5] = 0;
+        }
+      else if (strcmp (name, "rotate") == 0 && (n_args == 1 || n_args == 3))
+        {
+          gdouble a = args[0] * G_PI / 180.0;
+          gdouble cx = n_args == 3 ? args[1] : 0;
+          gdouble cy = n_args == 3 ? args[2] : 0;
+
+          m[0] = cos (a); m[1] = sin (a);
+          m[2] = -sin (a); m[3] = cos (a);
+          m[4] = cx - m[0] * cx - m[2] * cy;
+          m[5] = cy - m[1] * cx - m[3] * cy;
+        }
+      else
+        {
+          break;
+        }
+
+      flag_matrix_multiply (matrix, m);
+    }
+
+  g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+               "unsupported transform \"%s\"", value);
+  return FALSE;
+}
+
+
+
+static void
+flag_emit_ellipse (FlagCompiler *compiler,
+                   gdouble       cx,
+                   gdouble       cy,
+                   gdouble       rx,
+                   gdouble       ry)
+{
+  gdouble kx = rx * KAPPA, ky = ry * KAPPA;
+
+  flag_emit_point (compiler, XKB_FLAG_OP_MOVE_TO, cx + rx, cy);
+  flag_emit_curve (compiler, cx + rx, cy + ky, cx + kx, cy + ry, cx, cy + ry);
+  flag_emit_curve (compiler, cx - kx, cy + ry, cx - rx, cy + ky, cx - rx, cy);
+  flag_emit_curve (compiler, cx - rx, cy - ky, cx - kx, cy - ry, cx, cy - ry);
+  flag_emit_curve (compiler, cx + kx, cy - ry, cx + rx, cy - ky, cx + rx, cy);
+  flag_emit_op (compiler, XKB_FLAG_OP_CLOSE_PATH);
+}
+
+
+
+static gboolean
+flag_emit_points (FlagCompiler *compiler,
+                  const gchar  *points,
+                  gboolean      close,
+                  GError      **error)
+{
+  gdouble x, y;
+  gint    n = 0;
+
+  while (flag_read_number (&points, &x))
+    {
+      if (!flag_read_number (&points, &y))
+        {
+          g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                       "odd number of coordinates in points");
+          return FALSE;
+        }
+
+      flag_emit_point (compiler, n++ == 0 ? XKB_FLAG_OP_MOVE_TO : XKB_FLAG_OP_LINE_TO, x, y);
+    }
+
+  if (close)
+    flag_emit_op (compiler, XKB_FLAG_OP_CLOSE_PATH);
+
+  return TRUE;
+}
+
+
+
+static gboolean
+flag_emit_path (FlagCompiler *compiler,
+                const gchar  *d,
+                GError      **error)
+{
+  const gchar *p = d;
+  gchar        cmd = 0, prev = 0;
+  gboolean     rel;
+  gdouble      cx = 0, cy = 0, sx = 0, sy = 0;
+  gdouble      lcx = 0, lcy = 0, lqx = 0, lqy = 0;
+  gdouble      a[6];
+
+  #define READ_ARGS(n) \
+    { \
+      gint k; \
+      for (k = 0; k < (n); k++) \
+        if (!flag_read_number (&p, &a[k])) \
+          goto invalid; \
+    }
+
+  while (TRUE)
+    {
+      while (g_ascii_isspace (*p) || *p == ',')
+        p++;
+
+      if (*p == '\0')
+        break;
+
+      if (g_ascii_isalpha (*p))
+        cmd = *p++;
+      else if (cmd == 0)
+        goto invalid;
+
+      rel = g_ascii_islower (cmd);
+
+      switch (g_ascii_toupper (cmd))
+        {
+        case 'M':
+          READ_ARGS (2);
+          if (rel) { a[0] += cx; a[1] += cy; }
+          cx = sx = a[0];
+          cy = sy = a[1];
+          flag_emit_point (compiler, XKB_FLAG_OP_MOVE_TO, cx, cy);
+          /* further coordinate pairs are implicit line-to commands */
+          cmd = rel ? 'l' : 'L';
+          break;
+
+        case 'L':
+          READ_ARGS (2);
+          if (rel) { a[0] += cx; a[1] += cy; }
+          cx = a[0];
+          cy = a[1];
+          flag_emit_point (compiler, XKB_FLAG_OP_LINE_TO, cx, cy);
+          break;
+
+        case 'H':
+          READ_ARGS (1);
+          cx = rel ? cx + a[0] : a[0];
+          flag_emit_point (compiler, XKB_FLAG_OP_LINE_TO, cx, cy);
+          break;
+
+        case 'V':
+          READ_ARGS (1);
+          cy = rel ? cy + a[0] : a[0];
+          flag_emit_point (compiler, XKB_FLAG_OP_LINE_TO, cx, cy);
+          break;
+
+        case 'C':
+          READ_ARGS (6);
+          if (rel)
+            {
+              a[0] += cx; a[1] += cy;
+              a[2] += cx; a[3] += cy;
+              a[4] += cx; a[5] += cy;
+            }
+          flag_emit_curve (compiler, a[0], a[1], a[2], a[3], a[4], a[5]);
+          lcx = a[2]; lcy = a[3];
+          cx = a[4]; cy = a[5];
+          break;
+
+        case 'S':
+          READ_ARGS (4);
+          if (rel)
+            {
+              a[0] += cx; a[1] += cy;
+              a[2] += cx; a[3] += cy;
+            }
+          if (g_ascii_toupper (prev) == 'C' || g_ascii_toupper (prev) == 'S')
+            flag_emit_curve (compiler, 2 * cx - lcx, 2 * cy - lcy, a[0], a[1], a[2], a[3]);
+          else
+            flag_emit_curve (compiler, cx, cy, a[0], a[1], a[2], a[3]);
+          lcx = a[0]; lcy = a[1];
+          cx = a[2]; cy = a[3];
+          break;
+
+        case 'Q':
+        case 'T':
+          if (g_ascii_toupper (cmd) == 'Q')
+            {
+              READ_ARGS (4);
+              if (rel)
+                {
+                  a[0] += cx; a[1] += cy;
+                  a[2] += cx; a[3] += cy;
+                }
+            }
+          else
+            {
+              READ_ARGS (2);
+              if (rel) { a[0] += cx; a[1] += cy; }
+              a[2] = a[0];
+              a[3] = a[1];
+              if (g_ascii_toupper (prev) == 'Q' || g_ascii_toupper (prev) == 'T')
+                {
+                  a[0] = 2 * cx - lqx;
+                  a[1] = 2 * cy - lqy;
+                }
+              else
+                {
+                  a[0] = cx;
+                  a[1] = cy;
+                }
+            }
+          /* elevate the quadratic segment to a cubic one */
+          flag_emit_curve (compiler,
+                           cx + 2.0 / 3.0 * (a[0] - cx), cy + 2.0 / 3.0 * (a[1] - cy),
+                           a[2] + 2.0 / 3.0 * (a[0] - a[2]), a[3] + 2.0 / 3.0 * (a[1] - a[3]),
+                           a[2], a[3]);
+          lqx = a[0]; lqy = a[1];
+          cx = a[2]; cy = a[3];
+          break;
+
+        case 'Z':
+          flag_emit_op (compiler, XKB_FLAG_OP_CLOSE_PATH);
+          cx = sx;
+          cy = sy;
+          break;
+
+        default:
+          g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                       "unsupported path command '%c'", cmd);
+          return FALSE;
+        }
+
+      prev = cmd;
+    }
+
+  #undef READ_ARGS
+
+  return TRUE;
+
+invalid:
+  g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+               "invalid path data near \"%.16s\"", p);
+  return FALSE;
+}
+
+
+
+static gboolean
+flag_emit_image (FlagCompiler *compiler,
+                 const gchar  *href,
+                 gdouble       x,
+                 gdouble       y,
+                 gdouble       width,
+                 gdouble       height,
+                 GError      **error)
+{
+  static const gchar prefix[] = "data:image/png;base64,";
+  guchar *data;
+  gsize   len;
+
+  if (href == NULL || !g_str_has_prefix (href, prefix))
+    {
+      g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                   "only embedded PNG images are supported");
+      return FALSE;
+    }
+
+  /* g_base64_decode() skips the line breaks inkscape puts into the data */
+  data = g_base64_decode (href + strlen (prefix), &len);
+  if (len < 8 || memcmp (data, "\211PNG\r\n\032\n", 8) != 0)
+    {
+      g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                   "embedded image is not a PNG");
+      g_free (data);
+      return FALSE;
+    }
+
+  flag_emit_op (compiler, XKB_FLAG_OP_IMAGE);
+  flag_emit_float (compiler, x);
+  flag_emit_float (compiler, y);
+  flag_emit_float (compiler, width);
+  flag_emit_float (compiler, height);
+  flag_emit_u32 (compiler->program, len);
+  g_byte_array_append (compiler->program, data, len);
+
+  g_free (data);
+  return TRUE;
+}
+
+
+
+static const gchar *
+flag_lookup_attribute (const gchar **attribute_names,
+                       const gchar **attribute_values,
+                       const gchar  *name)
+{
+  gint i;
+
+  for (i = 0; attribute_names[i] != NULL; i++)
+    if (strcmp (attribute_names[i], name) == 0)
+      return attribute_values[i];
+
+  return NULL;
+}
+
+
+
+static void
+flag_start_element (GMarkupParseContext  *context,
+                    const gchar          *element_name,
+                    const gchar         **attribute_names,
+                    const gchar         **attribute_values,
+                    gpointer              user_data,
+                    GError              **error)
+{
+  FlagCompiler *compiler = user_data;
+  FlagStyle     style;
+  const gchar  *value;
+  gdouble       matrix[6];
+  gdouble       vb[4];
+
+  #define ATTR(name) flag_lookup_attribute (attribute_names, attribute_values, name)
+  #define NUM(name) flag_attribute_number (ATTR (name), 0)
+
+  compiler->depth++;
+
+  if (compiler->skip_depth > 0)
+    {
+      compiler->skip_depth++;
+      return;
+    }
+
+  /* metadata, definitions and editor specific elements never paint */
+  if (strcmp (element_name, "metadata") == 0 ||
+      strcmp (element_name, "defs") == 0 ||
+      strcmp (element_name, "title") == 0 ||
+      strcmp (element_name, "desc") == 0 ||
+      strchr (element_name, ':') != NULL)
+    {
+      compiler->skip_depth = 1;
+      return;
+    }
+
+  style = *flag_current_style (compiler);
+  style.transformed = FALSE;
+
+  if (!flag_apply_style (&style, attribute_names, attribute_values,
+                         strcmp (element_name, "g") == 0 || strcmp (element_name, "svg") == 0,
+                         error))
+    return;
+
+  if ((value = ATTR ("transform")) != NULL)
+    {
+      if (!flag_parse_transform (value, matrix, error))
+        return;
+
+      flag_emit_op (compiler, XKB_FLAG_OP_SAVE);
+      flag_emit_op (compiler, XKB_FLAG_OP_TRANSFORM);
+      flag_emit_float (compiler, matrix[0]);
+      flag_emit_float (compiler, matrix[1]);
+      flag_emit_float (compiler, matrix[2]);
+      flag_emit_float (compiler, matrix[3]);
+      flag_emit_float (compiler, matrix[4]);
+      flag_emit_float (compiler, matrix[5]);
+      style.transformed = TRUE;
+    }
+
+  g_array_append_val (compiler->styles, style);
+
+  if (strcmp (element_name, "svg") == 0)
+    {
+      if (compiler->depth != 1)
+        goto unsupported;
+
+      compiler->width = NUM ("width");
+      compiler->height = NUM ("height");
+
+      value = ATTR ("viewBox");
+      if (value != NULL &&
+          flag_read_number (&value, &vb[0]) && flag_read_number (&value, &vb[1]) &&
+          flag_read_number (&value, &vb[2]) && flag_read_number (&value, &vb[3]) &&
+          vb[2] > 0 && vb[3] > 0)
+        {
+          if (compiler->width <= 0 || compiler->height <= 0)
+            {
+              compiler->width = vb[2];
+              compiler->height = vb[3];
+            }
+
+          flag_emit_op (compiler, XKB_FLAG_OP_TRANSFORM);
+          flag_emit_float (compiler, compiler->width / vb[2]);
+          flag_emit_float (compiler, 0);
+          flag_emit_float (compiler, 0);
+          flag_emit_float (compiler, compiler->height / vb[3]);
+          flag_emit_float (compiler, -vb[0] * compiler->width / vb[2]);
+          flag_emit_float (compiler, -vb[1] * compiler->height / vb[3]);
+        }
+
+      if (compiler->width <= 0 || compiler->height <= 0)
+        {
+          g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                       "missing image size");
+        }
+    }
+  else if (strcmp (element_name, "g") == 0)
+    {
+      /* only the style and transform matter */
+    }
+  else if (strcmp (element_name, "image") == 0)
+    {
+      value = ATTR ("xlink:href");
+      if (value == NULL)
+        value = ATTR ("href");
+
+      flag_emit_image (compiler, value, NUM ("x"), NUM ("y"),
+                       NUM ("width"), NUM ("height"), error);
+    }
+  else if (style.none)
+    {
+      /* invisible shape */
+    }
+  else if (strcmp (element_name, "rect") == 0)
+    {
+      if (NUM ("rx") > 0 || NUM ("ry") > 0)
+        goto unsupported;
+
+      flag_emit_point (compiler, XKB_FLAG_OP_MOVE_TO, NUM ("x"), NUM ("y"));
+      flag_emit_point (compiler, XKB_FLAG_OP_LINE_TO, NUM ("x") + NUM ("width"), NUM ("y"));
+      flag_emit_point (compiler, XKB_FLAG_OP_LINE_TO, NUM ("x") + NUM ("width"),
+                       NUM ("y") + NUM ("height"));
+      flag_emit_point (compiler, XKB_FLAG_OP_LINE_TO, NUM ("x"), NUM ("y") + NUM ("height"));
+      flag_emit_op (compiler, XKB_FLAG_OP_CLOSE_PATH);
+      flag_emit_fill (compiler);
+    }
+  else if (strcmp (element_name, "circle") == 0)
+    {
+      flag_emit_ellipse (compiler, NUM ("cx"), NUM ("cy"), NUM ("r"), NUM ("r"));
+      flag_emit_fill (compiler);
+    }
+  else if (strcmp (element_name, "ellipse") == 0)
+    {
+      flag_emit_ellipse (compiler, NUM ("cx"), NUM ("cy"), NUM ("rx"), NUM ("ry"));
+      flag_emit_fill (compiler);
+    }
+  else if (strcmp (element_name, "polygon") == 0 || strcmp (element_name, "polyline") == 0)
+    {
+      if (flag_emit_points (compiler, ATTR ("points"), TRUE, error))
+        flag_emit_fill (compiler);
+    }
+  else if (strcmp (element_name, "path") == 0)
+    {
+      if (ATTR ("d") != NULL && flag_emit_path (compiler, ATTR ("d"), error))
+        flag_emit_fill (compiler);
+    }
+  else
+    {
+      goto unsupported;
+    }
+
+  #undef NUM
+  #undef ATTR
+
+  return;
+
+unsupported:
+  g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_UNKNOWN_ELEMENT,
+               "unsupported element <%s>", element_name);
+}
+
+
+
+static void
+flag_end_element (GMarkupParseContext  *context,
+                  const gchar          *element_name,
+                  gpointer              user_data,
+                  GError              **error)
+{
+  FlagCompiler *compiler = user_data;
+
+  compiler->depth--;
+
+  if (compiler->skip_depth > 0)
+    {
+      compiler->skip_depth--;
+      return;
+    }
+
+  if (flag_current_style (compiler)->transformed)
+    flag_emit_op (compiler, XKB_FLAG_OP_RESTORE);
+
+  g_array_set_size (compiler->styles, compiler->styles->len - 1);
+}
+
+
+
+static GByteArray *
+flag_compile_file (const gchar  *filename,
+                   GError      **error)
+{
+  static const GMarkupParser parser =
+    {
+      flag_start_element,
+      flag_end_element,
+      NULL, NULL, NULL
+    };
+  GMarkupParseContext *context;
+  FlagCompiler         compiler;
+  FlagStyle            root_style;
+  gchar               *contents;
+  gsize                length;
+  gboolean             succeed;
+  union { gfloat f; guint32 u; } size;
+
+  if (!g_file_get_contents (filename, &contents, &length, error))
+    return NULL;
+
+  memset (&compiler, 0, sizeof (compiler));
+  compiler.program = g_byte_array_new ();
+  compiler.styles = g_array_new (FALSE, FALSE, sizeof (FlagStyle));
+
+  /* SVG painting defaults: opaque black fill, nonzero rule */
+  memset (&root_style, 0, sizeof (root_style));
+  root_style.rgba[3] = 0xff;
+  root_style.fill_rule = CAIRO_FILL_RULE_WINDING;
+  g_array_append_val (compiler.styles, root_style);
+
+  /* width and height are patched in once the root element is parsed */
+  flag_emit_float (&compiler, 0);
+  flag_emit_float (&compiler, 0);
+
+  context = g_markup_parse_context_new (&parser, G_MARKUP_PREFIX_ERROR_POSITION,
+                                        &compiler, NULL);
+  succeed = g_markup_parse_context_parse (context, contents, length, error)
+            && g_markup_parse_context_end_parse (context, error);
+  g_markup_parse_context_free (context);
+  g_array_free (compiler.styles, TRUE);
+  g_free (contents);
+
+  if (!succeed)
+    {
+      g_byte_array_free (compiler.program, TRUE);
+      return NULL;
+    }
+
+  flag_emit_op (&compiler, XKB_FLAG_OP_END);
+
+  size.f = compiler.width;
+  size.u = GUINT32_TO_LE (size.u);
+  memcpy (compiler.program->data, &size.u, 4);
+
+  size.f = compiler.height;
+  size.u = GUINT32_TO_LE (size.u);
+  memcpy (compiler.program->data + 4, &size.u, 4);
+
+  return compiler.program;
+}
+
+
+
+static gint
+flag_entry_compare (gconstpointer a,
+                    gconstpointer b)
+{
+  return strcmp (((const FlagEntry *) a)->name, ((const FlagEntry *) b)->name);
+}
+
+
+
+static gchar *output = NULL;
+
+static GOptionEntry option_entries[] =
+{
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "Write the bundle to FILE", "FILE" },
+  { NULL }
+};
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GOptionContext *context;
+  GError         *error = NULL;
+  GArray         *entries;
+  GByteArray     *bundle;
+  FlagEntry       entry;
+  gchar          *basename;
+  gchar           name[XKB_FLAG_BUNDLE_NAME_LEN];
+  guint32         offset;
+  guint           i;
+  gint            n;
+
+  context = g_option_context_new ("FLAG.svg... - compile flags for the xkb plugin");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error) || output == NULL)
+    {
+      g_printerr ("%s\n", error != NULL ? error->message : "no output file given");
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (context);
+
+  entries = g_array_new (FALSE, FALSE, sizeof (FlagEntry));
+
+  for (n = 1; n < argc; n++)
+    {
+      basename = g_path_get_basename (argv[n]);
+      if (g_str_has_suffix (basename, ".svg"))
+        basename[strlen (basename) - 4] = '\0';
+
+      if (strlen (basename) >= XKB_FLAG_BUNDLE_NAME_LEN)
+        {
+          g_printerr ("%s: skipped, name too long\n", argv[n]);
+          g_free (basename);
+          continue;
+        }
+
+      entry.name = basename;
+      entry.program = flag_compile_file (argv[n], &error);
+
+      if (entry.program == NULL)
+        {
+          /* the plugin falls back to the SVG for this flag */
+          g_printerr ("%s: skipped, %s\n", argv[n], error->message);
+          g_clear_error (&error);
+          g_free (basename);
+          continue;
+        }
+
+      g_array_append_val (entries, entry);
+    }
+
+  g_array_sort (entries, flag_entry_compare);
+
+  bundle = g_byte_array_new ();
+  g_byte_array_append (bundle, (const guint8 *) XKB_FLAG_BUNDLE_MAGIC, XKB_FLAG_BUNDLE_MAGIC_LEN);
+  flag_emit_u32 (bundle, XKB_FLAG_BUNDLE_VERSION);
+  flag_emit_u32 (bundle, entries->len);
+
+  offset = XKB_FLAG_BUNDLE_HEADER_SIZE + entries->len * XKB_FLAG_BUNDLE_ENTRY_SIZE;
+  for (i = 0; i < entries->len; i++)
+    {
+      FlagEntry *e = &g_array_index (entries, FlagEntry, i);
+
+      memset (name, 0, sizeof (name));
+      strncpy (name, e->name, sizeof (name) - 1);
+      g_byte_array_append (bundle, (const guint8 *) name, sizeof (name));
+      flag_emit_u32 (bundle, offset);
+      flag_emit_u32 (bundle, e->program->len);
+      offset += e->program->len;
+    }
+
+  for (i = 0; i < entries->len; i++)
+    {
+      FlagEntry *e = &g_array_index (entries, FlagEntry, i);
+
+      g_byte_array_append (bundle, e->program->data, e->program->len);
+      g_byte_array_free (e->program, TRUE);
+      g_free (e->name);
+    }
+
+  if (!g_file_set_contents (output, (const gchar *) bundle->data, bundle->len, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      return EXIT_FAILURE;
+    }
+
+  g_byte_array_free (bundle, TRUE);
+  g_array_free (entries, TRUE);
+
+  return EXIT_SUCCESS;
+}
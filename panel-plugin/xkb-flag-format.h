@@ -0,0 +1,58 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-flag-format.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_FLAG_FORMAT_H_
+#define _XKB_FLAG_FORMAT_H_
+
+/*
+ * Compiled flag bundle, produced by xkb-flag-compiler at build time and
+ * interpreted by xkb-cairo.c at run time. All integers and floats are
+ * stored little-endian and may be unaligned.
+ *
+ *   header:  "XKBFLAGS" | guint32 version | guint32 n_entries
+ *   index:   n_entries * { gchar name[16] | guint32 offset | guint32 length },
+ *            sorted by name
+ *   program: float width | float height | op*
+ *
+ * Each op is a single opcode byte followed by its arguments.
+ */
+
+#define XKB_FLAG_BUNDLE_MAGIC           "XKBFLAGS"
+#define XKB_FLAG_BUNDLE_MAGIC_LEN       8
+#define XKB_FLAG_BUNDLE_VERSION         1
+#define XKB_FLAG_BUNDLE_NAME_LEN        16
+#define XKB_FLAG_BUNDLE_HEADER_SIZE     (XKB_FLAG_BUNDLE_MAGIC_LEN + 4 + 4)
+#define XKB_FLAG_BUNDLE_ENTRY_SIZE      (XKB_FLAG_BUNDLE_NAME_LEN + 4 + 4)
+#define XKB_FLAG_BUNDLE_FILENAME        "flags.xkbf"
+
+typedef enum
+{
+  XKB_FLAG_OP_END                 = 0,  /* no arguments */
+  XKB_FLAG_OP_MOVE_TO             = 1,  /* float x, y */
+  XKB_FLAG_OP_LINE_TO             = 2,  /* float x, y */
+  XKB_FLAG_OP_CURVE_TO            = 3,  /* float x1, y1, x2, y2, x3, y3 */
+  XKB_FLAG_OP_CLOSE_PATH          = 4,  /* no arguments */
+  XKB_FLAG_OP_SET_RGBA            = 5,  /* guint8 r, g, b, a */
+  XKB_FLAG_OP_FILL                = 6,  /* guint8 fill rule (cairo_fill_rule_t) */
+  XKB_FLAG_OP_SAVE                = 7,  /* no arguments */
+  XKB_FLAG_OP_RESTORE             = 8,  /* no arguments */
+  XKB_FLAG_OP_TRANSFORM           = 9,  /* float xx, yx, xy, yy, x0, y0 */
+  XKB_FLAG_OP_IMAGE               = 10, /* float x, y, width, height | guint32 length | PNG data */
+} XkbFlagOp;
+
+#endif
@@ -0,0 +1,321 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-group-rules.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#include "xkb-group-rules.h"
+
+#include <string.h>
+
+/*
+ * Rules have the form "FIELD:PATTERN=LAYOUT", where FIELD is "class" for
+ * the WM_CLASS written as "instance.Class" or "title" for the window
+ * title, PATTERN is a regular expression searched for anywhere in the
+ * field and LAYOUT is a layout code with an optional variant, e.g.
+ * "class:^(jetbrains|code)-=us" or "title:Пошта=ua". The first rule
+ * which matches wins.
+ *
+ * All the rules of a field are joined into one alternation, so a window
+ * is checked against any number of rules with one g_regex_match call per
+ * field. PCRE still tries the alternatives one after another, this only
+ * saves the per-rule call and match data overhead. Each rule becomes an
+ * alternative of the form (?=.*?(?:PATTERN))(), the empty group at its
+ * end is the highest numbered group set when the alternative matches,
+ * so the match count alone tells which rule won. Back references and
+ * branch reset groups inside patterns are not supported.
+ */
+
+typedef enum
+{
+  RULE_FIELD_CLASS,
+  RULE_FIELD_TITLE,
+  N_RULE_FIELDS
+} XkbGroupRuleField;
+
+typedef struct
+{
+  gchar               *layout;
+  gchar               *variant;
+} XkbGroupRule;
+
+struct _XkbGroupRulesClass
+{
+  GObjectClass         __parent__;
+};
+
+struct _XkbGroupRules
+{
+  GObject              __parent__;
+
+  GArray              *rules;
+
+  GRegex              *matchers[N_RULE_FIELDS];
+
+  /* the rule index of each capture group, G_MAXUINT for groups of the
+   * patterns themselves */
+  GArray              *field_rules[N_RULE_FIELDS];
+};
+
+static const gchar *rule_field_names[N_RULE_FIELDS] = { "class", "title" };
+
+static void              xkb_group_rules_finalize              (GObject              *object);
+
+G_DEFINE_TYPE (XkbGroupRules, xkb_group_rules, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_group_rules_class_init (XkbGroupRulesClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_group_rules_finalize;
+}
+
+
+
+static void
+xkb_group_rule_clear (gpointer data)
+{
+  XkbGroupRule *rule = data;
+
+  g_free (rule->layout);
+  g_free (rule->variant);
+}
+
+
+
+static void
+xkb_group_rules_init (XkbGroupRules *group_rules)
+{
+  guint none = G_MAXUINT;
+  gint  i;
+
+  group_rules->rules = g_array_new (FALSE, TRUE, sizeof (XkbGroupRule));
+  g_array_set_clear_func (group_rules->rules, xkb_group_rule_clear);
+
+  for (i = 0; i < N_RULE_FIELDS; i++)
+    {
+      group_rules->matchers[i] = NULL;
+      group_rules->field_rules[i] = g_array_new (FALSE, FALSE, sizeof (guint));
+
+      /* group 0 is the whole match */
+      g_array_append_val (group_rules->field_rules[i], none);
+    }
+}
+
+
+
+static void
+xkb_group_rules_finalize (GObject *object)
+{
+  XkbGroupRules *group_rules = XKB_GROUP_RULES (object);
+  gint           i;
+
+  for (i = 0; i < N_RULE_FIELDS; i++)
+    {
+      if (group_rules->matchers[i] != NULL)
+        g_regex_unref (group_rules->matchers[i]);
+      g_array_unref (group_rules->field_rules[i]);
+    }
+
+  g_array_unref (group_rules->rules);
+
+  G_OBJECT_CLASS (xkb_group_rules_parent_class)->finalize (object);
+}
+
+
+
+static gboolean
+xkb_group_rules_parse (const gchar        *description,
+                       XkbGroupRuleField  *field,
+                       gchar             **pattern,
+                       XkbGroupRule       *rule)
+{
+  const gchar *colon, *equals;
+  gchar       *layout, *variant;
+  gint         i;
+
+  colon = strchr (description, ':');
+  equals = strrchr (description, '=');
+  if (colon == NULL || equals == NULL || equals < colon || equals[1] == '\0')
+    return FALSE;
+
+  for (i = 0; i < N_RULE_FIELDS; i++)
+    {
+      if (strlen (rule_field_names[i]) == (gsize) (colon - description) &&
+          strncmp (description, rule_field_names[i], colon - description) == 0)
+        break;
+    }
+
+  if (i == N_RULE_FIELDS)
+    return FALSE;
+
+  layout = g_strstrip (g_strdup (equals + 1));
+  variant = strchr (layout, '(');
+  if (variant != NULL && g_str_has_suffix (variant, ")"))
+    {
+      *variant++ = '\0';
+      variant[strlen (variant) - 1] = '\0';
+    }
+
+  *field = i;
+  *pattern = g_strndup (colon + 1, equals - colon - 1);
+  rule->layout = layout;
+  rule->variant = variant != NULL ? g_strdup (variant) : NULL;
+
+  return TRUE;
+}
+
+
+
+XkbGroupRules *
+xkb_group_rules_new (const gchar * const *rules)
+{
+  XkbGroupRules     *group_rules;
+  XkbGroupRuleField  field;
+  XkbGroupRule       rule;
+  GString           *combined[N_RULE_FIELDS];
+  GRegex            *regex;
+  GError            *error = NULL;
+  gchar             *pattern;
+  guint              index, none = G_MAXUINT;
+  gint               i, n_groups;
+
+  group_rules = g_object_new (TYPE_XKB_GROUP_RULES, NULL);
+
+  for (i = 0; i < N_RULE_FIELDS; i++)
+    combined[i] = g_string_new ("^(?:");
+
+  for (; rules != NULL && *rules != NULL; rules++)
+    {
+      if (!xkb_group_rules_parse (*rules, &field, &pattern, &rule))
+        {
+          g_warning ("Ignoring malformed group rule \"%s\"", *rules);
+          continue;
+        }
+
+      /* a broken pattern would take the whole field down with it */
+      regex = g_regex_new (pattern, 0, 0, &error);
+      if (regex == NULL)
+        {
+          g_warning ("Ignoring group rule \"%s\": %s", *rules, error->message);
+          g_clear_error (&error);
+          xkb_group_rule_clear (&rule);
+          g_free (pattern);
+          continue;
+        }
+      n_groups = g_regex_get_capture_count (regex);
+      g_regex_unref (regex);
+
+      if (group_rules->field_rules[field]->len > 1)
+        g_string_append_c (combined[field], '|');
+      g_string_append_printf (combined[field], "(?=.*?(?:%s))()", pattern);
+
+      index = group_rules->rules->len;
+      g_array_append_val (group_rules->rules, rule);
+
+      for (; n_groups > 0; n_groups--)
+        g_array_append_val (group_rules->field_rules[field], none);
+      g_array_append_val (group_rules->field_rules[field], index);
+
+      g_free (pattern);
+    }
+
+  for (i = 0; i < N_RULE_FIELDS; i++)
+    {
+      g_string_append_c (combined[i], ')');
+
+      if (group_rules->field_rules[i]->len > 1)
+        {
+          group_rules->matchers[i] = g_regex_new (combined[i]->str,
+                                                  G_REGEX_DOTALL | G_REGEX_OPTIMIZE,
+                                                  0, &error);
+          if (group_rules->matchers[i] == NULL)
+            {
+              g_warning ("Unable to compile the %s rules: %s",
+                         rule_field_names[i], error->message);
+              g_clear_error (&error);
+            }
+        }
+
+      g_string_free (combined[i], TRUE);
+    }
+
+  return group_rules;
+}
+
+
+
+static guint
+xkb_group_rules_match_field (XkbGroupRules     *group_rules,
+                             XkbGroupRuleField  field,
+                             const gchar       *subject)
+{
+  GMatchInfo *match_info;
+  guint       result = G_MAXUINT;
+  gint        count;
+
+  if (group_rules->matchers[field] == NULL || subject == NULL)
+    return G_MAXUINT;
+
+  if (g_regex_match (group_rules->matchers[field], subject, 0, &match_info))
+    {
+      /* the groups of later alternatives are never set, so the last set
+       * group is the marker of the alternative which matched */
+      count = g_match_info_get_match_count (match_info);
+      if (count > 0 && (guint) count <= group_rules->field_rules[field]->len)
+        result = g_array_index (group_rules->field_rules[field], guint, count - 1);
+    }
+
+  g_match_info_free (match_info);
+
+  return result;
+}
+
+
+
+/*
+ * Finds the first rule matching a window. The returned strings belong
+ * to the rules, variant is NULL when the rule does not name one.
+ */
+gboolean
+xkb_group_rules_match (XkbGroupRules  *group_rules,
+                       const gchar    *wm_class,
+                       const gchar    *title,
+                       const gchar   **layout,
+                       const gchar   **variant)
+{
+  XkbGroupRule *rule;
+  guint         index;
+
+  g_return_val_if_fail (IS_XKB_GROUP_RULES (group_rules), FALSE);
+  g_return_val_if_fail (layout != NULL && variant != NULL, FALSE);
+
+  index = MIN (xkb_group_rules_match_field (group_rules, RULE_FIELD_CLASS, wm_class),
+               xkb_group_rules_match_field (group_rules, RULE_FIELD_TITLE, title));
+
+  if (index == G_MAXUINT)
+    return FALSE;
+
+  rule = &g_array_index (group_rules->rules, XkbGroupRule, index);
+  *layout = rule->layout;
+  *variant = rule->variant;
+
+  return TRUE;
+}
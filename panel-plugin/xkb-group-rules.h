@@ -0,0 +1,49 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-group-rules.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_GROUP_RULES_H_
+#define _XKB_GROUP_RULES_H_
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _XkbGroupRulesClass     XkbGroupRulesClass;
+typedef struct _XkbGroupRules          XkbGroupRules;
+
+#define TYPE_XKB_GROUP_RULES             (xkb_group_rules_get_type ())
+#define XKB_GROUP_RULES(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_GROUP_RULES, XkbGroupRules))
+#define XKB_GROUP_RULES_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_GROUP_RULES, XkbGroupRulesClass))
+#define IS_XKB_GROUP_RULES(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_XKB_GROUP_RULES))
+#define IS_XKB_GROUP_RULES_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass),  TYPE_XKB_GROUP_RULES))
+#define XKB_GROUP_RULES_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj),  TYPE_XKB_GROUP_RULES, XkbGroupRulesClass))
+
+GType             xkb_group_rules_get_type                  (void)                           G_GNUC_CONST;
+
+
+XkbGroupRules    *xkb_group_rules_new                       (const gchar * const *rules);
+
+gboolean          xkb_group_rules_match                     (XkbGroupRules       *group_rules,
+                                                             const gchar         *wm_class,
+                                                             const gchar         *title,
+                                                             const gchar        **layout,
+                                                             const gchar        **variant);
+
+G_END_DECLS
+
+#endif
@@ -23,13 +23,29 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
 #include "xkb-keyboard.h"
+#include "xkb-class-store.h"
+#include "xkb-group-rules.h"
+#include "xkb-snapshot.h"
+#ifdef HAVE_XKLAVIER
+#include "xkb-backend-xkl.h"
+#endif
+#ifdef HAVE_XKBCOMMON
+#include "xkb-backend-xkbcommon.h"
+#endif
 #include "xkb-util.h"
+#include "xkb-audit.h"
+#include "xkb-trace.h"
+#include "xkb-probes.h"
+
+#include <string.h>
 
-#include <gdk/gdkx.h>
-#include <libxklavier/xklavier.h>
-#include <libwnck/libwnck.h>
-#include <librsvg/rsvg.h>
+#define ICON_WIDTH            30
+#define ICON_HEIGHT           22
 
 typedef struct
 {
@@ -39,10 +55,16 @@ typedef struct
   gint                  language_index;
   gchar                *variant;
   gchar                *pretty_layout_name;
-  GdkPixbuf            *display_pixbuf;
-  GdkPixbuf            *tooltip_pixbuf;
+  XkbCairoFlag         *display_flag;
+  GHashTable           *icon_surfaces;
 } XkbGroupData;
 
+typedef struct
+{
+  gchar               **layouts;
+  gchar               **variants;
+} XkbLayoutSet;
+
 struct _XkbKeyboardClass
 {
   GObjectClass         __parent__;
@@ -52,62 +74,98 @@ struct _XkbKeyboard
 {
   GObject              __parent__;
     
-  XklEngine           *engine;
-  XklConfigRec        *last_config_rec;
+  XkbBackend          *backend;
+  gchar              **last_layouts;
+  gchar              **last_variants;
 
   XkbXfconf           *config;
-  WnckScreen          *wnck_screen;
+
+  GMappedFile         *flag_bundle;
+
+  /* group names of the last run, saves the registry lookup at startup */
+  XkbSnapshot         *snapshot;
 
   guint                config_timeout_id;
 
+  /* the keyboard is already updated for the configuration it activated
+   * itself, the notification the server sends for it shortly after is
+   * not needed */
+  gint64               config_activated_time;
+
   XkbGroupData        *group_data;
 
   XkbGroupPolicy       group_policy;
 
+  GPtrArray           *layout_sets;
+  gint                 current_layout_set;
+
+  /* groups of the layout sets which are not active, kept built so
+   * switching sets does not go through the registry and flags again */
+  GHashTable          *warm_groups;
+
   GHashTable          *application_map;
   GHashTable          *window_map;
+  XkbClassStore       *class_store;
+
+  XkbGroupRules       *group_rules;
+  GHashTable          *seen_windows;
 
   guint                current_window_id;
   guint                current_application_id;
+  gchar               *current_wm_class;
+
+  gint                 workspace_groups[XKB_KEYBOARD_MAX_WORKSPACES];
+  gint                 current_workspace;
 
   gint                 group_count;
   gint                 current_group;
+  guint                changed_groups;
 
+  gulong               group_changed_handler_id;
+  gulong               config_changed_handler_id;
   gulong               active_window_changed_handler_id;
   gulong               application_closed_handler_id;
   gulong               window_closed_handler_id;
+  gulong               workspace_changed_handler_id;
 };
 
 static void              xkb_keyboard_group_policy_changed     (XkbKeyboard          *keyboard);
-
-static void              xkb_keyboard_active_window_changed    (WnckScreen           *screen,
-                                                                WnckWindow           *previously_active_window,
+static void              xkb_keyboard_layout_sets_changed      (XkbKeyboard          *keyboard);
+static void              xkb_keyboard_group_rules_changed      (XkbKeyboard          *keyboard);
+static void              xkb_keyboard_group_data_free          (XkbGroupData         *group_data);
+
+static void              xkb_keyboard_active_window_changed    (XkbBackend           *backend,
+                                                                guint                 window_id,
+                                                                guint                 application_id,
+                                                                const gchar          *wm_class,
+                                                                const gchar          *title,
+                                                                XkbKeyboard          *keyboard);
+static void              xkb_keyboard_application_closed       (XkbBackend           *backend,
+                                                                guint                 application_id,
                                                                 XkbKeyboard          *keyboard);
-static void              xkb_keyboard_application_closed       (WnckScreen           *screen,
-                                                                WnckApplication      *application,
+static void              xkb_keyboard_window_closed            (XkbBackend           *backend,
+                                                                guint                 window_id,
                                                                 XkbKeyboard          *keyboard);
-static void              xkb_keyboard_window_closed            (WnckScreen           *screen,
-                                                                WnckWindow           *window,
+static void              xkb_keyboard_workspace_changed        (XkbBackend           *backend,
+                                                                gint                  workspace,
                                                                 XkbKeyboard          *keyboard);
 
-static void              xkb_keyboard_xkl_state_changed        (XklEngine            *engine,
-                                                                XklEngineStateChange  change,
+static void              xkb_keyboard_backend_group_changed    (XkbBackend           *backend,
                                                                 gint                  group,
-                                                                gboolean              restore,
                                                                 XkbKeyboard          *keyboard);
 
-static void              xkb_keyboard_xkl_config_changed       (XklEngine            *engine,
+static void              xkb_keyboard_backend_config_changed   (XkbBackend           *backend,
                                                                 XkbKeyboard          *keyboard);
 
-static GdkFilterReturn   xkb_keyboard_handle_xevent            (GdkXEvent            *xev,
-                                                                GdkEvent             *event,
-                                                                gpointer              user_data);
-
+static XkbKeyboard      *xkb_keyboard_new_full                 (XkbXfconf            *config,
+                                                                XkbBackend           *backend,
+                                                                const gchar          *snapshot_name);
 static void              xkb_keyboard_free                     (XkbKeyboard          *keyboard);
 static void              xkb_keyboard_finalize                 (GObject              *object);
-static gboolean          xkb_keyboard_update_from_xkl          (XkbKeyboard          *keyboard);
+static gboolean          xkb_keyboard_update_from_backend      (XkbKeyboard          *keyboard);
 static void              xkb_keyboard_initialize_xkb_options   (XkbKeyboard          *keyboard,
-                                                                const XklConfigRec   *config_rec);
+                                                                gchar               **layouts,
+                                                                gchar               **variants);
 
 enum
 {
@@ -140,79 +198,195 @@ xkb_keyboard_class_init (XkbKeyboardClass *klass)
 
 
 
+static void
+xkb_keyboard_layout_set_free (gpointer data)
+{
+  XkbLayoutSet *layout_set = data;
+
+  g_strfreev (layout_set->layouts);
+  g_strfreev (layout_set->variants);
+  g_free (layout_set);
+}
+
+
+
+static void
+xkb_keyboard_warm_group_free (gpointer data)
+{
+  xkb_keyboard_group_data_free (data);
+  g_free (data);
+}
+
+
+
 static void
 xkb_keyboard_init (XkbKeyboard *keyboard)
 {
-  keyboard->engine = NULL;
-  keyboard->last_config_rec = NULL;
+  keyboard->backend = NULL;
+  keyboard->last_layouts = NULL;
+  keyboard->last_variants = NULL;
 
   keyboard->config = NULL;
-  keyboard->wnck_screen = NULL;
+
+  keyboard->flag_bundle = NULL;
+
+  keyboard->snapshot = NULL;
 
   keyboard->config_timeout_id = 0;
+  keyboard->config_activated_time = 0;
 
   keyboard->group_data = NULL;
   keyboard->group_policy = GROUP_POLICY_GLOBAL;
 
+  keyboard->layout_sets = g_ptr_array_new_with_free_func (xkb_keyboard_layout_set_free);
+  keyboard->current_layout_set = -1;
+  keyboard->warm_groups = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                 xkb_keyboard_warm_group_free);
+
   keyboard->application_map = NULL;
   keyboard->window_map = NULL;
+  keyboard->class_store = NULL;
+
+  keyboard->group_rules = NULL;
+  keyboard->seen_windows = g_hash_table_new (g_direct_hash, NULL);
 
   keyboard->current_window_id = 0;
   keyboard->current_application_id = 0;
+  keyboard->current_wm_class = NULL;
+
+  memset (keyboard->workspace_groups, 0, sizeof (keyboard->workspace_groups));
+  keyboard->current_workspace = -1;
 
   keyboard->group_count = 0;
   keyboard->current_group = 0;
+  keyboard->changed_groups = 0;
 
+  keyboard->group_changed_handler_id = 0;
+  keyboard->config_changed_handler_id = 0;
   keyboard->active_window_changed_handler_id = 0;
   keyboard->application_closed_handler_id = 0;
   keyboard->window_closed_handler_id = 0;
+  keyboard->workspace_changed_handler_id = 0;
 }
 
 
 
+/*
+ * The backend is libxklavier unless XFCE4_XKB_BACKEND=xkbcommon is set
+ * and the xkbcommon backend was built, or libxklavier was left out.
+ */
 XkbKeyboard *
 xkb_keyboard_new (XkbXfconf *config)
 {
   XkbKeyboard *keyboard;
+  XkbBackend  *backend = NULL;
+  const gchar *snapshot_name = NULL;
 
-  keyboard = g_object_new (TYPE_XKB_KEYBOARD, NULL);
+#ifdef HAVE_XKBCOMMON
+#ifdef HAVE_XKLAVIER
+  if (g_strcmp0 (g_getenv ("XFCE4_XKB_BACKEND"), "xkbcommon") == 0)
+#endif
+    {
+      backend = xkb_backend_xkbcommon_new ();
+      snapshot_name = "keyboard-xkbcommon";
+    }
+#endif
 
-  keyboard->group_policy = xkb_xfconf_get_group_policy (config);
+#ifdef HAVE_XKLAVIER
+  if (backend == NULL)
+    {
+      backend = xkb_backend_xkl_new ();
+      snapshot_name = "keyboard-xkl";
+    }
+#endif
+  keyboard = xkb_keyboard_new_full (config, backend, snapshot_name);
+
+  if (backend != NULL)
+    g_object_unref (backend);
+
+  return keyboard;
+}
 
-  g_signal_connect_swapped (G_OBJECT (config), "notify::" GROUP_POLICY,
-                            G_CALLBACK (xkb_keyboard_group_policy_changed), keyboard);
+
+
+/*
+ * Creates a keyboard on top of the given backend, which may be NULL when
+ * no keyboard is available. The keyboard keeps a reference to it.
+ */
+XkbKeyboard *
+xkb_keyboard_new_with_backend (XkbXfconf  *config,
+                               XkbBackend *backend)
+{
+  return xkb_keyboard_new_full (config, backend, NULL);
+}
+
+
+
+/*
+ * The backends describe the groups differently, each one keeps its own
+ * snapshot. Without a snapshot name the registry is always used.
+ */
+static XkbKeyboard *
+xkb_keyboard_new_full (XkbXfconf   *config,
+                       XkbBackend  *backend,
+                       const gchar *snapshot_name)
+{
+  XkbKeyboard *keyboard;
+  gchar       *bundle_filename;
+
+  g_return_val_if_fail (backend == NULL || IS_XKB_BACKEND (backend), NULL);
+
+  keyboard = g_object_new (TYPE_XKB_KEYBOARD, NULL);
+
+  if (backend != NULL && snapshot_name != NULL)
+    keyboard->snapshot = xkb_snapshot_new (snapshot_name);
 
   g_object_ref (config);
   keyboard->config = config;
 
-  keyboard->wnck_screen = wnck_screen_get_default ();
+  xkb_keyboard_group_policy_changed (keyboard);
 
-  keyboard->engine = xkl_engine_get_instance (gdk_x11_get_default_xdisplay ());
-
-  if (keyboard->engine)
-    {
-      xkb_keyboard_update_from_xkl (keyboard);
+  g_signal_connect_swapped (G_OBJECT (config), "notify::" GROUP_POLICY,
+                            G_CALLBACK (xkb_keyboard_group_policy_changed), keyboard);
 
-      xkl_engine_set_group_per_toplevel_window (keyboard->engine, FALSE);
+  g_signal_connect_swapped (G_OBJECT (config), "notify::" LAYOUT_SETS,
+                            G_CALLBACK (xkb_keyboard_layout_sets_changed), keyboard);
 
-      xkl_engine_start_listen (keyboard->engine, XKLL_TRACK_KEYBOARD_STATE);
+  xkb_keyboard_group_rules_changed (keyboard);
 
-      g_signal_connect (keyboard->engine, "X-state-changed",
-                        G_CALLBACK (xkb_keyboard_xkl_state_changed), keyboard);
-      g_signal_connect (keyboard->engine, "X-config-changed",
-                        G_CALLBACK (xkb_keyboard_xkl_config_changed), keyboard);
+  g_signal_connect_swapped (G_OBJECT (config), "notify::" GROUP_RULES,
+                            G_CALLBACK (xkb_keyboard_group_rules_changed), keyboard);
 
-      gdk_window_add_filter (NULL, xkb_keyboard_handle_xevent, keyboard);
+  bundle_filename = xkb_util_get_flag_bundle_filename ();
+  keyboard->flag_bundle = g_mapped_file_new (bundle_filename, FALSE, NULL);
+  g_free (bundle_filename);
 
+  if (backend != NULL)
+    {
+      keyboard->backend = g_object_ref (backend);
+
+      xkb_keyboard_layout_sets_changed (keyboard);
+      xkb_keyboard_update_from_backend (keyboard);
+      keyboard->current_group = xkb_backend_get_current_group (backend);
+
+      keyboard->group_changed_handler_id =
+        g_signal_connect (G_OBJECT (backend), "group-changed",
+                          G_CALLBACK (xkb_keyboard_backend_group_changed), keyboard);
+      keyboard->config_changed_handler_id =
+        g_signal_connect (G_OBJECT (backend), "config-changed",
+                          G_CALLBACK (xkb_keyboard_backend_config_changed), keyboard);
       keyboard->active_window_changed_handler_id =
-        g_signal_connect (G_OBJECT (keyboard->wnck_screen), "active-window-changed",
+        g_signal_connect (G_OBJECT (backend), "active-window-changed",
                           G_CALLBACK (xkb_keyboard_active_window_changed), keyboard);
       keyboard->application_closed_handler_id =
-        g_signal_connect (G_OBJECT (keyboard->wnck_screen), "application-closed",
+        g_signal_connect (G_OBJECT (backend), "application-closed",
                           G_CALLBACK (xkb_keyboard_application_closed), keyboard);
       keyboard->window_closed_handler_id =
-        g_signal_connect (G_OBJECT (keyboard->wnck_screen), "window-closed",
+        g_signal_connect (G_OBJECT (backend), "window-closed",
                           G_CALLBACK (xkb_keyboard_window_closed), keyboard);
+      keyboard->workspace_changed_handler_id =
+        g_signal_connect (G_OBJECT (backend), "workspace-changed",
+                          G_CALLBACK (xkb_keyboard_workspace_changed), keyboard);
     }
 
   return keyboard;
@@ -225,126 +399,249 @@ xkb_keyboard_get_initialized (XkbKeyboard *keyboard)
 {
   g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
 
-  return G_LIKELY (keyboard->engine != NULL);
+  return G_LIKELY (keyboard->backend != NULL);
 }
 
 
 
-static gchar *
-xkb_keyboard_xkb_description (XklConfigItem *config_item)
+/*
+ * Returns the backend the keyboard runs on, or NULL. The keyboard keeps
+ * the reference.
+ */
+XkbBackend *
+xkb_keyboard_get_backend (XkbKeyboard *keyboard)
 {
-  gchar *ci_description;
-  gchar *description;
-
-  ci_description = g_strstrip (config_item->description);
-
-  if (ci_description[0] == 0)
-    description = g_strdup (config_item->name);
-  else
-    description = g_strdup (ci_description);
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), NULL);
 
-  return description;
+  return keyboard->backend;
 }
 
 
 
-static gchar*
-xkb_keyboard_create_pretty_layout_name (XklConfigRegistry *registry,
-                                        XklConfigItem     *config_item,
-                                        gchar             *layout_name,
-                                        gchar             *layout_variant)
+static XkbCairoFlag *
+xkb_keyboard_load_flag (XkbKeyboard *keyboard,
+                        const gchar *group_name)
 {
-  gchar *pretty_layout_name;
+  XkbCairoFlag *flag = NULL;
+  gchar        *filename;
 
-  g_snprintf (config_item->name, sizeof (config_item->name),
-              "%s", layout_variant);
-  if (xkl_config_registry_find_variant (registry, layout_name, config_item))
+  /* flags installed by the user override the compiled ones */
+  filename = xkb_util_get_user_flag_filename (group_name);
+  if (filename != NULL)
     {
-      pretty_layout_name = xkb_keyboard_xkb_description (config_item);
+      flag = xkb_cairo_flag_new_from_svg (filename);
+      g_free (filename);
     }
-  else
+
+  if (flag == NULL && keyboard->flag_bundle != NULL)
+    flag = xkb_cairo_flag_new_from_bundle (keyboard->flag_bundle, group_name);
+
+  /* flags the compiler could not handle are only available as SVG */
+  if (flag == NULL)
     {
-      g_snprintf (config_item->name, sizeof (config_item->name),
-                 "%s", layout_name);
-      if (xkl_config_registry_find_layout (registry, config_item))
-        pretty_layout_name = xkb_keyboard_xkb_description (config_item);
-      else
-        pretty_layout_name = xkb_util_get_layout_string (layout_name, layout_variant);
+      filename = xkb_util_get_flag_filename (group_name);
+      flag = xkb_cairo_flag_new_from_svg (filename);
+      g_free (filename);
     }
 
-  return pretty_layout_name;
+  return flag;
 }
 
 
 
-static gchar *
-xkb_keyboard_obtain_language_name (XklConfigRegistry *registry,
-                                   XklConfigItem     *config_item,
-                                   gchar             *layout_name)
+static void
+xkb_keyboard_group_data_free (XkbGroupData *group_data)
 {
-  g_snprintf (config_item->name, sizeof (config_item->name),
-              "%s", layout_name);
+  g_free (group_data->country_name);
+  g_free (group_data->language_name);
+  g_free (group_data->variant);
+  g_free (group_data->pretty_layout_name);
 
-  if (xkl_config_registry_find_layout (registry, config_item))
-    return g_strdup (config_item->short_description);
-  else
-    return g_strdup (layout_name);
+  xkb_cairo_flag_free (group_data->display_flag);
+
+  if (group_data->icon_surfaces)
+    g_hash_table_destroy (group_data->icon_surfaces);
+
+  memset (group_data, 0, sizeof (XkbGroupData));
+}
+
+
+
+static gboolean
+xkb_keyboard_group_data_matches (const XkbGroupData *group_data,
+                                 const gchar        *layout,
+                                 const gchar        *variant)
+{
+  return group_data->country_name != NULL &&
+         g_strcmp0 (group_data->country_name, layout) == 0 &&
+         g_strcmp0 (group_data->variant, variant) == 0;
+}
+
+
+
+/*
+ * Returns the index of the first layout set which contains the given
+ * layout and variant, or -1.
+ */
+static gint
+xkb_keyboard_find_layout_set (XkbKeyboard *keyboard,
+                              const gchar *layout,
+                              const gchar *variant)
+{
+  XkbLayoutSet *layout_set;
+  guint         i;
+  gint          j;
+
+  for (i = 0; i < keyboard->layout_sets->len; i++)
+    {
+      layout_set = g_ptr_array_index (keyboard->layout_sets, i);
+
+      for (j = 0; layout_set->layouts[j] != NULL; j++)
+        {
+          if (g_strcmp0 (layout_set->layouts[j], layout) == 0 &&
+              g_strcmp0 (layout_set->variants[j], variant) == 0)
+            return i;
+        }
+    }
+
+  return -1;
 }
 
 
 
 static void
-xkb_keyboard_initialize_xkb_options (XkbKeyboard        *keyboard,
-                                     const XklConfigRec *config_rec)
+xkb_keyboard_initialize_xkb_options (XkbKeyboard  *keyboard,
+                                     gchar       **layouts,
+                                     gchar       **variants)
 {
   GHashTable         *country_indexes, *language_indexes;
-  gchar             **group;
-  gint                val, i;
+  gint                val, i, j;
   gpointer            pval;
-  gchar              *imgfilename;
-  XklConfigRegistry  *registry;
-  XklConfigItem      *config_item;
+  XkbGroupData       *old_group_data;
+  gint                old_group_count;
+  guint               new_groups = 0;
+  gchar             **pretty_names, **language_names;
+  gboolean            snapshot_valid = FALSE;
+
+  xkb_trace_begin ("initialize-xkb-options");
+  XKB_PROBE_REBUILD_START (g_strv_length (layouts));
+  xkb_trace_begin ("reuse-groups");
+
+  /* keep the old table around, groups which did not change are moved
+   * over instead of being rebuilt */
+  old_group_data = keyboard->group_data;
+  old_group_count = keyboard->group_count;
+  keyboard->group_data = NULL;
 
   xkb_keyboard_free (keyboard);
 
-  group = config_rec->layouts;
-  keyboard->group_count = 0;
-  while (*group)
-    {
-      group++;
-      keyboard->group_count++;
-    }
+  keyboard->group_count = g_strv_length (layouts);
 
   keyboard->window_map = g_hash_table_new (g_direct_hash, NULL);
   keyboard->application_map = g_hash_table_new (g_direct_hash, NULL);
   keyboard->group_data = (XkbGroupData *) g_new0 (XkbGroupData, keyboard->group_count);
+  keyboard->changed_groups = 0;
   country_indexes = g_hash_table_new (g_str_hash, g_str_equal);
   language_indexes = g_hash_table_new (g_str_hash, g_str_equal);
 
-  registry = xkl_config_registry_get_instance (keyboard->engine);
-  xkl_config_registry_load (registry, FALSE);
-  config_item = xkl_config_item_new ();
+  for (i = 0; i < keyboard->group_count; i++)
+    {
+      XkbGroupData *group_data = &keyboard->group_data[i];
+
+      if (i >= old_group_count ||
+          !xkb_keyboard_group_data_matches (&old_group_data[i], layouts[i], variants[i]))
+        {
+          keyboard->changed_groups |= 1 << i;
+        }
+
+      /* a group may have only moved to another position */
+      for (j = 0; j < old_group_count; j++)
+        {
+          if (xkb_keyboard_group_data_matches (&old_group_data[j], layouts[i], variants[i]))
+            {
+              *group_data = old_group_data[j];
+              memset (&old_group_data[j], 0, sizeof (XkbGroupData));
+              break;
+            }
+        }
+
+      if (group_data->country_name == NULL)
+        {
+          gchar    *key = g_strconcat (layouts[i], "(", variants[i], ")", NULL);
+          gpointer  orig_key, warm_group;
+
+          if (g_hash_table_lookup_extended (keyboard->warm_groups, key, &orig_key, &warm_group))
+            {
+              g_hash_table_steal (keyboard->warm_groups, key);
+              *group_data = *(XkbGroupData *) warm_group;
+              g_free (warm_group);
+              g_free (orig_key);
+            }
+          else
+            new_groups |= 1 << i;
+
+          g_free (key);
+        }
+    }
+
+  xkb_trace_end ("reuse-groups");
+
+  /* only groups seen for the first time need a registry lookup, and
+   * none of them when the last run had the same configuration */
+  xkb_trace_begin ("describe-groups");
+
+  pretty_names = g_new0 (gchar *, keyboard->group_count + 1);
+  language_names = g_new0 (gchar *, keyboard->group_count + 1);
+
+  if (new_groups != 0 && keyboard->snapshot != NULL &&
+      xkb_snapshot_get_groups (keyboard->snapshot,
+                               (const gchar * const *) layouts,
+                               (const gchar * const *) variants,
+                               pretty_names, language_names))
+    {
+      for (i = 0; i < keyboard->group_count; i++)
+        {
+          if (!(new_groups & (1 << i)))
+            {
+              g_clear_pointer (&pretty_names[i], g_free);
+              g_clear_pointer (&language_names[i], g_free);
+            }
+        }
+
+      snapshot_valid = TRUE;
+    }
+  else
+    {
+      xkb_backend_describe_groups (keyboard->backend,
+                                   (const gchar * const *) layouts,
+                                   (const gchar * const *) variants,
+                                   new_groups, pretty_names, language_names);
+    }
+
+  xkb_trace_end ("describe-groups");
+  xkb_trace_begin ("build-groups");
 
   for (i = 0; i < keyboard->group_count; i++)
     {
       XkbGroupData *group_data = &keyboard->group_data[i];
-      RsvgHandle *handle;
 
-      group_data->country_name = g_strdup (config_rec->layouts[i]);
+      if (new_groups & (1 << i))
+        {
+          group_data->country_name = g_strdup (layouts[i]);
+          group_data->variant = g_strdup (variants[i]);
+          group_data->pretty_layout_name = pretty_names[i];
+          group_data->language_name = language_names[i];
 
-      group_data->variant = (config_rec->variants[i] == NULL)
-                            ? g_strdup ("") : g_strdup (config_rec->variants[i]);
+          if (group_data->pretty_layout_name == NULL)
+            group_data->pretty_layout_name = xkb_util_get_layout_string (layouts[i], variants[i]);
 
-      group_data->pretty_layout_name =
-        xkb_keyboard_create_pretty_layout_name (registry,
-                                                config_item,
-                                                group_data->country_name,
-                                                group_data->variant);
+          if (group_data->language_name == NULL)
+            group_data->language_name = g_strdup (layouts[i]);
 
-      group_data->language_name =
-        xkb_keyboard_obtain_language_name (registry,
-                                           config_item,
-                                           group_data->country_name);
+          group_data->display_flag = xkb_keyboard_load_flag (keyboard, group_data->country_name);
+          group_data->icon_surfaces = g_hash_table_new_full (g_direct_hash, NULL, NULL,
+                                                             (GDestroyNotify) cairo_surface_destroy);
+        }
 
       #define MODIFY_INDEXES(table, name, index) \
         pval = g_hash_table_lookup (table, group_data->name); \
@@ -357,24 +654,71 @@ xkb_keyboard_initialize_xkb_options (XkbKeyboard        *keyboard,
       MODIFY_INDEXES (language_indexes, language_name, language_index);
 
       #undef MODIFY_INDEXES
+    }
+
+  /* the names were moved into the group data */
+  g_free (pretty_names);
+  g_free (language_names);
+
+  xkb_trace_end ("build-groups");
+
+  if (keyboard->snapshot != NULL && !snapshot_valid)
+    {
+      xkb_trace_begin ("save-snapshot");
+
+      pretty_names = g_new0 (gchar *, keyboard->group_count + 1);
+      language_names = g_new0 (gchar *, keyboard->group_count + 1);
+
+      for (i = 0; i < keyboard->group_count; i++)
+        {
+          pretty_names[i] = keyboard->group_data[i].pretty_layout_name;
+          language_names[i] = keyboard->group_data[i].language_name;
+        }
+
+      xkb_snapshot_set_groups (keyboard->snapshot,
+                               (const gchar * const *) layouts,
+                               (const gchar * const *) variants,
+                               (const gchar * const *) pretty_names,
+                               (const gchar * const *) language_names);
+      xkb_snapshot_save (keyboard->snapshot);
+
+      /* the names are still owned by the group data */
+      g_free (pretty_names);
+      g_free (language_names);
+
+      xkb_trace_end ("save-snapshot");
+    }
+
+  xkb_trace_begin ("retire-groups");
 
-      imgfilename = xkb_util_get_flag_filename (group_data->country_name);
-      handle = rsvg_handle_new_from_file (imgfilename, NULL);
-      if (handle)
+  for (j = 0; j < old_group_count; j++)
+    {
+      if (old_group_data[j].country_name == NULL)
+        continue;
+
+      /* groups of a layout set which is being left stay around */
+      if (xkb_keyboard_find_layout_set (keyboard, old_group_data[j].country_name,
+                                        old_group_data[j].variant) >= 0)
         {
-          group_data->display_pixbuf = rsvg_handle_get_pixbuf (handle);
-          group_data->tooltip_pixbuf = gdk_pixbuf_scale_simple (group_data->display_pixbuf,
-                                                                30, 22, GDK_INTERP_BILINEAR);
-          rsvg_handle_close (handle, NULL);
-          g_object_unref (handle);
+          XkbGroupData *warm_group = g_new (XkbGroupData, 1);
+
+          *warm_group = old_group_data[j];
+          g_hash_table_replace (keyboard->warm_groups,
+                                g_strconcat (warm_group->country_name, "(",
+                                             warm_group->variant, ")", NULL),
+                                warm_group);
         }
-      g_free (imgfilename);
+      else
+        xkb_keyboard_group_data_free (&old_group_data[j]);
     }
+  g_free (old_group_data);
 
-  g_object_unref (config_item);
-  g_object_unref (registry);
   g_hash_table_destroy (country_indexes);
   g_hash_table_destroy (language_indexes);
+
+  xkb_trace_end ("retire-groups");
+  XKB_PROBE_REBUILD_END (keyboard->group_count);
+  xkb_trace_end ("initialize-xkb-options");
 }
 
 
@@ -382,34 +726,27 @@ xkb_keyboard_initialize_xkb_options (XkbKeyboard        *keyboard,
 static void
 xkb_keyboard_free (XkbKeyboard *keyboard)
 {
-  gint          i;
-  XkbGroupData *group_data;
+  gint i;
 
   if (keyboard->window_map)
-    g_hash_table_destroy (keyboard->window_map);
+    {
+      g_hash_table_destroy (keyboard->window_map);
+      keyboard->window_map = NULL;
+    }
 
   if (keyboard->application_map)
-    g_hash_table_destroy (keyboard->application_map);
+    {
+      g_hash_table_destroy (keyboard->application_map);
+      keyboard->application_map = NULL;
+    }
 
   if (keyboard->group_data)
     {
       for (i = 0; i < keyboard->group_count; i++)
-        {
-          group_data = &keyboard->group_data[i];
-
-          g_free (group_data->country_name);
-          g_free (group_data->language_name);
-          g_free (group_data->variant);
-          g_free (group_data->pretty_layout_name);
-
-          if (group_data->display_pixbuf)
-            g_object_unref (group_data->display_pixbuf);
-
-          if (group_data->tooltip_pixbuf)
-            g_object_unref (group_data->tooltip_pixbuf);
-        }
+        xkb_keyboard_group_data_free (&keyboard->group_data[i]);
 
       g_free (keyboard->group_data);
+      keyboard->group_data = NULL;
     }
 }
 
@@ -420,31 +757,44 @@ xkb_keyboard_finalize (GObject *object)
 {
   XkbKeyboard *keyboard = XKB_KEYBOARD (object);
 
-  if (keyboard->engine)
+  if (keyboard->backend != NULL)
     {
-      xkl_engine_stop_listen (keyboard->engine, XKLL_TRACK_KEYBOARD_STATE);
-      g_object_unref (keyboard->engine);
-
-      gdk_window_remove_filter (NULL, xkb_keyboard_handle_xevent, keyboard);
+      g_signal_handler_disconnect (keyboard->backend, keyboard->group_changed_handler_id);
+      g_signal_handler_disconnect (keyboard->backend, keyboard->config_changed_handler_id);
+      g_signal_handler_disconnect (keyboard->backend, keyboard->active_window_changed_handler_id);
+      g_signal_handler_disconnect (keyboard->backend, keyboard->application_closed_handler_id);
+      g_signal_handler_disconnect (keyboard->backend, keyboard->window_closed_handler_id);
+      g_signal_handler_disconnect (keyboard->backend, keyboard->workspace_changed_handler_id);
+
+      g_object_unref (keyboard->backend);
     }
 
   xkb_keyboard_free (keyboard);
 
-  if (keyboard->last_config_rec != NULL)
-    g_object_unref (keyboard->last_config_rec);
+  if (keyboard->flag_bundle != NULL)
+    g_mapped_file_unref (keyboard->flag_bundle);
 
-  if (keyboard->config_timeout_id != 0)
-    g_source_remove (keyboard->config_timeout_id);
+  if (keyboard->snapshot != NULL)
+    g_object_unref (keyboard->snapshot);
 
-  if (keyboard->active_window_changed_handler_id > 0)
-    g_signal_handler_disconnect (keyboard->wnck_screen, keyboard->active_window_changed_handler_id);
+  g_strfreev (keyboard->last_layouts);
+  g_strfreev (keyboard->last_variants);
 
-  if (keyboard->application_closed_handler_id > 0)
-    g_signal_handler_disconnect (keyboard->wnck_screen, keyboard->application_closed_handler_id);
+  if (keyboard->class_store != NULL)
+    g_object_unref (keyboard->class_store);
+  g_free (keyboard->current_wm_class);
 
-  if (keyboard->window_closed_handler_id > 0)
-    g_signal_handler_disconnect (keyboard->wnck_screen, keyboard->window_closed_handler_id);
+  if (keyboard->group_rules != NULL)
+    g_object_unref (keyboard->group_rules);
+  g_hash_table_destroy (keyboard->seen_windows);
+
+  g_ptr_array_unref (keyboard->layout_sets);
+  g_hash_table_destroy (keyboard->warm_groups);
+
+  if (keyboard->config_timeout_id != 0)
+    g_source_remove (keyboard->config_timeout_id);
 
+  g_signal_handlers_disconnect_by_data (keyboard->config, keyboard);
   g_object_unref (keyboard->config);
 
   G_OBJECT_CLASS (xkb_keyboard_parent_class)->finalize (object);
@@ -458,12 +808,21 @@ xkb_keyboard_set_group (XkbKeyboard *keyboard,
 {
   g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
 
-  if (G_UNLIKELY (keyboard->engine == NULL || group < 0 || group >= keyboard->group_count))
+  if (G_UNLIKELY (keyboard->backend == NULL || group < 0 || group >= keyboard->group_count))
     return FALSE;
 
-  xkl_engine_lock_group (keyboard->engine, group);
+  xkb_audit_begin (XKB_AUDIT_OP_GROUP_SWITCH);
+
+  if (!xkb_backend_lock_group (keyboard->backend, group))
+    {
+      xkb_audit_end (XKB_AUDIT_OP_GROUP_SWITCH);
+      return FALSE;
+    }
+
   keyboard->current_group = group;
 
+  xkb_audit_end (XKB_AUDIT_OP_GROUP_SWITCH);
+
   return TRUE;
 }
 
@@ -474,12 +833,11 @@ xkb_keyboard_next_group (XkbKeyboard *keyboard)
 {
   g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
 
-  if (G_UNLIKELY (keyboard->engine == NULL))
+  if (G_UNLIKELY (keyboard->backend == NULL))
     return FALSE;
 
-  xkl_engine_lock_group (keyboard->engine, xkl_engine_get_next_group (keyboard->engine));
-
-  return TRUE;
+  return xkb_backend_lock_group (keyboard->backend,
+                                 xkb_backend_get_next_group (keyboard->backend));
 }
 
 
@@ -489,73 +847,359 @@ xkb_keyboard_prev_group (XkbKeyboard *keyboard)
 {
   g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
 
-  if (G_UNLIKELY (keyboard->engine == NULL))
+  if (G_UNLIKELY (keyboard->backend == NULL))
+    return FALSE;
+
+  return xkb_backend_lock_group (keyboard->backend,
+                                 xkb_backend_get_prev_group (keyboard->backend));
+}
+
+
+
+gint
+xkb_keyboard_get_layout_set_count (XkbKeyboard *keyboard)
+{
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), 0);
+
+  return keyboard->layout_sets->len;
+}
+
+
+
+/*
+ * Returns the layout set matching the running configuration, or -1 when
+ * the configuration is not one of the sets.
+ */
+gint
+xkb_keyboard_get_current_layout_set (XkbKeyboard *keyboard)
+{
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), -1);
+
+  return keyboard->current_layout_set;
+}
+
+
+
+/*
+ * Replaces the running groups with the given layout set and locks the
+ * given group of it. The keyboard is updated right away instead of
+ * waiting for the backend to report the new configuration.
+ */
+static gboolean
+xkb_keyboard_switch_layout_set (XkbKeyboard *keyboard,
+                                gint         set,
+                                gint         group)
+{
+  XkbLayoutSet *layout_set;
+
+  if (set == keyboard->current_layout_set)
+    return group == keyboard->current_group || xkb_keyboard_set_group (keyboard, group);
+
+  layout_set = g_ptr_array_index (keyboard->layout_sets, set);
+
+  if (!xkb_backend_activate_config (keyboard->backend,
+                                    (const gchar * const *) layout_set->layouts,
+                                    (const gchar * const *) layout_set->variants))
     return FALSE;
 
-  xkl_engine_lock_group (keyboard->engine, xkl_engine_get_prev_group (keyboard->engine));
+  keyboard->config_activated_time = g_get_monotonic_time ();
+
+  if (xkb_keyboard_update_from_backend (keyboard))
+    {
+      xkb_keyboard_set_group (keyboard, group);
+
+      g_signal_emit (G_OBJECT (keyboard),
+                     xkb_keyboard_signals[STATE_CHANGED],
+                     0, TRUE);
+    }
 
   return TRUE;
 }
 
 
 
+/*
+ * Replaces the running groups with the given layout set, the first group
+ * of the set becomes active.
+ */
+gboolean
+xkb_keyboard_set_layout_set (XkbKeyboard *keyboard,
+                             gint         set)
+{
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
+
+  if (G_UNLIKELY (keyboard->backend == NULL || set < 0 || set >= (gint) keyboard->layout_sets->len))
+    return FALSE;
+
+  if (set == keyboard->current_layout_set)
+    return TRUE;
+
+  return xkb_keyboard_switch_layout_set (keyboard, set, 0);
+}
+
+
+
+gboolean
+xkb_keyboard_next_layout_set (XkbKeyboard *keyboard)
+{
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
+
+  if (keyboard->layout_sets->len == 0)
+    return FALSE;
+
+  return xkb_keyboard_set_layout_set (keyboard,
+                                      (keyboard->current_layout_set + 1) % keyboard->layout_sets->len);
+}
+
+
+
+/*
+ * Switches to the given layout, activating the first layout set which
+ * contains it when it is not one of the running groups.
+ */
+gboolean
+xkb_keyboard_activate_layout (XkbKeyboard *keyboard,
+                              const gchar *layout,
+                              const gchar *variant)
+{
+  XkbLayoutSet *layout_set;
+  guint         i;
+  gint          j;
+
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), FALSE);
+  g_return_val_if_fail (layout != NULL, FALSE);
+
+  j = xkb_keyboard_find_group (keyboard, layout, variant);
+  if (j >= 0)
+    return xkb_keyboard_set_group (keyboard, j);
+
+  for (i = 0; i < keyboard->layout_sets->len; i++)
+    {
+      layout_set = g_ptr_array_index (keyboard->layout_sets, i);
+
+      for (j = 0; layout_set->layouts[j] != NULL; j++)
+        {
+          if (g_strcmp0 (layout_set->layouts[j], layout) == 0 &&
+              (variant == NULL || g_strcmp0 (layout_set->variants[j], variant) == 0))
+            {
+              return xkb_keyboard_switch_layout_set (keyboard, i, j);
+            }
+        }
+    }
+
+  return FALSE;
+}
+
+
+
 static void
 xkb_keyboard_group_policy_changed (XkbKeyboard *keyboard)
 {
   keyboard->group_policy = xkb_xfconf_get_group_policy (keyboard->config);
+
+  /* the store is only opened once the policy is used */
+  if (keyboard->group_policy == GROUP_POLICY_PER_WINDOW_CLASS && keyboard->class_store == NULL)
+    keyboard->class_store = xkb_class_store_new ();
+}
+
+
+
+static void
+xkb_keyboard_group_rules_changed (XkbKeyboard *keyboard)
+{
+  const gchar * const *rules;
+
+  if (keyboard->group_rules != NULL)
+    {
+      g_object_unref (keyboard->group_rules);
+      keyboard->group_rules = NULL;
+    }
+
+  rules = xkb_xfconf_get_group_rules (keyboard->config);
+  if (rules != NULL && *rules != NULL)
+    keyboard->group_rules = xkb_group_rules_new (rules);
+
+  /* windows which already showed up keep their layout */
+}
+
+
+
+/*
+ * Returns the group the rules give a window on its first activation,
+ * or -1 when no rule applies.
+ */
+static gint
+xkb_keyboard_match_group_rules (XkbKeyboard *keyboard,
+                                guint        window_id,
+                                const gchar *wm_class,
+                                const gchar *title)
+{
+  const gchar *layout, *variant;
+
+  if (keyboard->group_rules == NULL ||
+      g_hash_table_contains (keyboard->seen_windows, GUINT_TO_POINTER (window_id)))
+    return -1;
+
+  g_hash_table_add (keyboard->seen_windows, GUINT_TO_POINTER (window_id));
+
+  if (!xkb_group_rules_match (keyboard->group_rules, wm_class, title, &layout, &variant))
+    return -1;
+
+  return xkb_keyboard_find_group (keyboard, layout, variant);
 }
 
 
 
 static gboolean
-xkb_keyboard_xkl_config_rec_equals (const XklConfigRec *rec1,
-                                    const XklConfigRec *rec2)
+xkb_keyboard_strv_equals (gchar **array1,
+                          gchar **array2)
 {
   gint i;
 
-  g_return_val_if_fail (XKL_IS_CONFIG_REC (rec1), FALSE);
-  g_return_val_if_fail (XKL_IS_CONFIG_REC (rec2), FALSE);
+  for (i = 0; array1[i] || array2[i]; i++)
+    {
+      if (!array1[i] || !array2[i] || g_ascii_strcasecmp (array1[i], array2[i]) != 0)
+        return FALSE;
+    }
 
-  #define STRING_ARRAYS_NOT_EQUAL_RETURN(array1, array2) \
-    for (i = 0; array1[i] || array2[i]; i++) \
-      { \
-        if (!array1[i] || !array2[i] || g_ascii_strcasecmp (array1[i], array2[i]) != 0) \
-          return FALSE; \
-      }
+  return TRUE;
+}
 
-  STRING_ARRAYS_NOT_EQUAL_RETURN (rec1->layouts, rec2->layouts);
-  STRING_ARRAYS_NOT_EQUAL_RETURN (rec1->variants, rec2->variants);
 
-  #undef STRING_ARRAYS_NOT_EQUAL_RETURN
 
-  return TRUE;
+/*
+ * Parses a layout set of the form "us,de(nodeadkeys),ru". Returns NULL
+ * when the description contains no layout.
+ */
+static XkbLayoutSet *
+xkb_keyboard_layout_set_new (const gchar *description,
+                             guint        max_group_count)
+{
+  XkbLayoutSet  *layout_set;
+  gchar        **items;
+  gchar         *item, *variant;
+  guint          i, n = 0;
+
+  items = g_strsplit (description, ",", -1);
+
+  layout_set = g_new0 (XkbLayoutSet, 1);
+  layout_set->layouts = g_new0 (gchar *, g_strv_length (items) + 1);
+  layout_set->variants = g_new0 (gchar *, g_strv_length (items) + 1);
+
+  for (i = 0; items[i] != NULL && n < max_group_count; i++)
+    {
+      item = g_strstrip (items[i]);
+      if (*item == '\0')
+        continue;
+
+      variant = strchr (item, '(');
+      if (variant != NULL && g_str_has_suffix (variant, ")"))
+        {
+          *variant++ = '\0';
+          variant[strlen (variant) - 1] = '\0';
+        }
+      else
+        variant = "";
+
+      layout_set->layouts[n] = g_strdup (item);
+      layout_set->variants[n] = g_strdup (variant);
+      n++;
+    }
+
+  g_strfreev (items);
+
+  if (n == 0)
+    {
+      xkb_keyboard_layout_set_free (layout_set);
+      return NULL;
+    }
+
+  return layout_set;
+}
+
+
+
+static void
+xkb_keyboard_update_current_layout_set (XkbKeyboard *keyboard)
+{
+  XkbLayoutSet *layout_set;
+  guint         i;
+
+  keyboard->current_layout_set = -1;
+
+  if (keyboard->last_layouts == NULL)
+    return;
+
+  for (i = 0; i < keyboard->layout_sets->len; i++)
+    {
+      layout_set = g_ptr_array_index (keyboard->layout_sets, i);
+
+      if (xkb_keyboard_strv_equals (layout_set->layouts, keyboard->last_layouts) &&
+          xkb_keyboard_strv_equals (layout_set->variants, keyboard->last_variants))
+        {
+          keyboard->current_layout_set = i;
+          return;
+        }
+    }
+}
+
+
+
+static void
+xkb_keyboard_layout_sets_changed (XkbKeyboard *keyboard)
+{
+  const gchar * const *descriptions;
+  XkbLayoutSet        *layout_set;
+  guint                max_group_count;
+
+  if (G_UNLIKELY (keyboard->backend == NULL))
+    return;
+
+  g_ptr_array_set_size (keyboard->layout_sets, 0);
+  g_hash_table_remove_all (keyboard->warm_groups);
+
+  max_group_count = xkb_backend_get_max_group_count (keyboard->backend);
+
+  descriptions = xkb_xfconf_get_layout_sets (keyboard->config);
+  for (; descriptions != NULL && *descriptions != NULL; descriptions++)
+    {
+      layout_set = xkb_keyboard_layout_set_new (*descriptions, max_group_count);
+      if (layout_set != NULL)
+        g_ptr_array_add (keyboard->layout_sets, layout_set);
+    }
+
+  xkb_keyboard_update_current_layout_set (keyboard);
 }
 
 
 
 static gboolean
-xkb_keyboard_update_from_xkl (XkbKeyboard *keyboard)
+xkb_keyboard_update_from_backend (XkbKeyboard *keyboard)
 {
-  XklConfigRec *config_rec;
+  gchar **layouts, **variants;
 
-  config_rec = xkl_config_rec_new ();
-  xkl_config_rec_get_from_server (config_rec, keyboard->engine);
+  xkb_backend_get_config (keyboard->backend, &layouts, &variants);
 
-  if (keyboard->last_config_rec == NULL ||
-      !xkb_keyboard_xkl_config_rec_equals (config_rec, keyboard->last_config_rec))
+  if (keyboard->last_layouts == NULL ||
+      !xkb_keyboard_strv_equals (layouts, keyboard->last_layouts) ||
+      !xkb_keyboard_strv_equals (variants, keyboard->last_variants))
     {
-      xkb_keyboard_initialize_xkb_options (keyboard, config_rec);
+      xkb_keyboard_initialize_xkb_options (keyboard, layouts, variants);
 
-      if (keyboard->last_config_rec != NULL)
-        g_object_unref (keyboard->last_config_rec);
+      g_strfreev (keyboard->last_layouts);
+      g_strfreev (keyboard->last_variants);
 
-      keyboard->last_config_rec = config_rec;
+      keyboard->last_layouts = layouts;
+      keyboard->last_variants = variants;
+
+      xkb_keyboard_update_current_layout_set (keyboard);
 
       return TRUE;
     }
   else
     {
-      g_object_unref (config_rec);
+      g_strfreev (layouts);
+      g_strfreev (variants);
 
       return FALSE;
     }
@@ -564,31 +1208,28 @@ xkb_keyboard_update_from_xkl (XkbKeyboard *keyboard)
 
 
 static void
-xkb_keyboard_active_window_changed (WnckScreen  *screen,
-                                    WnckWindow  *previously_active_window,
-                                    XkbKeyboard *keyboard)
+xkb_keyboard_restore_window_group (XkbKeyboard *keyboard,
+                                   guint        window_id,
+                                   guint        application_id,
+                                   const gchar *wm_class,
+                                   const gchar *title)
 {
-  gint        group = 0;
+  gint        group = 0, rule_group;
   gpointer    key, value;
   GHashTable *hashtable = NULL;
   guint       id = 0;
-  WnckWindow *window;
-  guint       window_id, application_id;
-
-  g_return_if_fail (IS_XKB_KEYBOARD (keyboard));
+  gchar      *layout, *variant;
 
-  window = wnck_screen_get_active_window (screen);
-
-  if (!WNCK_IS_WINDOW (window))
-    return;
-
-  window_id = wnck_window_get_xid (window);
-  application_id = wnck_window_get_pid (window);
+  /* rules only give defaults, a remembered group wins */
+  rule_group = xkb_keyboard_match_group_rules (keyboard, window_id, wm_class, title);
 
   switch (keyboard->group_policy)
     {
     case GROUP_POLICY_GLOBAL:
-       return;
+    case GROUP_POLICY_PER_WORKSPACE:
+      if (rule_group >= 0)
+        xkb_keyboard_set_group (keyboard, rule_group);
+      return;
 
     case GROUP_POLICY_PER_WINDOW:
       hashtable = keyboard->window_map;
@@ -601,12 +1242,36 @@ xkb_keyboard_active_window_changed (WnckScreen  *screen,
       id = application_id;
       keyboard->current_application_id = id;
       break;
+
+    case GROUP_POLICY_PER_WINDOW_CLASS:
+      g_free (keyboard->current_wm_class);
+      keyboard->current_wm_class = g_strdup (wm_class);
+
+      /* new classes, and classes whose layout is not configured now,
+       * start in the group of their rule or the first one */
+      group = -1;
+      if (wm_class != NULL &&
+          xkb_class_store_lookup (keyboard->class_store, wm_class, &layout, &variant))
+        {
+          group = xkb_keyboard_find_group (keyboard, layout, variant);
+          g_free (layout);
+          g_free (variant);
+        }
+
+      if (group < 0)
+        group = MAX (rule_group, 0);
+
+      xkb_keyboard_set_group (keyboard, group);
+      return;
     }
 
   if (g_hash_table_lookup_extended (hashtable, GINT_TO_POINTER (id), &key, &value))
     group = GPOINTER_TO_INT (value);
   else
-    g_hash_table_insert (hashtable, GINT_TO_POINTER (id), GINT_TO_POINTER (group));
+    {
+      group = MAX (rule_group, 0);
+      g_hash_table_insert (hashtable, GINT_TO_POINTER (id), GINT_TO_POINTER (group));
+    }
 
   xkb_keyboard_set_group (keyboard, group);
 }
@@ -614,55 +1279,88 @@ xkb_keyboard_active_window_changed (WnckScreen  *screen,
 
 
 static void
-xkb_keyboard_application_closed (WnckScreen      *screen,
-                                 WnckApplication *application,
-                                 XkbKeyboard     *keyboard)
+xkb_keyboard_active_window_changed (XkbBackend  *backend,
+                                    guint        window_id,
+                                    guint        application_id,
+                                    const gchar *wm_class,
+                                    const gchar *title,
+                                    XkbKeyboard *keyboard)
 {
-  guint application_id;
-
   g_return_if_fail (IS_XKB_KEYBOARD (keyboard));
 
-  application_id = wnck_application_get_pid (application);
+  xkb_trace_begin ("active-window-changed");
+  xkb_audit_begin (XKB_AUDIT_OP_FOCUS_CHANGE);
 
-  switch (keyboard->group_policy)
-    {
-    case GROUP_POLICY_GLOBAL:
-    case GROUP_POLICY_PER_WINDOW:
-      break;
+  xkb_keyboard_restore_window_group (keyboard, window_id, application_id, wm_class, title);
 
-    case GROUP_POLICY_PER_APPLICATION:
-      g_hash_table_remove (keyboard->application_map, GINT_TO_POINTER (application_id));
-      break;
-    }
+  xkb_audit_end (XKB_AUDIT_OP_FOCUS_CHANGE);
+  xkb_trace_end ("active-window-changed");
 }
 
 
 
+/*
+ * The application and window maps are cleaned whatever the policy is,
+ * since entries made under another one would never go away otherwise.
+ */
 static void
-xkb_keyboard_window_closed (WnckScreen  *screen,
-                            WnckWindow  *window,
+xkb_keyboard_application_closed (XkbBackend  *backend,
+                                 guint        application_id,
+                                 XkbKeyboard *keyboard)
+{
+  g_return_if_fail (IS_XKB_KEYBOARD (keyboard));
+
+  if (keyboard->application_map != NULL)
+    g_hash_table_remove (keyboard->application_map, GINT_TO_POINTER (application_id));
+}
+
+
+
+static void
+xkb_keyboard_window_closed (XkbBackend  *backend,
+                            guint        window_id,
                             XkbKeyboard *keyboard)
 {
-  guint window_id;
+  g_return_if_fail (IS_XKB_KEYBOARD (keyboard));
+
+  g_hash_table_remove (keyboard->seen_windows, GUINT_TO_POINTER (window_id));
+
+  if (keyboard->window_map != NULL)
+    g_hash_table_remove (keyboard->window_map, GINT_TO_POINTER (window_id));
+}
+
+
+
+/*
+ * The groups of the workspaces live in a fixed array, so memory does not
+ * depend on the number of windows and a switch is a single lock.
+ */
+static void
+xkb_keyboard_workspace_changed (XkbBackend  *backend,
+                                gint         workspace,
+                                XkbKeyboard *keyboard)
+{
+  gint group;
 
   g_return_if_fail (IS_XKB_KEYBOARD (keyboard));
 
-  window_id = wnck_window_get_xid (window);
+  keyboard->current_workspace = workspace;
 
-  switch (keyboard->group_policy)
-    {
-    case GROUP_POLICY_GLOBAL:
-    case GROUP_POLICY_PER_APPLICATION:
-      break;
+  if (keyboard->group_policy != GROUP_POLICY_PER_WORKSPACE ||
+      workspace < 0 || workspace >= XKB_KEYBOARD_MAX_WORKSPACES)
+    return;
 
-    case GROUP_POLICY_PER_WINDOW:
-      g_hash_table_remove (keyboard->window_map, GINT_TO_POINTER (window_id));
-      break;
-    }
+  group = keyboard->workspace_groups[workspace];
+  if (group >= keyboard->group_count)
+    group = 0;
+
+  if (group != keyboard->current_group)
+    xkb_keyboard_set_group (keyboard, group);
 }
 
 
 
+
 gint
 xkb_keyboard_get_group_count (XkbKeyboard *keyboard)
 {
@@ -673,15 +1371,29 @@ xkb_keyboard_get_group_count (XkbKeyboard *keyboard)
 
 
 
+/*
+ * Returns a bit mask of the groups whose layout or variant differs from
+ * the group at the same position before the last configuration change.
+ */
+guint
+xkb_keyboard_get_changed_groups (XkbKeyboard *keyboard)
+{
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), 0);
+
+  return keyboard->changed_groups;
+}
+
+
+
 guint
 xkb_keyboard_get_max_group_count (XkbKeyboard *keyboard)
 {
   g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), 0);
 
-  if (G_UNLIKELY (keyboard->engine == NULL))
+  if (G_UNLIKELY (keyboard->backend == NULL))
     return 0;
 
-  return xkl_engine_get_max_num_groups(keyboard->engine);
+  return xkb_backend_get_max_group_count (keyboard->backend);
 }
 
 
@@ -718,6 +1430,49 @@ xkb_keyboard_get_group_name (XkbKeyboard    *keyboard,
 
 
 
+const gchar*
+xkb_keyboard_get_variant (XkbKeyboard *keyboard,
+                          gint         group)
+{
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), NULL);
+
+  if (group == -1)
+    group = xkb_keyboard_get_current_group (keyboard);
+
+  if (G_UNLIKELY (group < 0 || group >= keyboard->group_count))
+    return NULL;
+
+  return keyboard->group_data[group].variant;
+}
+
+
+
+gint
+xkb_keyboard_find_group (XkbKeyboard *keyboard,
+                         const gchar *layout,
+                         const gchar *variant)
+{
+  XkbGroupData *group_data;
+  gint          group;
+
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), -1);
+  g_return_val_if_fail (layout != NULL, -1);
+
+  for (group = 0; group < keyboard->group_count; group++)
+    {
+      group_data = &keyboard->group_data[group];
+
+      /* without a variant the first group with the layout wins */
+      if (g_strcmp0 (group_data->country_name, layout) == 0 &&
+          (variant == NULL || g_strcmp0 (group_data->variant, variant) == 0))
+        return group;
+    }
+
+  return -1;
+}
+
+
+
 gint
 xkb_keyboard_get_variant_index (XkbKeyboard    *keyboard,
                                 XkbDisplayName  display_name,
@@ -751,49 +1506,68 @@ xkb_keyboard_get_variant_index (XkbKeyboard    *keyboard,
 
 
 static void
-xkb_keyboard_xkl_state_changed (XklEngine            *engine,
-                                XklEngineStateChange  change,
-                                gint                  group,
-                                gboolean              restore,
-                                XkbKeyboard          *keyboard)
+xkb_keyboard_backend_group_changed (XkbBackend  *backend,
+                                    gint         group,
+                                    XkbKeyboard *keyboard)
 {
-  if (change == GROUP_CHANGED)
+  xkb_trace_begin ("group-changed");
+  xkb_audit_begin (XKB_AUDIT_OP_GROUP_SWITCH);
+  XKB_PROBE_GROUP_LOCK_CONFIRMED (group);
+
+  keyboard->current_group = group;
+
+  switch (keyboard->group_policy)
     {
-      keyboard->current_group = group;
+    case GROUP_POLICY_GLOBAL:
+      break;
 
-      switch (keyboard->group_policy)
-        {
-        case GROUP_POLICY_GLOBAL:
-          break;
-
-        case GROUP_POLICY_PER_WINDOW:
-          g_hash_table_insert (keyboard->window_map,
-                               GINT_TO_POINTER (keyboard->current_window_id),
-                               GINT_TO_POINTER (group));
-          break;
-
-        case GROUP_POLICY_PER_APPLICATION:
-          g_hash_table_insert (keyboard->application_map,
-                               GINT_TO_POINTER (keyboard->current_application_id),
-                               GINT_TO_POINTER (group));
-          break;
-        }
+    case GROUP_POLICY_PER_WINDOW:
+      g_hash_table_insert (keyboard->window_map,
+                           GINT_TO_POINTER (keyboard->current_window_id),
+                           GINT_TO_POINTER (group));
+      break;
 
-      g_signal_emit (G_OBJECT (keyboard),
-                     xkb_keyboard_signals[STATE_CHANGED],
-                     0, FALSE);
+    case GROUP_POLICY_PER_APPLICATION:
+      g_hash_table_insert (keyboard->application_map,
+                           GINT_TO_POINTER (keyboard->current_application_id),
+                           GINT_TO_POINTER (group));
+      break;
+
+    case GROUP_POLICY_PER_WINDOW_CLASS:
+      if (keyboard->current_wm_class != NULL && group >= 0 && group < keyboard->group_count)
+        xkb_class_store_set (keyboard->class_store, keyboard->current_wm_class,
+                             keyboard->group_data[group].country_name,
+                             keyboard->group_data[group].variant);
+      break;
+
+    case GROUP_POLICY_PER_WORKSPACE:
+      if (keyboard->current_workspace >= 0
+          && keyboard->current_workspace < XKB_KEYBOARD_MAX_WORKSPACES)
+        keyboard->workspace_groups[keyboard->current_workspace] = group;
+      break;
     }
+
+  g_signal_emit (G_OBJECT (keyboard),
+                 xkb_keyboard_signals[STATE_CHANGED],
+                 0, FALSE);
+
+  xkb_audit_end (XKB_AUDIT_OP_GROUP_SWITCH);
+  xkb_trace_end ("group-changed");
 }
 
 
 
 static gboolean
-xkb_keyboard_xkl_config_changed_timeout (gpointer user_data)
+xkb_keyboard_config_changed_timeout (gpointer user_data)
 {
   XkbKeyboard *keyboard = user_data;
   gboolean     updated;
 
-  updated = xkb_keyboard_update_from_xkl (keyboard);
+  xkb_audit_count (XKB_AUDIT_CONFIG_TIMEOUT);
+  xkb_trace_begin ("config-changed-timeout");
+  xkb_audit_begin (XKB_AUDIT_OP_CONFIG_REBUILD);
+
+  updated = xkb_keyboard_update_from_backend (keyboard);
 
   if (updated)
     {
@@ -806,55 +1580,92 @@ xkb_keyboard_xkl_config_changed_timeout (gpointer user_data)
 
   keyboard->config_timeout_id = 0;
 
+  xkb_audit_end (XKB_AUDIT_OP_CONFIG_REBUILD);
+  xkb_trace_end ("config-changed-timeout");
+
   return G_SOURCE_REMOVE;
 }
 
 
 
 static void
-xkb_keyboard_xkl_config_changed (XklEngine   *engine,
-                                 XkbKeyboard *keyboard)
+xkb_keyboard_backend_config_changed (XkbBackend  *backend,
+                                     XkbKeyboard *keyboard)
 {
+  gboolean activated;
+
+  if (keyboard->config_activated_time != 0)
+    {
+      activated = g_get_monotonic_time () - keyboard->config_activated_time < G_USEC_PER_SEC;
+      keyboard->config_activated_time = 0;
+
+      if (activated)
+        return;
+    }
+
   if (keyboard->config_timeout_id != 0)
     g_source_remove (keyboard->config_timeout_id);
 
-  keyboard->config_timeout_id = g_timeout_add (100, xkb_keyboard_xkl_config_changed_timeout, keyboard);
+  keyboard->config_timeout_id = g_timeout_add (100, xkb_keyboard_config_changed_timeout, keyboard);
 }
 
 
 
-static GdkFilterReturn
-xkb_keyboard_handle_xevent (GdkXEvent *xev,
-                            GdkEvent  *event,
-                            gpointer   user_data)
+const XkbCairoFlag *
+xkb_keyboard_get_flag (XkbKeyboard *keyboard,
+                       gint         group)
 {
-  XkbKeyboard *keyboard = user_data;
-  XEvent      *xevent = (XEvent *) xev;
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), NULL);
 
-  xkl_engine_filter_events (keyboard->engine, xevent);
+  if (group == -1)
+    group = xkb_keyboard_get_current_group (keyboard);
 
-  return GDK_FILTER_CONTINUE;
+  if (G_UNLIKELY (group < 0 || group >= keyboard->group_count))
+    return NULL;
+
+  return keyboard->group_data[group].display_flag;
 }
 
 
 
-GdkPixbuf *
-xkb_keyboard_get_pixbuf (XkbKeyboard *keyboard,
-                         gboolean     tooltip,
-                         gint         group)
+/*
+ * Returns the flag icon used by the tooltip and the popup menu, rendered
+ * for the given scale factor. Icons are created on demand and kept per
+ * scale factor, so moving the panel between monitors of different density
+ * never rescales an existing raster.
+ */
+cairo_surface_t *
+xkb_keyboard_get_icon_surface (XkbKeyboard *keyboard,
+                               gint         group,
+                               gint         scale_factor)
 {
+  XkbGroupData    *group_data;
+  cairo_surface_t *surface;
+
   g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), NULL);
 
   if (group == -1)
     group = xkb_keyboard_get_current_group (keyboard);
 
   if (G_UNLIKELY (group < 0 || group >= keyboard->group_count))
-    return 0;
+    return NULL;
 
-  if (tooltip)
-    return keyboard->group_data[group].tooltip_pixbuf;
-  else
-    return keyboard->group_data[group].display_pixbuf;
+  group_data = &keyboard->group_data[group];
+
+  if (group_data->display_flag == NULL)
+    return NULL;
+
+  scale_factor = MAX (scale_factor, 1);
+
+  surface = g_hash_table_lookup (group_data->icon_surfaces, GINT_TO_POINTER (scale_factor));
+  if (surface == NULL)
+    {
+      surface = xkb_cairo_flag_render_surface (group_data->display_flag,
+                                               ICON_WIDTH, ICON_HEIGHT, scale_factor);
+      g_hash_table_insert (group_data->icon_surfaces, GINT_TO_POINTER (scale_factor), surface);
+    }
+
+  return surface;
 }
 
 
@@ -30,9 +30,14 @@
 
 #include "xkb-xfconf.h"
 #include "xkb-properties.h"
+#include "xkb-cairo.h"
+#include "xkb-backend.h"
 
 G_BEGIN_DECLS
 
+/* workspaces beyond this share the global group */
+#define XKB_KEYBOARD_MAX_WORKSPACES   32
+
 typedef struct _XkbKeyboardClass      XkbKeyboardClass;
 typedef struct _XkbKeyboard           XkbKeyboard;
 
@@ -46,26 +51,48 @@ typedef struct _XkbKeyboard           XkbKeyboard;
 GType             xkb_keyboard_get_type                     (void)                           G_GNUC_CONST;
 
 XkbKeyboard      *xkb_keyboard_new                          (XkbXfconf       *config);
+XkbKeyboard      *xkb_keyboard_new_with_backend             (XkbXfconf       *config,
+                                                             XkbBackend      *backend);
 
 gboolean          xkb_keyboard_get_initialized              (XkbKeyboard     *keyboard);
+XkbBackend       *xkb_keyboard_get_backend                  (XkbKeyboard     *keyboard);
 
 gint              xkb_keyboard_get_group_count              (XkbKeyboard     *keyboard);
 guint             xkb_keyboard_get_max_group_count          (XkbKeyboard     *keyboard);
+guint             xkb_keyboard_get_changed_groups           (XkbKeyboard     *keyboard);
 const gchar*      xkb_keyboard_get_group_name               (XkbKeyboard     *keyboard,
                                                              XkbDisplayName   display_name,
                                                              gint             group);
+const gchar*      xkb_keyboard_get_variant                  (XkbKeyboard     *keyboard,
+                                                             gint             group);
 gint              xkb_keyboard_get_variant_index            (XkbKeyboard     *keyboard,
                                                              XkbDisplayName   display_name,
                                                              gint             group);
 
+gint              xkb_keyboard_find_group                   (XkbKeyboard     *keyboard,
+                                                             const gchar     *layout,
+                                                             const gchar     *variant);
+
 gboolean          xkb_keyboard_set_group                    (XkbKeyboard     *keyboard,
                                                              gint             group);
 gboolean          xkb_keyboard_next_group                   (XkbKeyboard     *keyboard);
 gboolean          xkb_keyboard_prev_group                   (XkbKeyboard     *keyboard);
 
-GdkPixbuf*        xkb_keyboard_get_pixbuf                   (XkbKeyboard     *keyboard,
-                                                             gboolean         tooltip,
+gint              xkb_keyboard_get_layout_set_count         (XkbKeyboard     *keyboard);
+gint              xkb_keyboard_get_current_layout_set       (XkbKeyboard     *keyboard);
+gboolean          xkb_keyboard_set_layout_set               (XkbKeyboard     *keyboard,
+                                                             gint             set);
+gboolean          xkb_keyboard_next_layout_set              (XkbKeyboard     *keyboard);
+gboolean          xkb_keyboard_activate_layout              (XkbKeyboard     *keyboard,
+                                                             const gchar     *layout,
+                                                             const gchar     *variant);
+
+const XkbCairoFlag*
+                  xkb_keyboard_get_flag                     (XkbKeyboard     *keyboard,
                                                              gint             group);
+cairo_surface_t*  xkb_keyboard_get_icon_surface             (XkbKeyboard     *keyboard,
+                                                             gint             group,
+                                                             gint             scale_factor);
 gchar*            xkb_keyboard_get_pretty_layout_name       (XkbKeyboard     *keyboard,
                                                              gint             group);
 gint              xkb_keyboard_get_current_group            (XkbKeyboard     *keyboard);
@@ -21,10 +21,11 @@
  */
 
 #include "xkb-modifier.h"
+#include "xkb-audit.h"
 
 #include <gdk/gdk.h>
+#include <gdk/gdkx.h>
 #include <X11/XKBlib.h>
-#include <X11/keysym.h>
 
 struct _XkbModifierClass
 {
@@ -36,7 +37,12 @@ struct _XkbModifier
   GObject              __parent__;
 
   gint                 xkb_event_type;
-  gboolean             caps_lock_enabled;
+
+  /* indicator names by XKB indicator index, NULL for unnamed ones */
+  gchar               *names[XkbNumIndicators];
+
+  /* raw XKB indicator state, one bit per indicator index */
+  guint                state;
 };
 
 static GdkFilterReturn   xkb_modifier_handle_xevent            (GdkXEvent            *xev,
@@ -79,8 +85,69 @@ xkb_modifier_class_init (XkbModifierClass *klass)
 static void
 xkb_modifier_init (XkbModifier *modifier)
 {
+  gint i;
+
   modifier->xkb_event_type = 0;
-  modifier->caps_lock_enabled = FALSE;
+
+  for (i = 0; i < XkbNumIndicators; i++)
+    modifier->names[i] = NULL;
+
+  modifier->state = 0;
+}
+
+
+
+static void
+xkb_modifier_load_names (XkbModifier *modifier,
+                         Display     *display)
+{
+  GdkDisplay *gdk_display;
+  XkbDescPtr  xkb_desc;
+  Atom        atoms[XkbNumIndicators];
+  gchar      *atom_names[XkbNumIndicators];
+  gint        indexes[XkbNumIndicators];
+  gint        i, n_atoms = 0;
+
+  for (i = 0; i < XkbNumIndicators; i++)
+    {
+      g_free (modifier->names[i]);
+      modifier->names[i] = NULL;
+    }
+
+  xkb_desc = XkbAllocKeyboard ();
+  if (xkb_desc == NULL)
+    return;
+
+  gdk_display = gdk_x11_lookup_xdisplay (display);
+  gdk_x11_display_error_trap_push (gdk_display);
+
+  /* only the indicator names, not the whole keyboard description */
+  if (XkbGetNames (display, XkbIndicatorNamesMask, xkb_desc) == Success &&
+      xkb_desc->names != NULL)
+    {
+      for (i = 0; i < XkbNumIndicators; i++)
+        {
+          if (xkb_desc->names->indicators[i] != None)
+            {
+              atoms[n_atoms] = xkb_desc->names->indicators[i];
+              indexes[n_atoms] = i;
+              n_atoms++;
+            }
+        }
+    }
+
+  XkbFreeKeyboard (xkb_desc, 0, True);
+
+  if (n_atoms > 0 && XGetAtomNames (display, atoms, n_atoms, atom_names))
+    {
+      for (i = 0; i < n_atoms; i++)
+        {
+          modifier->names[indexes[i]] = g_strdup (atom_names[i]);
+          XFree (atom_names[i]);
+        }
+    }
+
+  gdk_x11_display_error_trap_pop_ignored (gdk_display);
 }
 
 
@@ -90,44 +157,27 @@ xkb_modifier_new (void)
 {
   XkbModifier *modifier;
   Display     *display;
-  XkbDescRec  *xkb_desc;
-  gint         i;
-  guint        states, caps_lock_mask;
-  gchar       *atom_name;
+  guint        state;
 
   modifier = g_object_new (TYPE_XKB_MODIFIER, NULL);
 
-  /* obtain xkb_event type and caps lock state */
-  display = XOpenDisplay (NULL);
-  if (display != NULL)
+  display = gdk_x11_get_default_xdisplay ();
+
+  if (XkbQueryExtension (display, NULL, &modifier->xkb_event_type, NULL, NULL, NULL))
     {
-      xkb_desc = XkbGetKeyboard (display, XkbAllComponentsMask, XkbUseCoreKbd);
-      if (xkb_desc != NULL)
-        {
-          for (i = 0; i < XkbNumIndicators; i++)
-            {
-              if (xkb_desc->names->indicators[i])
-                {
-                  atom_name = XGetAtomName (display, xkb_desc->names->indicators[i]);
-                  if (g_strcmp0 (atom_name, "Caps Lock") == 0)
-                    {
-                      if (XkbGetIndicatorState (display, XkbUseCoreKbd, &states) == Success)
-                        {
-                          caps_lock_mask = 1 << i;
-                          modifier->caps_lock_enabled = (states & caps_lock_mask) == caps_lock_mask;
-                        }
-
-                      break;
-                    }
-                }
-             }
-
-          XkbFreeKeyboard(xkb_desc, 0, True);
-        }
+      xkb_modifier_load_names (modifier, display);
 
-      XkbQueryExtension(display, NULL, &modifier->xkb_event_type, NULL, NULL, NULL);
-      XCloseDisplay(display);
+      if (XkbGetIndicatorState (display, XkbUseCoreKbd, &state) == Success)
+        modifier->state = state;
+
+      /* every indicator arrives through the same event stream */
+      XkbSelectEventDetails (display, XkbUseCoreKbd, XkbIndicatorStateNotify,
+                             XkbAllIndicatorsMask, XkbAllIndicatorsMask);
+      XkbSelectEventDetails (display, XkbUseCoreKbd, XkbNamesNotify,
+                             XkbIndicatorNamesMask, XkbIndicatorNamesMask);
     }
+  else
+    modifier->xkb_event_type = 0;
 
   gdk_window_add_filter (NULL, xkb_modifier_handle_xevent, modifier);
 
@@ -140,9 +190,13 @@ static void
 xkb_modifier_finalize (GObject *object)
 {
   XkbModifier *modifier = XKB_MODIFIER (object);
+  gint         i;
 
   gdk_window_remove_filter (NULL, xkb_modifier_handle_xevent, modifier);
 
+  for (i = 0; i < XkbNumIndicators; i++)
+    g_free (modifier->names[i]);
+
   G_OBJECT_CLASS (xkb_modifier_parent_class)->finalize (object);
 }
 
@@ -153,28 +207,41 @@ xkb_modifier_handle_xevent (GdkXEvent *xev,
                             GdkEvent  *event,
                             gpointer   user_data)
 {
-  XkbModifier         *modifier = user_data;
-  Display             *display;
-  XkbStateNotifyEvent *state_event = xev;
-  guint                modifier_flags;
-
-  if (modifier->xkb_event_type != 0 &&
-      state_event->type == modifier->xkb_event_type &&
-      state_event->xkb_type == XkbStateNotify &&
-      state_event->changed & XkbModifierLockMask)
+  XkbModifier *modifier = user_data;
+  XkbEvent    *xkb_event = xev;
+
+  if (modifier->xkb_event_type == 0 || xkb_event->type != modifier->xkb_event_type)
+    return GDK_FILTER_CONTINUE;
+
+  xkb_audit_count (XKB_AUDIT_MODIFIER_EVENT);
+
+  switch (xkb_event->any.xkb_type)
     {
-      display = XOpenDisplay (NULL);
+    case XkbIndicatorStateNotify:
+      if (modifier->state != xkb_event->indicators.state)
+        {
+          xkb_audit_begin (XKB_AUDIT_OP_CAPS_LOCK);
+
+          modifier->state = xkb_event->indicators.state;
+
+          g_signal_emit (G_OBJECT (modifier),
+                         xkb_modifier_signals[MODIFIER_CHANGED],
+                         0);
 
-      if (display != NULL)
+          xkb_audit_end (XKB_AUDIT_OP_CAPS_LOCK);
+        }
+      break;
+
+    case XkbNamesNotify:
+      if (xkb_event->names.changed & XkbIndicatorNamesMask)
         {
-          modifier_flags = XkbKeysymToModifiers (display, XK_Caps_Lock);
-          modifier->caps_lock_enabled = (state_event->locked_mods & modifier_flags) == modifier_flags;
-          XCloseDisplay (display);
+          xkb_modifier_load_names (modifier, xkb_event->any.display);
 
           g_signal_emit (G_OBJECT (modifier),
                          xkb_modifier_signals[MODIFIER_CHANGED],
-                         0, FALSE);
+                         0);
         }
+      break;
     }
 
   return GDK_FILTER_CONTINUE;
@@ -183,9 +250,50 @@ xkb_modifier_handle_xevent (GdkXEvent *xev,
 
 
 gboolean
-xkb_modifier_get_caps_lock_enabled (XkbModifier *modifier)
+xkb_modifier_get_indicator_enabled (XkbModifier *modifier,
+                                    const gchar *name)
+{
+  gint i;
+
+  g_return_val_if_fail (IS_XKB_MODIFIER (modifier), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  for (i = 0; i < XkbNumIndicators; i++)
+    {
+      if (g_strcmp0 (modifier->names[i], name) == 0)
+        return (modifier->state & (1u << i)) != 0;
+    }
+
+  return FALSE;
+}
+
+
+
+guint
+xkb_modifier_get_indicators (XkbModifier *modifier)
 {
+  guint indicators = 0;
+
   g_return_val_if_fail (IS_XKB_MODIFIER (modifier), 0);
 
-  return modifier->caps_lock_enabled;
+  if (xkb_modifier_get_indicator_enabled (modifier, "Caps Lock"))
+    indicators |= INDICATOR_CAPS_LOCK;
+
+  if (xkb_modifier_get_indicator_enabled (modifier, "Num Lock"))
+    indicators |= INDICATOR_NUM_LOCK;
+
+  if (xkb_modifier_get_indicator_enabled (modifier, "Scroll Lock"))
+    indicators |= INDICATOR_SCROLL_LOCK;
+
+  return indicators;
+}
+
+
+
+gboolean
+xkb_modifier_get_caps_lock_enabled (XkbModifier *modifier)
+{
+  g_return_val_if_fail (IS_XKB_MODIFIER (modifier), FALSE);
+
+  return (xkb_modifier_get_indicators (modifier) & INDICATOR_CAPS_LOCK) != 0;
 }
@@ -25,6 +25,8 @@
 
 #include <glib-object.h>
 
+#include "xkb-properties.h"
+
 G_BEGIN_DECLS
 
 typedef struct _XkbModifierClass      XkbModifierClass;
@@ -41,6 +43,9 @@ GType             xkb_modifier_get_type                     (void)
 
 XkbModifier      *xkb_modifier_new                          (void);
 
+guint             xkb_modifier_get_indicators               (XkbModifier     *modifier);
+gboolean          xkb_modifier_get_indicator_enabled        (XkbModifier     *modifier,
+                                                             const gchar     *name);
 gboolean          xkb_modifier_get_caps_lock_enabled        (XkbModifier     *modifier);
 
 G_END_DECLS
@@ -0,0 +1,1026 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-plugin-host.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Development tool which runs the keyboard, modifier and configuration
+ * objects of the plugin and its button drawing in a plain window, without
+ * a panel. The configuration is not backed by xfconf, it only comes from
+ * the command line, so it runs the same on a bare X server such as Xvfb.
+ * Profilers and heap trackers then only see the plugin.
+ *
+ * With --memory-budget it drives the mock keyboard itself, round after
+ * round, and checks with the malloc statistics that the heap stops
+ * growing once the caches are warm. "make check" runs it under Xvfb.
+ * With --benchmark it times the start-up and group switches of the
+ * backend XFCE4_XKB_BACKEND picks on the X server.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+#include <gtk/gtk.h>
+#include <gdk/gdkx.h>
+#include <X11/XKBlib.h>
+
+#include "xkb-properties.h"
+#include "xkb-xfconf.h"
+#include "xkb-keyboard.h"
+#include "xkb-modifier.h"
+#include "xkb-backend-mock.h"
+#include "xkb-render.h"
+#include "xkb-recorder.h"
+#include "xkb-wait.h"
+#include "xkb-audit.h"
+#include "xkb-trace.h"
+#include "xkb-probes.h"
+
+/* a little more than the keyboard waits before it rebuilds on a layout
+ * change, fast replays keep this gap so the rebuild happens at the same
+ * point of the event stream */
+#define XKB_PLUGIN_HOST_CONFIG_DELAY  150
+
+/* how long to wait for the keyboard or the X server, in milliseconds */
+#define XKB_PLUGIN_HOST_WAIT          1000
+
+/* a memory budget round changes the layouts every this many rounds,
+ * the rebuild after it is the slow part */
+#define XKB_PLUGIN_HOST_BUDGET_LAYOUT_ROUNDS  10
+/* the growth past the warm-up which is still taken for allocator noise */
+#define XKB_PLUGIN_HOST_BUDGET_SLACK          16384
+/* the exit code automake takes for a skipped test */
+#define XKB_PLUGIN_HOST_EXIT_SKIP             77
+
+typedef enum
+{
+  XKB_PLUGIN_HOST_BUDGET_LAYOUTS,
+  XKB_PLUGIN_HOST_BUDGET_GROUPS,
+  XKB_PLUGIN_HOST_BUDGET_CAPS_LOCK,
+  XKB_PLUGIN_HOST_BUDGET_FOCUS,
+  XKB_PLUGIN_HOST_BUDGET_SETTINGS,
+  XKB_PLUGIN_HOST_BUDGET_DRAW,
+  XKB_PLUGIN_HOST_BUDGET_N_SUBSYSTEMS
+} XkbPluginHostBudgetSubsystem;
+
+typedef struct
+{
+  XkbXfconf           *config;
+  XkbKeyboard         *keyboard;
+  XkbModifier         *modifier;
+
+  GtkWidget           *window;
+  GtkWidget           *button;
+  GtkWidget           *layout_image;
+
+  XkbBackendMock      *mock;
+  GPtrArray           *trace;
+  guint                trace_position;
+  gint64               replay_start;
+  guint                replay_id;
+
+  guint                bench_state_changes;
+
+  gboolean             budget_rebuilt;
+  gboolean             budget_caps_lock;
+  gsize                budget_in_use;
+  gint64               budget_bytes[XKB_PLUGIN_HOST_BUDGET_N_SUBSYSTEMS];
+} XkbPluginHost;
+
+#ifdef HAVE_MALLINFO2
+static const gchar *budget_subsystem_names[XKB_PLUGIN_HOST_BUDGET_N_SUBSYSTEMS] =
+{
+  "layouts",
+  "groups",
+  "caps-lock",
+  "focus",
+  "settings",
+  "draw"
+};
+#endif
+
+
+
+static gint      opt_size = 32;
+static gchar    *opt_orientation = NULL;
+static gchar    *opt_display_type = NULL;
+static gchar    *opt_display_name = NULL;
+static gint      opt_display_scale = -1;
+static gboolean  opt_caps_lock_indicator = FALSE;
+static gchar    *opt_mock = NULL;
+static gint      opt_timeout = 0;
+static gchar    *opt_replay = NULL;
+static gboolean  opt_realtime = FALSE;
+static gint      opt_memory_budget = 0;
+static gint      opt_benchmark = 0;
+
+static GOptionEntry option_entries[] =
+{
+  { "size", 's', 0, G_OPTION_ARG_INT, &opt_size,
+    "Size of the panel row, in pixels", "SIZE" },
+  { "orientation", 'o', 0, G_OPTION_ARG_STRING, &opt_orientation,
+    "Orientation of the panel: horizontal or vertical", "ORIENTATION" },
+  { "display-type", 't', 0, G_OPTION_ARG_STRING, &opt_display_type,
+    "Show the layout as image, text or system", "TYPE" },
+  { "display-name", 'n', 0, G_OPTION_ARG_STRING, &opt_display_name,
+    "Show the country or the language name", "NAME" },
+  { "display-scale", 'S', 0, G_OPTION_ARG_INT, &opt_display_scale,
+    "Scale of the layout image or text, in percent", "SCALE" },
+  { "caps-lock-indicator", 'c', 0, G_OPTION_ARG_NONE, &opt_caps_lock_indicator,
+    "Show the caps lock indicator", NULL },
+  { "mock", 'm', 0, G_OPTION_ARG_STRING, &opt_mock,
+    "Use a mock keyboard with the given layouts, such as \"us,de(nodeadkeys)\"", "LAYOUTS" },
+  { "timeout", 'T', 0, G_OPTION_ARG_INT, &opt_timeout,
+    "Quit after SECONDS, instead of when the window is closed", "SECONDS" },
+  { "replay", 'r', 0, G_OPTION_ARG_FILENAME, &opt_replay,
+    "Replay a trace recorded with XFCE4_XKB_RECORD and quit", "FILE" },
+  { "realtime", 'R', 0, G_OPTION_ARG_NONE, &opt_realtime,
+    "Replay with the recorded timing instead of as fast as possible", NULL },
+  { "memory-budget", 'M', 0, G_OPTION_ARG_INT, &opt_memory_budget,
+    "Run ROUNDS of layout, group, Caps Lock, focus and setting changes on the mock "
+    "keyboard and fail if the heap keeps growing", "ROUNDS" },
+  { "benchmark", 'B', 0, G_OPTION_ARG_INT, &opt_benchmark,
+    "Time the start-up and SWITCHES group switches on the X keyboard and quit", "SWITCHES" },
+  { NULL }
+};
+
+
+
+static gboolean
+xkb_plugin_host_parse_enum (const gchar         *option,
+                            const gchar         *value,
+                            const gchar * const *names,
+                            guint               *result)
+{
+  guint i;
+
+  if (value == NULL)
+    return TRUE;
+
+  for (i = 0; names[i] != NULL; i++)
+    {
+      if (g_strcmp0 (names[i], value) == 0)
+        {
+          *result = i;
+          return TRUE;
+        }
+    }
+
+  g_printerr ("unknown %s \"%s\"\n", option, value);
+
+  return FALSE;
+}
+
+
+
+/*
+ * Splits a list such as "us,de(nodeadkeys)" into layouts and variants.
+ */
+static void
+xkb_plugin_host_parse_layouts (const gchar   *description,
+                               gchar       ***layouts,
+                               gchar       ***variants)
+{
+  gchar *variant;
+  guint  i;
+
+  *layouts = g_strsplit (description, ",", -1);
+  *variants = g_new0 (gchar *, g_strv_length (*layouts) + 1);
+
+  for (i = 0; (*layouts)[i] != NULL; i++)
+    {
+      variant = strchr ((*layouts)[i], '(');
+      if (variant != NULL)
+        {
+          *variant++ = '\0';
+          (*variants)[i] = g_strndup (variant, strcspn (variant, ")"));
+        }
+      else
+        (*variants)[i] = g_strdup ("");
+    }
+}
+
+
+
+static void
+xkb_plugin_host_mock_set_config (XkbBackendMock *mock,
+                                 const gchar    *description)
+{
+  gchar **layouts, **variants;
+
+  xkb_plugin_host_parse_layouts (description, &layouts, &variants);
+  xkb_backend_mock_set_config (mock,
+                               (const gchar * const *) layouts,
+                               (const gchar * const *) variants);
+
+  g_strfreev (layouts);
+  g_strfreev (variants);
+}
+
+
+
+/*
+ * Requests the size the panel plugin would request for a single row.
+ */
+static void
+xkb_plugin_host_set_size (XkbPluginHost  *host,
+                          GtkOrientation  orientation,
+                          gint            panel_size)
+{
+  gint     hsize, vsize;
+  gboolean proportional;
+
+  proportional = xkb_xfconf_get_display_type (host->config) == DISPLAY_TYPE_SYSTEM;
+
+  if (orientation == GTK_ORIENTATION_HORIZONTAL)
+    {
+      vsize = panel_size;
+      hsize = proportional ? panel_size : (gint) (1.33 * panel_size);
+    }
+  else
+    {
+      hsize = panel_size;
+      vsize = proportional ? panel_size : MAX ((gint) (0.75 * panel_size), 10);
+    }
+
+  gtk_widget_set_size_request (host->button, hsize, vsize);
+}
+
+
+
+static gboolean
+xkb_plugin_host_layout_image_draw (GtkWidget     *widget,
+                                   cairo_t       *cr,
+                                   XkbPluginHost *host)
+{
+  GtkAllocation allocation;
+
+  gtk_widget_get_allocation (widget, &allocation);
+
+  if (allocation.width <= 0 || allocation.height <= 0)
+    return FALSE;
+
+  xkb_trace_begin ("layout-image-draw");
+  XKB_PROBE_DRAW_START (allocation.width, allocation.height);
+
+  xkb_render_layout_image (cr, host->config, host->keyboard, host->modifier,
+                           gtk_widget_get_style_context (host->button),
+                           gtk_widget_get_state_flags (host->button),
+                           allocation.width, allocation.height);
+
+  XKB_PROBE_DRAW_END (allocation.width, allocation.height);
+  xkb_trace_end ("layout-image-draw");
+
+  return FALSE;
+}
+
+
+
+static void
+xkb_plugin_host_button_clicked (XkbPluginHost *host)
+{
+  xkb_keyboard_next_group (host->keyboard);
+}
+
+
+
+static void
+xkb_plugin_host_queue_draw (XkbPluginHost *host)
+{
+  gtk_widget_queue_draw (host->layout_image);
+}
+
+
+
+static void
+xkb_plugin_host_window_destroyed (XkbPluginHost *host)
+{
+  host->window = NULL;
+  gtk_main_quit ();
+}
+
+
+
+static void
+xkb_plugin_host_replay_property (XkbPluginHost *host,
+                                 const gchar   *name,
+                                 const gchar   *text)
+{
+  GVariant *variant;
+  GValue    value = G_VALUE_INIT;
+
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (host->config), name) == NULL)
+    return;
+
+  variant = g_variant_parse (NULL, text, NULL, NULL, NULL);
+  if (variant == NULL)
+    return;
+
+  g_dbus_gvariant_to_gvalue (variant, &value);
+  g_object_set_property (G_OBJECT (host->config), name, &value);
+
+  g_value_unset (&value);
+  g_variant_unref (variant);
+}
+
+
+
+/*
+ * Feeds a recorded event through the same entry points the X server,
+ * the window manager, xfconf and the panel use.
+ */
+static void
+xkb_plugin_host_replay_event (XkbPluginHost    *host,
+                              XkbRecorderEvent *event)
+{
+  gchar **args = event->args;
+
+  switch (event->type)
+    {
+    case XKB_RECORDER_CONFIG_CHANGED:
+      xkb_plugin_host_mock_set_config (host->mock, args[0]);
+      break;
+
+    case XKB_RECORDER_GROUP_CHANGED:
+      xkb_backend_mock_switch_group (host->mock, g_ascii_strtoll (args[0], NULL, 10));
+      break;
+
+    case XKB_RECORDER_ACTIVE_WINDOW_CHANGED:
+      xkb_backend_mock_activate_window (host->mock,
+                                        g_ascii_strtoull (args[0], NULL, 10),
+                                        g_ascii_strtoull (args[1], NULL, 10),
+                                        *args[2] != '\0' ? args[2] : NULL,
+                                        *args[3] != '\0' ? args[3] : NULL);
+      break;
+
+    case XKB_RECORDER_WINDOW_CLOSED:
+      xkb_backend_mock_close_window (host->mock, g_ascii_strtoull (args[0], NULL, 10));
+      break;
+
+    case XKB_RECORDER_APPLICATION_CLOSED:
+      xkb_backend_mock_close_application (host->mock, g_ascii_strtoull (args[0], NULL, 10));
+      break;
+
+    case XKB_RECORDER_WORKSPACE_CHANGED:
+      xkb_backend_mock_switch_workspace (host->mock, g_ascii_strtoll (args[0], NULL, 10));
+      break;
+
+    case XKB_RECORDER_PROPERTY_CHANGED:
+      xkb_plugin_host_replay_property (host, args[0], args[1]);
+      break;
+
+    case XKB_RECORDER_SIZE_CHANGED:
+      xkb_plugin_host_set_size (host,
+                                g_ascii_strtoll (args[0], NULL, 10) == GTK_ORIENTATION_VERTICAL
+                                ? GTK_ORIENTATION_VERTICAL : GTK_ORIENTATION_HORIZONTAL,
+                                MAX (g_ascii_strtoll (args[1], NULL, 10), 1));
+      break;
+
+    case XKB_RECORDER_N_EVENTS:
+      break;
+    }
+}
+
+
+
+/*
+ * Replays one event per main loop iteration, so redraws run in between
+ * like they do in the panel.
+ */
+static gboolean
+xkb_plugin_host_replay (gpointer user_data)
+{
+  XkbPluginHost    *host = user_data;
+  XkbRecorderEvent *event;
+  gint64            delay;
+
+  host->replay_id = 0;
+
+  if (host->trace_position >= host->trace->len)
+    {
+      g_print ("replayed %u events in %.1f ms\n", host->trace->len,
+               (g_get_monotonic_time () - host->replay_start) / 1000.0);
+      gtk_main_quit ();
+      return G_SOURCE_REMOVE;
+    }
+
+  event = g_ptr_array_index (host->trace, host->trace_position);
+
+  if (opt_realtime)
+    {
+      delay = event->time - (g_get_monotonic_time () - host->replay_start);
+      if (delay > 0)
+        {
+          host->replay_id = g_timeout_add (delay / 1000, xkb_plugin_host_replay, host);
+          return G_SOURCE_REMOVE;
+        }
+    }
+
+  host->trace_position++;
+  xkb_plugin_host_replay_event (host, event);
+
+  if (!opt_realtime && event->type == XKB_RECORDER_CONFIG_CHANGED)
+    host->replay_id = g_timeout_add (XKB_PLUGIN_HOST_CONFIG_DELAY, xkb_plugin_host_replay, host);
+  else
+    host->replay_id = g_idle_add (xkb_plugin_host_replay, host);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+static gboolean
+xkb_plugin_host_wait (XkbPluginHost *host,
+                      gboolean     (*condition) (XkbPluginHost *host))
+{
+  xkb_wait_until (condition (host), XKB_PLUGIN_HOST_WAIT);
+
+  return condition (host);
+}
+
+
+
+static gboolean
+xkb_plugin_host_bench_two_groups (XkbPluginHost *host)
+{
+  return xkb_keyboard_get_group_count (host->keyboard) >= 2;
+}
+
+
+
+static gboolean
+xkb_plugin_host_bench_switched (XkbPluginHost *host)
+{
+  return host->bench_state_changes > 0;
+}
+
+
+
+static void
+xkb_plugin_host_bench_state_changed (XkbPluginHost *host)
+{
+  host->bench_state_changes++;
+}
+
+
+
+static glong
+xkb_plugin_host_bench_resident_size (void)
+{
+  gchar *status = NULL;
+  gchar *line;
+  glong  size = -1;
+
+  if (g_file_get_contents ("/proc/self/status", &status, NULL, NULL))
+    {
+      line = strstr (status, "\nVmRSS:");
+      if (line != NULL)
+        size = strtol (line + strlen ("\nVmRSS:"), NULL, 10);
+    }
+
+  g_free (status);
+
+  return size;
+}
+
+
+
+/*
+ * Switches between the first two groups, waiting for the server to
+ * confirm every switch. Returns the exit code of the host.
+ */
+static gint
+xkb_plugin_host_benchmark (XkbPluginHost *host,
+                           guint          switches,
+                           gint64         startup)
+{
+  const gchar *layouts[] = { "us", "de", NULL };
+  const gchar *variants[] = { "", "", NULL };
+  XkbBackend  *backend;
+  gint64       start, elapsed = 0;
+  guint        i, switched = 0;
+
+  backend = xkb_keyboard_get_backend (host->keyboard);
+  if (backend == NULL)
+    {
+      g_printerr ("no keyboard, no benchmark\n");
+      return XKB_PLUGIN_HOST_EXIT_SKIP;
+    }
+
+  g_signal_connect_swapped (host->keyboard, "state-changed",
+                            G_CALLBACK (xkb_plugin_host_bench_state_changed), host);
+
+  /* only libxklavier can set the layouts, for xkbcommon run setxkbmap first */
+  if (!xkb_plugin_host_bench_two_groups (host)
+      && xkb_backend_activate_config (backend, layouts, variants))
+    xkb_plugin_host_wait (host, xkb_plugin_host_bench_two_groups);
+
+  if (xkb_plugin_host_bench_two_groups (host))
+    {
+      start = g_get_monotonic_time ();
+
+      for (i = 0; i < switches; i++)
+        {
+          host->bench_state_changes = 0;
+          if (!xkb_keyboard_set_group (host->keyboard,
+                                       xkb_keyboard_get_current_group (host->keyboard) == 0 ? 1 : 0)
+              || !xkb_plugin_host_wait (host, xkb_plugin_host_bench_switched))
+            {
+              g_printerr ("the server did not confirm group switch %u\n", i);
+              return EXIT_FAILURE;
+            }
+        }
+
+      elapsed = g_get_monotonic_time () - start;
+      switched = switches;
+    }
+  else
+    g_printerr ("the keyboard has a single group, no switches\n");
+
+  g_print ("%s: start-up %.1f ms, %u group switches in %.1f ms (%.0f us each), "
+           "resident %ld kB\n", G_OBJECT_TYPE_NAME (backend),
+           startup / 1000.0, switched, elapsed / 1000.0,
+           switched > 0 ? (gdouble) elapsed / switched : 0.0,
+           xkb_plugin_host_bench_resident_size ());
+
+  return EXIT_SUCCESS;
+}
+
+
+
+#ifdef HAVE_MALLINFO2
+static gsize
+xkb_plugin_host_budget_heap_in_use (void)
+{
+  struct mallinfo2 info;
+
+  info = mallinfo2 ();
+
+  return info.uordblks + info.hblkhd;
+}
+
+
+
+/*
+ * Adds the growth of the heap since the last sample to a subsystem,
+ * once the warm-up is over.
+ */
+static void
+xkb_plugin_host_budget_account (XkbPluginHost                *host,
+                                XkbPluginHostBudgetSubsystem  subsystem,
+                                gboolean                      measuring)
+{
+  gsize in_use;
+
+  in_use = xkb_plugin_host_budget_heap_in_use ();
+
+  if (measuring)
+    host->budget_bytes[subsystem] += (gint64) in_use - (gint64) host->budget_in_use;
+
+  host->budget_in_use = in_use;
+}
+
+
+
+static void
+xkb_plugin_host_budget_drain (void)
+{
+  while (g_main_context_pending (NULL))
+    g_main_context_iteration (NULL, FALSE);
+}
+
+
+
+static gboolean
+xkb_plugin_host_budget_allocated (XkbPluginHost *host)
+{
+  return gtk_widget_get_allocated_width (host->layout_image) > 1;
+}
+
+
+
+static gboolean
+xkb_plugin_host_budget_rebuilt (XkbPluginHost *host)
+{
+  return host->budget_rebuilt;
+}
+
+
+
+static gboolean
+xkb_plugin_host_budget_caps_lock_on (XkbPluginHost *host)
+{
+  return xkb_modifier_get_caps_lock_enabled (host->modifier);
+}
+
+
+
+static gboolean
+xkb_plugin_host_budget_caps_lock_off (XkbPluginHost *host)
+{
+  return !xkb_modifier_get_caps_lock_enabled (host->modifier);
+}
+
+
+
+static void
+xkb_plugin_host_budget_state_changed (XkbPluginHost *host,
+                                      gboolean       config_changed)
+{
+  if (config_changed)
+    host->budget_rebuilt = TRUE;
+}
+
+
+
+/* draws the button right away instead of on the next frame */
+static void
+xkb_plugin_host_budget_draw (XkbPluginHost *host,
+                             gboolean       measuring)
+{
+  cairo_surface_t *surface;
+  cairo_t         *cr;
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+                                        gtk_widget_get_allocated_width (host->layout_image),
+                                        gtk_widget_get_allocated_height (host->layout_image));
+  cr = cairo_create (surface);
+  gtk_widget_draw (host->layout_image, cr);
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
+
+  xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_DRAW, measuring);
+}
+
+
+
+/* the locked modifiers of the server, the modifier object follows them */
+static gboolean
+xkb_plugin_host_budget_lock_caps (XkbPluginHost *host,
+                                  gboolean       enabled)
+{
+  Display *display;
+
+  display = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+  XkbLockModifiers (display, XkbUseCoreKbd, LockMask, enabled ? LockMask : 0);
+  XFlush (display);
+
+  return xkb_plugin_host_wait (host, enabled
+                               ? xkb_plugin_host_budget_caps_lock_on
+                               : xkb_plugin_host_budget_caps_lock_off);
+}
+
+
+
+static gboolean
+xkb_plugin_host_budget_round (XkbPluginHost *host,
+                              guint          round,
+                              gboolean       measuring)
+{
+  static const gchar *layouts[] = { "us,de(nodeadkeys),ua", "ua,us" };
+  guint               window, group_count, i;
+  gchar              *title;
+
+  if (round % XKB_PLUGIN_HOST_BUDGET_LAYOUT_ROUNDS == 0)
+    {
+      host->budget_rebuilt = FALSE;
+      xkb_plugin_host_mock_set_config (host->mock,
+                                       layouts[(round / XKB_PLUGIN_HOST_BUDGET_LAYOUT_ROUNDS) % 2]);
+      if (!xkb_plugin_host_wait (host, xkb_plugin_host_budget_rebuilt))
+        {
+          g_printerr ("the keyboard did not rebuild after a layout change\n");
+          return FALSE;
+        }
+      xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_LAYOUTS, measuring);
+      xkb_plugin_host_budget_draw (host, measuring);
+    }
+
+  group_count = MAX (xkb_keyboard_get_group_count (host->keyboard), 1);
+  for (i = 1; i <= 3; i++)
+    {
+      xkb_backend_mock_switch_group (host->mock, (round + i) % group_count);
+      xkb_plugin_host_budget_drain ();
+      xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_GROUPS, measuring);
+      xkb_plugin_host_budget_draw (host, measuring);
+    }
+
+  if (host->budget_caps_lock)
+    {
+      for (i = 0; i < 2; i++)
+        {
+          if (!xkb_plugin_host_budget_lock_caps (host, i == 0))
+            {
+              g_printerr ("the X server did not report a Caps Lock change\n");
+              return FALSE;
+            }
+          xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_CAPS_LOCK, measuring);
+          xkb_plugin_host_budget_draw (host, measuring);
+        }
+    }
+
+  /* windows come and go, the keyboard must forget the closed ones */
+  window = 2 * round + 1;
+  for (i = 0; i < 2; i++)
+    {
+      title = g_strdup_printf ("window %u", window + i);
+      xkb_backend_mock_activate_window (host->mock, window + i, window + i,
+                                        i == 0 ? "term.Term" : "mail.Mail", title);
+      g_free (title);
+      xkb_backend_mock_switch_group (host->mock, (round + i) % group_count);
+      xkb_plugin_host_budget_drain ();
+      xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_FOCUS, measuring);
+      xkb_plugin_host_budget_draw (host, measuring);
+    }
+  for (i = 0; i < 2; i++)
+    {
+      xkb_backend_mock_close_window (host->mock, window + i);
+      xkb_backend_mock_close_application (host->mock, window + i);
+    }
+  xkb_plugin_host_budget_drain ();
+  xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_FOCUS, measuring);
+
+  g_object_set (G_OBJECT (host->config),
+                DISPLAY_SCALE, (guint) (DISPLAY_SCALE_MAX - 10 * (round % 5)),
+                DISPLAY_NAME, round % 2,
+                NULL);
+  xkb_plugin_host_budget_drain ();
+  xkb_plugin_host_budget_account (host, XKB_PLUGIN_HOST_BUDGET_SETTINGS, measuring);
+  xkb_plugin_host_budget_draw (host, measuring);
+
+  return TRUE;
+}
+#endif
+
+
+
+/*
+ * Runs the rounds, the first tenth of them warms the caches up. Returns
+ * the exit code of the host.
+ */
+static gint
+xkb_plugin_host_memory_budget (XkbPluginHost *host,
+                               guint          rounds)
+{
+#ifdef HAVE_MALLINFO2
+  gsize    warm_in_use = 0;
+  gint64   growth;
+  guint    warm_up, round, i;
+
+  warm_up = MAX (rounds / 10, 1);
+
+  g_object_set (G_OBJECT (host->config), GROUP_POLICY, GROUP_POLICY_PER_WINDOW, NULL);
+  g_signal_connect_swapped (host->keyboard, "state-changed",
+                            G_CALLBACK (xkb_plugin_host_budget_state_changed), host);
+
+  if (!xkb_plugin_host_wait (host, xkb_plugin_host_budget_allocated))
+    {
+      g_printerr ("the button was never allocated\n");
+      return EXIT_FAILURE;
+    }
+
+  /* a server without the Caps Lock indicator leaves it out */
+  host->budget_caps_lock = xkb_plugin_host_budget_lock_caps (host, TRUE)
+                           && xkb_plugin_host_budget_lock_caps (host, FALSE);
+  if (!host->budget_caps_lock)
+    g_printerr ("no Caps Lock changes from the X server, leaving them out\n");
+
+  host->budget_in_use = xkb_plugin_host_budget_heap_in_use ();
+
+  for (round = 0; round < warm_up + rounds; round++)
+    {
+      if (round == warm_up)
+        {
+          host->budget_in_use = xkb_plugin_host_budget_heap_in_use ();
+          warm_in_use = host->budget_in_use;
+        }
+
+      if (!xkb_plugin_host_budget_round (host, round, round >= warm_up))
+        return EXIT_FAILURE;
+    }
+
+  growth = (gint64) xkb_plugin_host_budget_heap_in_use () - (gint64) warm_in_use;
+
+  g_print ("heap in use after %u warm-up rounds: %" G_GSIZE_FORMAT " bytes, "
+           "grown by %" G_GINT64_FORMAT " bytes in %u more rounds\n",
+           warm_up, warm_in_use, growth, rounds);
+  for (i = 0; i < XKB_PLUGIN_HOST_BUDGET_N_SUBSYSTEMS; i++)
+    g_print ("  %-10s %+" G_GINT64_FORMAT " bytes\n",
+             budget_subsystem_names[i], host->budget_bytes[i]);
+
+  if (growth > XKB_PLUGIN_HOST_BUDGET_SLACK)
+    {
+      g_printerr ("the heap grew by more than %d bytes\n", XKB_PLUGIN_HOST_BUDGET_SLACK);
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+#else
+  g_printerr ("the C library has no mallinfo2 (), no memory budget\n");
+
+  return XKB_PLUGIN_HOST_EXIT_SKIP;
+#endif
+}
+
+
+
+static gboolean
+xkb_plugin_host_timeout (gpointer user_data)
+{
+  gtk_main_quit ();
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  static const gchar *orientation_names[] = { "horizontal", "vertical", NULL };
+  static const gchar *display_type_names[] = { "image", "text", "system", NULL };
+  static const gchar *display_name_names[] = { "country", "language", NULL };
+
+  XkbPluginHost  host;
+  XkbBackend    *backend;
+  GError        *error = NULL;
+  guint          orientation = GTK_ORIENTATION_HORIZONTAL;
+  guint          display_type, display_name;
+  gint           status = EXIT_SUCCESS;
+  gint64         startup;
+
+  if (!gtk_init_with_args (&argc, &argv, "- run the xkb plugin without a panel",
+                           option_entries, NULL, &error))
+    {
+      g_printerr ("%s\n", error != NULL ? error->message : "cannot open display");
+      g_clear_error (&error);
+      return EXIT_FAILURE;
+    }
+
+  host.config = xkb_xfconf_new (NULL);
+
+  /* the names are in the order of the enums, options which are not
+   * given keep the defaults */
+  display_type = xkb_xfconf_get_display_type (host.config);
+  display_name = xkb_xfconf_get_display_name (host.config);
+
+  if (!xkb_plugin_host_parse_enum ("orientation", opt_orientation, orientation_names, &orientation) ||
+      !xkb_plugin_host_parse_enum ("display type", opt_display_type, display_type_names, &display_type) ||
+      !xkb_plugin_host_parse_enum ("display name", opt_display_name, display_name_names, &display_name))
+    {
+      g_object_unref (host.config);
+      return EXIT_FAILURE;
+    }
+
+  g_object_set (G_OBJECT (host.config),
+                DISPLAY_TYPE, display_type,
+                DISPLAY_NAME, display_name,
+                CAPS_LOCK_INDICATOR, opt_caps_lock_indicator,
+                NULL);
+  if (opt_display_scale >= 0)
+    g_object_set (G_OBJECT (host.config), DISPLAY_SCALE, (guint) opt_display_scale, NULL);
+
+  host.mock = NULL;
+  host.trace = NULL;
+  host.trace_position = 0;
+  host.replay_start = 0;
+  host.replay_id = 0;
+  memset (host.budget_bytes, 0, sizeof (host.budget_bytes));
+
+  if (opt_memory_budget > 0 && opt_replay != NULL)
+    {
+      g_printerr ("--memory-budget and --replay cannot be combined\n");
+      g_object_unref (host.config);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_benchmark > 0 && (opt_mock != NULL || opt_replay != NULL || opt_memory_budget > 0))
+    {
+      g_printerr ("--benchmark runs on the X keyboard, without --mock, --replay "
+                  "or --memory-budget\n");
+      g_object_unref (host.config);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_replay != NULL)
+    {
+      host.trace = xkb_recorder_load (opt_replay, &error);
+      if (host.trace == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          g_error_free (error);
+          g_object_unref (host.config);
+          return EXIT_FAILURE;
+        }
+    }
+
+  startup = g_get_monotonic_time ();
+  xkb_audit_begin (XKB_AUDIT_OP_STARTUP);
+
+  /* traces start with the layouts, they replace the mock ones */
+  if (opt_mock != NULL || opt_replay != NULL || opt_memory_budget > 0)
+    {
+      backend = xkb_backend_mock_new ();
+      host.mock = XKB_BACKEND_MOCK (backend);
+      xkb_plugin_host_mock_set_config (host.mock, opt_mock != NULL ? opt_mock : "us");
+
+      host.keyboard = xkb_keyboard_new_with_backend (host.config, backend);
+      g_object_unref (backend);
+    }
+  else
+    host.keyboard = xkb_keyboard_new (host.config);
+
+  if (!xkb_keyboard_get_initialized (host.keyboard))
+    g_printerr ("no keyboard, the button stays empty\n");
+
+  host.modifier = xkb_modifier_new ();
+
+  host.window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+  gtk_window_set_title (GTK_WINDOW (host.window), "xkb-plugin-host");
+  gtk_window_set_resizable (GTK_WINDOW (host.window), FALSE);
+  g_signal_connect_swapped (host.window, "destroy",
+                            G_CALLBACK (xkb_plugin_host_window_destroyed), &host);
+
+  host.button = gtk_button_new ();
+  gtk_button_set_relief (GTK_BUTTON (host.button), GTK_RELIEF_NONE);
+  gtk_container_add (GTK_CONTAINER (host.window), host.button);
+  g_signal_connect_swapped (host.button, "clicked",
+                            G_CALLBACK (xkb_plugin_host_button_clicked), &host);
+
+  host.layout_image = gtk_drawing_area_new ();
+  gtk_container_add (GTK_CONTAINER (host.button), host.layout_image);
+  g_signal_connect (host.layout_image, "draw",
+                    G_CALLBACK (xkb_plugin_host_layout_image_draw), &host);
+
+  g_signal_connect_swapped (host.keyboard, "state-changed",
+                            G_CALLBACK (xkb_plugin_host_queue_draw), &host);
+  g_signal_connect_swapped (host.modifier, "modifier-changed",
+                            G_CALLBACK (xkb_plugin_host_queue_draw), &host);
+  g_signal_connect_swapped (host.config, "configuration-changed",
+                            G_CALLBACK (xkb_plugin_host_queue_draw), &host);
+
+  xkb_plugin_host_set_size (&host, orientation, MAX (opt_size, 1));
+
+  gtk_widget_show_all (host.window);
+
+  xkb_audit_end (XKB_AUDIT_OP_STARTUP);
+  startup = g_get_monotonic_time () - startup;
+
+  if (opt_memory_budget > 0)
+    status = xkb_plugin_host_memory_budget (&host, opt_memory_budget);
+  else if (opt_benchmark > 0)
+    status = xkb_plugin_host_benchmark (&host, opt_benchmark, startup);
+  else
+    {
+      if (opt_timeout > 0)
+        g_timeout_add_seconds (opt_timeout, xkb_plugin_host_timeout, NULL);
+
+      if (host.trace != NULL)
+        {
+          host.replay_start = g_get_monotonic_time ();
+          host.replay_id = g_idle_add (xkb_plugin_host_replay, &host);
+        }
+
+      gtk_main ();
+    }
+
+  xkb_audit_report ();
+  xkb_trace_flush ();
+
+  if (host.replay_id != 0)
+    g_source_remove (host.replay_id);
+  if (host.trace != NULL)
+    g_ptr_array_unref (host.trace);
+
+  if (host.window != NULL)
+    {
+      g_signal_handlers_disconnect_by_func (host.window, xkb_plugin_host_window_destroyed, &host);
+      gtk_widget_destroy (host.window);
+    }
+
+  g_object_unref (host.modifier);
+  g_object_unref (host.keyboard);
+  g_object_unref (host.config);
+
+  return status;
+}
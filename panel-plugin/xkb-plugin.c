@@ -27,21 +27,36 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <libxfce4ui/libxfce4ui.h>
-#include <librsvg/rsvg.h>
 #include <garcon/garcon.h>
 
 #include "xkb-plugin.h"
 #include "xkb-properties.h"
 #include "xkb-keyboard.h"
 #include "xkb-modifier.h"
+#include "xkb-publisher.h"
+#include "xkb-dbus.h"
+#include "xkb-audit.h"
+#include "xkb-trace.h"
+#include "xkb-probes.h"
 #include "xkb-dialog.h"
 #include "xkb-cairo.h"
+#include "xkb-render.h"
+#include "xkb-snapshot.h"
+
+#ifdef HAVE_DEBUG_TOOLS
+#include "xkb-recorder.h"
+#endif
 
 typedef struct
 {
   XkbPlugin *plugin;
   gint group;
+  GtkWidget *item;
+  GtkWidget *image;
+  GtkWidget *label;
 } MenuItemData;
 
 struct _XkbPluginClass
@@ -56,11 +71,41 @@ struct _XkbPlugin
   XkbXfconf           *config;
   XkbKeyboard         *keyboard;
   XkbModifier         *modifier;
+  XkbPublisher        *publisher;
+  XkbDBus             *dbus;
+#ifdef HAVE_DEBUG_TOOLS
+  XkbRecorder         *recorder;
+#endif
 
   GtkWidget           *button;
   GtkWidget           *layout_image;
   GtkWidget           *popup;
-  MenuItemData        *popup_user_data;
+  GPtrArray           *popup_items;
+  guint                popup_prepare_id;
+
+  GtkWidget           *tooltip_box;
+  GtkWidget           *tooltip_image;
+  GtkWidget           *tooltip_label;
+
+  cairo_surface_t     *image_cache;
+  gint                 image_cache_width;
+  gint                 image_cache_height;
+  gint                 image_cache_scale;
+  GtkStateFlags        image_cache_state;
+  gboolean             image_cache_restored;
+
+  /* the button of the last run, painted until the first render */
+  XkbSnapshot         *snapshot;
+
+  /* nothing is rendered while the button can not be seen, changes are
+   * only recorded and drawn once it shows up again */
+  gboolean             visible;
+  gboolean             obscured;
+  gboolean             refresh_pending;
+  GtkWidget           *toplevel;
+  gulong               toplevel_configure_handler_id;
+  gulong               toplevel_visibility_handler_id;
+  gulong               toplevel_state_handler_id;
 };
 
 /* ------------------------------------------------------------------ *
@@ -75,6 +120,9 @@ static gboolean     xkb_plugin_size_changed             (XfcePanelPlugin *plugin
 static void         xkb_plugin_free_data                (XfcePanelPlugin *plugin);
 static void         xkb_plugin_about_show               (XfcePanelPlugin *plugin);
 static void         xkb_plugin_configure_plugin         (XfcePanelPlugin *plugin);
+static gboolean     xkb_plugin_remote_event             (XfcePanelPlugin *plugin,
+                                                         const gchar     *name,
+                                                         const GValue    *value);
 
 /* ----------------------------------------------------------------- *
  *                           XKB Stuff                               *
@@ -85,11 +133,16 @@ static void         xkb_plugin_state_changed            (XkbPlugin        *plugi
 
 static void         xkb_plugin_modifier_changed         (XkbPlugin        *plugin);
 
+static void         xkb_plugin_scale_factor_changed     (XkbPlugin        *plugin);
+
 static gboolean     xkb_plugin_calculate_sizes          (XkbPlugin        *plugin,
                                                          GtkOrientation    orientation,
                                                          gint              panel_size);
 
-static void         xkb_plugin_popup_menu_populate      (XkbPlugin        *plugin);
+static void         xkb_plugin_popup_menu_create        (XkbPlugin        *plugin);
+static void         xkb_plugin_popup_menu_update        (XkbPlugin        *plugin,
+                                                         guint             changed_groups);
+static void         xkb_plugin_popup_menu_schedule      (XkbPlugin        *plugin);
 static void         xkb_plugin_popup_menu_destroy       (XkbPlugin        *plugin);
 static void         xkb_plugin_popup_menu_show          (GtkWidget        *widget,
                                                          GdkEventButton   *event,
@@ -99,6 +152,10 @@ static void         xkb_plugin_popup_menu_deactivate    (XkbPlugin        *plugi
 
 static void         xkb_plugin_refresh_gui              (XkbPlugin        *plugin);
 
+static void         xkb_plugin_button_mapped            (XkbPlugin        *plugin);
+static void         xkb_plugin_button_unmapped          (XkbPlugin        *plugin);
+static void         xkb_plugin_toplevel_release         (XkbPlugin        *plugin);
+
 static void         xkb_plugin_configure_layout         (GtkWidget        *widget);
 
 static gboolean     xkb_plugin_button_clicked           (GtkWidget        *widget,
@@ -115,12 +172,23 @@ static gboolean     xkb_plugin_set_tooltip              (GtkWidget        *widge
                                                          GtkTooltip       *tooltip,
                                                          XkbPlugin        *plugin);
 
+static gchar       *xkb_plugin_layout_image_key         (XkbPlugin        *plugin,
+                                                         gint              width,
+                                                         gint              height,
+                                                         gint              scale_factor,
+                                                         GtkStateFlags     state);
+
 static gboolean     xkb_plugin_layout_image_draw        (GtkWidget        *widget,
                                                          cairo_t          *cr,
                                                          XkbPlugin        *plugin);
 
 static void         xkb_plugin_update_size_allocation   (XkbPlugin        *plugin);
 
+static void         xkb_plugin_configuration_changed    (XkbPlugin        *plugin,
+                                                         guint             changes);
+
+static void         xkb_plugin_image_cache_clear        (XkbPlugin        *plugin);
+
 /* ================================================================== *
  *                        Implementation                              *
  * ================================================================== */
@@ -141,6 +209,7 @@ xkb_plugin_class_init (XkbPluginClass *klass)
   plugin_class->configure_plugin = xkb_plugin_configure_plugin;
   plugin_class->orientation_changed = xkb_plugin_orientation_changed;
   plugin_class->size_changed = xkb_plugin_size_changed;
+  plugin_class->remote_event = xkb_plugin_remote_event;
 }
 
 
@@ -151,11 +220,38 @@ xkb_plugin_init (XkbPlugin *plugin)
   plugin->config = NULL;
   plugin->keyboard = NULL;
   plugin->modifier = NULL;
+  plugin->publisher = NULL;
+  plugin->dbus = NULL;
+#ifdef HAVE_DEBUG_TOOLS
+  plugin->recorder = NULL;
+#endif
 
   plugin->button = NULL;
   plugin->layout_image = NULL;
   plugin->popup = NULL;
-  plugin->popup_user_data = NULL;
+  plugin->popup_items = g_ptr_array_new_with_free_func (g_free);
+  plugin->popup_prepare_id = 0;
+
+  plugin->tooltip_box = NULL;
+  plugin->tooltip_image = NULL;
+  plugin->tooltip_label = NULL;
+
+  plugin->image_cache = NULL;
+  plugin->image_cache_width = 0;
+  plugin->image_cache_height = 0;
+  plugin->image_cache_scale = 0;
+  plugin->image_cache_state = 0;
+  plugin->image_cache_restored = FALSE;
+
+  plugin->snapshot = NULL;
+
+  plugin->visible = FALSE;
+  plugin->obscured = FALSE;
+  plugin->refresh_pending = FALSE;
+  plugin->toplevel = NULL;
+  plugin->toplevel_configure_handler_id = 0;
+  plugin->toplevel_visibility_handler_id = 0;
+  plugin->toplevel_state_handler_id = 0;
 }
 
 
@@ -166,19 +262,23 @@ xkb_plugin_construct (XfcePanelPlugin *plugin)
   XkbPlugin      *xkb_plugin;
   GtkWidget      *configure_layouts;
   GtkCssProvider *css_provider;
+  gchar          *snapshot_name;
+#ifdef HAVE_DEBUG_TOOLS
+  const gchar    *record_filename;
+#endif
 
   xkb_plugin = XKB_PLUGIN (plugin);
 
+  xkb_audit_begin (XKB_AUDIT_OP_STARTUP);
+
+  snapshot_name = g_strdup_printf ("button-%d", xfce_panel_plugin_get_unique_id (plugin));
+  xkb_plugin->snapshot = xkb_snapshot_new (snapshot_name);
+  g_free (snapshot_name);
+
   xkb_plugin->config = xkb_xfconf_new (xfce_panel_plugin_get_property_base (plugin));
 
-  g_signal_connect_swapped (G_OBJECT (xkb_plugin->config), "notify::" DISPLAY_TYPE,
-                            G_CALLBACK (xkb_plugin_update_size_allocation), xkb_plugin);
-  g_signal_connect_swapped (G_OBJECT (xkb_plugin->config), "notify::" DISPLAY_NAME,
-                            G_CALLBACK (xkb_plugin_refresh_gui), xkb_plugin);
-  g_signal_connect_swapped (G_OBJECT (xkb_plugin->config), "notify::" DISPLAY_SCALE,
-                            G_CALLBACK (xkb_plugin_refresh_gui), xkb_plugin);
-  g_signal_connect_swapped (G_OBJECT (xkb_plugin->config), "notify::" CAPS_LOCK_INDICATOR,
-                            G_CALLBACK (xkb_plugin_refresh_gui), xkb_plugin);
+  g_signal_connect_swapped (G_OBJECT (xkb_plugin->config), "configuration-changed",
+                            G_CALLBACK (xkb_plugin_configuration_changed), xkb_plugin);
 
   xkb_plugin->button = gtk_button_new ();
   gtk_button_set_relief (GTK_BUTTON (xkb_plugin->button), GTK_RELIEF_NONE);
@@ -206,6 +306,15 @@ xkb_plugin_construct (XfcePanelPlugin *plugin)
   g_signal_connect (xkb_plugin->button, "query-tooltip",
                     G_CALLBACK (xkb_plugin_set_tooltip), xkb_plugin);
 
+  /* the panel may be moved to a monitor with a different scale factor */
+  g_signal_connect_swapped (xkb_plugin->button, "notify::scale-factor",
+                            G_CALLBACK (xkb_plugin_scale_factor_changed), xkb_plugin);
+
+  g_signal_connect_swapped (xkb_plugin->button, "map",
+                            G_CALLBACK (xkb_plugin_button_mapped), xkb_plugin);
+  g_signal_connect_swapped (xkb_plugin->button, "unmap",
+                            G_CALLBACK (xkb_plugin_button_unmapped), xkb_plugin);
+
   xkb_plugin->layout_image = gtk_image_new ();
   gtk_container_add (GTK_CONTAINER (xkb_plugin->button), xkb_plugin->layout_image);
   g_signal_connect (G_OBJECT (xkb_plugin->layout_image), "draw",
@@ -220,7 +329,7 @@ xkb_plugin_construct (XfcePanelPlugin *plugin)
   if (xkb_keyboard_get_initialized (xkb_plugin->keyboard))
     {
       xkb_plugin_refresh_gui (xkb_plugin);
-      xkb_plugin_popup_menu_populate (xkb_plugin);
+      xkb_plugin_popup_menu_schedule (xkb_plugin);
     }
 
   xkb_plugin->modifier = xkb_modifier_new ();
@@ -228,6 +337,20 @@ xkb_plugin_construct (XfcePanelPlugin *plugin)
   g_signal_connect_swapped (G_OBJECT (xkb_plugin->modifier), "modifier-changed",
                             G_CALLBACK (xkb_plugin_modifier_changed), xkb_plugin);
 
+  if (xkb_keyboard_get_initialized (xkb_plugin->keyboard))
+    {
+      xkb_plugin->publisher = xkb_publisher_new (xkb_plugin->keyboard, xkb_plugin->modifier);
+      xkb_plugin->dbus = xkb_dbus_new (xkb_plugin->keyboard);
+
+#ifdef HAVE_DEBUG_TOOLS
+      /* a trace for xkb-plugin-host --replay */
+      record_filename = g_getenv ("XFCE4_XKB_RECORD");
+      if (record_filename != NULL && *record_filename != '\0')
+        xkb_plugin->recorder = xkb_recorder_new (record_filename, xkb_plugin->keyboard,
+                                                 xkb_plugin->config);
+#endif
+    }
+
   xfce_textdomain (GETTEXT_PACKAGE, LOCALEDIR, "UTF-8");
 
   xfce_panel_plugin_menu_show_configure (plugin);
@@ -241,6 +364,8 @@ xkb_plugin_construct (XfcePanelPlugin *plugin)
 
   g_signal_connect (G_OBJECT (configure_layouts), "activate",
                     G_CALLBACK (xkb_plugin_configure_layout), NULL);
+
+  xkb_audit_end (XKB_AUDIT_OP_STARTUP);
 }
 
 
@@ -271,11 +396,54 @@ static void
 xkb_plugin_free_data (XfcePanelPlugin *plugin)
 {
   XkbPlugin *xkb_plugin = XKB_PLUGIN (plugin);
+  gchar     *image_key;
+
+  if (xkb_plugin->popup_prepare_id != 0)
+    g_source_remove (xkb_plugin->popup_prepare_id);
+
+  xkb_plugin_toplevel_release (xkb_plugin);
+
+  xkb_audit_report ();
+  xkb_trace_flush ();
 
   xkb_plugin_popup_menu_destroy (xkb_plugin);
+  g_ptr_array_unref (xkb_plugin->popup_items);
+
+  if (xkb_plugin->image_cache != NULL)
+    {
+      image_key = xkb_plugin_layout_image_key (xkb_plugin,
+                                               xkb_plugin->image_cache_width,
+                                               xkb_plugin->image_cache_height,
+                                               xkb_plugin->image_cache_scale,
+                                               xkb_plugin->image_cache_state);
+      xkb_snapshot_set_image (xkb_plugin->snapshot, image_key, xkb_plugin->image_cache);
+      xkb_snapshot_save (xkb_plugin->snapshot);
+      g_free (image_key);
+    }
+  g_object_unref (xkb_plugin->snapshot);
+
+  xkb_plugin_image_cache_clear (xkb_plugin);
+
+  if (xkb_plugin->tooltip_box != NULL)
+    {
+      gtk_widget_destroy (xkb_plugin->tooltip_box);
+      g_object_unref (xkb_plugin->tooltip_box);
+    }
+
   gtk_widget_destroy (xkb_plugin->layout_image);
   gtk_widget_destroy (xkb_plugin->button);
 
+  if (xkb_plugin->dbus != NULL)
+    g_object_unref (G_OBJECT (xkb_plugin->dbus));
+
+  if (xkb_plugin->publisher != NULL)
+    g_object_unref (G_OBJECT (xkb_plugin->publisher));
+
+#ifdef HAVE_DEBUG_TOOLS
+  if (xkb_plugin->recorder != NULL)
+    g_object_unref (G_OBJECT (xkb_plugin->recorder));
+#endif
+
   g_object_unref (G_OBJECT (xkb_plugin->modifier));
   g_object_unref (G_OBJECT (xkb_plugin->keyboard));
   g_object_unref (G_OBJECT (xkb_plugin->config));
@@ -308,15 +476,32 @@ xkb_plugin_state_changed (XkbPlugin *plugin,
   xkb_plugin_refresh_gui (plugin);
 
   if (config_changed)
-    xkb_plugin_popup_menu_populate (plugin);
+    {
+      xkb_plugin_popup_menu_update (plugin, xkb_keyboard_get_changed_groups (plugin->keyboard));
+      xkb_plugin_popup_menu_schedule (plugin);
+    }
 }
 
 
 
 static void
-xkb_plugin_modifier_changed (XkbPlugin *plugin)
+xkb_plugin_scale_factor_changed (XkbPlugin *plugin)
 {
   xkb_plugin_refresh_gui (plugin);
+
+  /* menu icons are rendered per scale factor */
+  xkb_plugin_popup_menu_update (plugin, G_MAXUINT);
+}
+
+
+
+static void
+xkb_plugin_modifier_changed (XkbPlugin *plugin)
+{
+  /* indicators are only drawn on the system label */
+  if (xkb_xfconf_get_display_type (plugin->config) == DISPLAY_TYPE_SYSTEM &&
+      xkb_xfconf_get_caps_lock_indicator (plugin->config))
+    xkb_plugin_refresh_gui (plugin);
 }
 
 
@@ -342,6 +527,11 @@ xkb_plugin_calculate_sizes (XkbPlugin      *plugin,
   gboolean       proportional;
   XkbDisplayType display_type;
 
+#ifdef HAVE_DEBUG_TOOLS
+  if (plugin->recorder != NULL)
+    xkb_recorder_size_changed (plugin->recorder, orientation, panel_size);
+#endif
+
   display_type = xkb_xfconf_get_display_type (plugin->config);
   nrows = xfce_panel_plugin_get_nrows (XFCE_PANEL_PLUGIN (plugin));
   panel_size /= nrows;
@@ -396,8 +586,7 @@ xkb_plugin_popup_menu_destroy (XkbPlugin *plugin)
     {
       gtk_menu_popdown (GTK_MENU (plugin->popup));
       gtk_menu_detach (GTK_MENU (plugin->popup));
-      g_free (plugin->popup_user_data);
-      plugin->popup_user_data = NULL;
+      g_ptr_array_set_size (plugin->popup_items, 0);
       plugin->popup = NULL;
     }
 }
@@ -405,41 +594,138 @@ xkb_plugin_popup_menu_destroy (XkbPlugin *plugin)
 
 
 static void
-xkb_plugin_popup_menu_populate (XkbPlugin *plugin)
+xkb_plugin_popup_menu_item_update (XkbPlugin    *plugin,
+                                   MenuItemData *item_data)
+{
+  cairo_surface_t *surface;
+
+  surface = xkb_keyboard_get_icon_surface (plugin->keyboard, item_data->group,
+                                           gtk_widget_get_scale_factor (plugin->button));
+
+  gtk_image_set_from_surface (GTK_IMAGE (item_data->image), surface);
+  gtk_widget_set_visible (item_data->image, surface != NULL);
+
+  gtk_label_set_text (GTK_LABEL (item_data->label),
+                      xkb_keyboard_get_pretty_layout_name (plugin->keyboard, item_data->group));
+}
+
+
+
+static void
+xkb_plugin_popup_menu_item_append (XkbPlugin *plugin)
 {
-  gint       i, group_count;
-  gchar     *layout_string;
-  GtkWidget *menu_item;
+  MenuItemData *item_data;
+  GtkWidget    *box;
+
+  item_data = g_new0 (MenuItemData, 1);
+  item_data->plugin = plugin;
+  item_data->group = plugin->popup_items->len;
+
+  item_data->item = gtk_menu_item_new ();
+  box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+  item_data->image = gtk_image_new ();
+  item_data->label = gtk_label_new (NULL);
+  gtk_box_pack_start (GTK_BOX (box), item_data->image, FALSE, FALSE, 0);
+  gtk_box_pack_start (GTK_BOX (box), item_data->label, FALSE, FALSE, 0);
+  gtk_container_add (GTK_CONTAINER (item_data->item), box);
 
-  if (G_UNLIKELY (plugin == NULL))
+  g_signal_connect (G_OBJECT (item_data->item), "activate",
+                    G_CALLBACK (xkb_plugin_set_group), item_data);
+
+  gtk_widget_show (item_data->label);
+  gtk_widget_show (box);
+  gtk_widget_show (item_data->item);
+  gtk_menu_shell_append (GTK_MENU_SHELL (plugin->popup), item_data->item);
+
+  g_ptr_array_add (plugin->popup_items, item_data);
+
+  xkb_plugin_popup_menu_item_update (plugin, item_data);
+}
+
+
+
+/*
+ * Brings the menu in line with the keyboard model, touching only the items
+ * of groups in changed_groups and the items added or removed at the end.
+ */
+static void
+xkb_plugin_popup_menu_update (XkbPlugin *plugin,
+                              guint      changed_groups)
+{
+  gint          i, group_count;
+  MenuItemData *item_data;
+
+  if (plugin->popup == NULL)
     return;
 
   group_count = xkb_keyboard_get_group_count (plugin->keyboard);
 
-  xkb_plugin_popup_menu_destroy (plugin);
-  plugin->popup = gtk_menu_new ();
-  plugin->popup_user_data = g_new0 (MenuItemData, group_count);
+  while ((gint) plugin->popup_items->len > group_count)
+    {
+      item_data = g_ptr_array_index (plugin->popup_items, plugin->popup_items->len - 1);
+      gtk_widget_destroy (item_data->item);
+      g_ptr_array_remove_index (plugin->popup_items, plugin->popup_items->len - 1);
+    }
 
   for (i = 0; i < group_count; i++)
     {
-      layout_string = xkb_keyboard_get_pretty_layout_name (plugin->keyboard, i);
+      if (i >= (gint) plugin->popup_items->len)
+        xkb_plugin_popup_menu_item_append (plugin);
+      else if (changed_groups & (1 << i))
+        xkb_plugin_popup_menu_item_update (plugin, g_ptr_array_index (plugin->popup_items, i));
+    }
+}
 
-      menu_item = gtk_menu_item_new_with_label (layout_string);
 
-      plugin->popup_user_data[i].plugin = plugin;
-      plugin->popup_user_data[i].group = i;
 
-      g_signal_connect (G_OBJECT (menu_item), "activate",
-                        G_CALLBACK (xkb_plugin_set_group), &plugin->popup_user_data[i]);
+static void
+xkb_plugin_popup_menu_create (XkbPlugin *plugin)
+{
+  if (G_UNLIKELY (plugin == NULL) || plugin->popup != NULL)
+    return;
 
-      gtk_widget_show (menu_item);
-      gtk_menu_shell_append (GTK_MENU_SHELL (plugin->popup), menu_item);
-    }
+  plugin->popup = gtk_menu_new ();
 
   g_signal_connect_swapped (GTK_MENU_SHELL (plugin->popup), "deactivate",
                             G_CALLBACK (xkb_plugin_popup_menu_deactivate), plugin);
 
   gtk_menu_attach_to_widget (GTK_MENU (plugin->popup), plugin->button, NULL);
+
+  xkb_plugin_popup_menu_update (plugin, G_MAXUINT);
+}
+
+
+
+static gboolean
+xkb_plugin_popup_menu_prepare (gpointer user_data)
+{
+  XkbPlugin *plugin = user_data;
+
+  xkb_audit_count (XKB_AUDIT_POPUP_IDLE);
+
+  plugin->popup_prepare_id = 0;
+
+  /* realize the menu window ahead of time, so the first popup is fast */
+  xkb_plugin_popup_menu_create (plugin);
+  gtk_widget_realize (plugin->popup);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+static void
+xkb_plugin_popup_menu_schedule (XkbPlugin *plugin)
+{
+  /* the menu is only used for more than two groups, see
+   * xkb_plugin_button_clicked (), so don't create it otherwise */
+  if (plugin->popup == NULL && plugin->popup_prepare_id == 0 &&
+      xkb_keyboard_get_group_count (plugin->keyboard) > 2)
+    {
+      plugin->popup_prepare_id = g_idle_add_full (G_PRIORITY_LOW,
+                                                  xkb_plugin_popup_menu_prepare,
+                                                  plugin, NULL);
+    }
 }
 
 
@@ -449,6 +735,8 @@ xkb_plugin_popup_menu_show (GtkWidget      *widget,
                             GdkEventButton *event,
                             XkbPlugin      *plugin)
 {
+  xkb_plugin_popup_menu_create (plugin);
+
   gtk_widget_set_state_flags (widget, GTK_STATE_FLAG_CHECKED, FALSE);
 #if GTK_CHECK_VERSION(3, 22, 0)
   gtk_menu_popup_at_widget (GTK_MENU (plugin->popup), widget,
@@ -473,12 +761,163 @@ xkb_plugin_popup_menu_deactivate (XkbPlugin    *plugin,
 
 
 
+static gboolean
+xkb_plugin_get_on_monitor (XkbPlugin *plugin)
+{
+#if GTK_CHECK_VERSION(3, 22, 0)
+  GdkWindow     *window;
+  GdkMonitor    *monitor;
+  GdkRectangle   geometry, area;
+  gint           x, y;
+
+  window = gtk_widget_get_window (plugin->button);
+  if (window == NULL)
+    return FALSE;
+
+  monitor = gdk_display_get_monitor_at_window (gdk_window_get_display (window), window);
+  if (monitor == NULL)
+    return TRUE;
+
+  gdk_monitor_get_geometry (monitor, &geometry);
+  gtk_widget_get_allocation (plugin->button, &area);
+  gdk_window_get_origin (window, &x, &y);
+  area.x += x;
+  area.y += y;
+
+  /* an autohidden panel is moved off the monitor */
+  return gdk_rectangle_intersect (&geometry, &area, NULL);
+#else
+  return TRUE;
+#endif
+}
+
+
+
+static void
+xkb_plugin_update_visibility (XkbPlugin *plugin)
+{
+  GdkWindow *window;
+
+  window = gtk_widget_get_window (plugin->button);
+
+  plugin->visible = gtk_widget_get_mapped (plugin->button) &&
+                    window != NULL &&
+                    !(gdk_window_get_state (gdk_window_get_toplevel (window)) &
+                      (GDK_WINDOW_STATE_WITHDRAWN | GDK_WINDOW_STATE_ICONIFIED)) &&
+                    !plugin->obscured &&
+                    xkb_plugin_get_on_monitor (plugin);
+
+  if (plugin->visible && plugin->refresh_pending)
+    xkb_plugin_refresh_gui (plugin);
+}
+
+
+
+static gboolean
+xkb_plugin_toplevel_configured (GtkWidget *toplevel,
+                                GdkEvent  *event,
+                                XkbPlugin *plugin)
+{
+  xkb_plugin_update_visibility (plugin);
+
+  return FALSE;
+}
+
+
+
+static gboolean
+xkb_plugin_toplevel_visibility (GtkWidget          *toplevel,
+                                GdkEventVisibility *event,
+                                XkbPlugin          *plugin)
+{
+  /* never reported by compositing managers, which keep every window
+   * unobscured, the monitor check still catches autohide there */
+  plugin->obscured = event->state == GDK_VISIBILITY_FULLY_OBSCURED;
+  xkb_plugin_update_visibility (plugin);
+
+  return FALSE;
+}
+
+
+
+static void
+xkb_plugin_toplevel_release (XkbPlugin *plugin)
+{
+  if (plugin->toplevel == NULL)
+    return;
+
+  g_signal_handler_disconnect (plugin->toplevel, plugin->toplevel_configure_handler_id);
+  g_signal_handler_disconnect (plugin->toplevel, plugin->toplevel_visibility_handler_id);
+  g_signal_handler_disconnect (plugin->toplevel, plugin->toplevel_state_handler_id);
+  g_object_remove_weak_pointer (G_OBJECT (plugin->toplevel), (gpointer *) &plugin->toplevel);
+
+  plugin->toplevel = NULL;
+}
+
+
+
+static void
+xkb_plugin_button_mapped (XkbPlugin *plugin)
+{
+  GtkWidget *toplevel;
+  GdkWindow *window;
+
+  toplevel = gtk_widget_get_toplevel (plugin->button);
+
+  if (toplevel != plugin->toplevel && gtk_widget_is_toplevel (toplevel))
+    {
+      xkb_plugin_toplevel_release (plugin);
+
+      plugin->toplevel = toplevel;
+      g_object_add_weak_pointer (G_OBJECT (toplevel), (gpointer *) &plugin->toplevel);
+
+      window = gtk_widget_get_window (toplevel);
+      if (window != NULL)
+        gdk_window_set_events (window, gdk_window_get_events (window) | GDK_VISIBILITY_NOTIFY_MASK);
+      else
+        gtk_widget_add_events (toplevel, GDK_VISIBILITY_NOTIFY_MASK);
+
+      plugin->obscured = FALSE;
+      plugin->toplevel_configure_handler_id =
+        g_signal_connect (toplevel, "configure-event",
+                          G_CALLBACK (xkb_plugin_toplevel_configured), plugin);
+      plugin->toplevel_visibility_handler_id =
+        g_signal_connect (toplevel, "visibility-notify-event",
+                          G_CALLBACK (xkb_plugin_toplevel_visibility), plugin);
+      plugin->toplevel_state_handler_id =
+        g_signal_connect (toplevel, "window-state-event",
+                          G_CALLBACK (xkb_plugin_toplevel_configured), plugin);
+    }
+
+  xkb_plugin_update_visibility (plugin);
+}
+
+
+
+static void
+xkb_plugin_button_unmapped (XkbPlugin *plugin)
+{
+  plugin->visible = FALSE;
+}
+
+
+
 static void
 xkb_plugin_refresh_gui (XkbPlugin *plugin)
 {
-   GdkDisplay    *display;
+  GdkDisplay    *display;
   GtkAllocation  allocation;
 
+  if (!plugin->visible)
+    {
+      plugin->refresh_pending = TRUE;
+      return;
+    }
+
+  plugin->refresh_pending = FALSE;
+
+  xkb_plugin_image_cache_clear (plugin);
+
   gtk_widget_get_allocation (plugin->button, &allocation);
 
   /* Part of the image may remain visible after display type change */
@@ -581,6 +1020,113 @@ xkb_plugin_button_scrolled (GtkWidget      *button,
 
 
 
+static gint
+xkb_plugin_remote_event_group (XkbPlugin    *plugin,
+                               const GValue *value)
+{
+  const gchar *str;
+  gchar       *layout, *variant, *end;
+  gint64       index;
+  gint         group;
+
+  if (value == NULL)
+    return -1;
+
+  if (G_VALUE_HOLDS_INT (value))
+    return g_value_get_int (value);
+
+  if (G_VALUE_HOLDS_UINT (value))
+    return g_value_get_uint (value);
+
+  if (!G_VALUE_HOLDS_STRING (value) || (str = g_value_get_string (value)) == NULL)
+    return -1;
+
+  /* either a group index or a layout code like "us" or "us(intl)" */
+  index = g_ascii_strtoll (str, &end, 10);
+  if (end != str && *end == '\0')
+    return index >= 0 && index <= G_MAXINT ? (gint) index : -1;
+
+  layout = g_strdup (str);
+  variant = strchr (layout, '(');
+  if (variant != NULL && g_str_has_suffix (variant, ")"))
+    {
+      *variant++ = '\0';
+      variant[strlen (variant) - 1] = '\0';
+    }
+
+  group = xkb_keyboard_find_group (plugin->keyboard, layout, variant);
+
+  /* layouts of another layout set bring their set in */
+  if (group < 0 && xkb_keyboard_activate_layout (plugin->keyboard, layout, variant))
+    group = xkb_keyboard_find_group (plugin->keyboard, layout, variant);
+
+  g_free (layout);
+
+  return group;
+}
+
+
+
+static gboolean
+xkb_plugin_remote_event (XfcePanelPlugin *plugin,
+                         const gchar     *name,
+                         const GValue    *value)
+{
+  XkbPlugin *xkb_plugin = XKB_PLUGIN (plugin);
+  gint       group, group_count;
+
+  g_return_val_if_fail (name != NULL, FALSE);
+
+  xkb_audit_count (XKB_AUDIT_REMOTE_EVENT);
+
+  if (!xkb_keyboard_get_initialized (xkb_plugin->keyboard))
+    return FALSE;
+
+  group_count = xkb_keyboard_get_group_count (xkb_plugin->keyboard);
+  if (G_UNLIKELY (group_count <= 0))
+    return FALSE;
+
+  group = xkb_keyboard_get_current_group (xkb_plugin->keyboard);
+
+  if (strcmp (name, "set-group") == 0)
+    group = xkb_plugin_remote_event_group (xkb_plugin, value);
+  else if (strcmp (name, "next-group") == 0)
+    group = (group + 1) % group_count;
+  else if (strcmp (name, "prev-group") == 0)
+    group = (group + group_count - 1) % group_count;
+  else if (strcmp (name, "set-layout-set") == 0)
+    {
+      if (value != NULL && G_VALUE_HOLDS_INT (value))
+        return xkb_keyboard_set_layout_set (xkb_plugin->keyboard, g_value_get_int (value));
+      if (value != NULL && G_VALUE_HOLDS_UINT (value))
+        return xkb_keyboard_set_layout_set (xkb_plugin->keyboard, g_value_get_uint (value));
+      return FALSE;
+    }
+  else if (strcmp (name, "next-layout-set") == 0)
+    return xkb_keyboard_next_layout_set (xkb_plugin->keyboard);
+  else if (strcmp (name, "query") == 0)
+    {
+      /* remote events are one way, the answer goes out on the bus */
+      if (xkb_plugin->dbus != NULL)
+        xkb_dbus_announce (xkb_plugin->dbus);
+      return TRUE;
+    }
+  else
+    return FALSE;
+
+  /* a layout set brought in for the group has locked it already */
+  if (group >= 0 && group == xkb_keyboard_get_current_group (xkb_plugin->keyboard))
+    return TRUE;
+
+  /* redraw right away instead of waiting for the XKB round trip */
+  if (xkb_keyboard_set_group (xkb_plugin->keyboard, group))
+    xkb_plugin_refresh_gui (xkb_plugin);
+
+  return TRUE;
+}
+
+
+
 static gboolean
 xkb_plugin_set_tooltip (GtkWidget  *widget,
                         gint        x,
@@ -589,101 +1135,187 @@ xkb_plugin_set_tooltip (GtkWidget  *widget,
                         GtkTooltip *tooltip,
                         XkbPlugin  *plugin)
 {
-  gchar     *layout_name;
-  GdkPixbuf *pixbuf;
+  gchar           *layout_name;
+  cairo_surface_t *surface = NULL;
 
-  if (xkb_xfconf_get_display_tooltip_icon (plugin->config))
+  xkb_trace_begin ("set-tooltip");
+
+  /* a custom widget is used instead of gtk_tooltip_set_icon (), which
+   * only takes a pixbuf and would show it at the wrong size on HiDPI */
+  if (plugin->tooltip_box == NULL)
     {
-      pixbuf = xkb_keyboard_get_pixbuf (plugin->keyboard, TRUE, -1);
-      gtk_tooltip_set_icon (tooltip, pixbuf);
+      plugin->tooltip_box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+      g_object_ref_sink (plugin->tooltip_box);
+
+      plugin->tooltip_image = gtk_image_new ();
+      gtk_box_pack_start (GTK_BOX (plugin->tooltip_box), plugin->tooltip_image, FALSE, FALSE, 0);
+
+      plugin->tooltip_label = gtk_label_new (NULL);
+      gtk_box_pack_start (GTK_BOX (plugin->tooltip_box), plugin->tooltip_label, FALSE, FALSE, 0);
+      gtk_widget_show (plugin->tooltip_label);
+      gtk_widget_show (plugin->tooltip_box);
     }
 
+  if (xkb_xfconf_get_display_tooltip_icon (plugin->config))
+    surface = xkb_keyboard_get_icon_surface (plugin->keyboard, -1,
+                                             gtk_widget_get_scale_factor (widget));
+
+  gtk_image_set_from_surface (GTK_IMAGE (plugin->tooltip_image), surface);
+  gtk_widget_set_visible (plugin->tooltip_image, surface != NULL);
+
   layout_name = xkb_keyboard_get_pretty_layout_name (plugin->keyboard, -1);
 
-  gtk_tooltip_set_text (tooltip, layout_name);
+  gtk_label_set_text (GTK_LABEL (plugin->tooltip_label), layout_name != NULL ? layout_name : "");
+  gtk_tooltip_set_custom (tooltip, plugin->tooltip_box);
+
+  xkb_trace_end ("set-tooltip");
 
   return TRUE;
 }
 
 
 
-static gboolean
-xkb_plugin_layout_image_draw (GtkWidget *widget,
-                              cairo_t   *cr,
-                              XkbPlugin *plugin)
+/*
+ * Describes everything the button image is rendered from, an image of
+ * the last run with the same key can be painted as is.
+ */
+static gchar *
+xkb_plugin_layout_image_key (XkbPlugin     *plugin,
+                             gint           width,
+                             gint           height,
+                             gint           scale_factor,
+                             GtkStateFlags  state)
 {
-  const gchar          *group_name;
-  gint                  variant_index;
-  GdkPixbuf            *pixbuf;
-  GtkAllocation         allocation;
   GtkStyleContext      *style_ctx;
-  GtkStateFlags         state;
   PangoFontDescription *desc;
   GdkRGBA               rgba;
-  gint                  actual_hsize, actual_vsize;
-  XkbDisplayType        display_type;
   XkbDisplayName        display_name;
-  gint                  display_scale;
-  gboolean              caps_lock_indicator;
-  gboolean              caps_lock_enabled;
+  const gchar          *group_name;
+  gchar                *font, *color, *key;
+  guint                 indicators;
+
+  style_ctx = gtk_widget_get_style_context (plugin->button);
+  gtk_style_context_get_color (style_ctx, state, &rgba);
+  gtk_style_context_get (style_ctx, state, "font", &desc, NULL);
+
+  font = pango_font_description_to_string (desc);
+  color = gdk_rgba_to_string (&rgba);
+  pango_font_description_free (desc);
 
-  display_type = xkb_xfconf_get_display_type (plugin->config);
   display_name = xkb_xfconf_get_display_name (plugin->config);
-  display_scale = xkb_xfconf_get_display_scale (plugin->config);
-  caps_lock_indicator = xkb_xfconf_get_caps_lock_indicator (plugin->config);
+  indicators = xkb_xfconf_get_caps_lock_indicator (plugin->config) ? INDICATOR_CAPS_LOCK : 0;
+  indicators &= xkb_modifier_get_indicators (plugin->modifier);
+
+  group_name = xkb_keyboard_get_group_name (plugin->keyboard, display_name, -1);
+
+  key = g_strdup_printf ("%dx%d@%d %u %u %u %u %u %s %d %u %s %s",
+                         width, height, scale_factor, state,
+                         xkb_xfconf_get_display_type (plugin->config),
+                         display_name,
+                         xkb_xfconf_get_display_scale (plugin->config),
+                         indicators,
+                         group_name != NULL ? group_name : "",
+                         xkb_keyboard_get_variant_index (plugin->keyboard, display_name, -1),
+                         xkb_keyboard_get_max_group_count (plugin->keyboard),
+                         color, font);
+
+  g_free (font);
+  g_free (color);
+
+  return key;
+}
 
-  gtk_widget_get_allocation (widget, &allocation);
-  actual_hsize = allocation.width;
-  actual_vsize = allocation.height;
 
+
+static gboolean
+xkb_plugin_layout_image_draw (GtkWidget *widget,
+                              cairo_t   *cr,
+                              XkbPlugin *plugin)
+{
+  GtkAllocation  allocation;
+  GtkStateFlags  state;
+  gint           scale_factor;
+  cairo_t       *cache_cr;
+  gchar         *image_key;
+
+  gtk_widget_get_allocation (widget, &allocation);
   state = gtk_widget_get_state_flags (plugin->button);
-  style_ctx = gtk_widget_get_style_context (plugin->button);
-  gtk_style_context_get_color (style_ctx, state, &rgba);
+  scale_factor = gtk_widget_get_scale_factor (widget);
 
-  group_name = xkb_keyboard_get_group_name (plugin->keyboard, display_name, -1);
-  pixbuf = xkb_keyboard_get_pixbuf (plugin->keyboard, FALSE, -1);
-  variant_index = xkb_keyboard_get_variant_index (plugin->keyboard, display_name, -1);
-  caps_lock_enabled = xkb_modifier_get_caps_lock_enabled (plugin->modifier);
+  if (allocation.width <= 0 || allocation.height <= 0)
+    return FALSE;
 
-  if (pixbuf == NULL && display_type == DISPLAY_TYPE_IMAGE)
-    display_type = DISPLAY_TYPE_TEXT;
+  xkb_trace_begin ("layout-image-draw");
+  XKB_PROBE_DRAW_START (allocation.width, allocation.height);
 
-  DBG ("img_exposed: actual h/v (%d/%d)", actual_hsize, actual_vsize);
+  if (plugin->image_cache != NULL &&
+      (plugin->image_cache_width != allocation.width ||
+       plugin->image_cache_height != allocation.height ||
+       plugin->image_cache_scale != scale_factor ||
+       plugin->image_cache_state != state))
+    xkb_plugin_image_cache_clear (plugin);
 
-  switch (display_type)
+  /* render at device resolution once, then only blit on further draws */
+  if (plugin->image_cache == NULL)
     {
-    case DISPLAY_TYPE_IMAGE:
-      xkb_cairo_draw_flag (cr, pixbuf,
-                           actual_hsize, actual_vsize,
-                           variant_index,
-                           xkb_keyboard_get_max_group_count (plugin->keyboard),
-                           display_scale);
-      break;
+      /* the first image may come from the last run, the key is only
+       * worth building for that one and for saving the last image */
+      if (!plugin->image_cache_restored)
+        {
+          plugin->image_cache_restored = TRUE;
 
-    case DISPLAY_TYPE_TEXT:
-      xkb_cairo_draw_label (cr, group_name,
-                            actual_hsize, actual_vsize,
-                            variant_index,
-                            display_scale,
-                            rgba);
-      break;
+          image_key = xkb_plugin_layout_image_key (plugin,
+                                                   allocation.width, allocation.height,
+                                                   scale_factor, state);
+          plugin->image_cache = xkb_snapshot_get_image (plugin->snapshot, image_key);
+          g_free (image_key);
+        }
 
-    case DISPLAY_TYPE_SYSTEM:
-      gtk_style_context_get (style_ctx, state, "font", &desc, NULL);
+      if (plugin->image_cache == NULL)
+        {
+          plugin->image_cache =
+            gdk_window_create_similar_image_surface (gtk_widget_get_window (widget),
+                                                     CAIRO_FORMAT_ARGB32,
+                                                     allocation.width * scale_factor,
+                                                     allocation.height * scale_factor,
+                                                     scale_factor);
+
+          cache_cr = cairo_create (plugin->image_cache);
+          xkb_render_layout_image (cache_cr, plugin->config, plugin->keyboard, plugin->modifier,
+                                   gtk_widget_get_style_context (plugin->button), state,
+                                   allocation.width, allocation.height);
+          cairo_destroy (cache_cr);
+        }
 
-      xkb_cairo_draw_label_system (cr, group_name,
-                                   actual_hsize, actual_vsize,
-                                   variant_index,
-                                   caps_lock_indicator && caps_lock_enabled,
-                                   desc, rgba);
-      break;
+      plugin->image_cache_width = allocation.width;
+      plugin->image_cache_height = allocation.height;
+      plugin->image_cache_scale = scale_factor;
+      plugin->image_cache_state = state;
     }
 
+  cairo_set_source_surface (cr, plugin->image_cache, 0, 0);
+  cairo_paint (cr);
+
+  XKB_PROBE_DRAW_END (allocation.width, allocation.height);
+  xkb_trace_end ("layout-image-draw");
+
   return FALSE;
 }
 
 
 
+static void
+xkb_plugin_image_cache_clear (XkbPlugin *plugin)
+{
+  if (plugin->image_cache != NULL)
+    {
+      cairo_surface_destroy (plugin->image_cache);
+      plugin->image_cache = NULL;
+    }
+}
+
+
+
 static void
 xkb_plugin_update_size_allocation (XkbPlugin *plugin)
 {
@@ -691,3 +1323,18 @@ xkb_plugin_update_size_allocation (XkbPlugin *plugin)
                               xfce_panel_plugin_get_orientation (XFCE_PANEL_PLUGIN (plugin)),
                               xfce_panel_plugin_get_size (XFCE_PANEL_PLUGIN (plugin)));
 }
+
+
+
+static void
+xkb_plugin_configuration_changed (XkbPlugin *plugin,
+                                  guint      changes)
+{
+  /* recalculating the sizes refreshes the button as well */
+  if (changes & XKB_XFCONF_CHANGED_DISPLAY_TYPE)
+    xkb_plugin_update_size_allocation (plugin);
+  else if (changes & (XKB_XFCONF_CHANGED_DISPLAY_NAME
+                      | XKB_XFCONF_CHANGED_DISPLAY_SCALE
+                      | XKB_XFCONF_CHANGED_CAPS_LOCK_INDICATOR))
+    xkb_plugin_refresh_gui (plugin);
+}
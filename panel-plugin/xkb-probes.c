@@ -0,0 +1,85 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-probes.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xkb-probes.h"
+
+/*
+ * Sends the probes to sysprof as marks. The probe macros only call in
+ * here while sysprof is recording the panel. Spans remember when they
+ * began and become a single mark with a duration when they end.
+ */
+
+#define XKB_PROBE_MARK_GROUP  "xfce4-xkb"
+
+static gint64 probe_span_begin_time[XKB_PROBE_N_SPANS];
+
+
+
+void
+xkb_probe_mark (const gchar *name,
+                const gchar *format,
+                ...)
+{
+  va_list args;
+
+  va_start (args, format);
+  sysprof_collector_mark_vprintf (SYSPROF_CAPTURE_CURRENT_TIME, 0,
+                                  XKB_PROBE_MARK_GROUP, name, format, args);
+  va_end (args);
+}
+
+
+
+void
+xkb_probe_span_begin (XkbProbeSpan span)
+{
+  g_return_if_fail (span < XKB_PROBE_N_SPANS);
+
+  probe_span_begin_time[span] = SYSPROF_CAPTURE_CURRENT_TIME;
+}
+
+
+
+void
+xkb_probe_span_end (XkbProbeSpan  span,
+                    const gchar  *name,
+                    const gchar  *format,
+                    ...)
+{
+  va_list args;
+  gint64  begin_time;
+
+  g_return_if_fail (span < XKB_PROBE_N_SPANS);
+
+  /* sysprof may have started recording in the middle of the span */
+  begin_time = probe_span_begin_time[span];
+  probe_span_begin_time[span] = 0;
+
+  if (begin_time == 0)
+    return;
+
+  va_start (args, format);
+  sysprof_collector_mark_vprintf (begin_time, SYSPROF_CAPTURE_CURRENT_TIME - begin_time,
+                                  XKB_PROBE_MARK_GROUP, name, format, args);
+  va_end (args);
+}
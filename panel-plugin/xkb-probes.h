@@ -0,0 +1,135 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-probes.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _XKB_PROBES_H_
+#define _XKB_PROBES_H_
+
+#include <glib.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+#ifdef HAVE_SYSPROF
+#include <sysprof-capture.h>
+#endif
+
+G_BEGIN_DECLS
+
+/*
+ * Static probes at the key points of the plugin. With sys/sdt.h they
+ * are USDT probes of the "xfce4_xkb" provider, which compile to a nop
+ * until bpftrace or perf attach to them:
+ *
+ *   bpftrace -e 'usdt:libxkb.so:xfce4_xkb:draw_end { print(arg0) }'
+ *
+ * With sysprof-capture the spans and the group locks are also sent as
+ * marks of the "xfce4-xkb" group while sysprof records. Whether it does
+ * is checked inline, so the probes only cost a call while recording.
+ * X events are only USDT probes, as marks for every X event of the
+ * panel would bury the others.
+ */
+
+typedef enum
+{
+  XKB_PROBE_SPAN_REBUILD,
+  XKB_PROBE_SPAN_DRAW,
+  XKB_PROBE_N_SPANS
+} XkbProbeSpan;
+
+#ifdef HAVE_SYS_SDT_H
+#define XKB_PROBE_USDT1(name, arg1)         DTRACE_PROBE1 (xfce4_xkb, name, arg1)
+#define XKB_PROBE_USDT2(name, arg1, arg2)   DTRACE_PROBE2 (xfce4_xkb, name, arg1, arg2)
+#else
+#define XKB_PROBE_USDT1(name, arg1)         G_STMT_START { } G_STMT_END
+#define XKB_PROBE_USDT2(name, arg1, arg2)   G_STMT_START { } G_STMT_END
+#endif
+
+#ifdef HAVE_SYSPROF
+void        xkb_probe_mark                  (const gchar    *name,
+                                             const gchar    *format,
+                                             ...) G_GNUC_PRINTF (2, 3);
+void        xkb_probe_span_begin            (XkbProbeSpan    span);
+void        xkb_probe_span_end              (XkbProbeSpan    span,
+                                             const gchar    *name,
+                                             const gchar    *format,
+                                             ...) G_GNUC_PRINTF (3, 4);
+#else
+#define xkb_probe_mark(name, ...)           G_STMT_START { } G_STMT_END
+#define xkb_probe_span_begin(span)          G_STMT_START { } G_STMT_END
+#define xkb_probe_span_end(span, name, ...) G_STMT_START { } G_STMT_END
+#endif
+
+#ifdef HAVE_SYSPROF
+#define XKB_PROBE_SYSPROF(call) \
+  G_STMT_START { \
+    if (G_UNLIKELY (sysprof_collector_is_active ())) \
+      call; \
+  } G_STMT_END
+#else
+#define XKB_PROBE_SYSPROF(call)             G_STMT_START { } G_STMT_END
+#endif
+
+#define XKB_PROBE_X_EVENT_ACCEPTED(type) \
+  XKB_PROBE_USDT1 (x_event_accepted, type)
+
+#define XKB_PROBE_X_EVENT_REJECTED(type) \
+  XKB_PROBE_USDT1 (x_event_rejected, type)
+
+#define XKB_PROBE_GROUP_LOCK_REQUESTED(group) \
+  G_STMT_START { \
+    XKB_PROBE_USDT1 (group_lock_requested, group); \
+    XKB_PROBE_SYSPROF (xkb_probe_mark ("group-lock-requested", "group=%d", (gint) (group))); \
+  } G_STMT_END
+
+#define XKB_PROBE_GROUP_LOCK_CONFIRMED(group) \
+  G_STMT_START { \
+    XKB_PROBE_USDT1 (group_lock_confirmed, group); \
+    XKB_PROBE_SYSPROF (xkb_probe_mark ("group-lock-confirmed", "group=%d", (gint) (group))); \
+  } G_STMT_END
+
+#define XKB_PROBE_REBUILD_START(group_count) \
+  G_STMT_START { \
+    XKB_PROBE_USDT1 (rebuild_start, group_count); \
+    XKB_PROBE_SYSPROF (xkb_probe_span_begin (XKB_PROBE_SPAN_REBUILD)); \
+  } G_STMT_END
+
+#define XKB_PROBE_REBUILD_END(group_count) \
+  G_STMT_START { \
+    XKB_PROBE_USDT1 (rebuild_end, group_count); \
+    XKB_PROBE_SYSPROF (xkb_probe_span_end (XKB_PROBE_SPAN_REBUILD, "rebuild", \
+                                           "groups=%d", (gint) (group_count))); \
+  } G_STMT_END
+
+#define XKB_PROBE_DRAW_START(width, height) \
+  G_STMT_START { \
+    XKB_PROBE_USDT2 (draw_start, width, height); \
+    XKB_PROBE_SYSPROF (xkb_probe_span_begin (XKB_PROBE_SPAN_DRAW)); \
+  } G_STMT_END
+
+#define XKB_PROBE_DRAW_END(width, height) \
+  G_STMT_START { \
+    XKB_PROBE_USDT2 (draw_end, width, height); \
+    XKB_PROBE_SYSPROF (xkb_probe_span_end (XKB_PROBE_SPAN_DRAW, "draw", \
+                                           "size=%dx%d", (gint) (width), (gint) (height))); \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif
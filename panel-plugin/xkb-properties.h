@@ -32,6 +32,8 @@
 #define CAPS_LOCK_INDICATOR         "caps-lock-indicator"
 #define DISPLAY_TOOLTIP_ICON        "display-tooltip-icon"
 #define GROUP_POLICY                "group-policy"
+#define GROUP_RULES                 "group-rules"
+#define LAYOUT_SETS                 "layout-sets"
 
 typedef enum
 {
@@ -53,7 +55,16 @@ typedef enum
 {
   GROUP_POLICY_GLOBAL             = 0,
   GROUP_POLICY_PER_WINDOW         = 1,
-  GROUP_POLICY_PER_APPLICATION    = 2
+  GROUP_POLICY_PER_APPLICATION    = 2,
+  GROUP_POLICY_PER_WINDOW_CLASS   = 3,
+  GROUP_POLICY_PER_WORKSPACE      = 4
 } XkbGroupPolicy;
 
+typedef enum
+{
+  INDICATOR_CAPS_LOCK             = 1 << 0,
+  INDICATOR_NUM_LOCK              = 1 << 1,
+  INDICATOR_SCROLL_LOCK           = 1 << 2
+} XkbIndicator;
+
 #endif
@@ -0,0 +1,264 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-publisher.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xkb-publisher.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <gdk/gdk.h>
+
+#include "status/xkb-status-format.h"
+
+struct _XkbPublisherClass
+{
+  GObjectClass         __parent__;
+};
+
+struct _XkbPublisher
+{
+  GObject              __parent__;
+
+  XkbKeyboard         *keyboard;
+  XkbModifier         *modifier;
+
+  gchar               *path;
+  gint                 fd;
+  XkbStatusShared     *shared;
+
+  gulong               state_changed_handler_id;
+  gulong               modifier_changed_handler_id;
+};
+
+static void              xkb_publisher_update                  (XkbPublisher         *publisher);
+static void              xkb_publisher_finalize                (GObject              *object);
+
+G_DEFINE_TYPE (XkbPublisher, xkb_publisher, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_publisher_class_init (XkbPublisherClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_publisher_finalize;
+}
+
+
+
+static void
+xkb_publisher_init (XkbPublisher *publisher)
+{
+  publisher->keyboard = NULL;
+  publisher->modifier = NULL;
+
+  publisher->path = NULL;
+  publisher->fd = -1;
+  publisher->shared = NULL;
+
+  publisher->state_changed_handler_id = 0;
+  publisher->modifier_changed_handler_id = 0;
+}
+
+
+
+/*
+ * The file is named after the display, so every plugin instance of the
+ * panel would write to it. Only the instance holding the lock on it is
+ * the writer of the seqlock, the others try again on their next update
+ * and take over once the owner is gone.
+ */
+static gboolean
+xkb_publisher_acquire (XkbPublisher *publisher)
+{
+  struct stat      fd_stat, path_stat;
+  XkbStatusShared *shared;
+  gpointer         map;
+  gint             fd;
+  guint            sequence;
+
+  fd = open (publisher->path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return FALSE;
+
+  if (flock (fd, LOCK_EX | LOCK_NB) < 0)
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  /* the last owner may have unlinked the file between the open and the lock */
+  if (fstat (fd, &fd_stat) < 0 || stat (publisher->path, &path_stat) < 0 ||
+      fd_stat.st_dev != path_stat.st_dev || fd_stat.st_ino != path_stat.st_ino)
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  if (ftruncate (fd, sizeof (XkbStatusShared)) < 0)
+    {
+      close (fd);
+      return FALSE;
+    }
+
+  map = mmap (NULL, sizeof (XkbStatusShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    {
+      g_warning ("Unable to publish keyboard state to %s", publisher->path);
+      close (fd);
+      return FALSE;
+    }
+
+  /* a writer which died in the middle of an update left the sequence
+   * odd, which would turn the meaning of its parity around for good */
+  shared = map;
+  sequence = g_atomic_int_get ((gint *) &shared->sequence);
+  g_atomic_int_set ((gint *) &shared->sequence, (sequence + 1) & ~1);
+
+  /* the lock is held for as long as the descriptor stays open */
+  publisher->fd = fd;
+  publisher->shared = shared;
+
+  return TRUE;
+}
+
+
+
+XkbPublisher *
+xkb_publisher_new (XkbKeyboard *keyboard,
+                   XkbModifier *modifier)
+{
+  XkbPublisher *publisher;
+  GdkDisplay   *display;
+  gchar         number[16];
+  gchar        *filename;
+
+  publisher = g_object_new (TYPE_XKB_PUBLISHER, NULL);
+
+  publisher->keyboard = g_object_ref (keyboard);
+  publisher->modifier = g_object_ref (modifier);
+
+  display = gdk_display_get_default ();
+  xkb_status_display_number (display != NULL ? gdk_display_get_name (display) : NULL,
+                             number, sizeof (number));
+
+  filename = g_strconcat (XKB_STATUS_FILENAME_PREFIX, number, NULL);
+  publisher->path = g_build_filename (g_get_user_runtime_dir (), filename, NULL);
+  g_free (filename);
+
+  publisher->state_changed_handler_id =
+    g_signal_connect_swapped (G_OBJECT (keyboard), "state-changed",
+                              G_CALLBACK (xkb_publisher_update), publisher);
+  publisher->modifier_changed_handler_id =
+    g_signal_connect_swapped (G_OBJECT (modifier), "modifier-changed",
+                              G_CALLBACK (xkb_publisher_update), publisher);
+
+  xkb_publisher_update (publisher);
+
+  return publisher;
+}
+
+
+
+static void
+xkb_publisher_finalize (GObject *object)
+{
+  XkbPublisher *publisher = XKB_PUBLISHER (object);
+
+  if (publisher->state_changed_handler_id > 0)
+    g_signal_handler_disconnect (publisher->keyboard, publisher->state_changed_handler_id);
+
+  if (publisher->modifier_changed_handler_id > 0)
+    g_signal_handler_disconnect (publisher->modifier, publisher->modifier_changed_handler_id);
+
+  if (publisher->shared != NULL)
+    {
+      /* readers which still have the file mapped see the plugin is gone */
+      g_atomic_int_inc ((gint *) &publisher->shared->sequence);
+      publisher->shared->magic = 0;
+      g_atomic_int_inc ((gint *) &publisher->shared->sequence);
+
+      munmap (publisher->shared, sizeof (XkbStatusShared));
+      unlink (publisher->path);
+      close (publisher->fd);
+    }
+
+  g_free (publisher->path);
+
+  g_object_unref (publisher->modifier);
+  g_object_unref (publisher->keyboard);
+
+  G_OBJECT_CLASS (xkb_publisher_parent_class)->finalize (object);
+}
+
+
+
+static void
+xkb_publisher_copy_string (gchar       *dest,
+                           const gchar *src,
+                           gsize        size)
+{
+  memset (dest, 0, size);
+
+  if (src != NULL)
+    g_strlcpy (dest, src, size);
+}
+
+
+
+static void
+xkb_publisher_update (XkbPublisher *publisher)
+{
+  XkbStatusShared *shared;
+
+  if (publisher->shared == NULL && !xkb_publisher_acquire (publisher))
+    return;
+
+  shared = publisher->shared;
+
+  /* the sequence is odd while the data is being updated,
+   * g_atomic_int_inc () implies a full memory barrier */
+  g_atomic_int_inc ((gint *) &shared->sequence);
+
+  shared->magic = XKB_STATUS_MAGIC;
+  shared->version = XKB_STATUS_VERSION;
+  shared->pid = getpid ();
+
+  shared->group = xkb_keyboard_get_current_group (publisher->keyboard);
+  shared->group_count = xkb_keyboard_get_group_count (publisher->keyboard);
+  shared->caps_lock = xkb_modifier_get_caps_lock_enabled (publisher->modifier);
+
+  xkb_publisher_copy_string (shared->layout,
+                             xkb_keyboard_get_group_name (publisher->keyboard,
+                                                          DISPLAY_NAME_COUNTRY, -1),
+                             sizeof (shared->layout));
+  xkb_publisher_copy_string (shared->variant,
+                             xkb_keyboard_get_variant (publisher->keyboard, -1),
+                             sizeof (shared->variant));
+  xkb_publisher_copy_string (shared->pretty_name,
+                             xkb_keyboard_get_pretty_layout_name (publisher->keyboard, -1),
+                             sizeof (shared->pretty_name));
+
+  g_atomic_int_inc ((gint *) &shared->sequence);
+}
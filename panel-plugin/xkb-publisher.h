@@ -0,0 +1,46 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-publisher.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_PUBLISHER_H_
+#define _XKB_PUBLISHER_H_
+
+#include <glib-object.h>
+
+#include "xkb-keyboard.h"
+#include "xkb-modifier.h"
+
+G_BEGIN_DECLS
+
+typedef struct _XkbPublisherClass      XkbPublisherClass;
+typedef struct _XkbPublisher           XkbPublisher;
+
+#define TYPE_XKB_PUBLISHER             (xkb_publisher_get_type ())
+#define XKB_PUBLISHER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_PUBLISHER, XkbPublisher))
+#define XKB_PUBLISHER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_PUBLISHER, XkbPublisherClass))
+#define IS_XKB_PUBLISHER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_XKB_PUBLISHER))
+#define IS_XKB_PUBLISHER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass),  TYPE_XKB_PUBLISHER))
+#define XKB_PUBLISHER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj),  TYPE_XKB_PUBLISHER, XkbPublisherClass))
+
+GType             xkb_publisher_get_type                    (void)                           G_GNUC_CONST;
+
+XkbPublisher     *xkb_publisher_new                         (XkbKeyboard     *keyboard,
+                                                             XkbModifier     *modifier);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,466 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-recorder.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xkb-recorder.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * The recorder writes everything the plugin reacts to into a text file,
+ * one event per line: the time in microseconds since the recording
+ * started, the event name and its arguments, separated by tabs and
+ * escaped like C strings. The file starts with the state at the time
+ * the recording started, so xkb-plugin-host --replay can feed it back
+ * through the mock backend.
+ */
+
+#define XKB_RECORDER_HEADER     "# xkb-plugin trace 1"
+
+static const gchar *event_names[XKB_RECORDER_N_EVENTS] =
+{
+  "config-changed",
+  "group-changed",
+  "active-window-changed",
+  "window-closed",
+  "application-closed",
+  "workspace-changed",
+  "property-changed",
+  "size-changed"
+};
+
+static const guint event_arg_counts[XKB_RECORDER_N_EVENTS] =
+{
+  1, 1, 4, 1, 1, 1, 2, 2
+};
+
+struct _XkbRecorderClass
+{
+  GObjectClass         __parent__;
+};
+
+struct _XkbRecorder
+{
+  GObject              __parent__;
+
+  FILE                *file;
+  gint64               start_time;
+
+  XkbBackend          *backend;
+  XkbXfconf           *config;
+};
+
+static void              xkb_recorder_finalize                 (GObject              *object);
+
+G_DEFINE_TYPE (XkbRecorder, xkb_recorder, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_recorder_class_init (XkbRecorderClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_recorder_finalize;
+}
+
+
+
+static void
+xkb_recorder_init (XkbRecorder *recorder)
+{
+  recorder->file = NULL;
+  recorder->start_time = 0;
+
+  recorder->backend = NULL;
+  recorder->config = NULL;
+}
+
+
+
+static void
+xkb_recorder_finalize (GObject *object)
+{
+  XkbRecorder *recorder = XKB_RECORDER (object);
+
+  if (recorder->backend != NULL)
+    {
+      g_signal_handlers_disconnect_by_data (recorder->backend, recorder);
+      g_object_unref (recorder->backend);
+    }
+
+  g_signal_handlers_disconnect_by_data (recorder->config, recorder);
+  g_object_unref (recorder->config);
+
+  if (recorder->file != NULL)
+    fclose (recorder->file);
+
+  G_OBJECT_CLASS (xkb_recorder_parent_class)->finalize (object);
+}
+
+
+
+/*
+ * Writes an event with the given NULL-terminated list of arguments.
+ */
+static void
+xkb_recorder_write (XkbRecorder          *recorder,
+                    XkbRecorderEventType  type,
+                    ...)
+{
+  va_list      args;
+  const gchar *arg;
+  gchar       *escaped;
+
+  if (recorder->file == NULL)
+    return;
+
+  fprintf (recorder->file, "%" G_GINT64_FORMAT "\t%s",
+           g_get_monotonic_time () - recorder->start_time, event_names[type]);
+
+  va_start (args, type);
+  while ((arg = va_arg (args, const gchar *)) != NULL)
+    {
+      escaped = g_strescape (arg, NULL);
+      fprintf (recorder->file, "\t%s", escaped);
+      g_free (escaped);
+    }
+  va_end (args);
+
+  fputc ('\n', recorder->file);
+}
+
+
+
+static void
+xkb_recorder_config_changed (XkbBackend  *backend,
+                             XkbRecorder *recorder)
+{
+  GString  *description;
+  gchar   **layouts, **variants;
+  gint      i;
+
+  xkb_backend_get_config (backend, &layouts, &variants);
+
+  description = g_string_new (NULL);
+  for (i = 0; layouts[i] != NULL; i++)
+    {
+      if (i > 0)
+        g_string_append_c (description, ',');
+      g_string_append (description, layouts[i]);
+      if (variants[i] != NULL && *variants[i] != '\0')
+        g_string_append_printf (description, "(%s)", variants[i]);
+    }
+
+  xkb_recorder_write (recorder, XKB_RECORDER_CONFIG_CHANGED, description->str, NULL);
+
+  g_string_free (description, TRUE);
+  g_strfreev (layouts);
+  g_strfreev (variants);
+}
+
+
+
+static void
+xkb_recorder_group_changed (XkbBackend  *backend,
+                            gint         group,
+                            XkbRecorder *recorder)
+{
+  gchar group_str[16];
+
+  g_snprintf (group_str, sizeof (group_str), "%d", group);
+  xkb_recorder_write (recorder, XKB_RECORDER_GROUP_CHANGED, group_str, NULL);
+}
+
+
+
+static void
+xkb_recorder_active_window_changed (XkbBackend  *backend,
+                                    guint        window_id,
+                                    guint        application_id,
+                                    const gchar *wm_class,
+                                    const gchar *title,
+                                    XkbRecorder *recorder)
+{
+  gchar window_str[16], application_str[16];
+
+  g_snprintf (window_str, sizeof (window_str), "%u", window_id);
+  g_snprintf (application_str, sizeof (application_str), "%u", application_id);
+
+  /* windows without a class or title replay with empty ones */
+  xkb_recorder_write (recorder, XKB_RECORDER_ACTIVE_WINDOW_CHANGED,
+                      window_str, application_str,
+                      wm_class != NULL ? wm_class : "",
+                      title != NULL ? title : "", NULL);
+}
+
+
+
+static void
+xkb_recorder_window_closed (XkbBackend  *backend,
+                            guint        window_id,
+                            XkbRecorder *recorder)
+{
+  gchar window_str[16];
+
+  g_snprintf (window_str, sizeof (window_str), "%u", window_id);
+  xkb_recorder_write (recorder, XKB_RECORDER_WINDOW_CLOSED, window_str, NULL);
+}
+
+
+
+static void
+xkb_recorder_application_closed (XkbBackend  *backend,
+                                 guint        application_id,
+                                 XkbRecorder *recorder)
+{
+  gchar application_str[16];
+
+  g_snprintf (application_str, sizeof (application_str), "%u", application_id);
+  xkb_recorder_write (recorder, XKB_RECORDER_APPLICATION_CLOSED, application_str, NULL);
+}
+
+
+
+static void
+xkb_recorder_workspace_changed (XkbBackend  *backend,
+                                gint         workspace,
+                                XkbRecorder *recorder)
+{
+  gchar workspace_str[16];
+
+  g_snprintf (workspace_str, sizeof (workspace_str), "%d", workspace);
+  xkb_recorder_write (recorder, XKB_RECORDER_WORKSPACE_CHANGED, workspace_str, NULL);
+}
+
+
+
+static void
+xkb_recorder_property_changed (XkbXfconf   *config,
+                               GParamSpec  *pspec,
+                               XkbRecorder *recorder)
+{
+  const gchar * const  empty[] = { NULL };
+  GValue               value = G_VALUE_INIT;
+  GVariant            *variant = NULL;
+  const gchar * const *strv;
+  gchar               *text;
+
+  g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+  g_object_get_property (G_OBJECT (config), g_param_spec_get_name (pspec), &value);
+
+  if (G_VALUE_HOLDS (&value, G_TYPE_STRV))
+    {
+      strv = g_value_get_boxed (&value);
+      variant = g_variant_new_strv (strv != NULL ? strv : empty, -1);
+    }
+  else if (G_VALUE_HOLDS_UINT (&value))
+    variant = g_variant_new_uint32 (g_value_get_uint (&value));
+  else if (G_VALUE_HOLDS_INT (&value))
+    variant = g_variant_new_int32 (g_value_get_int (&value));
+  else if (G_VALUE_HOLDS_BOOLEAN (&value))
+    variant = g_variant_new_boolean (g_value_get_boolean (&value));
+
+  if (variant != NULL)
+    {
+      text = g_variant_print (g_variant_ref_sink (variant), TRUE);
+      xkb_recorder_write (recorder, XKB_RECORDER_PROPERTY_CHANGED,
+                          g_param_spec_get_name (pspec), text, NULL);
+      g_free (text);
+      g_variant_unref (variant);
+    }
+
+  g_value_unset (&value);
+}
+
+
+
+/*
+ * Starts recording the events of the keyboard backend and the changes of
+ * the configuration into a new file.
+ */
+XkbRecorder *
+xkb_recorder_new (const gchar *filename,
+                  XkbKeyboard *keyboard,
+                  XkbXfconf   *config)
+{
+  XkbRecorder  *recorder;
+  GParamSpec  **pspecs;
+  guint         n_pspecs, i;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (IS_XKB_KEYBOARD (keyboard), NULL);
+  g_return_val_if_fail (IS_XKB_XFCONF (config), NULL);
+
+  recorder = g_object_new (TYPE_XKB_RECORDER, NULL);
+
+  recorder->file = fopen (filename, "w");
+  if (recorder->file == NULL)
+    g_warning ("failed to open %s for recording: %s", filename, g_strerror (errno));
+  else
+    {
+      /* a trace is still usable when the process does not exit cleanly */
+      setvbuf (recorder->file, NULL, _IOLBF, 0);
+      fprintf (recorder->file, "%s\n", XKB_RECORDER_HEADER);
+    }
+
+  recorder->start_time = g_get_monotonic_time ();
+  recorder->config = g_object_ref (config);
+
+  /* the state at the start comes first, properties before the layouts
+   * so the replayed keyboard is built with the right policy */
+  pspecs = g_object_class_list_properties (G_OBJECT_GET_CLASS (config), &n_pspecs);
+  for (i = 0; i < n_pspecs; i++)
+    xkb_recorder_property_changed (config, pspecs[i], recorder);
+  g_free (pspecs);
+
+  g_signal_connect (G_OBJECT (config), "notify",
+                    G_CALLBACK (xkb_recorder_property_changed), recorder);
+
+  recorder->backend = xkb_keyboard_get_backend (keyboard);
+  if (recorder->backend != NULL)
+    {
+      g_object_ref (recorder->backend);
+
+      xkb_recorder_config_changed (recorder->backend, recorder);
+      xkb_recorder_group_changed (recorder->backend,
+                                  xkb_keyboard_get_current_group (keyboard), recorder);
+
+      g_signal_connect (G_OBJECT (recorder->backend), "config-changed",
+                        G_CALLBACK (xkb_recorder_config_changed), recorder);
+      g_signal_connect (G_OBJECT (recorder->backend), "group-changed",
+                        G_CALLBACK (xkb_recorder_group_changed), recorder);
+      g_signal_connect (G_OBJECT (recorder->backend), "active-window-changed",
+                        G_CALLBACK (xkb_recorder_active_window_changed), recorder);
+      g_signal_connect (G_OBJECT (recorder->backend), "window-closed",
+                        G_CALLBACK (xkb_recorder_window_closed), recorder);
+      g_signal_connect (G_OBJECT (recorder->backend), "application-closed",
+                        G_CALLBACK (xkb_recorder_application_closed), recorder);
+      g_signal_connect (G_OBJECT (recorder->backend), "workspace-changed",
+                        G_CALLBACK (xkb_recorder_workspace_changed), recorder);
+    }
+
+  return recorder;
+}
+
+
+
+void
+xkb_recorder_size_changed (XkbRecorder    *recorder,
+                           GtkOrientation  orientation,
+                           gint            size)
+{
+  gchar orientation_str[16], size_str[16];
+
+  g_return_if_fail (IS_XKB_RECORDER (recorder));
+
+  g_snprintf (orientation_str, sizeof (orientation_str), "%d", orientation);
+  g_snprintf (size_str, sizeof (size_str), "%d", size);
+  xkb_recorder_write (recorder, XKB_RECORDER_SIZE_CHANGED, orientation_str, size_str, NULL);
+}
+
+
+
+static void
+xkb_recorder_event_free (gpointer data)
+{
+  XkbRecorderEvent *event = data;
+
+  g_strfreev (event->args);
+  g_free (event);
+}
+
+
+
+/*
+ * Reads a trace written by the recorder, the events are returned in
+ * the order they were recorded.
+ */
+GPtrArray *
+xkb_recorder_load (const gchar  *filename,
+                   GError      **error)
+{
+  GPtrArray         *events;
+  XkbRecorderEvent  *event;
+  gchar             *contents;
+  gchar            **lines, **fields;
+  guint              n, i, n_fields;
+  gint               type;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+
+  if (!g_file_get_contents (filename, &contents, NULL, error))
+    return NULL;
+
+  lines = g_strsplit (contents, "\n", -1);
+  g_free (contents);
+
+  events = g_ptr_array_new_with_free_func (xkb_recorder_event_free);
+
+  for (n = 0; lines[n] != NULL; n++)
+    {
+      if (*lines[n] == '\0' || *lines[n] == '#')
+        continue;
+
+      fields = g_strsplit (lines[n], "\t", -1);
+      n_fields = g_strv_length (fields);
+
+      type = -1;
+      if (n_fields >= 2)
+        {
+          for (i = 0; i < XKB_RECORDER_N_EVENTS; i++)
+            {
+              if (strcmp (fields[1], event_names[i]) == 0)
+                {
+                  type = i;
+                  break;
+                }
+            }
+        }
+
+      if (type < 0 || n_fields - 2 != event_arg_counts[type])
+        {
+          g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                       "%s:%u: malformed event", filename, n + 1);
+          g_strfreev (fields);
+          g_strfreev (lines);
+          g_ptr_array_unref (events);
+          return NULL;
+        }
+
+      event = g_new0 (XkbRecorderEvent, 1);
+      event->time = g_ascii_strtoll (fields[0], NULL, 10);
+      event->type = type;
+      event->args = g_new0 (gchar *, n_fields - 1);
+      for (i = 2; i < n_fields; i++)
+        event->args[i - 2] = g_strcompress (fields[i]);
+
+      g_ptr_array_add (events, event);
+      g_strfreev (fields);
+    }
+
+  g_strfreev (lines);
+
+  return events;
+}
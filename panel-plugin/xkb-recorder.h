@@ -0,0 +1,74 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-recorder.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_RECORDER_H_
+#define _XKB_RECORDER_H_
+
+#include <gtk/gtk.h>
+
+#include "xkb-keyboard.h"
+#include "xkb-xfconf.h"
+
+G_BEGIN_DECLS
+
+typedef struct _XkbRecorderClass     XkbRecorderClass;
+typedef struct _XkbRecorder          XkbRecorder;
+
+#define TYPE_XKB_RECORDER             (xkb_recorder_get_type ())
+#define XKB_RECORDER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_RECORDER, XkbRecorder))
+#define XKB_RECORDER_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_RECORDER, XkbRecorderClass))
+#define IS_XKB_RECORDER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_XKB_RECORDER))
+#define IS_XKB_RECORDER_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass),  TYPE_XKB_RECORDER))
+#define XKB_RECORDER_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj),  TYPE_XKB_RECORDER, XkbRecorderClass))
+
+typedef enum
+{
+  XKB_RECORDER_CONFIG_CHANGED,            /* layouts, such as "us,de(nodeadkeys)" */
+  XKB_RECORDER_GROUP_CHANGED,             /* group */
+  XKB_RECORDER_ACTIVE_WINDOW_CHANGED,     /* window, application, class, title */
+  XKB_RECORDER_WINDOW_CLOSED,             /* window */
+  XKB_RECORDER_APPLICATION_CLOSED,        /* application */
+  XKB_RECORDER_WORKSPACE_CHANGED,         /* workspace */
+  XKB_RECORDER_PROPERTY_CHANGED,          /* name, value as GVariant text */
+  XKB_RECORDER_SIZE_CHANGED,              /* orientation, size */
+  XKB_RECORDER_N_EVENTS
+} XkbRecorderEventType;
+
+typedef struct
+{
+  gint64                time;   /* microseconds since the recording started */
+  XkbRecorderEventType  type;
+  gchar               **args;
+} XkbRecorderEvent;
+
+GType             xkb_recorder_get_type                     (void)                           G_GNUC_CONST;
+
+XkbRecorder      *xkb_recorder_new                          (const gchar         *filename,
+                                                             XkbKeyboard         *keyboard,
+                                                             XkbXfconf           *config);
+
+void              xkb_recorder_size_changed                 (XkbRecorder         *recorder,
+                                                             GtkOrientation       orientation,
+                                                             gint                 size);
+
+GPtrArray        *xkb_recorder_load                         (const gchar         *filename,
+                                                             GError             **error);
+
+G_END_DECLS
+
+#endif
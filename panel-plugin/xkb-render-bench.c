@@ -0,0 +1,426 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-render-bench.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+/*
+ * Micro-benchmark of the button drawing code. It draws every flag, and
+ * its name as text and with the system font, into image surfaces for a
+ * range of panel sizes, display scales and variant marker counts, and
+ * reports the time and the heap allocations per draw. It needs neither
+ * X nor a panel, so caching or format changes in xkb-cairo.c can be
+ * measured on any machine:
+ *
+ *   ./xkb-render-bench --bundle=flags.xkbf --png=/tmp/flags
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xkb-properties.h"
+#include "xkb-cairo.h"
+
+#define XKB_BENCH_MIN_SIZE      16
+#define XKB_BENCH_MAX_SIZE      128
+#define XKB_BENCH_MAX_MARKERS   3
+#define XKB_BENCH_MAX_GROUPS    4
+
+typedef enum
+{
+  XKB_BENCH_MODE_IMAGE,
+  XKB_BENCH_MODE_TEXT,
+  XKB_BENCH_MODE_SYSTEM,
+  XKB_BENCH_N_MODES
+} XkbBenchMode;
+
+typedef struct
+{
+  guint64 draws;
+  guint64 nanoseconds;
+  guint64 allocations;
+} XkbBenchStats;
+
+static const gchar *mode_names[XKB_BENCH_N_MODES] = { "image", "text", "system" };
+
+static gchar    *opt_bundle = NULL;
+static gchar    *opt_png_dir = NULL;
+static gchar    *opt_font = NULL;
+static gint      opt_iterations = 3;
+static gint      opt_size_step = 16;
+static gint      opt_scale_step = 25;
+
+static GOptionEntry option_entries[] =
+{
+  { "bundle", 'b', 0, G_OPTION_ARG_FILENAME, &opt_bundle,
+    "Draw the flags from a compiled bundle instead of from the SVG files", "FILE" },
+  { "png", 'p', 0, G_OPTION_ARG_FILENAME, &opt_png_dir,
+    "Write every image drawn in the first iteration to DIR", "DIR" },
+  { "font", 'f', 0, G_OPTION_ARG_STRING, &opt_font,
+    "Font of the system mode (default: Sans 10)", "FONT" },
+  { "iterations", 'i', 0, G_OPTION_ARG_INT, &opt_iterations,
+    "Draw everything N times (default: 3)", "N" },
+  { "size-step", 's', 0, G_OPTION_ARG_INT, &opt_size_step,
+    "Step between the panel sizes from 16 to 128 (default: 16)", "PIXELS" },
+  { "scale-step", 'S', 0, G_OPTION_ARG_INT, &opt_scale_step,
+    "Step between the display scales from 0 to 100 (default: 25)", "PERCENT" },
+  { NULL }
+};
+
+
+
+#ifdef __GLIBC__
+/* counts the heap allocations of the whole process, the benchmark only
+ * reads the counter around a draw */
+extern void *__libc_malloc  (size_t size);
+extern void *__libc_calloc  (size_t count, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static gint bench_allocations = 0;
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&bench_allocations);
+  return __libc_malloc (size);
+}
+
+
+
+void *
+calloc (size_t count,
+        size_t size)
+{
+  g_atomic_int_inc (&bench_allocations);
+  return __libc_calloc (count, size);
+}
+
+
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  g_atomic_int_inc (&bench_allocations);
+  return __libc_realloc (ptr, size);
+}
+
+#define xkb_bench_get_allocations() ((guint) g_atomic_int_get (&bench_allocations))
+#define XKB_BENCH_COUNTS_ALLOCATIONS TRUE
+#else
+#define xkb_bench_get_allocations() 0u
+#define XKB_BENCH_COUNTS_ALLOCATIONS FALSE
+#endif
+
+
+
+static guint64
+xkb_bench_get_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (guint64) ts.tv_sec * G_GUINT64_CONSTANT (1000000000) + ts.tv_nsec;
+}
+
+
+
+static void
+xkb_bench_write_png (cairo_surface_t *surface,
+                     XkbBenchMode     mode,
+                     const gchar     *name,
+                     gint             size,
+                     gint             scale,
+                     gint             markers)
+{
+  gchar *basename, *filename;
+
+  basename = g_strdup_printf ("%s-%s-%d-%d-%d.png", name, mode_names[mode], size, scale, markers);
+  filename = g_build_filename (opt_png_dir, basename, NULL);
+
+  if (cairo_surface_write_to_png (surface, filename) != CAIRO_STATUS_SUCCESS)
+    g_printerr ("cannot write %s\n", filename);
+
+  g_free (basename);
+  g_free (filename);
+}
+
+
+
+/*
+ * Draws one image the way the panel button does. Creating the context
+ * and clearing the surface are left out of the measurement.
+ */
+static void
+xkb_bench_draw (cairo_surface_t            *surface,
+                XkbBenchMode                mode,
+                const XkbCairoFlag         *flag,
+                const gchar                *name,
+                gint                        width,
+                gint                        height,
+                gint                        scale,
+                gint                        markers,
+                const PangoFontDescription *desc,
+                XkbBenchStats              *stats)
+{
+  static const GdkRGBA  rgba = { 0.0, 0.0, 0.0, 1.0 };
+  cairo_t              *cr;
+  guint64               start, end;
+  guint                 allocations;
+
+  cr = cairo_create (surface);
+  cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint (cr);
+  cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+
+  allocations = xkb_bench_get_allocations ();
+  start = xkb_bench_get_time ();
+
+  switch (mode)
+    {
+    case XKB_BENCH_MODE_IMAGE:
+      xkb_cairo_draw_flag (cr, flag, width, height, markers, XKB_BENCH_MAX_GROUPS, scale);
+      break;
+
+    case XKB_BENCH_MODE_TEXT:
+      xkb_cairo_draw_label (cr, name, width, height, markers, scale, rgba);
+      break;
+
+    case XKB_BENCH_MODE_SYSTEM:
+      xkb_cairo_draw_label_system (cr, name, width, height, markers, 0, desc, rgba);
+      break;
+
+    case XKB_BENCH_N_MODES:
+      break;
+    }
+
+  /* make sure the drawing is done, not only recorded */
+  cairo_surface_flush (surface);
+
+  end = xkb_bench_get_time ();
+
+  stats->draws++;
+  stats->nanoseconds += end - start;
+  stats->allocations += xkb_bench_get_allocations () - allocations;
+
+  cairo_destroy (cr);
+}
+
+
+
+static XkbCairoFlag *
+xkb_bench_load_flag (GMappedFile *bundle,
+                     const gchar *filename,
+                     const gchar *name)
+{
+  XkbCairoFlag *flag = NULL;
+
+  /* flags the compiler skipped are only available as SVG, like in the plugin */
+  if (bundle != NULL)
+    flag = xkb_cairo_flag_new_from_bundle (bundle, name);
+
+  if (flag == NULL)
+    flag = xkb_cairo_flag_new_from_svg (filename);
+
+  return flag;
+}
+
+
+
+static GPtrArray *
+xkb_bench_list_flags (const gchar *dirname)
+{
+  GPtrArray   *filenames;
+  GDir        *dir;
+  const gchar *basename;
+
+  filenames = g_ptr_array_new_with_free_func (g_free);
+
+  dir = g_dir_open (dirname, 0, NULL);
+  if (dir == NULL)
+    return filenames;
+
+  while ((basename = g_dir_read_name (dir)) != NULL)
+    {
+      if (g_str_has_suffix (basename, ".svg"))
+        g_ptr_array_add (filenames, g_build_filename (dirname, basename, NULL));
+    }
+  g_dir_close (dir);
+
+  return filenames;
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  GOptionContext       *context;
+  GError               *error = NULL;
+  GMappedFile          *bundle = NULL;
+  GPtrArray            *filenames;
+  PangoFontDescription *desc;
+  XkbBenchStats         stats[XKB_BENCH_N_MODES][XKB_BENCH_MAX_SIZE + 1];
+  XkbBenchStats         totals[XKB_BENCH_N_MODES];
+  cairo_surface_t      *surface;
+  XkbCairoFlag         *flag;
+  gchar                *name;
+  guint                 i;
+  gint                  iteration, size, width, scale, markers, mode;
+
+  context = g_option_context_new ("[SVG...] - benchmark the drawing of the xkb plugin button");
+  g_option_context_add_main_entries (context, option_entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s\n", error->message);
+      g_error_free (error);
+      g_option_context_free (context);
+      return EXIT_FAILURE;
+    }
+  g_option_context_free (context);
+
+  opt_iterations = MAX (opt_iterations, 1);
+  opt_size_step = MAX (opt_size_step, 1);
+  opt_scale_step = MAX (opt_scale_step, 1);
+
+  if (argc > 1)
+    {
+      filenames = g_ptr_array_new_with_free_func (g_free);
+      for (i = 1; i < (guint) argc; i++)
+        g_ptr_array_add (filenames, g_strdup (argv[i]));
+    }
+  else
+    filenames = xkb_bench_list_flags (XKB_BENCH_FLAGS_DIR);
+
+  if (filenames->len == 0)
+    {
+      g_printerr ("no flags to draw\n");
+      g_ptr_array_unref (filenames);
+      return EXIT_FAILURE;
+    }
+
+  if (opt_bundle != NULL)
+    {
+      bundle = g_mapped_file_new (opt_bundle, FALSE, &error);
+      if (bundle == NULL)
+        {
+          g_printerr ("%s\n", error->message);
+          g_error_free (error);
+          g_ptr_array_unref (filenames);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (opt_png_dir != NULL)
+    g_mkdir_with_parents (opt_png_dir, 0755);
+
+  desc = pango_font_description_from_string (opt_font != NULL ? opt_font : "Sans 10");
+  memset (stats, 0, sizeof (stats));
+  memset (totals, 0, sizeof (totals));
+
+  for (iteration = 0; iteration < opt_iterations; iteration++)
+    {
+      for (i = 0; i < filenames->len; i++)
+        {
+          const gchar *filename = g_ptr_array_index (filenames, i);
+          gchar       *basename = g_path_get_basename (filename);
+
+          name = g_strndup (basename, strcspn (basename, "."));
+          g_free (basename);
+
+          flag = xkb_bench_load_flag (bundle, filename, name);
+          if (flag == NULL && iteration == 0)
+            g_printerr ("cannot load %s, only its name is drawn\n", filename);
+
+          for (size = XKB_BENCH_MIN_SIZE; size <= XKB_BENCH_MAX_SIZE; size += opt_size_step)
+            {
+              /* the button of a horizontal panel */
+              width = (gint) (1.33 * size);
+              surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, size);
+
+              for (mode = 0; mode < XKB_BENCH_N_MODES; mode++)
+                {
+                  if (mode == XKB_BENCH_MODE_IMAGE && flag == NULL)
+                    continue;
+
+                  for (scale = DISPLAY_SCALE_MIN; scale <= DISPLAY_SCALE_MAX; scale += opt_scale_step)
+                    {
+                      /* the system mode does not scale */
+                      if (mode == XKB_BENCH_MODE_SYSTEM && scale != DISPLAY_SCALE_MIN)
+                        break;
+
+                      for (markers = 0; markers <= XKB_BENCH_MAX_MARKERS; markers++)
+                        {
+                          xkb_bench_draw (surface, mode, flag, name, width, size, scale, markers,
+                                          desc, &stats[mode][size]);
+
+                          if (opt_png_dir != NULL && iteration == 0)
+                            xkb_bench_write_png (surface, mode, name, size, scale, markers);
+                        }
+                    }
+                }
+
+              cairo_surface_destroy (surface);
+            }
+
+          if (flag != NULL)
+            xkb_cairo_flag_free (flag);
+          g_free (name);
+        }
+    }
+
+  g_print ("%-8s %6s %10s %12s %14s\n", "mode", "size", "draws", "ns/draw", "allocs/draw");
+
+  for (mode = 0; mode < XKB_BENCH_N_MODES; mode++)
+    {
+      for (size = XKB_BENCH_MIN_SIZE; size <= XKB_BENCH_MAX_SIZE; size += opt_size_step)
+        {
+          XkbBenchStats *s = &stats[mode][size];
+
+          if (s->draws == 0)
+            continue;
+
+          totals[mode].draws += s->draws;
+          totals[mode].nanoseconds += s->nanoseconds;
+          totals[mode].allocations += s->allocations;
+
+          g_print ("%-8s %6d %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %14.1f\n",
+                   mode_names[mode], size, s->draws, s->nanoseconds / s->draws,
+                   XKB_BENCH_COUNTS_ALLOCATIONS ? (gdouble) s->allocations / s->draws : -1.0);
+        }
+
+      if (totals[mode].draws > 0)
+        g_print ("%-8s %6s %10" G_GUINT64_FORMAT " %12" G_GUINT64_FORMAT " %14.1f\n",
+                 mode_names[mode], "all", totals[mode].draws,
+                 totals[mode].nanoseconds / totals[mode].draws,
+                 XKB_BENCH_COUNTS_ALLOCATIONS
+                 ? (gdouble) totals[mode].allocations / totals[mode].draws : -1.0);
+    }
+
+  pango_font_description_free (desc);
+  if (bundle != NULL)
+    g_mapped_file_unref (bundle);
+  g_ptr_array_unref (filenames);
+
+  return EXIT_SUCCESS;
+}
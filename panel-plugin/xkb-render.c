@@ -0,0 +1,95 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-render.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "xkb-render.h"
+#include "xkb-cairo.h"
+
+/*
+ * Draws the current group the way the panel button shows it. The button
+ * and the plugin host share this, so both render exactly the same.
+ */
+void
+xkb_render_layout_image (cairo_t         *cr,
+                         XkbXfconf       *config,
+                         XkbKeyboard     *keyboard,
+                         XkbModifier     *modifier,
+                         GtkStyleContext *style_ctx,
+                         GtkStateFlags    state,
+                         gint             actual_hsize,
+                         gint             actual_vsize)
+{
+  const gchar          *group_name;
+  gint                  variant_index;
+  const XkbCairoFlag   *flag;
+  PangoFontDescription *desc;
+  GdkRGBA               rgba;
+  XkbDisplayType        display_type;
+  XkbDisplayName        display_name;
+  gint                  display_scale;
+  guint                 indicators;
+
+  display_type = xkb_xfconf_get_display_type (config);
+  display_name = xkb_xfconf_get_display_name (config);
+  display_scale = xkb_xfconf_get_display_scale (config);
+  indicators = xkb_xfconf_get_caps_lock_indicator (config) ? INDICATOR_CAPS_LOCK : 0;
+
+  gtk_style_context_get_color (style_ctx, state, &rgba);
+
+  group_name = xkb_keyboard_get_group_name (keyboard, display_name, -1);
+  flag = xkb_keyboard_get_flag (keyboard, -1);
+  variant_index = xkb_keyboard_get_variant_index (keyboard, display_name, -1);
+  indicators &= xkb_modifier_get_indicators (modifier);
+
+  if (flag == NULL && display_type == DISPLAY_TYPE_IMAGE)
+    display_type = DISPLAY_TYPE_TEXT;
+
+  switch (display_type)
+    {
+    case DISPLAY_TYPE_IMAGE:
+      xkb_cairo_draw_flag (cr, flag,
+                           actual_hsize, actual_vsize,
+                           variant_index,
+                           xkb_keyboard_get_max_group_count (keyboard),
+                           display_scale);
+      break;
+
+    case DISPLAY_TYPE_TEXT:
+      xkb_cairo_draw_label (cr, group_name,
+                            actual_hsize, actual_vsize,
+                            variant_index,
+                            display_scale,
+                            rgba);
+      break;
+
+    case DISPLAY_TYPE_SYSTEM:
+      gtk_style_context_get (style_ctx, state, "font", &desc, NULL);
+
+      xkb_cairo_draw_label_system (cr, group_name,
+                                   actual_hsize, actual_vsize,
+                                   variant_index,
+                                   indicators,
+                                   desc, rgba);
+
+      pango_font_description_free (desc);
+      break;
+    }
+}
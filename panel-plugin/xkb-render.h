@@ -0,0 +1,41 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-render.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_RENDER_H_
+#define _XKB_RENDER_H_
+
+#include <gtk/gtk.h>
+
+#include "xkb-xfconf.h"
+#include "xkb-keyboard.h"
+#include "xkb-modifier.h"
+
+G_BEGIN_DECLS
+
+void              xkb_render_layout_image                   (cairo_t             *cr,
+                                                             XkbXfconf           *config,
+                                                             XkbKeyboard         *keyboard,
+                                                             XkbModifier         *modifier,
+                                                             GtkStyleContext     *style_ctx,
+                                                             GtkStateFlags        state,
+                                                             gint                 actual_hsize,
+                                                             gint                 actual_vsize);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,385 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-snapshot.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "xkb-snapshot.h"
+
+#include <string.h>
+
+/*
+ * A snapshot is a small key file in the user runtime directory which
+ * keeps what the last run had to compute at startup: the names of the
+ * groups, looked up in the registry, and the last rendered button. It
+ * does not survive the session, and anything which does not match the
+ * live state is ignored, so a stale snapshot only costs the lookup.
+ */
+
+#define XKB_SNAPSHOT_DIRNAME        "xfce4/xkb"
+#define XKB_SNAPSHOT_VERSION        1
+
+#define XKB_SNAPSHOT_GROUP_SNAPSHOT "Snapshot"
+#define XKB_SNAPSHOT_GROUP_GROUPS   "Groups"
+#define XKB_SNAPSHOT_GROUP_IMAGE    "Image"
+
+struct _XkbSnapshotClass
+{
+  GObjectClass         __parent__;
+};
+
+struct _XkbSnapshot
+{
+  GObject              __parent__;
+
+  gchar               *filename;
+  GKeyFile            *key_file;
+  gboolean             dirty;
+};
+
+static void              xkb_snapshot_finalize                 (GObject              *object);
+
+G_DEFINE_TYPE (XkbSnapshot, xkb_snapshot, G_TYPE_OBJECT)
+
+
+
+static void
+xkb_snapshot_class_init (XkbSnapshotClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = xkb_snapshot_finalize;
+}
+
+
+
+static void
+xkb_snapshot_init (XkbSnapshot *snapshot)
+{
+  snapshot->filename = NULL;
+  snapshot->key_file = NULL;
+  snapshot->dirty = FALSE;
+}
+
+
+
+/*
+ * Loads the snapshot of the given name, a missing or unreadable one is
+ * the same as an empty one.
+ */
+XkbSnapshot *
+xkb_snapshot_new (const gchar *name)
+{
+  XkbSnapshot *snapshot;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  snapshot = g_object_new (TYPE_XKB_SNAPSHOT, NULL);
+
+  /* falls back to the user cache directory without XDG_RUNTIME_DIR */
+  snapshot->filename = g_build_filename (g_get_user_runtime_dir (),
+                                         XKB_SNAPSHOT_DIRNAME, name, NULL);
+
+  snapshot->key_file = g_key_file_new ();
+  if (!g_key_file_load_from_file (snapshot->key_file, snapshot->filename, G_KEY_FILE_NONE, NULL) ||
+      g_key_file_get_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_SNAPSHOT,
+                              "version", NULL) != XKB_SNAPSHOT_VERSION)
+    {
+      g_key_file_free (snapshot->key_file);
+      snapshot->key_file = g_key_file_new ();
+    }
+
+  return snapshot;
+}
+
+
+
+static void
+xkb_snapshot_finalize (GObject *object)
+{
+  XkbSnapshot *snapshot = XKB_SNAPSHOT (object);
+
+  g_key_file_free (snapshot->key_file);
+  g_free (snapshot->filename);
+
+  G_OBJECT_CLASS (xkb_snapshot_parent_class)->finalize (object);
+}
+
+
+
+static gchar *
+xkb_snapshot_fingerprint (const gchar * const *layouts,
+                          const gchar * const *variants)
+{
+  GString *fingerprint;
+  gint     i;
+
+  fingerprint = g_string_new (NULL);
+
+  for (i = 0; layouts[i] != NULL; i++)
+    g_string_append_printf (fingerprint, "%s%s(%s)", i > 0 ? "," : "",
+                            layouts[i], variants[i] != NULL ? variants[i] : "");
+
+  return g_string_free (fingerprint, FALSE);
+}
+
+
+
+/*
+ * Fills the pretty and language names of all groups when the snapshot
+ * was taken for the same layouts and variants, the caller owns them.
+ */
+gboolean
+xkb_snapshot_get_groups (XkbSnapshot         *snapshot,
+                         const gchar * const *layouts,
+                         const gchar * const *variants,
+                         gchar              **pretty_names,
+                         gchar              **language_names)
+{
+  gchar *fingerprint, *saved_fingerprint;
+  gchar  key[32];
+  gint   i;
+
+  g_return_val_if_fail (IS_XKB_SNAPSHOT (snapshot), FALSE);
+
+  fingerprint = xkb_snapshot_fingerprint (layouts, variants);
+  saved_fingerprint = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                                             "fingerprint", NULL);
+
+  if (g_strcmp0 (fingerprint, saved_fingerprint) != 0)
+    {
+      g_free (fingerprint);
+      g_free (saved_fingerprint);
+      return FALSE;
+    }
+
+  g_free (fingerprint);
+  g_free (saved_fingerprint);
+
+  for (i = 0; layouts[i] != NULL; i++)
+    {
+      g_snprintf (key, sizeof (key), "pretty-name-%d", i);
+      pretty_names[i] = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                                               key, NULL);
+
+      g_snprintf (key, sizeof (key), "language-name-%d", i);
+      language_names[i] = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                                                 key, NULL);
+    }
+
+  return TRUE;
+}
+
+
+
+void
+xkb_snapshot_set_groups (XkbSnapshot         *snapshot,
+                         const gchar * const *layouts,
+                         const gchar * const *variants,
+                         const gchar * const *pretty_names,
+                         const gchar * const *language_names)
+{
+  gchar *fingerprint, *saved_fingerprint;
+  gchar  key[32];
+  gint   i;
+
+  g_return_if_fail (IS_XKB_SNAPSHOT (snapshot));
+
+  fingerprint = xkb_snapshot_fingerprint (layouts, variants);
+  saved_fingerprint = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                                             "fingerprint", NULL);
+
+  if (g_strcmp0 (fingerprint, saved_fingerprint) == 0)
+    {
+      g_free (fingerprint);
+      g_free (saved_fingerprint);
+      return;
+    }
+  g_free (saved_fingerprint);
+
+  g_key_file_remove_group (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS, NULL);
+
+  g_key_file_set_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                         "fingerprint", fingerprint);
+  g_free (fingerprint);
+
+  for (i = 0; layouts[i] != NULL; i++)
+    {
+      g_snprintf (key, sizeof (key), "pretty-name-%d", i);
+      g_key_file_set_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                             key, pretty_names[i] != NULL ? pretty_names[i] : "");
+
+      g_snprintf (key, sizeof (key), "language-name-%d", i);
+      g_key_file_set_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_GROUPS,
+                             key, language_names[i] != NULL ? language_names[i] : "");
+    }
+
+  snapshot->dirty = TRUE;
+}
+
+
+
+/*
+ * Returns a copy of the image saved under the given key or NULL. The key
+ * has to describe everything the image was rendered from.
+ */
+cairo_surface_t *
+xkb_snapshot_get_image (XkbSnapshot *snapshot,
+                        const gchar *key)
+{
+  cairo_surface_t *surface;
+  gchar           *saved_key, *encoded;
+  guchar          *pixels, *data;
+  gsize            length;
+  gint             width, height, scale, stride, y;
+
+  g_return_val_if_fail (IS_XKB_SNAPSHOT (snapshot), NULL);
+  g_return_val_if_fail (key != NULL, NULL);
+
+  saved_key = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "key", NULL);
+  if (g_strcmp0 (saved_key, key) != 0)
+    {
+      g_free (saved_key);
+      return NULL;
+    }
+  g_free (saved_key);
+
+  width = g_key_file_get_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "width", NULL);
+  height = g_key_file_get_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "height", NULL);
+  scale = g_key_file_get_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "scale", NULL);
+
+  encoded = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "data", NULL);
+  if (encoded == NULL)
+    return NULL;
+
+  pixels = g_base64_decode (encoded, &length);
+  g_free (encoded);
+
+  if (width <= 0 || height <= 0 || scale <= 0 || length != (gsize) width * height * 4)
+    {
+      g_free (pixels);
+      return NULL;
+    }
+
+  surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+  if (cairo_surface_status (surface) != CAIRO_STATUS_SUCCESS)
+    {
+      cairo_surface_destroy (surface);
+      g_free (pixels);
+      return NULL;
+    }
+
+  cairo_surface_flush (surface);
+  data = cairo_image_surface_get_data (surface);
+  stride = cairo_image_surface_get_stride (surface);
+
+  for (y = 0; y < height; y++)
+    memcpy (data + y * stride, pixels + y * width * 4, width * 4);
+
+  cairo_surface_mark_dirty (surface);
+  cairo_surface_set_device_scale (surface, scale, scale);
+
+  g_free (pixels);
+
+  return surface;
+}
+
+
+
+void
+xkb_snapshot_set_image (XkbSnapshot     *snapshot,
+                        const gchar     *key,
+                        cairo_surface_t *surface)
+{
+  gchar   *saved_key, *encoded;
+  guchar  *pixels, *data;
+  gdouble  scale;
+  gint     width, height, stride, y;
+
+  g_return_if_fail (IS_XKB_SNAPSHOT (snapshot));
+  g_return_if_fail (key != NULL);
+
+  if (cairo_surface_get_type (surface) != CAIRO_SURFACE_TYPE_IMAGE ||
+      cairo_image_surface_get_format (surface) != CAIRO_FORMAT_ARGB32)
+    return;
+
+  saved_key = g_key_file_get_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "key", NULL);
+  if (g_strcmp0 (saved_key, key) == 0)
+    {
+      g_free (saved_key);
+      return;
+    }
+  g_free (saved_key);
+
+  cairo_surface_flush (surface);
+  width = cairo_image_surface_get_width (surface);
+  height = cairo_image_surface_get_height (surface);
+  stride = cairo_image_surface_get_stride (surface);
+  data = cairo_image_surface_get_data (surface);
+  cairo_surface_get_device_scale (surface, &scale, NULL);
+
+  /* rows are stored without the padding of the stride */
+  pixels = g_malloc ((gsize) width * height * 4);
+  for (y = 0; y < height; y++)
+    memcpy (pixels + y * width * 4, data + y * stride, width * 4);
+
+  encoded = g_base64_encode (pixels, (gsize) width * height * 4);
+  g_free (pixels);
+
+  g_key_file_set_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "key", key);
+  g_key_file_set_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "width", width);
+  g_key_file_set_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "height", height);
+  g_key_file_set_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "scale", (gint) scale);
+  g_key_file_set_string (snapshot->key_file, XKB_SNAPSHOT_GROUP_IMAGE, "data", encoded);
+  g_free (encoded);
+
+  snapshot->dirty = TRUE;
+}
+
+
+
+/*
+ * Writes the snapshot if it was changed since it was loaded or saved.
+ */
+void
+xkb_snapshot_save (XkbSnapshot *snapshot)
+{
+  gchar  *dirname, *data;
+  gsize   length;
+  GError *error = NULL;
+
+  g_return_if_fail (IS_XKB_SNAPSHOT (snapshot));
+
+  if (!snapshot->dirty)
+    return;
+
+  snapshot->dirty = FALSE;
+
+  g_key_file_set_integer (snapshot->key_file, XKB_SNAPSHOT_GROUP_SNAPSHOT,
+                          "version", XKB_SNAPSHOT_VERSION);
+
+  dirname = g_path_get_dirname (snapshot->filename);
+  g_mkdir_with_parents (dirname, 0700);
+  g_free (dirname);
+
+  data = g_key_file_to_data (snapshot->key_file, &length, NULL);
+  if (!g_file_set_contents (snapshot->filename, data, length, &error))
+    {
+      g_warning ("failed to save %s: %s", snapshot->filename, error->message);
+      g_error_free (error);
+    }
+  g_free (data);
+}
@@ -0,0 +1,62 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-snapshot.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_SNAPSHOT_H_
+#define _XKB_SNAPSHOT_H_
+
+#include <glib-object.h>
+#include <cairo/cairo.h>
+
+G_BEGIN_DECLS
+
+typedef struct _XkbSnapshotClass     XkbSnapshotClass;
+typedef struct _XkbSnapshot          XkbSnapshot;
+
+#define TYPE_XKB_SNAPSHOT             (xkb_snapshot_get_type ())
+#define XKB_SNAPSHOT(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_SNAPSHOT, XkbSnapshot))
+#define XKB_SNAPSHOT_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_SNAPSHOT, XkbSnapshotClass))
+#define IS_XKB_SNAPSHOT(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), TYPE_XKB_SNAPSHOT))
+#define IS_XKB_SNAPSHOT_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass),  TYPE_XKB_SNAPSHOT))
+#define XKB_SNAPSHOT_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj),  TYPE_XKB_SNAPSHOT, XkbSnapshotClass))
+
+GType             xkb_snapshot_get_type                     (void)                           G_GNUC_CONST;
+
+XkbSnapshot      *xkb_snapshot_new                          (const gchar         *name);
+
+gboolean          xkb_snapshot_get_groups                   (XkbSnapshot         *snapshot,
+                                                             const gchar * const *layouts,
+                                                             const gchar * const *variants,
+                                                             gchar              **pretty_names,
+                                                             gchar              **language_names);
+void              xkb_snapshot_set_groups                   (XkbSnapshot         *snapshot,
+                                                             const gchar * const *layouts,
+                                                             const gchar * const *variants,
+                                                             const gchar * const *pretty_names,
+                                                             const gchar * const *language_names);
+
+cairo_surface_t  *xkb_snapshot_get_image                    (XkbSnapshot         *snapshot,
+                                                             const gchar         *key);
+void              xkb_snapshot_set_image                    (XkbSnapshot         *snapshot,
+                                                             const gchar         *key,
+                                                             cairo_surface_t     *surface);
+
+void              xkb_snapshot_save                         (XkbSnapshot         *snapshot);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,166 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-trace.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "xkb-trace.h"
+
+/*
+ * Writes begin and end events of the plugin in the Chrome trace event
+ * format, which Perfetto opens next to a system trace. The tracer is
+ * switched on with XFCE4_XKB_TRACE=FILE in the environment of the panel.
+ *
+ * Recording an event claims a slot of a ring buffer with one atomic
+ * add and fills it in. Once the ring is half full, the event which gets
+ * there adds a low priority idle, which writes the ring out after the
+ * main loop has handled everything pending, so the writes do not land
+ * inside the spans being measured. The ring is also written out when
+ * the plugin goes away and on xkb_trace_flush (). Should writing fall
+ * behind, the oldest events are overwritten and counted as dropped.
+ *
+ * Timestamps come from the monotonic clock, which is the clock of
+ * system traces. The file is a JSON array which is left open, so it is
+ * a valid trace after every flush.
+ */
+
+#define XKB_TRACE_RING_SIZE   4096
+#define XKB_TRACE_FLUSH_AT    (XKB_TRACE_RING_SIZE / 2)
+
+typedef struct
+{
+  const gchar *name;
+  gint64       time;
+  gchar        phase;
+} XkbTraceEvent;
+
+static gint           trace_enabled = -1;
+static FILE          *trace_file = NULL;
+static XkbTraceEvent  trace_ring[XKB_TRACE_RING_SIZE];
+static gint           trace_head = 0;
+static guint          trace_tail = 0;
+static guint          trace_dropped = 0;
+static guint          trace_flush_id = 0;
+
+
+
+static gboolean
+xkb_trace_flush_idle (gpointer user_data)
+{
+  trace_flush_id = 0;
+  xkb_trace_flush ();
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+gboolean
+xkb_trace_get_enabled (void)
+{
+  const gchar *filename;
+
+  if (G_LIKELY (trace_enabled >= 0))
+    return trace_enabled;
+
+  trace_enabled = FALSE;
+
+  filename = g_getenv ("XFCE4_XKB_TRACE");
+  if (filename == NULL || *filename == '\0')
+    return FALSE;
+
+  trace_file = fopen (filename, "w");
+  if (trace_file == NULL)
+    {
+      g_warning ("cannot write trace to %s", filename);
+      return FALSE;
+    }
+
+  fputs ("[\n", trace_file);
+  trace_enabled = TRUE;
+
+  return TRUE;
+}
+
+
+
+void
+xkb_trace_event_real (const gchar *name,
+                      gchar        phase)
+{
+  XkbTraceEvent *event;
+  guint          position;
+
+  position = (guint) g_atomic_int_add (&trace_head, 1);
+
+  event = &trace_ring[position % XKB_TRACE_RING_SIZE];
+  event->name = name;
+  event->phase = phase;
+  event->time = g_get_monotonic_time ();
+
+  if (G_UNLIKELY (position - trace_tail >= XKB_TRACE_FLUSH_AT && trace_flush_id == 0))
+    trace_flush_id = g_idle_add_full (G_PRIORITY_LOW, xkb_trace_flush_idle, NULL, NULL);
+}
+
+
+
+void
+xkb_trace_flush (void)
+{
+  XkbTraceEvent *event;
+  guint          head, position;
+  gint           pid;
+
+  if (trace_file == NULL)
+    return;
+
+  if (trace_flush_id != 0)
+    {
+      g_source_remove (trace_flush_id);
+      trace_flush_id = 0;
+    }
+
+  head = (guint) g_atomic_int_get (&trace_head);
+  pid = getpid ();
+
+  if (head - trace_tail > XKB_TRACE_RING_SIZE)
+    {
+      trace_dropped += head - trace_tail - XKB_TRACE_RING_SIZE;
+      trace_tail = head - XKB_TRACE_RING_SIZE;
+    }
+
+  /* the events are recorded on the main thread, which is also the
+   * thread id of the process */
+  for (position = trace_tail; position != head; position++)
+    {
+      event = &trace_ring[position % XKB_TRACE_RING_SIZE];
+      fprintf (trace_file,
+               "{\"name\":\"%s\",\"cat\":\"xkb\",\"ph\":\"%c\",\"ts\":%" G_GINT64_FORMAT ","
+               "\"pid\":%d,\"tid\":%d},\n",
+               event->name, event->phase, event->time, pid, pid);
+    }
+
+  trace_tail = head;
+  fflush (trace_file);
+
+  if (trace_dropped > 0)
+    {
+      g_warning ("trace fell behind, %u events were dropped", trace_dropped);
+      trace_dropped = 0;
+    }
+}
@@ -0,0 +1,47 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-trace.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _XKB_TRACE_H_
+#define _XKB_TRACE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean    xkb_trace_get_enabled           (void);
+void        xkb_trace_event_real            (const gchar    *name,
+                                             gchar           phase);
+void        xkb_trace_flush                 (void);
+
+/* names must be static strings, only the pointer is kept */
+#define xkb_trace_begin(name) \
+  G_STMT_START { \
+    if (G_UNLIKELY (xkb_trace_get_enabled ())) \
+      xkb_trace_event_real (name, 'B'); \
+  } G_STMT_END
+
+#define xkb_trace_end(name) \
+  G_STMT_START { \
+    if (G_UNLIKELY (xkb_trace_get_enabled ())) \
+      xkb_trace_event_real (name, 'E'); \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif
@@ -26,6 +26,7 @@
 #include <string.h>
 
 #include "xkb-util.h"
+#include "xkb-flag-format.h"
 
 
 
@@ -50,6 +51,52 @@ xkb_util_get_flag_filename (const gchar* group_name)
 
 
 
+gchar*
+xkb_util_get_user_flag_filename (const gchar* group_name)
+{
+  gchar* filename;
+
+  if (!group_name)
+    return NULL;
+
+  filename = g_strconcat (g_get_user_data_dir (), "/", FLAGSRELDIR, "/", group_name, ".svg", NULL);
+
+  if (!g_file_test (filename, G_FILE_TEST_EXISTS))
+    {
+      g_free (filename);
+      return NULL;
+    }
+
+  return filename;
+}
+
+
+
+gchar*
+xkb_util_get_flag_bundle_filename (void)
+{
+  return g_strconcat (DATADIR, "/", FLAGSRELDIR, "/", XKB_FLAG_BUNDLE_FILENAME, NULL);
+}
+
+
+
+/*
+ * GLib only knows about XDG_STATE_HOME since 2.72.
+ */
+gchar*
+xkb_util_get_user_state_filename (const gchar *filename)
+{
+  const gchar *state_dir;
+
+  state_dir = g_getenv ("XDG_STATE_HOME");
+  if (state_dir != NULL && g_path_is_absolute (state_dir))
+    return g_build_filename (state_dir, filename, NULL);
+
+  return g_build_filename (g_get_home_dir (), ".local", "state", filename, NULL);
+}
+
+
+
 gchar*
 xkb_util_get_layout_string (const gchar *group_name,
                             const gchar *variant)
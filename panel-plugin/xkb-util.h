@@ -29,6 +29,9 @@
 #include <glib.h>
 
 gchar*      xkb_util_get_flag_filename      (const gchar   *group_name);
+gchar*      xkb_util_get_user_flag_filename (const gchar   *group_name);
+gchar*      xkb_util_get_flag_bundle_filename (void);
+gchar*      xkb_util_get_user_state_filename (const gchar  *filename);
 
 gchar*      xkb_util_get_layout_string      (const gchar   *group_name,
                                              const gchar   *variant);
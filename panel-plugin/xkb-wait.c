@@ -0,0 +1,71 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-wait.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Bounded waits on the default main loop, for the plugin host and the
+ * tests, which drive the keyboard without a panel around it.
+ */
+
+#include "xkb-wait.h"
+
+
+
+static gboolean
+xkb_wait_timeout (gpointer user_data)
+{
+  XkbWait *wait = user_data;
+
+  wait->timed_out = TRUE;
+  wait->timeout_id = 0;
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+void
+xkb_wait_start (XkbWait *wait,
+                guint    milliseconds)
+{
+  g_return_if_fail (wait != NULL);
+
+  wait->timed_out = FALSE;
+  wait->timeout_id = g_timeout_add (milliseconds, xkb_wait_timeout, wait);
+}
+
+
+
+void
+xkb_wait_stop (XkbWait *wait)
+{
+  g_return_if_fail (wait != NULL);
+
+  if (wait->timeout_id != 0)
+    g_source_remove (wait->timeout_id);
+
+  wait->timeout_id = 0;
+}
+
+
+
+/* runs the default main loop for the whole time */
+void
+xkb_wait_run (guint milliseconds)
+{
+  xkb_wait_until (FALSE, milliseconds);
+}
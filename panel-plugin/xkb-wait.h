@@ -0,0 +1,51 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-wait.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_WAIT_H_
+#define _XKB_WAIT_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  guint                timeout_id;
+  gboolean             timed_out;
+} XkbWait;
+
+void              xkb_wait_start                            (XkbWait             *wait,
+                                                             guint                milliseconds);
+
+void              xkb_wait_stop                             (XkbWait             *wait);
+
+void              xkb_wait_run                              (guint                milliseconds);
+
+/* runs the default main loop until the condition holds or the time is up */
+#define xkb_wait_until(condition, milliseconds) \
+  G_STMT_START { \
+    XkbWait _xkb_wait; \
+    xkb_wait_start (&_xkb_wait, (milliseconds)); \
+    while (!(condition) && !_xkb_wait.timed_out) \
+      g_main_context_iteration (NULL, TRUE); \
+    xkb_wait_stop (&_xkb_wait); \
+  } G_STMT_END
+
+G_END_DECLS
+
+#endif
@@ -25,6 +25,7 @@
 #endif
 
 #include "xkb-xfconf.h"
+#include "xkb-audit.h"
 
 #include <string.h>
 
@@ -46,6 +47,8 @@ static void            xkb_xfconf_set_property        (GObject          *object,
                                                        guint             prop_id,
                                                        const GValue     *value,
                                                        GParamSpec       *pspec);
+static void            xkb_xfconf_notify              (GObject          *object,
+                                                       GParamSpec       *pspec);
 
 struct _XkbXfconfClass
 {
@@ -62,6 +65,21 @@ struct _XkbXfconf
   gboolean             caps_lock_indicator;
   gboolean             display_tooltip_icon;
   XkbGroupPolicy       group_policy;
+  gchar              **layout_sets;
+  gchar              **group_rules;
+
+  XfconfChannel       *channel;
+  gchar               *property_base;
+  gulong               property_changed_handler_id;
+
+  /* changes are collected into one configuration-changed emission
+   * while an update is open */
+  gint                 update_depth;
+  guint                pending_changes;
+  guint                channel_update_id;
+
+  /* values which came from the channel, they are not written back */
+  guint                synced_changes;
 };
 
 enum
@@ -73,6 +91,8 @@ enum
   PROP_CAPS_LOCK_INDICATOR,
   PROP_DISPLAY_TOOLTIP_ICON,
   PROP_GROUP_POLICY,
+  PROP_LAYOUT_SETS,
+  PROP_GROUP_RULES,
   N_PROPERTIES,
 };
 
@@ -97,6 +117,7 @@ xkb_xfconf_class_init (XkbXfconfClass *klass)
   gobject_class->finalize = xkb_xfconf_finalize;
   gobject_class->get_property = xkb_xfconf_get_property;
   gobject_class->set_property = xkb_xfconf_set_property;
+  gobject_class->notify = xkb_xfconf_notify;
 
   g_object_class_install_property (gobject_class, PROP_DISPLAY_TYPE,
                                    g_param_spec_uint (DISPLAY_TYPE, NULL, NULL,
@@ -132,17 +153,27 @@ xkb_xfconf_class_init (XkbXfconfClass *klass)
   g_object_class_install_property (gobject_class, PROP_GROUP_POLICY,
                                    g_param_spec_uint (GROUP_POLICY, NULL, NULL,
                                                       GROUP_POLICY_GLOBAL,
-                                                      GROUP_POLICY_PER_APPLICATION,
+                                                      GROUP_POLICY_PER_WORKSPACE,
                                                       DEFAULT_GROUP_POLICY,
                                                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_LAYOUT_SETS,
+                                   g_param_spec_boxed (LAYOUT_SETS, NULL, NULL,
+                                                       G_TYPE_STRV,
+                                                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GROUP_RULES,
+                                   g_param_spec_boxed (GROUP_RULES, NULL, NULL,
+                                                       G_TYPE_STRV,
+                                                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   xkb_xfconf_signals[CONFIGURATION_CHANGED] =
     g_signal_new (g_intern_static_string ("configuration-changed"),
                   G_TYPE_FROM_CLASS (gobject_class),
                   G_SIGNAL_RUN_LAST,
                   0, NULL, NULL,
-                  g_cclosure_marshal_VOID__VOID,
-                  G_TYPE_NONE, 0);
+                  g_cclosure_marshal_VOID__UINT,
+                  G_TYPE_NONE, 1, G_TYPE_UINT);
 }
 
 
@@ -156,6 +187,16 @@ xkb_xfconf_init (XkbXfconf *config)
   config->caps_lock_indicator = DEFAULT_CAPS_LOCK_INDICATOR;
   config->display_tooltip_icon = DEFAULT_DISPLAY_TOOLTIP_ICON;
   config->group_policy = DEFAULT_GROUP_POLICY;
+  config->layout_sets = NULL;
+  config->group_rules = NULL;
+
+  config->channel = NULL;
+  config->property_base = NULL;
+  config->property_changed_handler_id = 0;
+  config->update_depth = 0;
+  config->pending_changes = 0;
+  config->channel_update_id = 0;
+  config->synced_changes = 0;
 }
 
 
@@ -163,7 +204,20 @@ xkb_xfconf_init (XkbXfconf *config)
 static void
 xkb_xfconf_finalize (GObject *object)
 {
-  xfconf_shutdown ();
+  XkbXfconf *config = XKB_XFCONF (object);
+
+  g_strfreev (config->layout_sets);
+  g_strfreev (config->group_rules);
+
+  if (config->channel_update_id != 0)
+    g_source_remove (config->channel_update_id);
+
+  if (config->property_changed_handler_id != 0)
+    g_signal_handler_disconnect (config->channel, config->property_changed_handler_id);
+  g_free (config->property_base);
+
+  if (config->channel != NULL)
+    xfconf_shutdown ();
   G_OBJECT_CLASS (xkb_xfconf_parent_class)->finalize (object);
 }
 
@@ -203,6 +257,14 @@ xkb_xfconf_get_property (GObject    *object,
       g_value_set_uint (value, config->group_policy);
       break;
 
+    case PROP_LAYOUT_SETS:
+      g_value_set_boxed (value, config->layout_sets);
+      break;
+
+    case PROP_GROUP_RULES:
+      g_value_set_boxed (value, config->group_rules);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -211,6 +273,58 @@ xkb_xfconf_get_property (GObject    *object,
 
 
 
+/* the bits of XkbXfconfChange follow the order of the properties */
+#define XKB_XFCONF_CHANGE(pspec) (1u << ((pspec)->param_id - 1))
+
+
+
+static void
+xkb_xfconf_emit_changes (XkbXfconf *config)
+{
+  guint changes = config->pending_changes;
+
+  config->pending_changes = 0;
+
+  if (changes != 0)
+    g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0, changes);
+}
+
+
+
+static void
+xkb_xfconf_changed (XkbXfconf  *config,
+                    GParamSpec *pspec)
+{
+  g_object_notify_by_pspec (G_OBJECT (config), pspec);
+
+  config->pending_changes |= XKB_XFCONF_CHANGE (pspec);
+
+  if (config->update_depth == 0)
+    xkb_xfconf_emit_changes (config);
+}
+
+
+
+static gboolean
+xkb_xfconf_strv_equal (gchar **strv1,
+                       gchar **strv2)
+{
+  gint i;
+
+  if (strv1 == NULL || strv2 == NULL)
+    return strv1 == strv2;
+
+  for (i = 0; strv1[i] != NULL && strv2[i] != NULL; i++)
+    {
+      if (strcmp (strv1[i], strv2[i]) != 0)
+        return FALSE;
+    }
+
+  return strv1[i] == strv2[i];
+}
+
+
+
 static void
 xkb_xfconf_set_property (GObject      *object,
                          guint         prop_id,
@@ -220,6 +334,7 @@ xkb_xfconf_set_property (GObject      *object,
   XkbXfconf *config = XKB_XFCONF (object);
   guint      val_uint;
   gboolean   val_boolean;
+  gchar    **val_strv;
 
   switch (prop_id)
     {
@@ -228,8 +343,7 @@ xkb_xfconf_set_property (GObject      *object,
       if (config->display_type != val_uint)
         {
           config->display_type = val_uint;
-          g_object_notify (G_OBJECT (config), DISPLAY_TYPE);
-          g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0);
+          xkb_xfconf_changed (config, pspec);
         }
       break;
 
@@ -238,8 +352,7 @@ xkb_xfconf_set_property (GObject      *object,
       if (config->display_name != val_uint)
         {
           config->display_name = val_uint;
-          g_object_notify (G_OBJECT (config), DISPLAY_NAME);
-          g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0);
+          xkb_xfconf_changed (config, pspec);
         }
       break;
 
@@ -248,8 +361,7 @@ xkb_xfconf_set_property (GObject      *object,
       if (config->display_scale != val_uint)
         {
           config->display_scale = val_uint;
-          g_object_notify (G_OBJECT (config), DISPLAY_SCALE);
-          g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0);
+          xkb_xfconf_changed (config, pspec);
         }
       break;
 
@@ -258,8 +370,7 @@ xkb_xfconf_set_property (GObject      *object,
       if (config->caps_lock_indicator != val_boolean)
         {
           config->caps_lock_indicator = val_boolean;
-          g_object_notify (G_OBJECT (config), CAPS_LOCK_INDICATOR);
-          g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0);
+          xkb_xfconf_changed (config, pspec);
         }
       break;
 
@@ -268,8 +379,7 @@ xkb_xfconf_set_property (GObject      *object,
       if (config->display_tooltip_icon != val_boolean)
         {
           config->display_tooltip_icon = val_boolean;
-          g_object_notify (G_OBJECT (config), DISPLAY_TOOLTIP_ICON);
-          g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0);
+          xkb_xfconf_changed (config, pspec);
         }
       break;
 
@@ -278,8 +388,27 @@ xkb_xfconf_set_property (GObject      *object,
       if (config->group_policy != val_uint)
         {
           config->group_policy = val_uint;
-          g_object_notify (G_OBJECT (config), GROUP_POLICY);
-          g_signal_emit (G_OBJECT (config), xkb_xfconf_signals[CONFIGURATION_CHANGED], 0);
+          xkb_xfconf_changed (config, pspec);
+        }
+      break;
+
+    case PROP_LAYOUT_SETS:
+      val_strv = g_value_get_boxed (value);
+      if (!xkb_xfconf_strv_equal (config->layout_sets, val_strv))
+        {
+          g_strfreev (config->layout_sets);
+          config->layout_sets = g_strdupv (val_strv);
+          xkb_xfconf_changed (config, pspec);
+        }
+      break;
+
+    case PROP_GROUP_RULES:
+      val_strv = g_value_get_boxed (value);
+      if (!xkb_xfconf_strv_equal (config->group_rules, val_strv))
+        {
+          g_strfreev (config->group_rules);
+          config->group_rules = g_strdupv (val_strv);
+          xkb_xfconf_changed (config, pspec);
         }
       break;
 
@@ -345,42 +474,260 @@ xkb_xfconf_get_group_policy (XkbXfconf *config)
 
 
 
+/*
+ * Returns the configured layout sets, each a comma separated list of
+ * layouts with optional variants in parentheses, e.g. "us,de(nodeadkeys)".
+ */
+const gchar * const *
+xkb_xfconf_get_layout_sets (XkbXfconf *config)
+{
+  g_return_val_if_fail (IS_XKB_XFCONF (config), NULL);
+  return (const gchar * const *) config->layout_sets;
+}
+
+
+
+/*
+ * Returns the rules giving new windows their first layout, each of the
+ * form "FIELD:PATTERN=LAYOUT", see XkbGroupRules.
+ */
+const gchar * const *
+xkb_xfconf_get_group_rules (XkbXfconf *config)
+{
+  g_return_val_if_fail (IS_XKB_XFCONF (config), NULL);
+  return (const gchar * const *) config->group_rules;
+}
+
+
+
+/*
+ * Converts a value as stored by xfconfd to the type of the property.
+ * Arrays come as a GPtrArray of GValues.
+ */
+static gboolean
+xkb_xfconf_value_from_channel (const GValue *channel_value,
+                               GParamSpec   *pspec,
+                               GValue       *value)
+{
+  GType      type = G_PARAM_SPEC_VALUE_TYPE (pspec);
+  GPtrArray *array;
+  GValue    *item;
+  gchar    **strv;
+  guint      i, n = 0;
+
+  g_value_init (value, type);
+
+  if (type == G_TYPE_STRV && G_VALUE_HOLDS (channel_value, G_TYPE_PTR_ARRAY))
+    {
+      array = g_value_get_boxed (channel_value);
+      strv = g_new0 (gchar *, (array != NULL ? array->len : 0) + 1);
+
+      for (i = 0; array != NULL && i < array->len; i++)
+        {
+          item = g_ptr_array_index (array, i);
+          if (G_VALUE_HOLDS_STRING (item))
+            strv[n++] = g_value_dup_string (item);
+        }
+
+      g_value_take_boxed (value, strv);
+      return TRUE;
+    }
+
+  if (g_value_type_transformable (G_VALUE_TYPE (channel_value), type) &&
+      g_value_transform (channel_value, value))
+    return TRUE;
+
+  g_value_unset (value);
+  return FALSE;
+}
+
+
+
+static void
+xkb_xfconf_apply (XkbXfconf    *config,
+                  const gchar  *name,
+                  const GValue *channel_value)
+{
+  GParamSpec *pspec;
+  GValue      value = G_VALUE_INIT;
+
+  pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (config), name);
+  if (pspec == NULL)
+    return;
+
+  /* a reset property goes back to its default */
+  if (channel_value == NULL || G_VALUE_TYPE (channel_value) == G_TYPE_INVALID)
+    {
+      g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+      g_param_value_set_default (pspec, &value);
+    }
+  else if (!xkb_xfconf_value_from_channel (channel_value, pspec, &value))
+    return;
+
+  g_param_value_validate (pspec, &value);
+
+  /* outside of an update the notification has already been handled */
+  config->synced_changes |= XKB_XFCONF_CHANGE (pspec);
+  g_object_set_property (G_OBJECT (config), name, &value);
+  if (config->update_depth == 0)
+    config->synced_changes &= ~XKB_XFCONF_CHANGE (pspec);
+
+  g_value_unset (&value);
+}
+
+
+
+static gboolean
+xkb_xfconf_channel_commit (gpointer user_data)
+{
+  XkbXfconf *config = user_data;
+
+  xkb_audit_count (XKB_AUDIT_CONFIG_COMMIT);
+
+  config->channel_update_id = 0;
+  xkb_xfconf_commit_update (config);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+
+static void
+xkb_xfconf_property_changed (XfconfChannel *channel,
+                             const gchar   *property,
+                             const GValue  *value,
+                             XkbXfconf     *config)
+{
+  gsize len = strlen (config->property_base);
+
+  if (strncmp (property, config->property_base, len) != 0 || property[len] != '/')
+    return;
+
+  /* xfconfd sends one signal per property, a burst of them (a profile
+   * import, a script) is committed at once when the loop goes idle */
+  if (config->channel_update_id == 0)
+    {
+      xkb_xfconf_begin_update (config);
+      config->channel_update_id = g_idle_add (xkb_xfconf_channel_commit, config);
+    }
+
+  xkb_xfconf_apply (config, property + len + 1, value);
+}
+
+
+
+static void
+xkb_xfconf_notify (GObject    *object,
+                   GParamSpec *pspec)
+{
+  XkbXfconf  *config = XKB_XFCONF (object);
+  GValue      value = G_VALUE_INIT;
+  gchar      *property;
+  gchar     **strv;
+
+  if (config->channel == NULL || (config->synced_changes & XKB_XFCONF_CHANGE (pspec)))
+    return;
+
+  property = g_strconcat (config->property_base, "/", g_param_spec_get_name (pspec), NULL);
+
+  g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (pspec));
+  g_object_get_property (object, g_param_spec_get_name (pspec), &value);
+
+  if (G_VALUE_HOLDS (&value, G_TYPE_STRV))
+    {
+      strv = g_value_get_boxed (&value);
+      if (strv == NULL || *strv == NULL)
+        xfconf_channel_reset_property (config->channel, property, FALSE);
+      else
+        xfconf_channel_set_string_list (config->channel, property, (const gchar * const *) strv);
+    }
+  else
+    xfconf_channel_set_property (config->channel, property, &value);
+
+  g_value_unset (&value);
+  g_free (property);
+}
+
+
+
+/*
+ * Opens an update, changes made until the matching commit are reported
+ * by a single configuration-changed emission. Updates nest.
+ */
+void
+xkb_xfconf_begin_update (XkbXfconf *config)
+{
+  g_return_if_fail (IS_XKB_XFCONF (config));
+
+  if (config->update_depth++ == 0)
+    g_object_freeze_notify (G_OBJECT (config));
+}
+
+
+
+void
+xkb_xfconf_commit_update (XkbXfconf *config)
+{
+  g_return_if_fail (IS_XKB_XFCONF (config));
+  g_return_if_fail (config->update_depth > 0);
+
+  if (--config->update_depth > 0)
+    return;
+
+  g_object_thaw_notify (G_OBJECT (config));
+  config->synced_changes = 0;
+
+  xkb_xfconf_emit_changes (config);
+}
+
+
+
+/*
+ * All the properties of the plugin are fetched with a single call and
+ * changes to any of them arrive through one channel handler, instead of
+ * a binding, round trip and handler per property.
+ *
+ * Without a property base the configuration is not backed by xfconf and
+ * only changes through g_object_set (), as in the plugin host.
+ */
 XkbXfconf *
 xkb_xfconf_new (const gchar *property_base)
 {
-  XkbXfconf     *config;
-  XfconfChannel *channel;
-  gchar         *property;
+  XkbXfconf      *config;
+  GHashTable     *properties;
+  GHashTableIter  iter;
+  gpointer        key, value;
+  gsize           len;
 
   config = g_object_new (TYPE_XKB_XFCONF, NULL);
 
-  if (xfconf_init (NULL))
+  if (property_base != NULL && xfconf_init (NULL))
     {
-      channel = xfconf_channel_get ("xfce4-panel");
+      config->channel = xfconf_channel_get ("xfce4-panel");
+      config->property_base = g_strdup (property_base);
 
-      property = g_strconcat (property_base, "/" DISPLAY_TYPE, NULL);
-      xfconf_g_property_bind (channel, property, G_TYPE_UINT, config, DISPLAY_TYPE);
-      g_free (property);
+      properties = xfconf_channel_get_properties (config->channel, property_base);
+      if (properties != NULL)
+        {
+          xkb_xfconf_begin_update (config);
 
-      property = g_strconcat (property_base, "/" DISPLAY_NAME, NULL);
-      xfconf_g_property_bind (channel, property, G_TYPE_UINT, config, DISPLAY_NAME);
-      g_free (property);
+          len = strlen (property_base);
 
-      property = g_strconcat (property_base, "/" DISPLAY_SCALE, NULL);
-      xfconf_g_property_bind (channel, property, G_TYPE_UINT, config, DISPLAY_SCALE);
-      g_free (property);
+          g_hash_table_iter_init (&iter, properties);
+          while (g_hash_table_iter_next (&iter, &key, &value))
+            {
+              if (strncmp (key, property_base, len) == 0 && ((gchar *) key)[len] == '/')
+                xkb_xfconf_apply (config, (gchar *) key + len + 1, value);
+            }
 
-      property = g_strconcat (property_base, "/" CAPS_LOCK_INDICATOR, NULL);
-      xfconf_g_property_bind (channel, property, G_TYPE_BOOLEAN, config, CAPS_LOCK_INDICATOR);
-      g_free (property);
+          g_hash_table_destroy (properties);
 
-      property = g_strconcat (property_base, "/" DISPLAY_TOOLTIP_ICON, NULL);
-      xfconf_g_property_bind (channel, property, G_TYPE_BOOLEAN, config, DISPLAY_TOOLTIP_ICON);
-      g_free (property);
+          xkb_xfconf_commit_update (config);
+        }
 
-      property = g_strconcat (property_base, "/" GROUP_POLICY, NULL);
-      xfconf_g_property_bind (channel, property, G_TYPE_UINT, config, GROUP_POLICY);
-      g_free (property);
+      config->property_changed_handler_id =
+        g_signal_connect (G_OBJECT (config->channel), "property-changed",
+                          G_CALLBACK (xkb_xfconf_property_changed), config);
     }
 
   return config;
@@ -31,6 +31,19 @@ G_BEGIN_DECLS
 typedef struct _XkbXfconfClass      XkbXfconfClass;
 typedef struct _XkbXfconf           XkbXfconf;
 
+/* the changes reported by the configuration-changed signal */
+typedef enum
+{
+  XKB_XFCONF_CHANGED_DISPLAY_TYPE         = 1 << 0,
+  XKB_XFCONF_CHANGED_DISPLAY_NAME         = 1 << 1,
+  XKB_XFCONF_CHANGED_DISPLAY_SCALE        = 1 << 2,
+  XKB_XFCONF_CHANGED_CAPS_LOCK_INDICATOR  = 1 << 3,
+  XKB_XFCONF_CHANGED_DISPLAY_TOOLTIP_ICON = 1 << 4,
+  XKB_XFCONF_CHANGED_GROUP_POLICY         = 1 << 5,
+  XKB_XFCONF_CHANGED_LAYOUT_SETS          = 1 << 6,
+  XKB_XFCONF_CHANGED_GROUP_RULES          = 1 << 7,
+} XkbXfconfChange;
+
 #define TYPE_XKB_XFCONF             (xkb_xfconf_get_type ())
 #define XKB_XFCONF(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), TYPE_XKB_XFCONF, XkbXfconf))
 #define XKB_XFCONF_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass),  TYPE_XKB_XFCONF, XkbXfconfClass))
@@ -42,12 +55,19 @@ GType           xkb_xfconf_get_type                        (void)
 
 XkbXfconf      *xkb_xfconf_new                             (const gchar   *property_base);
 
+void            xkb_xfconf_begin_update                    (XkbXfconf     *config);
+void            xkb_xfconf_commit_update                   (XkbXfconf     *config);
+
 XkbDisplayType  xkb_xfconf_get_display_type                (XkbXfconf     *config);
 XkbDisplayName  xkb_xfconf_get_display_name                (XkbXfconf     *config);
 guint           xkb_xfconf_get_display_scale               (XkbXfconf     *config);
 gboolean        xkb_xfconf_get_caps_lock_indicator         (XkbXfconf     *config);
 gboolean        xkb_xfconf_get_display_tooltip_icon        (XkbXfconf     *config);
 XkbGroupPolicy  xkb_xfconf_get_group_policy                (XkbXfconf     *config);
+const gchar * const *
+                xkb_xfconf_get_layout_sets                 (XkbXfconf     *config);
+const gchar * const *
+                xkb_xfconf_get_group_rules                 (XkbXfconf     *config);
 
 G_END_DECLS
 
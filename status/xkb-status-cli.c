@@ -0,0 +1,137 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-status-cli.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xkb-status.h"
+
+#define DEFAULT_FORMAT "%l"
+
+
+
+static void
+usage (const char *program)
+{
+  fprintf (stderr,
+           "Usage: %s [-d DISPLAY] [-p PATH] [-f FORMAT]\n"
+           "\n"
+           "Print the keyboard layout published by the Xfce xkb panel plugin.\n"
+           "\n"
+           "FORMAT may contain:\n"
+           "  %%l  layout code        %%v  variant\n"
+           "  %%n  layout name        %%g  group index\n"
+           "  %%G  group count        %%c  1 if Caps Lock is on, else 0\n"
+           "  %%%%  a literal %%\n"
+           "The default format is \"%s\".\n",
+           program, DEFAULT_FORMAT);
+}
+
+
+
+static void
+print_snapshot (const char              *format,
+                const XkbStatusSnapshot *snapshot)
+{
+  const char *p;
+
+  for (p = format; *p != '\0'; p++)
+    {
+      if (*p != '%' || p[1] == '\0')
+        {
+          putchar (*p);
+          continue;
+        }
+
+      switch (*++p)
+        {
+        case 'l': fputs (snapshot->layout, stdout); break;
+        case 'v': fputs (snapshot->variant, stdout); break;
+        case 'n': fputs (snapshot->pretty_name, stdout); break;
+        case 'g': printf ("%d", snapshot->group); break;
+        case 'G': printf ("%d", snapshot->group_count); break;
+        case 'c': putchar (snapshot->caps_lock ? '1' : '0'); break;
+        case '%': putchar ('%'); break;
+        default:  putchar ('%'); putchar (*p); break;
+        }
+    }
+
+  putchar ('\n');
+}
+
+
+
+int
+main (int    argc,
+      char **argv)
+{
+  XkbStatus         *status;
+  XkbStatusSnapshot  snapshot;
+  const char        *format = DEFAULT_FORMAT;
+  const char        *display = NULL;
+  char              *path = NULL;
+  int                opt;
+
+  while ((opt = getopt (argc, argv, "d:p:f:h")) != -1)
+    {
+      switch (opt)
+        {
+        case 'd': display = optarg; break;
+        case 'p': path = strdup (optarg); break;
+        case 'f': format = optarg; break;
+        default:
+          usage (argv[0]);
+          return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+  if (path == NULL)
+    path = xkb_status_get_path (display);
+
+  status = path != NULL ? xkb_status_open (path) : NULL;
+  if (status == NULL)
+    {
+      fprintf (stderr, "%s: %s: %s\n", argv[0], path != NULL ? path : "status file",
+               strerror (errno));
+      free (path);
+      return EXIT_FAILURE;
+    }
+
+  if (xkb_status_read (status, &snapshot) < 0)
+    {
+      fprintf (stderr, "%s: %s: %s\n", argv[0], path,
+               errno == ENOENT ? "the plugin is not running" : strerror (errno));
+      xkb_status_close (status);
+      free (path);
+      return EXIT_FAILURE;
+    }
+
+  print_snapshot (format, &snapshot);
+
+  xkb_status_close (status);
+  free (path);
+
+  return EXIT_SUCCESS;
+}
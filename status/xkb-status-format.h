@@ -0,0 +1,82 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-status-format.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_STATUS_FORMAT_H_
+#define _XKB_STATUS_FORMAT_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Layout of the status file the plugin keeps mapped in the user runtime
+ * directory, one file per X display. The writer increments sequence before
+ * and after every update, so it is odd while an update is in progress.
+ * Readers copy the data and retry if the sequence was odd or changed.
+ */
+
+#define XKB_STATUS_MAGIC            0x53424b58  /* "XKBS" */
+#define XKB_STATUS_VERSION          1
+#define XKB_STATUS_FILENAME_PREFIX  "xfce4-xkb-status-"
+
+#define XKB_STATUS_LAYOUT_LEN       32
+#define XKB_STATUS_VARIANT_LEN      64
+#define XKB_STATUS_NAME_LEN         128
+
+typedef struct
+{
+  uint32_t  magic;
+  uint32_t  version;
+  uint32_t  sequence;
+  int32_t   pid;
+
+  int32_t   group;
+  int32_t   group_count;
+  int32_t   caps_lock;
+  int32_t   reserved;
+
+  char      layout[XKB_STATUS_LAYOUT_LEN];
+  char      variant[XKB_STATUS_VARIANT_LEN];
+  char      pretty_name[XKB_STATUS_NAME_LEN];
+} XkbStatusShared;
+
+/* Reduces a display name such as "localhost:10.0" to "10", so the writer
+ * (which gets ":10" from GDK) and readers (which see $DISPLAY) agree on
+ * the file name. */
+static inline void
+xkb_status_display_number (const char *display,
+                           char       *buffer,
+                           size_t      length)
+{
+  const char *colon;
+  size_t      n = 0;
+
+  colon = display != NULL ? strrchr (display, ':') : NULL;
+  if (colon != NULL)
+    {
+      for (colon++; colon[n] >= '0' && colon[n] <= '9' && n + 1 < length; n++)
+        buffer[n] = colon[n];
+    }
+
+  if (n == 0 && length > 1)
+    buffer[n++] = '0';
+
+  buffer[n] = '\0';
+}
+
+#endif
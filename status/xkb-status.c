@@ -0,0 +1,203 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-status.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "xkb-status.h"
+#include "xkb-status-format.h"
+
+/* a writer never holds the sequence odd for long, but it may have died
+ * in the middle of an update */
+#define MAX_RETRIES 1000
+
+struct _XkbStatus
+{
+  const XkbStatusShared *shared;
+};
+
+
+
+char *
+xkb_status_get_path (const char *display)
+{
+  const char *runtime_dir;
+  const char *home;
+  char        number[16];
+  char       *path;
+  size_t      length;
+
+  xkb_status_display_number (display != NULL ? display : getenv ("DISPLAY"),
+                             number, sizeof (number));
+
+  /* same fallback as g_get_user_runtime_dir () */
+  runtime_dir = getenv ("XDG_RUNTIME_DIR");
+  if (runtime_dir == NULL || *runtime_dir == '\0')
+    runtime_dir = getenv ("XDG_CACHE_HOME");
+
+  if (runtime_dir == NULL || *runtime_dir == '\0')
+    {
+      home = getenv ("HOME");
+      if (home == NULL)
+        {
+          errno = ENOENT;
+          return NULL;
+        }
+
+      length = strlen (home) + strlen ("/.cache/") + strlen (XKB_STATUS_FILENAME_PREFIX)
+               + strlen (number) + 1;
+      path = malloc (length);
+      if (path != NULL)
+        snprintf (path, length, "%s/.cache/%s%s", home, XKB_STATUS_FILENAME_PREFIX, number);
+      return path;
+    }
+
+  length = strlen (runtime_dir) + 1 + strlen (XKB_STATUS_FILENAME_PREFIX) + strlen (number) + 1;
+  path = malloc (length);
+  if (path != NULL)
+    snprintf (path, length, "%s/%s%s", runtime_dir, XKB_STATUS_FILENAME_PREFIX, number);
+
+  return path;
+}
+
+
+
+XkbStatus *
+xkb_status_open (const char *path)
+{
+  XkbStatus   *status;
+  char        *default_path = NULL;
+  struct stat  st;
+  void        *map;
+  int          fd;
+
+  if (path == NULL)
+    {
+      default_path = xkb_status_get_path (NULL);
+      if (default_path == NULL)
+        return NULL;
+      path = default_path;
+    }
+
+  fd = open (path, O_RDONLY | O_CLOEXEC);
+  free (default_path);
+
+  if (fd < 0)
+    return NULL;
+
+  if (fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (XkbStatusShared))
+    {
+      close (fd);
+      errno = EINVAL;
+      return NULL;
+    }
+
+  map = mmap (NULL, sizeof (XkbStatusShared), PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  status = malloc (sizeof (XkbStatus));
+  if (status == NULL)
+    {
+      munmap (map, sizeof (XkbStatusShared));
+      return NULL;
+    }
+
+  status->shared = map;
+
+  return status;
+}
+
+
+
+int
+xkb_status_read (XkbStatus         *status,
+                 XkbStatusSnapshot *snapshot)
+{
+  const XkbStatusShared *shared = status->shared;
+  uint32_t               seq1, seq2;
+  int32_t                pid;
+  int                    retries;
+
+  for (retries = 0; retries < MAX_RETRIES; retries++)
+    {
+      seq1 = __atomic_load_n (&shared->sequence, __ATOMIC_ACQUIRE);
+      if (seq1 & 1)
+        continue;
+
+      if (shared->magic != XKB_STATUS_MAGIC || shared->version != XKB_STATUS_VERSION)
+        {
+          errno = ENOENT;
+          return -1;
+        }
+
+      pid = shared->pid;
+      snapshot->group = shared->group;
+      snapshot->group_count = shared->group_count;
+      snapshot->caps_lock = shared->caps_lock;
+      memcpy (snapshot->layout, shared->layout, sizeof (snapshot->layout));
+      memcpy (snapshot->variant, shared->variant, sizeof (snapshot->variant));
+      memcpy (snapshot->pretty_name, shared->pretty_name, sizeof (snapshot->pretty_name));
+
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+      seq2 = __atomic_load_n (&shared->sequence, __ATOMIC_RELAXED);
+
+      if (seq1 == seq2)
+        {
+          snapshot->layout[sizeof (snapshot->layout) - 1] = '\0';
+          snapshot->variant[sizeof (snapshot->variant) - 1] = '\0';
+          snapshot->pretty_name[sizeof (snapshot->pretty_name) - 1] = '\0';
+
+          /* the file outlives a crashed plugin */
+          if (pid > 0 && kill (pid, 0) < 0 && errno == ESRCH)
+            {
+              errno = ENOENT;
+              return -1;
+            }
+
+          return 0;
+        }
+    }
+
+  errno = EAGAIN;
+  return -1;
+}
+
+
+
+void
+xkb_status_close (XkbStatus *status)
+{
+  if (status == NULL)
+    return;
+
+  munmap ((void *) status->shared, sizeof (XkbStatusShared));
+  free (status);
+}
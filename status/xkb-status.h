@@ -0,0 +1,64 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* xkb-status.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _XKB_STATUS_H_
+#define _XKB_STATUS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free access to the keyboard layout state published by the xkb
+ * panel plugin, meant for status bars and shell prompts which would
+ * otherwise have to query the X server on every refresh.
+ */
+
+typedef struct _XkbStatus XkbStatus;
+
+typedef struct
+{
+  int   group;
+  int   group_count;
+  int   caps_lock;
+  char  layout[32];
+  char  variant[64];
+  char  pretty_name[128];
+} XkbStatusSnapshot;
+
+/* Returns the status file of the given X display, or of $DISPLAY if NULL.
+ * The result must be released with free (). */
+char       *xkb_status_get_path     (const char        *display);
+
+/* Maps the status file at path, or the default one if path is NULL.
+ * Returns NULL and sets errno on failure. */
+XkbStatus  *xkb_status_open         (const char        *path);
+
+/* Takes a consistent snapshot of the published state. Returns 0 on
+ * success, or -1 and sets errno: ENOENT if the plugin has exited, EAGAIN
+ * if no consistent copy could be taken. */
+int         xkb_status_read         (XkbStatus         *status,
+                                     XkbStatusSnapshot *snapshot);
+
+void        xkb_status_close        (XkbStatus         *status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
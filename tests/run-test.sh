@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Runs one test with its own XDG directories, inside a private D-Bus
+# session and on an Xvfb server when dbus-run-session and xvfb-run are
+# installed. The plugin objects then never touch the settings, caches
+# or X server of the user running "make check".
+#
+
+test_home=`mktemp -d "${TMPDIR:-/tmp}/xkb-test.XXXXXX"` || exit 99
+trap 'rm -rf "$test_home"' EXIT
+
+XDG_CONFIG_HOME="$test_home/config"
+XDG_CACHE_HOME="$test_home/cache"
+XDG_DATA_HOME="$test_home/data"
+XDG_RUNTIME_DIR="$test_home/runtime"
+export XDG_CONFIG_HOME XDG_CACHE_HOME XDG_DATA_HOME XDG_RUNTIME_DIR
+mkdir -p "$XDG_CONFIG_HOME" "$XDG_CACHE_HOME" "$XDG_DATA_HOME" "$XDG_RUNTIME_DIR"
+chmod 700 "$XDG_RUNTIME_DIR"
+
+if type xvfb-run >/dev/null 2>&1; then
+  set -- xvfb-run -a -s "-screen 0 640x480x24 +extension XKEYBOARD" "$@"
+else
+  unset DISPLAY
+fi
+
+if type dbus-run-session >/dev/null 2>&1; then
+  set -- dbus-run-session -- "$@"
+else
+  unset DBUS_SESSION_BUS_ADDRESS
+fi
+
+"$@"
@@ -0,0 +1,234 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* test-audit.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Runs the keyboard on the libxklavier backend against the Xvfb server
+ * of run-test.sh with the audit switched on, and checks what it costs:
+ * the X round trips of a group switch, and the main loop wakeups of a
+ * plugin nobody types into, which must be none at all.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "xkb-properties.h"
+#include "xkb-xfconf.h"
+#include "xkb-keyboard.h"
+#include "xkb-modifier.h"
+#include "xkb-backend.h"
+#include "xkb-audit.h"
+#include "xkb-wait.h"
+
+#define TEST_TIMEOUT             5000
+
+/* a group switch is XkbLockGroup and the XSync behind it */
+#define SWITCH_COUNT             20
+#define SWITCH_ROUND_TRIPS       1
+#define SWITCH_REQUESTS          4
+
+/* XKB_TEST_IDLE_SECONDS watches the idle plugin longer, e.g. for 60 s */
+#define IDLE_SETTLE_SECONDS      2
+#define IDLE_SECONDS             3
+
+typedef struct
+{
+  XkbXfconf           *config;
+  XkbKeyboard         *keyboard;
+  XkbModifier         *modifier;
+
+  guint                state_changes;
+} Fixture;
+
+static GPollFunc       idle_default_poll = NULL;
+static gint64          idle_deadline = 0;
+static guint           idle_wakeups = 0;
+
+
+
+/* every return from poll before the deadline is a wakeup of the process,
+ * whatever source it was for */
+static gint
+idle_poll (GPollFD *fds,
+           guint    nfds,
+           gint     timeout)
+{
+  gint64 remaining;
+  gint   result;
+
+  /* sleep until the deadline at most, so the watch needs no timer of
+   * its own, and round up so that poll does not return just before it */
+  remaining = MAX (idle_deadline - g_get_monotonic_time () + 999, 0) / 1000;
+  if (timeout < 0 || timeout > remaining)
+    timeout = remaining;
+
+  result = idle_default_poll (fds, nfds, timeout);
+
+  if (g_get_monotonic_time () < idle_deadline)
+    idle_wakeups++;
+
+  return result;
+}
+
+
+
+static void
+fixture_state_changed (XkbKeyboard *keyboard,
+                       gboolean     config_changed,
+                       Fixture     *fixture)
+{
+  fixture->state_changes++;
+}
+
+
+
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  const gchar *layouts[] = { "us", "de", NULL };
+  const gchar *variants[] = { "", "", NULL };
+  XkbBackend  *backend;
+
+  fixture->config = xkb_xfconf_new (NULL);
+  fixture->keyboard = xkb_keyboard_new (fixture->config);
+  fixture->modifier = xkb_modifier_new ();
+  fixture->state_changes = 0;
+
+  g_signal_connect (fixture->keyboard, "state-changed",
+                    G_CALLBACK (fixture_state_changed), fixture);
+
+  backend = xkb_keyboard_get_backend (fixture->keyboard);
+  if (backend == NULL
+      || !xkb_backend_activate_config (backend, layouts, variants))
+    return;
+
+  xkb_wait_until (xkb_keyboard_get_group_count (fixture->keyboard) == 2, TEST_TIMEOUT);
+}
+
+
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  g_object_unref (fixture->modifier);
+  g_object_unref (fixture->keyboard);
+  g_object_unref (fixture->config);
+}
+
+
+
+static void
+test_group_switch (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  XkbAuditOperationStats stats;
+  guint                  i;
+
+  if (xkb_keyboard_get_group_count (fixture->keyboard) != 2)
+    {
+      g_test_skip ("the X server did not take the layouts");
+      return;
+    }
+
+  xkb_audit_reset ();
+
+  for (i = 0; i < SWITCH_COUNT; i++)
+    {
+      fixture->state_changes = 0;
+      g_assert_true (xkb_keyboard_set_group (fixture->keyboard, (i + 1) % 2));
+      xkb_wait_until (fixture->state_changes > 0, TEST_TIMEOUT);
+      g_assert_cmpuint (fixture->state_changes, >, 0);
+    }
+
+  /* the request and the confirmation from the server both count */
+  xkb_audit_get_operation_stats (XKB_AUDIT_OP_GROUP_SWITCH, &stats);
+  g_assert_cmpuint (stats.count, ==, 2 * SWITCH_COUNT);
+
+  if (g_test_verbose ())
+    g_printerr ("%lu requests, %lu round trips, %" G_GUINT64_FORMAT " bytes sent, "
+                "%" G_GUINT64_FORMAT " bytes received for %u switches\n",
+                stats.requests, stats.round_trips, stats.bytes_sent,
+                stats.bytes_received, SWITCH_COUNT);
+
+  g_assert_cmpuint (stats.round_trips, <=, SWITCH_ROUND_TRIPS * SWITCH_COUNT);
+  g_assert_cmpuint (stats.requests, <=, SWITCH_REQUESTS * SWITCH_COUNT);
+}
+
+
+
+static void
+test_idle_wakeups (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  const gchar *seconds;
+  guint        idle_seconds = IDLE_SECONDS;
+
+  seconds = g_getenv ("XKB_TEST_IDLE_SECONDS");
+  if (seconds != NULL)
+    idle_seconds = MAX (g_ascii_strtoull (seconds, NULL, 10), 1);
+
+  /* the start-up and the layout change may still have work queued */
+  xkb_wait_run (IDLE_SETTLE_SECONDS * 1000);
+  xkb_audit_reset ();
+
+  idle_wakeups = 0;
+  idle_deadline = g_get_monotonic_time () + (gint64) idle_seconds * G_USEC_PER_SEC;
+  idle_default_poll = g_main_context_get_poll_func (NULL);
+  g_main_context_set_poll_func (NULL, idle_poll);
+
+  while (g_get_monotonic_time () < idle_deadline)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_main_context_set_poll_func (NULL, idle_default_poll);
+
+  if (g_test_verbose ())
+    g_printerr ("%u wakeups in %u s, %u from sources of the plugin\n",
+                idle_wakeups, idle_seconds, xkb_audit_get_wakeups ());
+
+  g_assert_cmpuint (idle_wakeups, ==, 0);
+  g_assert_cmpuint (xkb_audit_get_wakeups (), ==, 0);
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  g_setenv ("XFCE4_XKB_AUDIT", "1", TRUE);
+  g_unsetenv ("XFCE4_XKB_BACKEND");
+
+  g_test_init (&argc, &argv, NULL);
+
+  if (!gtk_init_check (&argc, &argv))
+    {
+      g_printerr ("no X display, skipping\n");
+      return 77;
+    }
+
+  g_test_add ("/audit/group-switch", Fixture, NULL,
+              fixture_setup, test_group_switch, fixture_teardown);
+  g_test_add ("/audit/idle-wakeups", Fixture, NULL,
+              fixture_setup, test_idle_wakeups, fixture_teardown);
+
+  return g_test_run ();
+}
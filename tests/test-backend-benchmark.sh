@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# Times the start-up and the group switches of the libxklavier and the
+# xkbcommon backend side by side, as far as they were built, on the
+# Xvfb server of run-test.sh. It only fails when a backend does not
+# work at all, the timings are there to be read. The resident sizes
+# only differ between builds with --with-keyboard-backend=xklavier and
+# =xkbcommon, a build of both loads the libraries of both.
+# XKB_TEST_SWITCHES sets the number of group switches.
+#
+
+host="${XKB_PLUGIN_HOST:-../panel-plugin/xkb-plugin-host}"
+switches="${XKB_TEST_SWITCHES:-200}"
+
+if test -z "$DISPLAY"; then
+  echo "no X display, skipping"
+  exit 77
+fi
+
+# the xkbcommon backend cannot set the layouts itself
+if type setxkbmap >/dev/null 2>&1; then
+  setxkbmap -layout us,de
+fi
+
+backends=
+if test "x$XKB_HAVE_XKLAVIER" = "xyes"; then
+  backends="xkl"
+fi
+if test "x$XKB_HAVE_XKBCOMMON" = "xyes"; then
+  backends="$backends xkbcommon"
+fi
+
+for backend in $backends; do
+  # an empty runtime directory, no snapshot shortens the start-up
+  runtime=`mktemp -d "${XDG_RUNTIME_DIR:-${TMPDIR:-/tmp}}/benchmark.XXXXXX"` || exit 99
+  XDG_RUNTIME_DIR="$runtime" XFCE4_XKB_BACKEND=$backend \
+    "$host" --benchmark=$switches || exit $?
+done
@@ -0,0 +1,473 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* test-dbus.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Exports a keyboard on the mock backend on the private session bus of
+ * run-test.sh and talks to it over a second connection, like a client
+ * in another process would.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "xkb-properties.h"
+#include "xkb-xfconf.h"
+#include "xkb-keyboard.h"
+#include "xkb-backend-mock.h"
+#include "xkb-dbus.h"
+#include "xkb-wait.h"
+
+#define XKB_DBUS_NAME            "org.xfce.XkbPlugin"
+#define XKB_DBUS_PATH            "/org/xfce/XkbPlugin"
+#define XKB_DBUS_INTERFACE       "org.xfce.XkbPlugin.Keyboard"
+
+#define TEST_TIMEOUT             5000
+
+typedef struct
+{
+  XkbXfconf           *config;
+  XkbBackendMock      *mock;
+  XkbKeyboard         *keyboard;
+  XkbDBus             *dbus;
+
+  GDBusConnection     *client;
+  guint                subscription_id;
+
+  /* the GroupChanged and PropertiesChanged signals as received */
+  GPtrArray           *group_changed;
+  GPtrArray           *properties_changed;
+
+  gboolean             name_appeared;
+  GVariant            *reply;
+  GError              *error;
+} Fixture;
+
+
+
+/* waits for the condition and fails the test if it never holds */
+#define fixture_wait_for(condition) \
+  G_STMT_START { \
+    xkb_wait_until (condition, TEST_TIMEOUT); \
+    g_assert_true (condition); \
+  } G_STMT_END
+
+
+
+static void
+fixture_set_config (Fixture     *fixture,
+                    const gchar *layouts,
+                    const gchar *variants)
+{
+  gchar **layout_list, **variant_list;
+
+  layout_list = g_strsplit (layouts, ",", -1);
+  variant_list = g_strsplit (variants, ",", -1);
+
+  xkb_backend_mock_set_config (fixture->mock,
+                               (const gchar * const *) layout_list,
+                               (const gchar * const *) variant_list);
+
+  g_strfreev (layout_list);
+  g_strfreev (variant_list);
+}
+
+
+
+static void
+fixture_signal (GDBusConnection *connection,
+                const gchar     *sender_name,
+                const gchar     *object_path,
+                const gchar     *interface_name,
+                const gchar     *signal_name,
+                GVariant        *parameters,
+                gpointer         user_data)
+{
+  Fixture *fixture = user_data;
+
+  if (g_strcmp0 (signal_name, "GroupChanged") == 0)
+    g_ptr_array_add (fixture->group_changed, g_variant_ref (parameters));
+  else if (g_strcmp0 (signal_name, "PropertiesChanged") == 0)
+    g_ptr_array_add (fixture->properties_changed, g_variant_ref (parameters));
+}
+
+
+
+static void
+fixture_name_appeared (GDBusConnection *connection,
+                       const gchar     *name,
+                       const gchar     *name_owner,
+                       gpointer         user_data)
+{
+  Fixture *fixture = user_data;
+
+  fixture->name_appeared = TRUE;
+}
+
+
+
+static void
+fixture_call_done (GObject      *source,
+                   GAsyncResult *result,
+                   gpointer      user_data)
+{
+  Fixture *fixture = user_data;
+
+  fixture->reply = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), result,
+                                                  &fixture->error);
+  if (fixture->reply == NULL)
+    fixture->reply = g_variant_ref_sink (g_variant_new ("()"));
+}
+
+
+
+/* the keyboard answers from this main loop, a blocking call would never
+ * get a reply */
+static GVariant *
+fixture_call (Fixture     *fixture,
+              const gchar *interface_name,
+              const gchar *method_name,
+              GVariant    *parameters)
+{
+  GVariant *reply;
+
+  g_clear_error (&fixture->error);
+  fixture->reply = NULL;
+
+  g_dbus_connection_call (fixture->client, XKB_DBUS_NAME, XKB_DBUS_PATH,
+                          interface_name, method_name, parameters, NULL,
+                          G_DBUS_CALL_FLAGS_NONE, -1, NULL,
+                          fixture_call_done, fixture);
+
+  fixture_wait_for (fixture->reply != NULL);
+
+  reply = fixture->reply;
+  fixture->reply = NULL;
+
+  return reply;
+}
+
+
+
+static GVariant *
+fixture_get_property (Fixture     *fixture,
+                      const gchar *property_name)
+{
+  GVariant *reply, *value = NULL;
+
+  reply = fixture_call (fixture, "org.freedesktop.DBus.Properties", "Get",
+                        g_variant_new ("(ss)", XKB_DBUS_INTERFACE, property_name));
+  g_assert_no_error (fixture->error);
+
+  g_variant_get (reply, "(v)", &value);
+  g_variant_unref (reply);
+
+  return value;
+}
+
+
+
+static gboolean
+fixture_call_group_method (Fixture     *fixture,
+                           const gchar *method_name,
+                           GVariant    *parameters)
+{
+  GVariant *reply;
+  gboolean  success;
+
+  reply = fixture_call (fixture, XKB_DBUS_INTERFACE, method_name, parameters);
+  g_assert_no_error (fixture->error);
+
+  g_variant_get (reply, "(b)", &success);
+  g_variant_unref (reply);
+
+  return success;
+}
+
+
+
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  const gchar *address;
+  GError      *error = NULL;
+  guint        watch_id;
+
+  fixture->group_changed = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+  fixture->properties_changed = g_ptr_array_new_with_free_func ((GDestroyNotify) g_variant_unref);
+  fixture->name_appeared = FALSE;
+  fixture->reply = NULL;
+  fixture->error = NULL;
+  fixture->client = NULL;
+  fixture->dbus = NULL;
+
+  address = g_getenv ("DBUS_SESSION_BUS_ADDRESS");
+  if (address == NULL)
+    return;
+
+  fixture->config = xkb_xfconf_new (NULL);
+  fixture->mock = XKB_BACKEND_MOCK (xkb_backend_mock_new ());
+  fixture_set_config (fixture, "us,de", ",nodeadkeys");
+  fixture->keyboard = xkb_keyboard_new_with_backend (fixture->config, XKB_BACKEND (fixture->mock));
+  fixture->dbus = xkb_dbus_new (fixture->keyboard);
+
+  fixture->client =
+    g_dbus_connection_new_for_address_sync (address,
+                                            G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                            G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+                                            NULL, NULL, &error);
+  g_assert_no_error (error);
+
+  fixture->subscription_id =
+    g_dbus_connection_signal_subscribe (fixture->client, NULL, NULL, NULL, XKB_DBUS_PATH,
+                                        NULL, G_DBUS_SIGNAL_FLAGS_NONE,
+                                        fixture_signal, fixture, NULL);
+
+  watch_id = g_bus_watch_name_on_connection (fixture->client, XKB_DBUS_NAME,
+                                             G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                             fixture_name_appeared, NULL,
+                                             fixture, NULL);
+  fixture_wait_for (fixture->name_appeared);
+  g_bus_unwatch_name (watch_id);
+}
+
+
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  if (fixture->client != NULL)
+    {
+      g_dbus_connection_signal_unsubscribe (fixture->client, fixture->subscription_id);
+      g_dbus_connection_close_sync (fixture->client, NULL, NULL);
+      g_object_unref (fixture->client);
+    }
+
+  if (fixture->dbus != NULL)
+    {
+      g_object_unref (fixture->dbus);
+      g_object_unref (fixture->keyboard);
+      g_object_unref (fixture->mock);
+      g_object_unref (fixture->config);
+    }
+
+  g_ptr_array_unref (fixture->group_changed);
+  g_ptr_array_unref (fixture->properties_changed);
+  g_clear_error (&fixture->error);
+}
+
+
+
+static gboolean
+fixture_skip (Fixture *fixture)
+{
+  if (fixture->client == NULL)
+    {
+      g_test_skip ("no private D-Bus session");
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+assert_group_changed (GVariant    *parameters,
+                      gint         group,
+                      const gchar *layout,
+                      const gchar *variant)
+{
+  const gchar *signal_layout, *signal_variant;
+  gint         signal_group;
+
+  g_variant_get (parameters, "(i&s&s)", &signal_group, &signal_layout, &signal_variant);
+
+  g_assert_cmpint (signal_group, ==, group);
+  g_assert_cmpstr (signal_layout, ==, layout);
+  g_assert_cmpstr (signal_variant, ==, variant);
+}
+
+
+
+static void
+test_groups (Fixture       *fixture,
+             gconstpointer  user_data)
+{
+  GVariant    *value;
+  const gchar *layout, *variant, *pretty_name;
+
+  if (fixture_skip (fixture))
+    return;
+
+  value = fixture_get_property (fixture, "CurrentGroup");
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 0);
+  g_variant_unref (value);
+
+  value = fixture_get_property (fixture, "Groups");
+  g_assert_cmpstr (g_variant_get_type_string (value), ==, "a(sss)");
+  g_assert_cmpuint (g_variant_n_children (value), ==, 2);
+
+  g_variant_get_child (value, 0, "(&s&s&s)", &layout, &variant, &pretty_name);
+  g_assert_cmpstr (layout, ==, "us");
+  g_assert_cmpstr (variant, ==, "");
+  g_assert_cmpstr (pretty_name, ==, "us");
+
+  g_variant_get_child (value, 1, "(&s&s&s)", &layout, &variant, &pretty_name);
+  g_assert_cmpstr (layout, ==, "de");
+  g_assert_cmpstr (variant, ==, "nodeadkeys");
+  g_assert_cmpstr (pretty_name, ==, "de (nodeadkeys)");
+
+  g_variant_unref (value);
+}
+
+
+
+static void
+test_set_group (Fixture       *fixture,
+                gconstpointer  user_data)
+{
+  GVariant *changed, *value;
+  gchar    *interface_name;
+
+  if (fixture_skip (fixture))
+    return;
+
+  g_assert_true (fixture_call_group_method (fixture, "SetGroup", g_variant_new ("(i)", 1)));
+  fixture_wait_for (fixture->properties_changed->len == 1);
+
+  g_assert_cmpuint (fixture->group_changed->len, ==, 1);
+  assert_group_changed (g_ptr_array_index (fixture->group_changed, 0), 1, "de", "nodeadkeys");
+
+  /* only the group changed, the groups are not sent again */
+  g_variant_get (g_ptr_array_index (fixture->properties_changed, 0),
+                 "(s@a{sv}@as)", &interface_name, &changed, NULL);
+  g_assert_cmpstr (interface_name, ==, XKB_DBUS_INTERFACE);
+  g_assert_true (g_variant_lookup (changed, "CurrentGroup", "i", NULL));
+  g_assert_false (g_variant_lookup (changed, "Groups", "@a(sss)", NULL));
+  g_free (interface_name);
+  g_variant_unref (changed);
+
+  value = fixture_get_property (fixture, "CurrentGroup");
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 1);
+  g_variant_unref (value);
+
+  /* a group which does not exist changes nothing */
+  g_assert_false (fixture_call_group_method (fixture, "SetGroup", g_variant_new ("(i)", 2)));
+  g_assert_false (fixture_call_group_method (fixture, "SetGroup", g_variant_new ("(i)", -1)));
+
+  value = fixture_get_property (fixture, "CurrentGroup");
+  g_assert_cmpint (g_variant_get_int32 (value), ==, 1);
+  g_variant_unref (value);
+
+  g_assert_cmpuint (fixture->group_changed->len, ==, 1);
+  g_assert_cmpuint (fixture->properties_changed->len, ==, 1);
+
+  /* the next group wraps around */
+  g_assert_true (fixture_call_group_method (fixture, "NextGroup", NULL));
+  fixture_wait_for (fixture->group_changed->len == 2);
+  assert_group_changed (g_ptr_array_index (fixture->group_changed, 1), 0, "us", "");
+
+  g_assert_true (fixture_call_group_method (fixture, "PrevGroup", NULL));
+  fixture_wait_for (fixture->group_changed->len == 3);
+  assert_group_changed (g_ptr_array_index (fixture->group_changed, 2), 1, "de", "nodeadkeys");
+
+  /* unknown methods are errors */
+  value = fixture_call (fixture, XKB_DBUS_INTERFACE, "Reset", NULL);
+  g_assert_error (fixture->error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD);
+  g_variant_unref (value);
+}
+
+
+
+static gboolean
+properties_have_groups (GPtrArray *properties_changed)
+{
+  GVariant *changed;
+  gboolean  found = FALSE;
+  guint     i;
+
+  for (i = 0; i < properties_changed->len && !found; i++)
+    {
+      g_variant_get (g_ptr_array_index (properties_changed, i), "(&s@a{sv}@as)",
+                     NULL, &changed, NULL);
+      found = g_variant_lookup (changed, "Groups", "@a(sss)", NULL);
+      g_variant_unref (changed);
+    }
+
+  return found;
+}
+
+
+
+static void
+test_config_changed (Fixture       *fixture,
+                     gconstpointer  user_data)
+{
+  GVariant    *changed, *groups = NULL;
+  const gchar *layout;
+  guint        i;
+
+  if (fixture_skip (fixture))
+    return;
+
+  fixture_set_config (fixture, "ua,us,de", ",,nodeadkeys");
+  fixture_wait_for (properties_have_groups (fixture->properties_changed));
+
+  /* the new groups come with the change, clients need not fetch them */
+  for (i = 0; i < fixture->properties_changed->len && groups == NULL; i++)
+    {
+      g_variant_get (g_ptr_array_index (fixture->properties_changed, i), "(&s@a{sv}@as)",
+                     NULL, &changed, NULL);
+      groups = g_variant_lookup_value (changed, "Groups", G_VARIANT_TYPE ("a(sss)"));
+      g_variant_unref (changed);
+    }
+
+  g_assert_nonnull (groups);
+  g_assert_cmpuint (g_variant_n_children (groups), ==, 3);
+  g_variant_get_child (groups, 0, "(&s&s&s)", &layout, NULL, NULL);
+  g_assert_cmpstr (layout, ==, "ua");
+  g_variant_unref (groups);
+
+  g_assert_cmpuint (fixture->group_changed->len, >=, 1);
+  assert_group_changed (g_ptr_array_index (fixture->group_changed,
+                                           fixture->group_changed->len - 1),
+                        0, "ua", "");
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/dbus/groups", Fixture, NULL,
+              fixture_setup, test_groups, fixture_teardown);
+  g_test_add ("/dbus/set-group", Fixture, NULL,
+              fixture_setup, test_set_group, fixture_teardown);
+  g_test_add ("/dbus/config-changed", Fixture, NULL,
+              fixture_setup, test_config_changed, fixture_teardown);
+
+  return g_test_run ();
+}
@@ -0,0 +1,317 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* test-keyboard.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Runs the keyboard model on the mock backend, which needs neither an
+ * X server nor a window manager.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "xkb-properties.h"
+#include "xkb-xfconf.h"
+#include "xkb-keyboard.h"
+#include "xkb-backend-mock.h"
+#include "xkb-wait.h"
+
+/* the keyboard rebuilds a little after the server reports a change */
+#define REBUILD_WAIT             300
+
+typedef struct
+{
+  XkbXfconf           *config;
+  XkbBackendMock      *mock;
+  XkbKeyboard         *keyboard;
+} Fixture;
+
+
+
+static void
+fixture_set_config (Fixture     *fixture,
+                    const gchar *layouts,
+                    const gchar *variants)
+{
+  gchar **layout_list, **variant_list;
+
+  layout_list = g_strsplit (layouts, ",", -1);
+  variant_list = g_strsplit (variants, ",", -1);
+
+  xkb_backend_mock_set_config (fixture->mock,
+                               (const gchar * const *) layout_list,
+                               (const gchar * const *) variant_list);
+
+  g_strfreev (layout_list);
+  g_strfreev (variant_list);
+}
+
+
+
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  XkbGroupPolicy policy = GPOINTER_TO_UINT (user_data);
+
+  fixture->config = xkb_xfconf_new (NULL);
+  g_object_set (fixture->config, GROUP_POLICY, policy, NULL);
+
+  fixture->mock = XKB_BACKEND_MOCK (xkb_backend_mock_new ());
+  fixture_set_config (fixture, "us,de,ua", ",nodeadkeys,");
+
+  fixture->keyboard = xkb_keyboard_new_with_backend (fixture->config,
+                                                     XKB_BACKEND (fixture->mock));
+}
+
+
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  g_object_unref (fixture->keyboard);
+  g_object_unref (fixture->mock);
+  g_object_unref (fixture->config);
+}
+
+
+
+static void
+test_groups (Fixture       *fixture,
+             gconstpointer  user_data)
+{
+  g_assert_true (xkb_keyboard_get_initialized (fixture->keyboard));
+  g_assert_cmpint (xkb_keyboard_get_group_count (fixture->keyboard), ==, 3);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+
+  g_assert_cmpstr (xkb_keyboard_get_variant (fixture->keyboard, 1), ==, "nodeadkeys");
+  g_assert_cmpint (xkb_keyboard_find_group (fixture->keyboard, "de", "nodeadkeys"), ==, 1);
+  g_assert_cmpint (xkb_keyboard_find_group (fixture->keyboard, "ua", NULL), ==, 2);
+  g_assert_cmpint (xkb_keyboard_find_group (fixture->keyboard, "de", ""), ==, -1);
+  g_assert_cmpint (xkb_keyboard_find_group (fixture->keyboard, "fr", NULL), ==, -1);
+}
+
+
+
+static void
+test_set_group (Fixture       *fixture,
+                gconstpointer  user_data)
+{
+  g_assert_true (xkb_keyboard_set_group (fixture->keyboard, 2));
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+
+  g_assert_true (xkb_keyboard_next_group (fixture->keyboard));
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+
+  g_assert_true (xkb_keyboard_prev_group (fixture->keyboard));
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+
+  g_assert_false (xkb_keyboard_set_group (fixture->keyboard, 3));
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+}
+
+
+
+static void
+test_per_window (Fixture       *fixture,
+                 gconstpointer  user_data)
+{
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "term.Term", "shell");
+  xkb_keyboard_set_group (fixture->keyboard, 1);
+
+  /* a new window starts in the first group */
+  xkb_backend_mock_activate_window (fixture->mock, 2, 2, "mail.Mail", "inbox");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+  xkb_keyboard_set_group (fixture->keyboard, 2);
+
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "term.Term", "shell");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+
+  xkb_backend_mock_activate_window (fixture->mock, 2, 2, "mail.Mail", "inbox");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+
+  /* a closed window is forgotten */
+  xkb_backend_mock_close_window (fixture->mock, 1);
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "term.Term", "shell");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+}
+
+
+
+static void
+test_per_window_class (Fixture       *fixture,
+                       gconstpointer  user_data)
+{
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "term.Term", "shell");
+  xkb_keyboard_set_group (fixture->keyboard, 1);
+
+  /* other windows of the class share the layout */
+  xkb_backend_mock_activate_window (fixture->mock, 2, 2, "mail.Mail", "inbox");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+
+  xkb_backend_mock_activate_window (fixture->mock, 3, 3, "term.Term", "other shell");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+
+  /* the class keeps its layout, not its group, across a reorder */
+  xkb_backend_mock_activate_window (fixture->mock, 2, 2, "mail.Mail", "inbox");
+  fixture_set_config (fixture, "ua,us,de", ",,nodeadkeys");
+  xkb_wait_run (REBUILD_WAIT);
+  g_assert_cmpint (xkb_keyboard_get_group_count (fixture->keyboard), ==, 3);
+
+  xkb_backend_mock_activate_window (fixture->mock, 3, 3, "term.Term", "other shell");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+
+  /* and falls back to the first group once the layout is gone */
+  xkb_backend_mock_activate_window (fixture->mock, 2, 2, "mail.Mail", "inbox");
+  fixture_set_config (fixture, "us,ua", ",");
+  xkb_wait_run (REBUILD_WAIT);
+
+  xkb_backend_mock_activate_window (fixture->mock, 3, 3, "term.Term", "other shell");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+}
+
+
+
+static void
+test_per_workspace (Fixture       *fixture,
+                    gconstpointer  user_data)
+{
+  xkb_backend_mock_switch_workspace (fixture->mock, 0);
+  xkb_keyboard_set_group (fixture->keyboard, 1);
+
+  /* a workspace not visited yet starts in the first group */
+  xkb_backend_mock_switch_workspace (fixture->mock, 1);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+  xkb_keyboard_set_group (fixture->keyboard, 2);
+
+  xkb_backend_mock_switch_workspace (fixture->mock, 0);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+
+  xkb_backend_mock_switch_workspace (fixture->mock, 1);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+
+  /* the workspaces past the array keep whatever group is locked */
+  xkb_backend_mock_switch_workspace (fixture->mock, XKB_KEYBOARD_MAX_WORKSPACES);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+  xkb_keyboard_set_group (fixture->keyboard, 0);
+
+  xkb_backend_mock_switch_workspace (fixture->mock, 0);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+
+  xkb_backend_mock_switch_workspace (fixture->mock, XKB_KEYBOARD_MAX_WORKSPACES + 1);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+
+  /* and do not overwrite the group of the workspaces in it */
+  xkb_backend_mock_switch_workspace (fixture->mock, 1);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+}
+
+
+
+static void
+test_group_rules (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  const gchar *rules[] = { "class:^mail\\.=de(nodeadkeys)", "title:Пошта=ua", NULL };
+
+  g_object_set (fixture->config, GROUP_RULES, rules, NULL);
+
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "mail.Mail", "inbox");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+
+  xkb_backend_mock_activate_window (fixture->mock, 2, 2, "browser.Browser", "Пошта - Browser");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 2);
+
+  xkb_backend_mock_activate_window (fixture->mock, 3, 3, "term.Term", "shell");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+
+  /* a group picked by hand wins over the rule */
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "mail.Mail", "inbox");
+  xkb_keyboard_set_group (fixture->keyboard, 0);
+  xkb_backend_mock_activate_window (fixture->mock, 3, 3, "term.Term", "shell");
+  xkb_backend_mock_activate_window (fixture->mock, 1, 1, "mail.Mail", "inbox");
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+}
+
+
+
+static void
+test_layout_sets (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  const gchar *sets[] = { "us,de(nodeadkeys),ua", "fr,it", NULL };
+  guint        lock_count;
+
+  g_object_set (fixture->config, LAYOUT_SETS, sets, NULL);
+  g_assert_cmpint (xkb_keyboard_get_layout_set_count (fixture->keyboard), ==, 2);
+  g_assert_cmpint (xkb_keyboard_get_current_layout_set (fixture->keyboard), ==, 0);
+
+  g_assert_true (xkb_keyboard_set_layout_set (fixture->keyboard, 1));
+  g_assert_cmpint (xkb_keyboard_get_current_layout_set (fixture->keyboard), ==, 1);
+  g_assert_cmpint (xkb_keyboard_get_group_count (fixture->keyboard), ==, 2);
+  g_assert_cmpint (xkb_keyboard_find_group (fixture->keyboard, "it", ""), ==, 1);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 0);
+
+  g_assert_true (xkb_keyboard_next_layout_set (fixture->keyboard));
+  g_assert_cmpint (xkb_keyboard_get_current_layout_set (fixture->keyboard), ==, 0);
+  g_assert_cmpint (xkb_keyboard_get_group_count (fixture->keyboard), ==, 3);
+  g_assert_cmpstr (xkb_keyboard_get_variant (fixture->keyboard, 1), ==, "nodeadkeys");
+
+  g_assert_false (xkb_keyboard_set_layout_set (fixture->keyboard, 2));
+  g_assert_cmpint (xkb_keyboard_get_current_layout_set (fixture->keyboard), ==, 0);
+
+  /* a set-group naming a layout of another set brings the set in and
+   * locks the group once */
+  lock_count = xkb_backend_mock_get_lock_count (fixture->mock);
+  g_assert_true (xkb_keyboard_activate_layout (fixture->keyboard, "it", NULL));
+  g_assert_cmpint (xkb_keyboard_get_current_layout_set (fixture->keyboard), ==, 1);
+  g_assert_cmpint (xkb_keyboard_get_current_group (fixture->keyboard), ==, 1);
+  g_assert_cmpuint (xkb_backend_mock_get_lock_count (fixture->mock), ==, lock_count + 1);
+
+  g_assert_false (xkb_keyboard_activate_layout (fixture->keyboard, "jp", NULL));
+  g_assert_cmpint (xkb_keyboard_get_current_layout_set (fixture->keyboard), ==, 1);
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/keyboard/groups", Fixture, GUINT_TO_POINTER (GROUP_POLICY_GLOBAL),
+              fixture_setup, test_groups, fixture_teardown);
+  g_test_add ("/keyboard/set-group", Fixture, GUINT_TO_POINTER (GROUP_POLICY_GLOBAL),
+              fixture_setup, test_set_group, fixture_teardown);
+  g_test_add ("/keyboard/per-window", Fixture, GUINT_TO_POINTER (GROUP_POLICY_PER_WINDOW),
+              fixture_setup, test_per_window, fixture_teardown);
+  g_test_add ("/keyboard/per-window-class", Fixture, GUINT_TO_POINTER (GROUP_POLICY_PER_WINDOW_CLASS),
+              fixture_setup, test_per_window_class, fixture_teardown);
+  g_test_add ("/keyboard/per-workspace", Fixture, GUINT_TO_POINTER (GROUP_POLICY_PER_WORKSPACE),
+              fixture_setup, test_per_workspace, fixture_teardown);
+  g_test_add ("/keyboard/group-rules", Fixture, GUINT_TO_POINTER (GROUP_POLICY_PER_WINDOW),
+              fixture_setup, test_group_rules, fixture_teardown);
+  g_test_add ("/keyboard/layout-sets", Fixture, GUINT_TO_POINTER (GROUP_POLICY_GLOBAL),
+              fixture_setup, test_layout_sets, fixture_teardown);
+
+  return g_test_run ();
+}
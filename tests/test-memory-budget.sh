@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# Runs the memory budget of the plugin host once per display type, on
+# the mock keyboard and the Xvfb server of run-test.sh. The host fails
+# when the heap still grows after the warm-up and prints the growth of
+# every subsystem. XKB_TEST_MEMORY_ROUNDS sets the number of rounds.
+#
+
+host="${XKB_PLUGIN_HOST:-../panel-plugin/xkb-plugin-host}"
+rounds="${XKB_TEST_MEMORY_ROUNDS:-2000}"
+
+if test -z "$DISPLAY"; then
+  echo "no X display, skipping"
+  exit 77
+fi
+
+# GSlice caches would hide allocations from the malloc statistics
+G_SLICE=always-malloc
+export G_SLICE
+
+for display_type in image text system; do
+  echo "display type $display_type:"
+  "$host" --mock=us --display-type=$display_type --caps-lock-indicator \
+          --memory-budget=$rounds || exit $?
+done
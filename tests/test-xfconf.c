@@ -0,0 +1,386 @@
+/* vim: set backspace=2 ts=4 softtabstop=4 sw=4 cinoptions=>4 expandtab autoindent smartindent: */
+/* test-xfconf.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "xkb-properties.h"
+#include "xkb-xfconf.h"
+#include "xkb-wait.h"
+
+#define BURST_SIZE          100
+
+/* the channel tests run against the xfconfd of the session bus, which
+ * run-test.sh makes a private one */
+#define PROPERTY_BASE       "/plugins/xkb-test"
+#define CHANGES_BASE        "/plugins/xkb-test-changes"
+#define OTHER_BASE          "/plugins/xkb-test-other"
+#define CHANNEL_TIMEOUT     5000
+
+typedef struct
+{
+  guint                emissions;
+  guint                changes;
+} Changes;
+
+
+
+static void
+changes_record (XkbXfconf *config,
+                guint      changes,
+                Changes   *record)
+{
+  record->emissions++;
+  record->changes |= changes;
+}
+
+
+
+static void
+notify_count (XkbXfconf  *config,
+              GParamSpec *pspec,
+              guint      *count)
+{
+  (*count)++;
+}
+
+
+
+static void
+test_defaults (void)
+{
+  XkbXfconf *config;
+
+  config = xkb_xfconf_new (NULL);
+
+  g_assert_cmpuint (xkb_xfconf_get_display_type (config), ==, DISPLAY_TYPE_IMAGE);
+  g_assert_cmpuint (xkb_xfconf_get_display_name (config), ==, DISPLAY_NAME_COUNTRY);
+  g_assert_cmpuint (xkb_xfconf_get_display_scale (config), ==, DISPLAY_SCALE_MAX);
+  g_assert_true (xkb_xfconf_get_caps_lock_indicator (config));
+  g_assert_cmpuint (xkb_xfconf_get_group_policy (config), ==, GROUP_POLICY_PER_APPLICATION);
+  g_assert_null (xkb_xfconf_get_layout_sets (config));
+  g_assert_null (xkb_xfconf_get_group_rules (config));
+
+  g_object_unref (config);
+}
+
+
+
+static void
+test_single_change (void)
+{
+  XkbXfconf *config;
+  Changes    record = { 0, 0 };
+
+  config = xkb_xfconf_new (NULL);
+  g_signal_connect (config, "configuration-changed", G_CALLBACK (changes_record), &record);
+
+  /* outside an update every change is reported on its own */
+  g_object_set (config, DISPLAY_TYPE, DISPLAY_TYPE_TEXT, NULL);
+  g_assert_cmpuint (record.emissions, ==, 1);
+  g_assert_cmpuint (record.changes, ==, XKB_XFCONF_CHANGED_DISPLAY_TYPE);
+
+  g_object_set (config, DISPLAY_SCALE, 50, NULL);
+  g_assert_cmpuint (record.emissions, ==, 2);
+  g_assert_cmpuint (record.changes, ==, XKB_XFCONF_CHANGED_DISPLAY_TYPE |
+                                        XKB_XFCONF_CHANGED_DISPLAY_SCALE);
+
+  /* setting the current value is not a change */
+  g_object_set (config, DISPLAY_SCALE, 50, NULL);
+  g_assert_cmpuint (record.emissions, ==, 2);
+
+  g_object_unref (config);
+}
+
+
+
+static void
+test_update_burst (void)
+{
+  XkbXfconf   *config;
+  Changes      record = { 0, 0 };
+  guint        notifications = 0;
+  gchar       *rule;
+  const gchar *rules[2] = { NULL, NULL };
+  guint        i;
+
+  config = xkb_xfconf_new (NULL);
+  g_signal_connect (config, "configuration-changed", G_CALLBACK (changes_record), &record);
+  g_signal_connect (config, "notify::" DISPLAY_SCALE, G_CALLBACK (notify_count), &notifications);
+
+  xkb_xfconf_begin_update (config);
+
+  for (i = 0; i < BURST_SIZE; i++)
+    {
+      g_object_set (config,
+                    DISPLAY_SCALE, i % (DISPLAY_SCALE_MAX + 1),
+                    DISPLAY_TYPE, i % 2 == 0 ? DISPLAY_TYPE_TEXT : DISPLAY_TYPE_SYSTEM,
+                    NULL);
+
+      rule = g_strdup_printf ("class:^app%u$=us", i);
+      rules[0] = rule;
+      g_object_set (config, GROUP_RULES, rules, NULL);
+      g_free (rule);
+
+      /* nested updates only end with the outermost one */
+      xkb_xfconf_begin_update (config);
+      g_object_set (config, CAPS_LOCK_INDICATOR, i % 2 != 0, NULL);
+      xkb_xfconf_commit_update (config);
+    }
+
+  g_assert_cmpuint (record.emissions, ==, 0);
+  g_assert_cmpuint (notifications, ==, 0);
+
+  xkb_xfconf_commit_update (config);
+
+  g_assert_cmpuint (record.emissions, ==, 1);
+  g_assert_cmpuint (record.changes, ==, XKB_XFCONF_CHANGED_DISPLAY_TYPE |
+                                        XKB_XFCONF_CHANGED_DISPLAY_SCALE |
+                                        XKB_XFCONF_CHANGED_CAPS_LOCK_INDICATOR |
+                                        XKB_XFCONF_CHANGED_GROUP_RULES);
+  g_assert_cmpuint (notifications, ==, 1);
+
+  /* the last value of the burst wins */
+  g_assert_cmpuint (xkb_xfconf_get_display_scale (config), ==, (BURST_SIZE - 1) % (DISPLAY_SCALE_MAX + 1));
+  g_assert_cmpuint (xkb_xfconf_get_display_type (config), ==, DISPLAY_TYPE_SYSTEM);
+  g_assert_cmpstr (xkb_xfconf_get_group_rules (config)[0], ==, "class:^app99$=us");
+
+  /* an update without changes is not reported */
+  xkb_xfconf_begin_update (config);
+  g_object_set (config, DISPLAY_TYPE, DISPLAY_TYPE_SYSTEM, NULL);
+  xkb_xfconf_commit_update (config);
+
+  g_assert_cmpuint (record.emissions, ==, 1);
+
+  g_object_unref (config);
+}
+
+
+
+/* counts the xfconfd calls going out on the session bus */
+static GDBusMessage *
+xfconf_call_filter (GDBusConnection *connection,
+                    GDBusMessage    *message,
+                    gboolean         incoming,
+                    gpointer         user_data)
+{
+  gint *calls = user_data;
+
+  if (!incoming &&
+      g_dbus_message_get_message_type (message) == G_DBUS_MESSAGE_TYPE_METHOD_CALL &&
+      g_strcmp0 (g_dbus_message_get_interface (message), "org.xfce.Xfconf") == 0)
+    {
+      if (g_strcmp0 (g_dbus_message_get_member (message), "GetAllProperties") == 0)
+        g_atomic_int_inc (&calls[0]);
+      else if (g_strcmp0 (g_dbus_message_get_member (message), "GetProperty") == 0)
+        g_atomic_int_inc (&calls[1]);
+    }
+
+  return message;
+}
+
+
+
+static gboolean
+xfconf_query (const gchar *property,
+              ...)
+{
+  GPtrArray   *argv;
+  const gchar *arg;
+  va_list      args;
+  gint         status;
+  GError      *error = NULL;
+  gboolean     result;
+
+  argv = g_ptr_array_new ();
+  g_ptr_array_add (argv, "xfconf-query");
+  g_ptr_array_add (argv, "--channel");
+  g_ptr_array_add (argv, "xfce4-panel");
+  g_ptr_array_add (argv, "--property");
+  g_ptr_array_add (argv, (gpointer) property);
+
+  va_start (args, property);
+  while ((arg = va_arg (args, const gchar *)) != NULL)
+    g_ptr_array_add (argv, (gpointer) arg);
+  va_end (args);
+
+  g_ptr_array_add (argv, NULL);
+
+  result = g_spawn_sync (NULL, (gchar **) argv->pdata, NULL, G_SPAWN_SEARCH_PATH,
+                         NULL, NULL, NULL, NULL, &status, &error) &&
+           g_spawn_check_exit_status (status, &error);
+  if (!result)
+    {
+      g_test_message ("xfconf-query %s failed: %s", property, error->message);
+      g_error_free (error);
+    }
+
+  g_ptr_array_free (argv, TRUE);
+
+  return result;
+}
+
+
+
+static gboolean
+channel_skip (void)
+{
+  gchar *path;
+
+  if (g_getenv ("DBUS_SESSION_BUS_ADDRESS") == NULL)
+    {
+      g_test_skip ("no private D-Bus session");
+      return TRUE;
+    }
+
+  path = g_find_program_in_path ("xfconf-query");
+  g_free (path);
+  if (path == NULL)
+    {
+      g_test_skip ("xfconf-query is not installed");
+      return TRUE;
+    }
+
+  return FALSE;
+}
+
+
+
+/* waits until the changes in the mask have been reported */
+static void
+channel_wait (Changes *record,
+              guint    changes)
+{
+  xkb_wait_until ((record->changes & changes) == changes, CHANNEL_TIMEOUT);
+  g_assert_cmpuint (record->changes & changes, ==, changes);
+}
+
+
+
+static void
+test_channel_load (void)
+{
+  GDBusConnection *connection;
+  XkbXfconf       *config;
+  gint             calls[2] = { 0, 0 };
+  guint            filter_id;
+
+  if (channel_skip ())
+    return;
+
+  g_assert_true (xfconf_query (PROPERTY_BASE "/" DISPLAY_TYPE,
+                               "--create", "--type", "uint", "--set", "1", NULL));
+  g_assert_true (xfconf_query (PROPERTY_BASE "/" DISPLAY_SCALE,
+                               "--create", "--type", "uint", "--set", "40", NULL));
+  g_assert_true (xfconf_query (PROPERTY_BASE "/" CAPS_LOCK_INDICATOR,
+                               "--create", "--type", "bool", "--set", "false", NULL));
+  g_assert_true (xfconf_query (PROPERTY_BASE "/" GROUP_RULES, "--create", "--force-array",
+                               "--type", "string", "--set", "class:^mail=de",
+                               "--type", "string", "--set", "title:Пошта=ua", NULL));
+  g_assert_true (xfconf_query (OTHER_BASE "/" DISPLAY_NAME,
+                               "--create", "--type", "uint", "--set", "1", NULL));
+
+  connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+  g_assert_nonnull (connection);
+  filter_id = g_dbus_connection_add_filter (connection, xfconf_call_filter, calls, NULL);
+
+  config = xkb_xfconf_new (PROPERTY_BASE);
+
+  g_dbus_connection_flush_sync (connection, NULL, NULL);
+  g_dbus_connection_remove_filter (connection, filter_id);
+
+  /* everything comes with one call, nothing is fetched one by one */
+  g_assert_cmpint (g_atomic_int_get (&calls[0]), ==, 1);
+  g_assert_cmpint (g_atomic_int_get (&calls[1]), ==, 0);
+
+  g_assert_cmpuint (xkb_xfconf_get_display_type (config), ==, DISPLAY_TYPE_TEXT);
+  g_assert_cmpuint (xkb_xfconf_get_display_scale (config), ==, 40);
+  g_assert_false (xkb_xfconf_get_caps_lock_indicator (config));
+  g_assert_cmpuint (g_strv_length ((gchar **) xkb_xfconf_get_group_rules (config)), ==, 2);
+  g_assert_cmpstr (xkb_xfconf_get_group_rules (config)[1], ==, "title:Пошта=ua");
+
+  /* the properties of other plugins are left alone, the rest keeps
+   * its defaults */
+  g_assert_cmpuint (xkb_xfconf_get_display_name (config), ==, DISPLAY_NAME_COUNTRY);
+  g_assert_true (xkb_xfconf_get_display_tooltip_icon (config));
+
+  g_object_unref (config);
+  g_object_unref (connection);
+}
+
+
+
+static void
+test_channel_changes (void)
+{
+  XkbXfconf *config;
+  Changes    record = { 0, 0 };
+
+  if (channel_skip ())
+    return;
+
+  g_assert_true (xfconf_query (CHANGES_BASE "/" DISPLAY_SCALE,
+                               "--create", "--type", "uint", "--set", "40", NULL));
+
+  config = xkb_xfconf_new (CHANGES_BASE);
+  g_signal_connect (config, "configuration-changed", G_CALLBACK (changes_record), &record);
+
+  /* changes made by other clients arrive through the channel handler,
+   * changes of other plugins are not routed here */
+  g_assert_true (xfconf_query (CHANGES_BASE "/" DISPLAY_NAME,
+                               "--create", "--type", "uint", "--set", "1", NULL));
+  g_assert_true (xfconf_query (CHANGES_BASE "/" GROUP_POLICY,
+                               "--create", "--type", "uint", "--set", "3", NULL));
+  g_assert_true (xfconf_query (OTHER_BASE "/" DISPLAY_TYPE,
+                               "--create", "--type", "uint", "--set", "2", NULL));
+  channel_wait (&record, XKB_XFCONF_CHANGED_DISPLAY_NAME | XKB_XFCONF_CHANGED_GROUP_POLICY);
+
+  g_assert_cmpuint (record.changes, ==, XKB_XFCONF_CHANGED_DISPLAY_NAME |
+                                        XKB_XFCONF_CHANGED_GROUP_POLICY);
+  g_assert_cmpuint (xkb_xfconf_get_display_name (config), ==, DISPLAY_NAME_LANGUAGE);
+  g_assert_cmpuint (xkb_xfconf_get_group_policy (config), ==, GROUP_POLICY_PER_WINDOW_CLASS);
+  g_assert_cmpuint (xkb_xfconf_get_display_type (config), ==, DISPLAY_TYPE_IMAGE);
+
+  /* a reset property goes back to its default */
+  record.changes = 0;
+  g_assert_true (xfconf_query (CHANGES_BASE "/" DISPLAY_SCALE, "--reset", NULL));
+  channel_wait (&record, XKB_XFCONF_CHANGED_DISPLAY_SCALE);
+  g_assert_cmpuint (xkb_xfconf_get_display_scale (config), ==, DISPLAY_SCALE_MAX);
+
+  g_object_unref (config);
+}
+
+
+
+gint
+main (gint    argc,
+      gchar **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/xfconf/defaults", test_defaults);
+  g_test_add_func ("/xfconf/single-change", test_single_change);
+  g_test_add_func ("/xfconf/update-burst", test_update_burst);
+  g_test_add_func ("/xfconf/channel/load", test_channel_load);
+  g_test_add_func ("/xfconf/channel/changes", test_channel_changes);
+
+  return g_test_run ();
+}